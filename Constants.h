@@ -12,14 +12,23 @@
 #pragma mark - Instances
 #ifdef DEVELOPMENT
 #define DISCOUNT_SERVICE_URL @"http://snoopy.apphb.com/api/discounts/%@/%@"
+#define DISCOUNT_BATCH_SERVICE_URL @"http://snoopy.apphb.com/api/discounts/%@"
+#define DISCOUNT_CHANGES_SERVICE_URL @"http://snoopy.apphb.com/api/discounts/%@/changes?since=%llu"
+#define DISCOUNT_RULES_SERVICE_URL @"http://snoopy.apphb.com/api/discounts/%@/rules"
 #endif
 
 #ifdef STAGING
 #define DISCOUNT_SERVICE_URL @"http://snoopy.apphb.com/api/discounts/%@/%@"
+#define DISCOUNT_BATCH_SERVICE_URL @"http://snoopy.apphb.com/api/discounts/%@"
+#define DISCOUNT_CHANGES_SERVICE_URL @"http://snoopy.apphb.com/api/discounts/%@/changes?since=%llu"
+#define DISCOUNT_RULES_SERVICE_URL @"http://snoopy.apphb.com/api/discounts/%@/rules"
 #endif
 
 #ifdef PRODUCTION
 #define DISCOUNT_SERVICE_URL @"http://snoopy.apphb.com/api/discounts/%@/%@"
+#define DISCOUNT_BATCH_SERVICE_URL @"http://snoopy.apphb.com/api/discounts/%@"
+#define DISCOUNT_CHANGES_SERVICE_URL @"http://snoopy.apphb.com/api/discounts/%@/changes?since=%llu"
+#define DISCOUNT_RULES_SERVICE_URL @"http://snoopy.apphb.com/api/discounts/%@/rules"
 #endif
 
 #endif
@@ -0,0 +1,117 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ds_dhash.h"
+
+namespace {
+
+/* Size of the thumbnail */
+const int kCols = 9;
+const int kRows = 8;
+
+}  // namespace
+
+uint64_t ds_dhash(const uint8_t *gray, int w, int h, int bpr, int step) {
+  if (!gray || w < kCols || h < kRows) return 0;
+  if (step < 1) step = 1;
+
+  /* Average each cell of the thumbnail */
+  uint32_t cells[kRows][kCols];
+  for (int cy = 0; cy < kRows; cy++) {
+    int y0 = cy * h / kRows;
+    int y1 = (cy + 1) * h / kRows;
+    for (int cx = 0; cx < kCols; cx++) {
+      int x0 = cx * w / kCols;
+      int x1 = (cx + 1) * w / kCols;
+      uint32_t sum = 0;
+      uint32_t n = 0;
+      for (int y = y0; y < y1; y += step) {
+        const uint8_t *row = gray + (int64_t) y * bpr;
+        for (int x = x0; x < x1; x += step) sum += row[x];
+        n += (x1 - x0 + step - 1) / step;
+      }
+      cells[cy][cx] = n ? sum / n : 0;
+    }
+  }
+
+  uint64_t hash = 0;
+  for (int cy = 0; cy < kRows; cy++) {
+    for (int cx = 0; cx < kCols - 1; cx++) {
+      hash = (hash << 1) | (cells[cy][cx] > cells[cy][cx + 1] ? 1 : 0);
+    }
+  }
+  return hash;
+}
+
+int ds_dhash_distance(uint64_t a, uint64_t b) {
+  uint64_t x = a ^ b;
+  int n = 0;
+  while (x) {
+    x &= x - 1;
+    n++;
+  }
+  return n;
+}
+
+void ds_dedup_init(ds_dedup_t *d, int max_distance, int scene_distance, double ttl) {
+  d->max_distance = max_distance;
+  d->scene_distance = scene_distance;
+  d->ttl = ttl;
+  d->last = 0;
+  d->skipped = 0;
+  ds_dedup_clear(d);
+}
+
+void ds_dedup_clear(ds_dedup_t *d) {
+  for (int i = 0; i < DS_DEDUP_SIZE; i++) {
+    d->hashes[i] = 0;
+    d->times[i] = 0;
+  }
+  d->next = 0;
+}
+
+int ds_dedup_seen(ds_dedup_t *d, uint64_t hash, double now) {
+  uint64_t last = d->last;
+  d->last = hash;
+
+  /* A new scene re-arms the search */
+  if (ds_dhash_distance(hash, last) > d->scene_distance) {
+    ds_dedup_clear(d);
+    return 0;
+  }
+
+  for (int i = 0; i < DS_DEDUP_SIZE; i++) {
+    if (d->times[i] <= 0 || now - d->times[i] > d->ttl) continue;
+    if (ds_dhash_distance(hash, d->hashes[i]) <= d->max_distance) {
+      d->skipped++;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void ds_dedup_add(ds_dedup_t *d, uint64_t hash, double now) {
+  d->hashes[d->next] = hash;
+  d->times[d->next] = now;
+  d->next = (d->next + 1) % DS_DEDUP_SIZE;
+}
@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _DS_DHASH_H
+#define _DS_DHASH_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*************************************************
+ * Frame deduplication
+ *
+ * 64-bit difference hash (dHash) of grayscale frames: the frame is reduced
+ * to a 9x8 thumbnail and each bit tells whether a thumbnail pixel is
+ * brighter than its right neighbor. Frames of the same scene have hashes
+ * a few bits apart, whatever the exposure.
+ *
+ * A dedup filter remembers the hashes of recent frames that did not match
+ * anything, so that the search can be skipped on frames that look the
+ * same. Entries expire after a while (e.g. the database may have been
+ * updated), and all of them are forgotten when the scene changes.
+ *************************************************/
+
+/**
+ * Compute the dHash of a grayscale image.
+ * Thumbnail cells are averaged every `step` pixels in both directions.
+ */
+uint64_t ds_dhash(const uint8_t *gray, int w, int h, int bpr, int step);
+
+/**
+ * Number of differing bits between two hashes.
+ */
+int ds_dhash_distance(uint64_t a, uint64_t b);
+
+/** Capacity of a dedup filter */
+#define DS_DEDUP_SIZE 8
+
+/** Type of a dedup filter, to be initialized with `ds_dedup_init` */
+typedef struct {
+  int max_distance;                   /* hashes at most this far apart are the same frame */
+  int scene_distance;                 /* hashes further apart than this are a new scene */
+  double ttl;                         /* lifetime of an entry, in seconds */
+  uint64_t last;                      /* hash of the last frame checked */
+  uint64_t hashes[DS_DEDUP_SIZE];     /* hashes of recent frames without match */
+  double times[DS_DEDUP_SIZE];        /* time each entry was added (0 if none) */
+  int next;                           /* next entry to overwrite */
+  uint32_t skipped;                   /* number of frames reported as seen */
+} ds_dedup_t;
+
+/**
+ * Initialize an empty dedup filter.
+ */
+void ds_dedup_init(ds_dedup_t *d, int max_distance, int scene_distance, double ttl);
+
+/**
+ * Forget all the entries.
+ */
+void ds_dedup_clear(ds_dedup_t *d);
+
+/**
+ * Check a frame against the filter.
+ * `now` specifies the current time, in seconds.
+ * The return value is 1 if the frame looks like a recent frame without
+ * match (i.e. it can be skipped), 0 otherwise.
+ */
+int ds_dedup_seen(ds_dedup_t *d, uint64_t hash, double now);
+
+/**
+ * Remember a frame that did not match anything.
+ */
+void ds_dedup_add(ds_dedup_t *d, uint64_t hash, double now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,376 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ds_image.h"
+
+#include <string.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+  #include <arm_neon.h>
+  #define DS_NEON 1
+#elif defined(__AVX2__)
+  #include <immintrin.h>
+  #define DS_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+  #include <emmintrin.h>
+  #define DS_SSE2 1
+#endif
+
+namespace {
+
+/* BT.601 luma weights, in 8-bit fixed point (they sum up to 256) */
+const int kWeightR = 77;
+const int kWeightG = 150;
+const int kWeightB = 29;
+
+/* Side of the square tiles used to rotate by 90 or 270 degrees */
+const int kTile = 32;
+
+/*************************************************
+ * Row kernels
+ *************************************************/
+
+inline uint8_t Luma(const uint8_t *bgra) {
+  return (uint8_t) ((kWeightB * bgra[0] + kWeightG * bgra[1] + kWeightR * bgra[2] + 128) >> 8);
+}
+
+void RowBgraToGrayRef(const uint8_t *src, uint8_t *dst, int n) {
+  for (int i = 0; i < n; i++, src += 4) dst[i] = Luma(src);
+}
+
+void RowDownscale2xRef(const uint8_t *r0, const uint8_t *r1, uint8_t *dst, int n) {
+  for (int i = 0; i < n; i++, r0 += 2, r1 += 2) {
+    dst[i] = (uint8_t) ((r0[0] + r0[1] + r1[0] + r1[1] + 2) >> 2);
+  }
+}
+
+#if DS_NEON
+void RowBgraToGray(const uint8_t *src, uint8_t *dst, int n) {
+  const uint8x8_t wr = vdup_n_u8(kWeightR);
+  const uint8x8_t wg = vdup_n_u8(kWeightG);
+  const uint8x8_t wb = vdup_n_u8(kWeightB);
+  int i = 0;
+  for (; i + 8 <= n; i += 8, src += 32) {
+    uint8x8x4_t px = vld4_u8(src);
+    uint16x8_t acc = vmull_u8(px.val[2], wr);
+    acc = vmlal_u8(acc, px.val[1], wg);
+    acc = vmlal_u8(acc, px.val[0], wb);
+    vst1_u8(dst + i, vrshrn_n_u16(acc, 8));
+  }
+  RowBgraToGrayRef(src, dst + i, n - i);
+}
+
+void RowDownscale2x(const uint8_t *r0, const uint8_t *r1, uint8_t *dst, int n) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8, r0 += 16, r1 += 16) {
+    uint16x8_t acc = vpaddlq_u8(vld1q_u8(r0));
+    acc = vpadalq_u8(acc, vld1q_u8(r1));
+    vst1_u8(dst + i, vrshrn_n_u16(acc, 2));
+  }
+  RowDownscale2xRef(r0, r1, dst + i, n - i);
+}
+#elif DS_AVX2
+/* Luma of 8 BGRA pixels as 32-bit lanes */
+inline __m256i Luma8(__m256i px) {
+  const __m256i wbr = _mm256_set1_epi32((kWeightR << 16) | kWeightB);
+  const __m256i wg = _mm256_set1_epi32(kWeightG);
+  const __m256i lo = _mm256_set1_epi32(0x00ff00ff);
+  __m256i br = _mm256_and_si256(px, lo);           /* B, R as 16-bit lanes */
+  __m256i ga = _mm256_srli_epi16(px, 8);           /* G, A as 16-bit lanes */
+  __m256i y = _mm256_add_epi32(_mm256_madd_epi16(br, wbr), _mm256_madd_epi16(ga, wg));
+  return _mm256_srli_epi32(_mm256_add_epi32(y, _mm256_set1_epi32(128)), 8);
+}
+
+void RowBgraToGray(const uint8_t *src, uint8_t *dst, int n) {
+  /* Undo the per-128-bit-lane interleaving of the pack instructions */
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  int i = 0;
+  for (; i + 32 <= n; i += 32, src += 128) {
+    const __m256i *p = (const __m256i *) src;
+    __m256i y0 = Luma8(_mm256_loadu_si256(p));
+    __m256i y1 = Luma8(_mm256_loadu_si256(p + 1));
+    __m256i y2 = Luma8(_mm256_loadu_si256(p + 2));
+    __m256i y3 = Luma8(_mm256_loadu_si256(p + 3));
+    __m256i y = _mm256_packus_epi16(_mm256_packs_epi32(y0, y1), _mm256_packs_epi32(y2, y3));
+    _mm256_storeu_si256((__m256i *) (dst + i), _mm256_permutevar8x32_epi32(y, order));
+  }
+  RowBgraToGrayRef(src, dst + i, n - i);
+}
+
+void RowDownscale2x(const uint8_t *r0, const uint8_t *r1, uint8_t *dst, int n) {
+  const __m256i lo = _mm256_set1_epi16(0x00ff);
+  const __m256i two = _mm256_set1_epi16(2);
+  int i = 0;
+  for (; i + 32 <= n; i += 32, r0 += 64, r1 += 64) {
+    __m256i s[2];
+    for (int k = 0; k < 2; k++) {
+      __m256i a = _mm256_loadu_si256((const __m256i *) r0 + k);
+      __m256i b = _mm256_loadu_si256((const __m256i *) r1 + k);
+      __m256i sum = _mm256_add_epi16(_mm256_and_si256(a, lo), _mm256_srli_epi16(a, 8));
+      sum = _mm256_add_epi16(sum, _mm256_and_si256(b, lo));
+      sum = _mm256_add_epi16(sum, _mm256_srli_epi16(b, 8));
+      s[k] = _mm256_srli_epi16(_mm256_add_epi16(sum, two), 2);
+    }
+    __m256i d = _mm256_permute4x64_epi64(_mm256_packus_epi16(s[0], s[1]), 0xd8);
+    _mm256_storeu_si256((__m256i *) (dst + i), d);
+  }
+  RowDownscale2xRef(r0, r1, dst + i, n - i);
+}
+#elif DS_SSE2
+/* Luma of 4 BGRA pixels as 32-bit lanes */
+inline __m128i Luma4(__m128i px) {
+  const __m128i wbr = _mm_set1_epi32((kWeightR << 16) | kWeightB);
+  const __m128i wg = _mm_set1_epi32(kWeightG);
+  const __m128i lo = _mm_set1_epi32(0x00ff00ff);
+  __m128i br = _mm_and_si128(px, lo);              /* B, R as 16-bit lanes */
+  __m128i ga = _mm_srli_epi16(px, 8);              /* G, A as 16-bit lanes */
+  __m128i y = _mm_add_epi32(_mm_madd_epi16(br, wbr), _mm_madd_epi16(ga, wg));
+  return _mm_srli_epi32(_mm_add_epi32(y, _mm_set1_epi32(128)), 8);
+}
+
+void RowBgraToGray(const uint8_t *src, uint8_t *dst, int n) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16, src += 64) {
+    const __m128i *p = (const __m128i *) src;
+    __m128i y0 = Luma4(_mm_loadu_si128(p));
+    __m128i y1 = Luma4(_mm_loadu_si128(p + 1));
+    __m128i y2 = Luma4(_mm_loadu_si128(p + 2));
+    __m128i y3 = Luma4(_mm_loadu_si128(p + 3));
+    __m128i y = _mm_packus_epi16(_mm_packs_epi32(y0, y1), _mm_packs_epi32(y2, y3));
+    _mm_storeu_si128((__m128i *) (dst + i), y);
+  }
+  RowBgraToGrayRef(src, dst + i, n - i);
+}
+
+void RowDownscale2x(const uint8_t *r0, const uint8_t *r1, uint8_t *dst, int n) {
+  const __m128i lo = _mm_set1_epi16(0x00ff);
+  const __m128i two = _mm_set1_epi16(2);
+  int i = 0;
+  for (; i + 16 <= n; i += 16, r0 += 32, r1 += 32) {
+    __m128i s[2];
+    for (int k = 0; k < 2; k++) {
+      __m128i a = _mm_loadu_si128((const __m128i *) r0 + k);
+      __m128i b = _mm_loadu_si128((const __m128i *) r1 + k);
+      __m128i sum = _mm_add_epi16(_mm_and_si128(a, lo), _mm_srli_epi16(a, 8));
+      sum = _mm_add_epi16(sum, _mm_and_si128(b, lo));
+      sum = _mm_add_epi16(sum, _mm_srli_epi16(b, 8));
+      s[k] = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+    }
+    _mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(s[0], s[1]));
+  }
+  RowDownscale2xRef(r0, r1, dst + i, n - i);
+}
+#else
+void RowBgraToGray(const uint8_t *src, uint8_t *dst, int n) {
+  RowBgraToGrayRef(src, dst, n);
+}
+
+void RowDownscale2x(const uint8_t *r0, const uint8_t *r1, uint8_t *dst, int n) {
+  RowDownscale2xRef(r0, r1, dst, n);
+}
+#endif
+
+/*************************************************
+ * Image kernels
+ *************************************************/
+
+typedef void (*RowConvert)(const uint8_t *src, uint8_t *dst, int n);
+
+void RowCopy(const uint8_t *src, uint8_t *dst, int n) {
+  memcpy(dst, src, n);
+}
+
+void RotateToGray(const uint8_t *src, int w, int h, int src_bpr, ds_pix_fmt fmt,
+                  ds_rotation rot, uint8_t *dst, int dst_bpr, RowConvert convert) {
+  const int bpp = (fmt == DS_PIX_BGRA) ? 4 : 1;
+  if (fmt != DS_PIX_BGRA) convert = RowCopy;
+
+  switch (rot) {
+    case DS_ROTATE_0:
+      for (int y = 0; y < h; y++) convert(src + (size_t) y * src_bpr, dst + (size_t) y * dst_bpr, w);
+      break;
+
+    case DS_ROTATE_180:
+      /* Convert each row in place at its destination, then mirror it */
+      for (int y = 0; y < h; y++) {
+        uint8_t *row = dst + (size_t) (h - 1 - y) * dst_bpr;
+        convert(src + (size_t) y * src_bpr, row, w);
+        for (int i = 0, j = w - 1; i < j; i++, j--) {
+          uint8_t t = row[i];
+          row[i] = row[j];
+          row[j] = t;
+        }
+      }
+      break;
+
+    case DS_ROTATE_90:
+    case DS_ROTATE_270: {
+      /* Convert tile by tile so that the transposed writes stay in cache */
+      uint8_t tile[kTile][kTile];
+      for (int ty = 0; ty < h; ty += kTile) {
+        int th = (h - ty < kTile) ? h - ty : kTile;
+        for (int tx = 0; tx < w; tx += kTile) {
+          int tw = (w - tx < kTile) ? w - tx : kTile;
+          for (int i = 0; i < th; i++) {
+            convert(src + (size_t) (ty + i) * src_bpr + (size_t) tx * bpp, tile[i], tw);
+          }
+          for (int j = 0; j < tw; j++) {
+            if (rot == DS_ROTATE_90) {
+              /* (x, y) goes to (h - 1 - y, x) */
+              uint8_t *out = dst + (size_t) (tx + j) * dst_bpr + (h - 1 - ty);
+              for (int i = 0; i < th; i++) out[-i] = tile[i][j];
+            }
+            else {
+              /* (x, y) goes to (y, w - 1 - x) */
+              uint8_t *out = dst + (size_t) (w - 1 - tx - j) * dst_bpr + ty;
+              for (int i = 0; i < th; i++) out[i] = tile[i][j];
+            }
+          }
+        }
+      }
+      break;
+    }
+  }
+}
+
+void Downscale2x(const uint8_t *src, int w, int h, int src_bpr,
+                 uint8_t *dst, int dst_bpr,
+                 void (*row)(const uint8_t *, const uint8_t *, uint8_t *, int)) {
+  for (int y = 0; y < h / 2; y++) {
+    const uint8_t *r0 = src + (size_t) (2 * y) * src_bpr;
+    row(r0, r0 + src_bpr, dst + (size_t) y * dst_bpr, w / 2);
+  }
+}
+
+}  // namespace
+
+/*************************************************
+ * Public API
+ *************************************************/
+
+const char *ds_image_simd(void) {
+#if DS_NEON
+  return "neon";
+#elif DS_AVX2
+  return "avx2";
+#elif DS_SSE2
+  return "sse2";
+#else
+  return "scalar";
+#endif
+}
+
+void ds_bgra_to_gray(const uint8_t *src, int w, int h, int src_bpr,
+                     uint8_t *dst, int dst_bpr) {
+  for (int y = 0; y < h; y++) RowBgraToGray(src + (size_t) y * src_bpr, dst + (size_t) y * dst_bpr, w);
+}
+
+void ds_bgra_to_gray_ref(const uint8_t *src, int w, int h, int src_bpr,
+                         uint8_t *dst, int dst_bpr) {
+  for (int y = 0; y < h; y++) RowBgraToGrayRef(src + (size_t) y * src_bpr, dst + (size_t) y * dst_bpr, w);
+}
+
+void ds_rotate_to_gray(const uint8_t *src, int w, int h, int src_bpr, ds_pix_fmt fmt,
+                       ds_rotation rot, uint8_t *dst, int dst_bpr) {
+  RotateToGray(src, w, h, src_bpr, fmt, rot, dst, dst_bpr, RowBgraToGray);
+}
+
+void ds_rotate_to_gray_ref(const uint8_t *src, int w, int h, int src_bpr, ds_pix_fmt fmt,
+                           ds_rotation rot, uint8_t *dst, int dst_bpr) {
+  RotateToGray(src, w, h, src_bpr, fmt, rot, dst, dst_bpr, RowBgraToGrayRef);
+}
+
+void ds_gray_downscale_2x(const uint8_t *src, int w, int h, int src_bpr,
+                          uint8_t *dst, int dst_bpr) {
+  Downscale2x(src, w, h, src_bpr, dst, dst_bpr, RowDownscale2x);
+}
+
+void ds_gray_downscale_2x_ref(const uint8_t *src, int w, int h, int src_bpr,
+                              uint8_t *dst, int dst_bpr) {
+  Downscale2x(src, w, h, src_bpr, dst, dst_bpr, RowDownscale2xRef);
+}
+
+void ds_gray_resize_area(const uint8_t *src, int w, int h, int src_bpr,
+                         uint8_t *dst, int dw, int dh, int dst_bpr) {
+  for (int y = 0; y < dh; y++) {
+    int y0 = (int) ((int64_t) y * h / dh);
+    int y1 = (int) ((int64_t) (y + 1) * h / dh);
+    if (y1 <= y0) y1 = y0 + 1;
+    uint8_t *out = dst + (size_t) y * dst_bpr;
+    for (int x = 0; x < dw; x++) {
+      int x0 = (int) ((int64_t) x * w / dw);
+      int x1 = (int) ((int64_t) (x + 1) * w / dw);
+      if (x1 <= x0) x1 = x0 + 1;
+      uint32_t sum = 0;
+      for (int yy = y0; yy < y1; yy++) {
+        const uint8_t *row = src + (size_t) yy * src_bpr;
+        for (int xx = x0; xx < x1; xx++) sum += row[xx];
+      }
+      uint32_t area = (uint32_t) ((y1 - y0) * (x1 - x0));
+      out[x] = (uint8_t) ((sum + area / 2) / area);
+    }
+  }
+}
+
+size_t ds_prepare_gray_size(int w, int h) {
+  /* Room for the upright image, plus the output of a final area resize */
+  return 2 * (size_t) w * (size_t) h;
+}
+
+int ds_prepare_gray(const uint8_t *src, int w, int h, int src_bpr, ds_pix_fmt fmt,
+                    ds_rotation rot, int min_side, int max_side,
+                    uint8_t *buf, size_t buf_size, ds_gray_t *out) {
+  if (!src || !buf || !out || w <= 0 || h <= 0 || max_side <= 0 ||
+      buf_size < ds_prepare_gray_size(w, h)) {
+    return -1;
+  }
+
+  bool swap = (rot == DS_ROTATE_90 || rot == DS_ROTATE_270);
+  int cw = swap ? h : w;
+  int ch = swap ? w : h;
+  ds_rotate_to_gray(src, w, h, src_bpr, fmt, rot, buf, cw);
+
+  /* Halve in place while too large, as long as it remains large enough */
+  while ((cw > max_side || ch > max_side) && cw / 2 >= min_side && ch / 2 >= min_side) {
+    ds_gray_downscale_2x(buf, cw, ch, cw, buf, cw / 2);
+    cw /= 2;
+    ch /= 2;
+  }
+
+  out->data = buf;
+  if (cw > max_side || ch > max_side) {
+    int dw = (cw >= ch) ? max_side : (int) ((int64_t) cw * max_side / ch);
+    int dh = (cw >= ch) ? (int) ((int64_t) ch * max_side / cw) : max_side;
+    if (dw < 1) dw = 1;
+    if (dh < 1) dh = 1;
+    out->data = buf + (size_t) w * h;
+    ds_gray_resize_area(buf, cw, ch, cw, out->data, dw, dh, dw);
+    cw = dw;
+    ch = dh;
+  }
+
+  out->width = cw;
+  out->height = ch;
+  out->bpr = cw;
+  return 0;
+}
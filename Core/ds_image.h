@@ -0,0 +1,136 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _DS_IMAGE_H
+#define _DS_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*************************************************
+ * Image preprocessing kernels
+ *
+ * Turn camera frames into upright 8-bit grayscale images sized for the
+ * scanner. Every kernel has a SIMD implementation (NEON on ARM, SSE2 or
+ * AVX2 on x86, picked at compile time) and a scalar reference one (`_ref`
+ * suffix) that produces the exact same output.
+ *
+ * Grayscale conversion uses the BT.601 luma weights in 8-bit fixed point:
+ *   Y = (77 R + 150 G + 29 B + 128) >> 8
+ *
+ * Unless noted otherwise, source and destination buffers must not overlap.
+ *************************************************/
+
+/** Clockwise rotation that makes an image upright */
+typedef enum {
+  DS_ROTATE_0 = 0,
+  DS_ROTATE_90,
+  DS_ROTATE_180,
+  DS_ROTATE_270
+} ds_rotation;
+
+/** Pixel format of a source image */
+typedef enum {
+  DS_PIX_BGRA = 0,                    /* 32bpp BGRA */
+  DS_PIX_GRAY                         /* 8bpp grey (e.g. a luma plane) */
+} ds_pix_fmt;
+
+/** An 8-bit grayscale image */
+typedef struct {
+  uint8_t *data;
+  int width;
+  int height;
+  int bpr;                            /* bytes per row */
+} ds_gray_t;
+
+/**
+ * Get the name of the SIMD implementation compiled in ("neon", "avx2",
+ * "sse2" or "scalar").
+ */
+const char *ds_image_simd(void);
+
+/**
+ * Convert a BGRA image into grayscale.
+ */
+void ds_bgra_to_gray(const uint8_t *src, int w, int h, int src_bpr,
+                     uint8_t *dst, int dst_bpr);
+void ds_bgra_to_gray_ref(const uint8_t *src, int w, int h, int src_bpr,
+                         uint8_t *dst, int dst_bpr);
+
+/**
+ * Convert (if needed) and rotate an image in a single pass.
+ * The destination is `h` x `w` pixels for 90 and 270 degrees rotations.
+ */
+void ds_rotate_to_gray(const uint8_t *src, int w, int h, int src_bpr, ds_pix_fmt fmt,
+                       ds_rotation rot, uint8_t *dst, int dst_bpr);
+void ds_rotate_to_gray_ref(const uint8_t *src, int w, int h, int src_bpr, ds_pix_fmt fmt,
+                           ds_rotation rot, uint8_t *dst, int dst_bpr);
+
+/**
+ * Halve a grayscale image by averaging 2x2 blocks.
+ * The destination is `w / 2` x `h / 2` pixels (the last odd row or column
+ * is dropped). It may be the source buffer itself, provided that
+ * `dst_bpr` is not greater than `src_bpr`.
+ */
+void ds_gray_downscale_2x(const uint8_t *src, int w, int h, int src_bpr,
+                          uint8_t *dst, int dst_bpr);
+void ds_gray_downscale_2x_ref(const uint8_t *src, int w, int h, int src_bpr,
+                              uint8_t *dst, int dst_bpr);
+
+/**
+ * Shrink a grayscale image to an arbitrary smaller size by averaging the
+ * source area covered by each destination pixel (scalar only).
+ */
+void ds_gray_resize_area(const uint8_t *src, int w, int h, int src_bpr,
+                         uint8_t *dst, int dw, int dh, int dst_bpr);
+
+/**
+ * Get the size of the scratch buffer needed by `ds_prepare_gray` for a
+ * `w` x `h` source image.
+ */
+size_t ds_prepare_gray_size(int w, int h);
+
+/**
+ * Turn a source image into an upright grayscale image whose largest side
+ * is at most `max_side` pixels, using as few passes as possible:
+ * conversion and rotation are fused, then 2x downscales are applied while
+ * the image remains at least `min_side` pixels wide and high, and a final
+ * area resize is applied if it is still too large.
+ * `buf` is a scratch buffer of at least `ds_prepare_gray_size` bytes, that
+ * holds the output image described by `out`.
+ * The return value is 0 on success, -1 if the buffer is too small or the
+ * arguments are invalid.
+ */
+int ds_prepare_gray(const uint8_t *src, int w, int h, int src_bpr, ds_pix_fmt fmt,
+                    ds_rotation rot, int min_side, int max_side,
+                    uint8_t *buf, size_t buf_size, ds_gray_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ds_latency.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The timeout is this many times the 99th percentile */
+#define DS_LATENCY_TIMEOUT_FACTOR 2.0
+
+static int ds_latency_cmp(const void *a, const void *b) {
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+void ds_latency_init(ds_latency_t *l) {
+  memset(l, 0, sizeof(*l));
+}
+
+void ds_latency_add(ds_latency_t *l, double latency) {
+  l->samples[l->next] = latency;
+  l->next = (l->next + 1) % DS_LATENCY_WINDOW;
+  if (l->count < DS_LATENCY_WINDOW) l->count++;
+}
+
+uint32_t ds_latency_count(const ds_latency_t *l) {
+  return l->count;
+}
+
+double ds_latency_percentile(const ds_latency_t *l, double p) {
+  double sorted[DS_LATENCY_WINDOW];
+  uint32_t rank;
+  if (l->count == 0) return -1;
+
+  memcpy(sorted, l->samples, l->count * sizeof(*sorted));
+  qsort(sorted, l->count, sizeof(*sorted), ds_latency_cmp);
+  /* Nearest-rank method */
+  rank = (uint32_t) ceil(p / 100.0 * l->count);
+  if (rank < 1) rank = 1;
+  if (rank > l->count) rank = l->count;
+  return sorted[rank - 1];
+}
+
+double ds_latency_timeout(const ds_latency_t *l, double min, double max,
+                          uint32_t min_samples) {
+  double timeout;
+  if (l->count < min_samples || l->count == 0) return max;
+  timeout = DS_LATENCY_TIMEOUT_FACTOR * ds_latency_percentile(l, 99.0);
+  if (timeout < min) timeout = min;
+  if (timeout > max) timeout = max;
+  return timeout;
+}
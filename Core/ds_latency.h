@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _DS_LATENCY_H
+#define _DS_LATENCY_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*************************************************
+ * Request latencies and adaptive timeouts
+ *
+ * Keeps the latencies of the most recent requests to a backend, so as to
+ * derive percentiles (e.g. to hedge slow requests) and a timeout that
+ * follows the backend: twice the 99th percentile, within given bounds.
+ *
+ * A request that times out must still be recorded, with the timeout it was
+ * given as latency. Otherwise a backend that becomes slower than the
+ * current timeout only produces timeouts, which are never recorded, and the
+ * timeout can never grow back to cover its new latency.
+ *
+ * NOTE: not thread-safe, callers must serialize accesses.
+ *************************************************/
+
+/** Number of recent samples kept */
+#define DS_LATENCY_WINDOW 64
+
+/** Type of a latency window, to be initialized with `ds_latency_init` */
+typedef struct {
+  double samples[DS_LATENCY_WINDOW];  /* ring buffer, in seconds */
+  uint32_t count;                     /* number of samples held */
+  uint32_t next;                      /* index of the next sample */
+} ds_latency_t;
+
+/**
+ * Initialize an empty window.
+ */
+void ds_latency_init(ds_latency_t *l);
+
+/**
+ * Record the latency (in seconds) of a request, replacing the oldest one
+ * once the window is full.
+ */
+void ds_latency_add(ds_latency_t *l, double latency);
+
+/**
+ * Get the number of samples held (at most DS_LATENCY_WINDOW).
+ */
+uint32_t ds_latency_count(const ds_latency_t *l);
+
+/**
+ * Get the given percentile (between 0 and 100) of the samples held
+ * (nearest-rank method), or a negative value if there is none.
+ */
+double ds_latency_percentile(const ds_latency_t *l, double p);
+
+/**
+ * Get the timeout (in seconds) to give to the next request: twice the 99th
+ * percentile, bounded by `min` and `max`, or `max` as long as fewer than
+ * `min_samples` samples have been recorded.
+ */
+double ds_latency_timeout(const ds_latency_t *l, double min, double max,
+                          uint32_t min_samples);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
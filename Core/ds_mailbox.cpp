@@ -0,0 +1,57 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ds_mailbox.h"
+
+namespace {
+
+/* Atomically replace the value of `*p` (full memory barrier), so that the
+ * contents of an item are visible to the thread that takes it */
+inline void *Exchange(void *volatile *p, void *value) {
+  void *expected = 0;
+  for (;;) {
+    void *old = __sync_val_compare_and_swap(p, expected, value);
+    if (old == expected) return old;
+    expected = old;
+  }
+}
+
+}  // namespace
+
+void ds_mailbox_init(ds_mailbox_t *m) {
+  m->slot = 0;
+  m->posted = 0;
+  m->dropped = 0;
+  __sync_synchronize();
+}
+
+void *ds_mailbox_post(ds_mailbox_t *m, void *item) {
+  void *stale = Exchange(&m->slot, item);
+  __sync_fetch_and_add(&m->posted, 1);
+  if (stale) __sync_fetch_and_add(&m->dropped, 1);
+  return stale;
+}
+
+void *ds_mailbox_take(ds_mailbox_t *m) {
+  return Exchange(&m->slot, 0);
+}
@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _DS_MAILBOX_H
+#define _DS_MAILBOX_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*************************************************
+ * Latest-item-wins mailbox
+ *
+ * Lock-free single slot used to hand items (e.g. camera frames) over from
+ * a producer to a consumer running at its own pace: posting an item
+ * replaces the one still waiting, if any, so that the consumer always gets
+ * the freshest item and the producer never blocks.
+ *
+ * Items are opaque pointers. The mailbox does not own them: the producer
+ * gets back the item it replaced and must release it, the consumer must
+ * release the items it takes.
+ *
+ * Posting and taking may run concurrently from any number of threads. They
+ * are lock-free, not wait-free: both swap the slot with a compare-and-swap
+ * loop, which retries if another thread changed the slot in the meantime
+ * (some thread always makes progress, but a given one may retry). See
+ * tools/mailbox_stress.cpp for a stress test.
+ *************************************************/
+
+/** Type of a mailbox, to be initialized with `ds_mailbox_init` */
+typedef struct {
+  void *volatile slot;                /* pending item (NULL if none) */
+  volatile uint32_t posted;           /* number of items posted */
+  volatile uint32_t dropped;          /* number of items replaced before being taken */
+} ds_mailbox_t;
+
+/**
+ * Initialize an empty mailbox.
+ */
+void ds_mailbox_init(ds_mailbox_t *m);
+
+/**
+ * Post an item (which must not be NULL).
+ * The return value is the pending item it replaced, which has never been
+ * taken and must be released by the caller, or NULL.
+ */
+void *ds_mailbox_post(ds_mailbox_t *m, void *item);
+
+/**
+ * Take the pending item.
+ * The return value is the item, or NULL if the mailbox is empty.
+ */
+void *ds_mailbox_take(ds_mailbox_t *m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ds_quality.h"
+
+double ds_sharpness(const uint8_t *gray, int w, int h, int bpr, int step) {
+  if (!gray || w < 3 || h < 3) return 0;
+  if (step < 1) step = 1;
+
+  int64_t sum = 0;
+  int64_t sum2 = 0;
+  int64_t n = 0;
+  for (int y = 1; y < h - 1; y += step) {
+    const uint8_t *row = gray + (int64_t) y * bpr;
+    const uint8_t *up = row - bpr;
+    const uint8_t *down = row + bpr;
+    for (int x = 1; x < w - 1; x += step) {
+      int lap = 4 * row[x] - row[x - 1] - row[x + 1] - up[x] - down[x];
+      sum += lap;
+      sum2 += lap * lap;
+    }
+    n += (w - 2 + step - 1) / step;
+  }
+
+  double mean = (double) sum / n;
+  return (double) sum2 / n - mean * mean;
+}
+
+void ds_gate_init(ds_gate_t *g, double ratio, double decay, int max_skips) {
+  g->ratio = ratio;
+  g->decay = decay;
+  g->max_skips = max_skips;
+  g->peak = 0;
+  g->skips = 0;
+  g->admitted = 0;
+  g->rejected = 0;
+}
+
+int ds_gate_admit(ds_gate_t *g, double score) {
+  g->peak *= g->decay;
+  if (score > g->peak) g->peak = score;
+
+  if (score < g->ratio * g->peak && g->skips < g->max_skips) {
+    g->skips++;
+    g->rejected++;
+    return 0;
+  }
+
+  g->skips = 0;
+  g->admitted++;
+  return 1;
+}
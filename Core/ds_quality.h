@@ -0,0 +1,84 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _DS_QUALITY_H
+#define _DS_QUALITY_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*************************************************
+ * Frame quality gate
+ *
+ * Cheap sharpness estimate of a grayscale frame, used to keep blurred or
+ * defocused frames (that have no chance to be recognized) away from the
+ * scanner. The threshold adapts to the scene: a frame is rejected when it
+ * is much less sharp than the sharpest recent frames.
+ *************************************************/
+
+/**
+ * Estimate the sharpness of a grayscale image, as the variance of its
+ * Laplacian (4-neighbors) sampled every `step` pixels in both directions.
+ * Blurred images have low values. The cost is about w x h / step^2
+ * Laplacian evaluations (i.e. well under 1 ms for a 720p frame with a step
+ * of 4).
+ */
+double ds_sharpness(const uint8_t *gray, int w, int h, int bpr, int step);
+
+/** Type of an adaptive frame gate, to be initialized with `ds_gate_init` */
+typedef struct {
+  double ratio;                       /* admission threshold, relative to the peak */
+  double decay;                       /* per-frame decay factor of the peak */
+  int max_skips;                      /* consecutive rejections before forcing an admission */
+  double peak;                        /* decaying peak of the recent scores */
+  int skips;                          /* current number of consecutive rejections */
+  uint32_t admitted;                  /* number of admitted frames */
+  uint32_t rejected;                  /* number of rejected frames */
+} ds_gate_t;
+
+/**
+ * Initialize a gate.
+ * `ratio` specifies the fraction of the recent peak score under which a
+ * frame is rejected (e.g. 0.5).
+ * `decay` specifies how fast the peak fades, per frame (e.g. 0.98, i.e. a
+ * half-life of about one second at 30 fps).
+ * `max_skips` specifies the number of consecutive rejections after which a
+ * frame is admitted anyway, so that low-contrast scenes still get scanned
+ * from time to time.
+ */
+void ds_gate_init(ds_gate_t *g, double ratio, double decay, int max_skips);
+
+/**
+ * Submit the score of a frame (see `ds_sharpness`).
+ * The return value is 1 if the frame should be processed, 0 otherwise.
+ */
+int ds_gate_admit(ds_gate_t *g, double score);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
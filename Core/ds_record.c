@@ -0,0 +1,349 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "ds_record.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef DS_RECORD_LZ4
+#include <lz4.h>
+#endif
+
+#define DS_RECORD_MAGIC   0x43525344u /* "DSRC" */
+#define DS_RECORD_VERSION 1u
+#define DS_FRAME_MAGIC    0x52465344u /* "DSFR" */
+#define DS_HEADER_SIZE    16
+#define DS_FRAME_SIZE     32
+
+/* On-disk header layout (little-endian):
+ *   0  magic       u32
+ *   4  version     u32
+ *   8  flags       u32   flags the recording was created with
+ *  12  reserved    u32
+ *
+ * On-disk frame header layout (little-endian):
+ *   0  magic       u32
+ *   4  timestamp   i64   microseconds
+ *  12  width       u16
+ *  14  height      u16
+ *  16  fmt         u8
+ *  17  orientation u8
+ *  18  codec       u8    0: raw, 1: LZ4
+ *  19  reserved    u8
+ *  20  options     u32
+ *  24  raw_size    u32   size of the packed pixels
+ *  28  size        u32   size of the pixels as stored
+ */
+
+enum {
+  DS_CODEC_RAW = 0,
+  DS_CODEC_LZ4
+};
+
+struct ds_record_writer_t_ {
+  FILE *file;
+  int compress;
+  uint64_t size;
+  unsigned char *raw;                 /* packed pixels */
+  size_t raw_capacity;
+  unsigned char *packed;              /* compressed pixels */
+  size_t packed_capacity;
+  int failed;
+};
+
+struct ds_record_reader_t_ {
+  FILE *file;
+  unsigned char *raw;
+  size_t raw_capacity;
+  unsigned char *packed;
+  size_t packed_capacity;
+};
+
+/*************************************************
+ * Helpers
+ *************************************************/
+
+static uint32_t ds_get_u32(const unsigned char *p) {
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+         ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint64_t ds_get_u64(const unsigned char *p) {
+  return (uint64_t) ds_get_u32(p) | ((uint64_t) ds_get_u32(p + 4) << 32);
+}
+
+static void ds_put_u32(unsigned char *p, uint32_t v) {
+  p[0] = (unsigned char) v;
+  p[1] = (unsigned char) (v >> 8);
+  p[2] = (unsigned char) (v >> 16);
+  p[3] = (unsigned char) (v >> 24);
+}
+
+static void ds_put_u64(unsigned char *p, uint64_t v) {
+  ds_put_u32(p, (uint32_t) v);
+  ds_put_u32(p + 4, (uint32_t) (v >> 32));
+}
+
+/* Grow a buffer to at least `size` bytes; the return value is 0 on success */
+static int ds_reserve(unsigned char **buf, size_t *capacity, size_t size) {
+  if (*capacity >= size) return 0;
+  unsigned char *grown = (unsigned char *) realloc(*buf, size);
+  if (!grown) return -1;
+  *buf = grown;
+  *capacity = size;
+  return 0;
+}
+
+/* Bytes per packed row of the (first) plane, and number of rows of all planes */
+static int ds_frame_layout(int fmt, int width, int height, size_t *row, size_t *rows) {
+  if (width <= 0 || height <= 0 || width > 0xffff || height > 0xffff) return -1;
+  switch (fmt) {
+    case DS_FRAME_BGRA:
+      *row = 4 * (size_t) width;
+      *rows = (size_t) height;
+      return 0;
+    case DS_FRAME_GRAY8:
+      *row = (size_t) width;
+      *rows = (size_t) height;
+      return 0;
+    case DS_FRAME_NV21:
+      *row = (size_t) width;
+      *rows = (size_t) height + (size_t) (height + 1) / 2;
+      return 0;
+    default:
+      return -1;
+  }
+}
+
+int ds_record_lz4(void) {
+#ifdef DS_RECORD_LZ4
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+/*************************************************
+ * Writer
+ *************************************************/
+
+ds_errcode ds_record_writer_open(const char *path, int flags, ds_record_writer_t **w) {
+  if (!path || !w) return DS_MISUSE;
+  *w = NULL;
+
+  ds_record_writer_t *writer = (ds_record_writer_t *) calloc(1, sizeof(*writer));
+  if (!writer) return DS_NOMEM;
+  writer->compress = (flags & DS_RECORD_COMPRESS) && ds_record_lz4();
+  writer->file = fopen(path, "wb");
+  if (!writer->file) {
+    free(writer);
+    return DS_ERROR;
+  }
+
+  unsigned char hdr[DS_HEADER_SIZE];
+  memset(hdr, 0, sizeof(hdr));
+  ds_put_u32(hdr, DS_RECORD_MAGIC);
+  ds_put_u32(hdr + 4, DS_RECORD_VERSION);
+  ds_put_u32(hdr + 8, writer->compress ? DS_RECORD_COMPRESS : 0);
+  if (fwrite(hdr, 1, sizeof(hdr), writer->file) != sizeof(hdr) || fflush(writer->file) != 0) {
+    fclose(writer->file);
+    free(writer);
+    return DS_ERROR;
+  }
+  writer->size = sizeof(hdr);
+
+  *w = writer;
+  return DS_SUCCESS;
+}
+
+ds_errcode ds_record_writer_add(ds_record_writer_t *w, const ds_frame_t *frame) {
+  if (!w || !frame || !frame->data) return DS_MISUSE;
+  if (w->failed) return DS_ERROR;
+
+  size_t row, rows;
+  if (ds_frame_layout(frame->fmt, frame->width, frame->height, &row, &rows) != 0 ||
+      frame->bpr < (int) row)
+    return DS_MISUSE;
+  size_t raw_size = row * rows;
+  if (raw_size > 0xffffffffu) return DS_MISUSE;
+
+  /* Pack the rows, unless they already are and are stored as is */
+  const unsigned char *raw = frame->data;
+  if ((size_t) frame->bpr != row || w->compress) {
+    if (ds_reserve(&w->raw, &w->raw_capacity, raw_size) != 0) return DS_NOMEM;
+    for (size_t y = 0; y < rows; y++)
+      memcpy(w->raw + y * row, frame->data + y * (size_t) frame->bpr, row);
+    raw = w->raw;
+  }
+
+  const unsigned char *payload = raw;
+  size_t size = raw_size;
+  int codec = DS_CODEC_RAW;
+#ifdef DS_RECORD_LZ4
+  if (w->compress && raw_size <= LZ4_MAX_INPUT_SIZE) {
+    int bound = LZ4_compressBound((int) raw_size);
+    if (ds_reserve(&w->packed, &w->packed_capacity, (size_t) bound) != 0) return DS_NOMEM;
+    int n = LZ4_compress_default((const char *) raw, (char *) w->packed, (int) raw_size, bound);
+    if (n > 0 && (size_t) n < raw_size) {
+      payload = w->packed;
+      size = (size_t) n;
+      codec = DS_CODEC_LZ4;
+    }
+  }
+#endif
+
+  unsigned char hdr[DS_FRAME_SIZE];
+  memset(hdr, 0, sizeof(hdr));
+  ds_put_u32(hdr, DS_FRAME_MAGIC);
+  ds_put_u64(hdr + 4, (uint64_t) frame->timestamp);
+  hdr[12] = (unsigned char) frame->width;
+  hdr[13] = (unsigned char) (frame->width >> 8);
+  hdr[14] = (unsigned char) frame->height;
+  hdr[15] = (unsigned char) (frame->height >> 8);
+  hdr[16] = (unsigned char) frame->fmt;
+  hdr[17] = (unsigned char) frame->orientation;
+  hdr[18] = (unsigned char) codec;
+  ds_put_u32(hdr + 20, (uint32_t) frame->options);
+  ds_put_u32(hdr + 24, (uint32_t) raw_size);
+  ds_put_u32(hdr + 28, (uint32_t) size);
+
+  int ok = fwrite(hdr, 1, sizeof(hdr), w->file) == sizeof(hdr) &&
+           fwrite(payload, 1, size, w->file) == size &&
+           fflush(w->file) == 0;
+  if (!ok) {
+    w->failed = 1;
+    return DS_ERROR;
+  }
+
+  w->size += sizeof(hdr) + size;
+  return DS_SUCCESS;
+}
+
+uint64_t ds_record_writer_size(const ds_record_writer_t *w) {
+  return w ? w->size : 0;
+}
+
+ds_errcode ds_record_writer_close(ds_record_writer_t *w) {
+  if (!w) return DS_MISUSE;
+  int failed = w->failed;
+  if (fclose(w->file) != 0) failed = 1;
+  free(w->raw);
+  free(w->packed);
+  free(w);
+  return failed ? DS_ERROR : DS_SUCCESS;
+}
+
+/*************************************************
+ * Reader
+ *************************************************/
+
+ds_errcode ds_record_reader_open(const char *path, ds_record_reader_t **r) {
+  if (!path || !r) return DS_MISUSE;
+  *r = NULL;
+
+  FILE *file = fopen(path, "rb");
+  if (!file) return DS_NOFILE;
+
+  unsigned char hdr[DS_HEADER_SIZE];
+  if (fread(hdr, 1, sizeof(hdr), file) != sizeof(hdr) ||
+      ds_get_u32(hdr) != DS_RECORD_MAGIC ||
+      ds_get_u32(hdr + 4) != DS_RECORD_VERSION) {
+    fclose(file);
+    return DS_CORRUPT;
+  }
+
+  ds_record_reader_t *reader = (ds_record_reader_t *) calloc(1, sizeof(*reader));
+  if (!reader) {
+    fclose(file);
+    return DS_NOMEM;
+  }
+  reader->file = file;
+
+  *r = reader;
+  return DS_SUCCESS;
+}
+
+ds_errcode ds_record_reader_next(ds_record_reader_t *r, ds_frame_t *frame) {
+  if (!r || !frame) return DS_MISUSE;
+
+  unsigned char hdr[DS_FRAME_SIZE];
+  if (fread(hdr, 1, sizeof(hdr), r->file) != sizeof(hdr))
+    return ferror(r->file) ? DS_ERROR : DS_NOREC;
+  if (ds_get_u32(hdr) != DS_FRAME_MAGIC) return DS_CORRUPT;
+
+  int width = hdr[12] | (hdr[13] << 8);
+  int height = hdr[14] | (hdr[15] << 8);
+  int fmt = hdr[16];
+  int codec = hdr[18];
+  uint32_t raw_size = ds_get_u32(hdr + 24);
+  uint32_t size = ds_get_u32(hdr + 28);
+
+  size_t row, rows;
+  if (ds_frame_layout(fmt, width, height, &row, &rows) != 0 || row * rows != raw_size)
+    return DS_CORRUPT;
+  if (codec == DS_CODEC_RAW) {
+    if (size != raw_size) return DS_CORRUPT;
+  }
+  else if (codec != DS_CODEC_LZ4 || size > raw_size) {
+    return DS_CORRUPT;
+  }
+
+  if (ds_reserve(&r->raw, &r->raw_capacity, raw_size) != 0) return DS_NOMEM;
+  unsigned char *dst = r->raw;
+  if (codec == DS_CODEC_LZ4) {
+    if (ds_reserve(&r->packed, &r->packed_capacity, size) != 0) return DS_NOMEM;
+    dst = r->packed;
+  }
+  if (fread(dst, 1, size, r->file) != size)
+    return ferror(r->file) ? DS_ERROR : DS_NOREC;
+
+  if (codec == DS_CODEC_LZ4) {
+#ifdef DS_RECORD_LZ4
+    int n = LZ4_decompress_safe((const char *) r->packed, (char *) r->raw, (int) size, (int) raw_size);
+    if (n < 0 || (uint32_t) n != raw_size) return DS_CORRUPT;
+#else
+    return DS_MISUSE;
+#endif
+  }
+
+  frame->data = r->raw;
+  frame->width = width;
+  frame->height = height;
+  frame->bpr = (int) row;
+  frame->fmt = fmt;
+  frame->orientation = hdr[17];
+  frame->options = (int) ds_get_u32(hdr + 20);
+  frame->timestamp = (int64_t) ds_get_u64(hdr + 4);
+  return DS_SUCCESS;
+}
+
+void ds_record_reader_close(ds_record_reader_t *r) {
+  if (!r) return;
+  fclose(r->file);
+  free(r->raw);
+  free(r->packed);
+  free(r);
+}
@@ -0,0 +1,156 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _DS_RECORD_H
+#define _DS_RECORD_H
+
+#include <stdint.h>
+
+#include "ds_table.h"                 /* error codes */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*************************************************
+ * Frame recordings
+ *
+ * Append-only file of raw camera frames, along with what the scanner needs
+ * to process them again offline: capture time, orientation and scan
+ * options. A recording is a header followed by frames:
+ *
+ *   +----------------------+
+ *   | header   (16 bytes)  |
+ *   +----------------------+
+ *   | frame header         |
+ *   |          (32 bytes)  |  one per frame, in capture order
+ *   | pixels               |
+ *   +----------------------+
+ *   | ...                  |
+ *
+ * Rows are stored packed (no padding). Each frame stands on its own and is
+ * flushed as soon as it is added, so that a recording can be streamed (e.g.
+ * read from a pipe while being written) and an interrupted recording is
+ * still readable up to its last complete frame.
+ *
+ * Frames may be LZ4-compressed, which requires building with
+ * `DS_RECORD_LZ4` defined and linking liblz4. Without it, recordings are
+ * written uncompressed and compressed ones cannot be read.
+ *
+ * All integers are stored little-endian.
+ *************************************************/
+
+/** Pixel format of a frame (same values as `ms_pix_fmt_t`) */
+enum {
+  DS_FRAME_BGRA = 0,                  /* 32bpp BGRA */
+  DS_FRAME_GRAY8,                     /* 8bpp grey (e.g. a luma plane) */
+  DS_FRAME_NV21                       /* 8bpp luma plane followed by the interleaved VU plane */
+};
+
+/** Recording flags */
+enum {
+  DS_RECORD_COMPRESS = 1 << 0         /* LZ4-compress the frames */
+};
+
+/** A recorded frame */
+typedef struct {
+  const uint8_t *data;                /* pixels */
+  int width;
+  int height;
+  int bpr;                            /* bytes per row (of each plane for NV21) */
+  int fmt;                            /* one of the `DS_FRAME_*` formats */
+  int orientation;                    /* orientation of the frame (`ms_ori_t`) */
+  int options;                        /* scan options in effect (`MSResultType` bitmask) */
+  int64_t timestamp;                  /* capture time, in microseconds (any origin) */
+} ds_frame_t;
+
+/** Type of a recording writer */
+typedef struct ds_record_writer_t_ ds_record_writer_t;
+
+/** Type of a recording reader */
+typedef struct ds_record_reader_t_ ds_record_reader_t;
+
+/**
+ * Check if LZ4 compression is available (i.e. if `DS_RECORD_LZ4` was
+ * defined at build time).
+ */
+int ds_record_lz4(void);
+
+/**
+ * Create a recording (or truncate an existing one).
+ * `flags` is a bitwise-or of the `DS_RECORD_*` flags. Compression is
+ * silently turned off if it is not available.
+ * `w` specifies the pointer to the variable into which the writer is
+ * assigned. It must be released with `ds_record_writer_close`.
+ * The return value is `DS_SUCCESS` or an error code.
+ */
+ds_errcode ds_record_writer_open(const char *path, int flags, ds_record_writer_t **w);
+
+/**
+ * Append a frame to a recording.
+ * A frame that does not compress well is stored as is.
+ * The return value is `DS_SUCCESS` or an error code.
+ */
+ds_errcode ds_record_writer_add(ds_record_writer_t *w, const ds_frame_t *frame);
+
+/**
+ * Get the number of bytes written so far, header included.
+ */
+uint64_t ds_record_writer_size(const ds_record_writer_t *w);
+
+/**
+ * Close and release a recording writer.
+ * The return value is `DS_SUCCESS`, or an error code if the last writes
+ * failed.
+ */
+ds_errcode ds_record_writer_close(ds_record_writer_t *w);
+
+/**
+ * Open a recording (any readable file, including a pipe).
+ * `r` specifies the pointer to the variable into which the reader is
+ * assigned. It must be released with `ds_record_reader_close`.
+ * The return value is `DS_SUCCESS` or an error code.
+ */
+ds_errcode ds_record_reader_open(const char *path, ds_record_reader_t **r);
+
+/**
+ * Read the next frame of a recording.
+ * The pixels of `frame` belong to the reader and stay valid until the next
+ * call.
+ * The return value is `DS_SUCCESS`, `DS_NOREC` at the end of the recording
+ * (an incomplete last frame is ignored), `DS_MISUSE` if the frame is
+ * compressed but compression is not available, or an error code.
+ */
+ds_errcode ds_record_reader_next(ds_record_reader_t *r, ds_frame_t *frame);
+
+/**
+ * Release a recording reader.
+ */
+void ds_record_reader_close(ds_record_reader_t *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
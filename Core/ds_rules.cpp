@@ -0,0 +1,342 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ds_rules.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace ds {
+
+static const int64_t kUnboundedPast   = -0x7fffffffffffffffLL - 1;
+static const int64_t kUnboundedFuture =  0x7fffffffffffffffLL;
+static const uint8_t kEveryDay        = 0x7f;
+static const int     kMaxSegments     = 64;
+
+/*************************************************
+ * Parsing helpers
+ *************************************************/
+
+static void Split(const std::string &str, char sep, std::vector<std::string> *out) {
+  out->clear();
+  size_t start = 0;
+  while (start <= str.size()) {
+    size_t end = str.find(sep, start);
+    if (end == std::string::npos) end = str.size();
+    if (end > start) out->push_back(str.substr(start, end - start));
+    start = end + 1;
+  }
+}
+
+static void Tokenize(const std::string &line, std::vector<std::string> *out) {
+  out->clear();
+  size_t i = 0;
+  while (i < line.size()) {
+    while (i < line.size() && (line[i] == ' ' || line[i] == '\t' || line[i] == '\r')) i++;
+    size_t start = i;
+    while (i < line.size() && line[i] != ' ' && line[i] != '\t' && line[i] != '\r') i++;
+    if (i > start) out->push_back(line.substr(start, i - start));
+  }
+}
+
+static bool ParseInt(const std::string &str, int64_t min, int64_t max, int64_t *value) {
+  if (str.empty()) return false;
+  char *end = NULL;
+  long long v = strtoll(str.c_str(), &end, 10);
+  if (*end != '\0' || v < min || v > max) return false;
+  *value = v;
+  return true;
+}
+
+static std::string LineError(size_t line, const std::string &what) {
+  char prefix[32];
+  snprintf(prefix, sizeof(prefix), "line %lu: ", (unsigned long) line);
+  return prefix + what;
+}
+
+/*************************************************
+ * Rule set
+ *************************************************/
+
+RuleSet::RuleSet() : user_segments_(0) {}
+
+void RuleSet::Clear() {
+  rules_.clear();
+  by_product_.clear();
+  by_category_.clear();
+  any_product_.clear();
+  categories_.clear();
+  segment_bits_.clear();
+  user_segments_ = 0;
+}
+
+bool RuleSet::Parse(const std::string &text, std::string *error) {
+  Clear();
+
+  size_t lineno = 0;
+  size_t start = 0;
+  while (start < text.size()) {
+    size_t end = text.find('\n', start);
+    if (end == std::string::npos) end = text.size();
+    lineno++;
+
+    std::string line = text.substr(start, end - start);
+    size_t comment = line.find('#');
+    if (comment != std::string::npos) line.erase(comment);
+
+    std::string what;
+    if (!ParseLine(line, &what)) {
+      if (error) *error = LineError(lineno, what);
+      Clear();
+      return false;
+    }
+    start = end + 1;
+  }
+
+  return true;
+}
+
+bool RuleSet::InternSegment(const std::string &name, uint64_t *bit) {
+  std::map<std::string, int>::const_iterator it = segment_bits_.find(name);
+  if (it == segment_bits_.end()) {
+    if ((int) segment_bits_.size() >= kMaxSegments) return false;
+    it = segment_bits_.insert(std::make_pair(name, (int) segment_bits_.size())).first;
+  }
+  *bit = 1ULL << it->second;
+  return true;
+}
+
+bool RuleSet::ParseLine(const std::string &line, std::string *error) {
+  std::vector<std::string> fields;
+  Tokenize(line, &fields);
+  if (fields.empty()) return true;
+
+  std::vector<std::string> values;
+  const std::string &kind = fields[0];
+
+  if (kind == "segments") {
+    if (fields.size() != 2) {
+      *error = "expected: segments <name>[,<name>...]";
+      return false;
+    }
+    Split(fields[1], ',', &values);
+    for (size_t i = 0; i < values.size(); i++) {
+      uint64_t bit = 0;
+      if (!InternSegment(values[i], &bit)) {
+        *error = "too many segments";
+        return false;
+      }
+      user_segments_ |= bit;
+    }
+    return true;
+  }
+
+  if (kind == "category") {
+    if (fields.size() != 3) {
+      *error = "expected: category <product> <category>[,<category>...]";
+      return false;
+    }
+    Split(fields[2], ',', &values);
+    std::vector<std::string> &categories = categories_[fields[1]];
+    categories.insert(categories.end(), values.begin(), values.end());
+    return true;
+  }
+
+  if (kind != "rule") {
+    *error = "unknown record: " + kind;
+    return false;
+  }
+
+  Rule rule;
+  rule.off = -1;
+  rule.priority = 0;
+  rule.segments = 0;
+  rule.from = kUnboundedPast;
+  rule.until = kUnboundedFuture;
+  rule.hour_from = -1;
+  rule.hour_to = -1;
+  rule.days = kEveryDay;
+
+  std::vector<std::string> products;
+  std::vector<std::string> categories;
+
+  for (size_t i = 1; i < fields.size(); i++) {
+    size_t eq = fields[i].find('=');
+    if (eq == std::string::npos) {
+      *error = "expected key=value: " + fields[i];
+      return false;
+    }
+    std::string key = fields[i].substr(0, eq);
+    std::string value = fields[i].substr(eq + 1);
+    int64_t v = 0;
+
+    if (key == "off") {
+      if (!ParseInt(value, 0, 100, &v)) {
+        *error = "invalid off: " + value;
+        return false;
+      }
+      rule.off = (int) v;
+    }
+    else if (key == "priority") {
+      if (!ParseInt(value, -1000000, 1000000, &v)) {
+        *error = "invalid priority: " + value;
+        return false;
+      }
+      rule.priority = (int) v;
+    }
+    else if (key == "product") {
+      Split(value, ',', &values);
+      products.insert(products.end(), values.begin(), values.end());
+    }
+    else if (key == "category") {
+      Split(value, ',', &values);
+      categories.insert(categories.end(), values.begin(), values.end());
+    }
+    else if (key == "segment") {
+      Split(value, ',', &values);
+      for (size_t j = 0; j < values.size(); j++) {
+        uint64_t bit = 0;
+        if (!InternSegment(values[j], &bit)) {
+          *error = "too many segments";
+          return false;
+        }
+        rule.segments |= bit;
+      }
+    }
+    else if (key == "from" || key == "until") {
+      if (!ParseInt(value, kUnboundedPast, kUnboundedFuture, &v)) {
+        *error = "invalid " + key + ": " + value;
+        return false;
+      }
+      if (key == "from") rule.from = v;
+      else rule.until = v;
+    }
+    else if (key == "hours") {
+      /* The end of the day is 24, hence `0-24` for the whole day */
+      size_t dash = value.find('-');
+      int64_t h0 = 0, h1 = 0;
+      if (dash == std::string::npos ||
+          !ParseInt(value.substr(0, dash), 0, 23, &h0) ||
+          !ParseInt(value.substr(dash + 1), 0, 24, &h1)) {
+        *error = "invalid hours: " + value;
+        return false;
+      }
+      if (h0 == h1) {
+        *error = "empty hours: " + value;
+        return false;
+      }
+      rule.hour_from = (int) h0;
+      rule.hour_to = (int) h1;
+    }
+    else if (key == "days") {
+      rule.days = 0;
+      for (size_t j = 0; j < value.size(); j++) {
+        if (value[j] < '0' || value[j] > '6') {
+          *error = "invalid days: " + value;
+          return false;
+        }
+        rule.days |= (uint8_t) (1 << (value[j] - '0'));
+      }
+    }
+    else {
+      *error = "unknown field: " + key;
+      return false;
+    }
+  }
+
+  if (rule.off < 0) {
+    *error = "missing off";
+    return false;
+  }
+  if (rule.from >= rule.until) {
+    *error = "empty time range";
+    return false;
+  }
+
+  uint32_t id = (uint32_t) rules_.size();
+  rules_.push_back(rule);
+  for (size_t i = 0; i < products.size(); i++) by_product_[products[i]].push_back(id);
+  for (size_t i = 0; i < categories.size(); i++) by_category_[categories[i]].push_back(id);
+  if (products.empty() && categories.empty()) any_product_.push_back(id);
+  return true;
+}
+
+uint64_t RuleSet::SegmentMask(const std::vector<std::string> &names) const {
+  uint64_t mask = 0;
+  for (size_t i = 0; i < names.size(); i++) {
+    std::map<std::string, int>::const_iterator it = segment_bits_.find(names[i]);
+    if (it != segment_bits_.end()) mask |= 1ULL << it->second;
+  }
+  return mask;
+}
+
+/*************************************************
+ * Evaluation
+ *************************************************/
+
+void RuleSet::Match(const std::vector<uint32_t> &ids, const RuleContext &ctx,
+                    int hour, int day, const Rule **best) const {
+  for (size_t i = 0; i < ids.size(); i++) {
+    const Rule &r = rules_[ids[i]];
+    if (r.segments && !(r.segments & ctx.segments)) continue;
+    if (ctx.time < r.from || ctx.time >= r.until) continue;
+    if (!(r.days & (1 << day))) continue;
+    if (r.hour_from >= 0) {
+      bool in = (r.hour_from <= r.hour_to) ? (hour >= r.hour_from && hour < r.hour_to)
+                                           : (hour >= r.hour_from || hour < r.hour_to);
+      if (!in) continue;
+    }
+    if (*best == NULL || r.priority > (*best)->priority ||
+        (r.priority == (*best)->priority && r.off > (*best)->off)) {
+      *best = &r;
+    }
+  }
+}
+
+int RuleSet::Evaluate(const std::string &product, const RuleContext &ctx) const {
+  /* Local day of week (0 = Sunday, 1970-01-01 was a Thursday) and hour */
+  int64_t local = ctx.time + ctx.utc_offset;
+  int64_t days = local >= 0 ? local / 86400 : (local - 86399) / 86400;
+  int64_t secs = local - days * 86400;
+  int hour = (int) (secs / 3600);
+  int day = (int) (((days + 4) % 7 + 7) % 7);
+
+  const Rule *best = NULL;
+
+  Index::const_iterator it = by_product_.find(product);
+  if (it != by_product_.end()) Match(it->second, ctx, hour, day, &best);
+
+  std::map<std::string, std::vector<std::string> >::const_iterator cats = categories_.find(product);
+  if (cats != categories_.end()) {
+    for (size_t i = 0; i < cats->second.size(); i++) {
+      it = by_category_.find(cats->second[i]);
+      if (it != by_category_.end()) Match(it->second, ctx, hour, day, &best);
+    }
+  }
+
+  Match(any_product_, ctx, hour, day, &best);
+
+  return best ? best->off : -1;
+}
+
+}  // namespace ds
@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _DS_RULES_H
+#define _DS_RULES_H
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+/*************************************************
+ * Discount rules
+ *
+ * Compact text format pushed by the backend during sync, that lets the
+ * personalized discount of a product be computed on the device. Each line
+ * is a record made of whitespace-separated fields, `#` starts a comment:
+ *
+ *   segments gold,student
+ *   category <product ID> shoes,sale
+ *   rule off=20 category=shoes segment=gold from=1356998400 until=1359676800
+ *   rule off=35 product=<product ID> hours=18-22 days=06 priority=1
+ *
+ * - `segments` lists the segments the user belongs to (at most 64 distinct
+ *   segments may be referenced overall),
+ * - `category` lists the categories of a product,
+ * - `rule` grants `off` percents on a `product` or a `category` (or on any
+ *   product if none is given). It may be restricted to a user `segment`, to
+ *   a [`from`, `until`) range of UNIX timestamps, to a daily `hours` window
+ *   (local time, end excluded, 24 is the end of the day so that `0-24` is
+ *   the whole day, may wrap around midnight as in `22-2`, must not be empty)
+ *   and to some week `days` (0 = Sunday). Product, category and segment fields may list
+ *   several comma-separated values.
+ *
+ * When several rules apply, the one with the highest `priority` (default 0)
+ * wins, then the one with the highest discount. A winning `off=0` rule is an
+ * explicit "no discount", e.g. to exclude a product from a wider rule.
+ *************************************************/
+
+namespace ds {
+
+/** Evaluation context of a rule set */
+struct RuleContext {
+  uint64_t segments;     /* bit mask of the user segments (see `RuleSet::segments`) */
+  int64_t time;          /* UNIX timestamp */
+  int32_t utc_offset;    /* offset of the local time zone, in seconds */
+
+  RuleContext() : segments(0), time(0), utc_offset(0) {}
+};
+
+/**
+ * Set of discount rules indexed for fast evaluation
+ *
+ * Only the rules targeting the product, its categories, or any product are
+ * checked, so evaluating is independent of the total number of rules.
+ */
+class RuleSet {
+ public:
+  RuleSet();
+
+  /**
+   * Parse the given rules, replacing any rule previously held.
+   * Returns false on malformed input, in which case `error` (if not NULL)
+   * receives a description of the problem and the set is left empty.
+   */
+  bool Parse(const std::string &text, std::string *error);
+
+  /**
+   * Get the bit mask of the given segment names, e.g. to fill a context.
+   * Unknown segments are ignored.
+   */
+  uint64_t SegmentMask(const std::vector<std::string> &names) const;
+
+  /**
+   * Get the bit mask of the segments listed by the `segments` records.
+   */
+  uint64_t segments() const { return user_segments_; }
+
+  /**
+   * Compute the discount of a product, in percents, or -1 if no rule
+   * applies (0 means that a rule grants no discount).
+   */
+  int Evaluate(const std::string &product, const RuleContext &ctx) const;
+
+  /**
+   * Number of rules held by the set.
+   */
+  size_t size() const { return rules_.size(); }
+
+ private:
+  struct Rule {
+    int off;
+    int priority;
+    uint64_t segments;   /* 0 means anyone */
+    int64_t from;        /* INT64_MIN if unbounded */
+    int64_t until;       /* INT64_MAX if unbounded */
+    int hour_from;       /* -1 if any time of day */
+    int hour_to;         /* excluded, 24 for the end of the day */
+    uint8_t days;        /* bit mask, 0x7f means every day */
+  };
+
+  typedef std::map<std::string, std::vector<uint32_t> > Index;
+
+  void Clear();
+  bool ParseLine(const std::string &line, std::string *error);
+  bool InternSegment(const std::string &name, uint64_t *bit);
+  void Match(const std::vector<uint32_t> &ids, const RuleContext &ctx,
+             int hour, int day, const Rule **best) const;
+
+  std::vector<Rule> rules_;
+  Index by_product_;
+  Index by_category_;
+  std::vector<uint32_t> any_product_;
+  std::map<std::string, std::vector<std::string> > categories_;
+  std::map<std::string, int> segment_bits_;
+  uint64_t user_segments_;
+};
+
+}  // namespace ds
+
+#endif
@@ -0,0 +1,73 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ds_sched.h"
+
+namespace {
+
+/* Weight of a new measure in the moving averages */
+const double kAlpha = 0.1;
+
+/* Frames arriving slightly early are still scanned, to absorb the camera
+ * jitter (as a fraction of the interval) */
+const double kSlack = 0.1;
+
+void UpdateInterval(ds_sched_t *s) {
+  double interval = s->cost[DS_STAGE_FRAME] / s->budget;
+  if (interval < s->min_interval) interval = s->min_interval;
+  if (interval > s->max_interval) interval = s->max_interval;
+  s->interval = interval;
+}
+
+}  // namespace
+
+void ds_sched_init(ds_sched_t *s, double min_interval, double max_interval, double budget) {
+  s->min_interval = min_interval;
+  s->max_interval = max_interval;
+  s->budget = (budget > 0) ? budget : 1;
+  for (int i = 0; i < DS_STAGE_NB; i++) {
+    s->cost[i] = 0;
+    s->samples[i] = 0;
+  }
+  s->interval = min_interval;
+  s->last = -1;
+}
+
+void ds_sched_set_budget(ds_sched_t *s, double budget) {
+  s->budget = (budget > 0) ? budget : 1;
+  UpdateInterval(s);
+}
+
+void ds_sched_record(ds_sched_t *s, ds_stage stage, double seconds) {
+  if (stage < 0 || stage >= DS_STAGE_NB || seconds < 0) return;
+  if (s->samples[stage] == 0) s->cost[stage] = seconds;
+  else s->cost[stage] += kAlpha * (seconds - s->cost[stage]);
+  s->samples[stage]++;
+  if (stage == DS_STAGE_FRAME) UpdateInterval(s);
+}
+
+int ds_sched_due(ds_sched_t *s, double now) {
+  if (s->last >= 0 && now - s->last < (1 - kSlack) * s->interval) return 0;
+  s->last = now;
+  return 1;
+}
@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _DS_SCHED_H
+#define _DS_SCHED_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*************************************************
+ * Scan scheduler
+ *
+ * Picks the scan cadence from the measured recognition costs, so that
+ * scanning stays within a CPU budget (a fraction of one core) instead of
+ * trying to keep up with the camera: with a per-frame cost `c` and a budget
+ * `b`, frames are scanned at most every `c / b` seconds. Each device thus
+ * converges to its own sustainable rate.
+ *************************************************/
+
+/** Stages whose cost is measured */
+typedef enum {
+  DS_STAGE_FRAME = 0,                 /* whole scan of a frame (drives the cadence) */
+  DS_STAGE_SEARCH,                    /* offline image search */
+  DS_STAGE_MATCH,                     /* match against a locked result */
+  DS_STAGE_DECODE,                    /* barcode decoding */
+  DS_STAGE_NB                         /* number of stages - do not use! */
+} ds_stage;
+
+/** Type of a scheduler, to be initialized with `ds_sched_init` */
+typedef struct {
+  double min_interval;                /* shortest interval between two scans, in seconds */
+  double max_interval;                /* longest interval between two scans, in seconds */
+  double budget;                      /* fraction of a CPU core scanning may use */
+  double cost[DS_STAGE_NB];           /* moving average of each stage, in seconds */
+  uint32_t samples[DS_STAGE_NB];      /* number of measures of each stage */
+  double interval;                    /* current interval between two scans */
+  double last;                        /* time of the last scan (negative if none) */
+} ds_sched_t;
+
+/**
+ * Initialize a scheduler.
+ * `min_interval` and `max_interval` specify the bounds of the interval
+ * between two scans, in seconds (e.g. one camera frame and half a second).
+ * `budget` specifies the fraction of a CPU core scanning may use (e.g. 0.5).
+ */
+void ds_sched_init(ds_sched_t *s, double min_interval, double max_interval, double budget);
+
+/**
+ * Change the CPU budget, e.g. when the battery runs low.
+ */
+void ds_sched_set_budget(ds_sched_t *s, double budget);
+
+/**
+ * Record the duration of a stage, in seconds.
+ * Recording a `DS_STAGE_FRAME` duration updates the interval.
+ */
+void ds_sched_record(ds_sched_t *s, ds_stage stage, double seconds);
+
+/**
+ * Check if a frame should be scanned.
+ * `now` specifies the current time, in seconds.
+ * The return value is 1 if the frame should be scanned (it is then counted
+ * as the last scan), 0 if it should be skipped.
+ */
+int ds_sched_due(ds_sched_t *s, double now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
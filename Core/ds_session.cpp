@@ -0,0 +1,277 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "ds_session.h"
+
+namespace ds {
+
+/* Deduplication parameters (see `ds_dedup_init`) */
+static const int    kDedupMaxDistance   = 4;
+static const int    kDedupSceneDistance = 16;
+static const double kDedupTTL           = 2.0;
+
+/* Tracking parameters (see `ds_tracker_init`) */
+static const int      kTrackRadius        = 6;
+static const double   kTrackMinScore      = 0.8;
+/* Number of tracked frames after which a full match runs anyway */
+static const uint32_t kTrackMatchInterval = 10;
+
+/* Strategy parameters (see `ds_strategy_init`): unproductive formats run
+ * every 4th frame, and a format is unproductive after 90 frames without hit */
+static const int      kStrategyPeriod = 4;
+static const uint32_t kStrategyWindow = 90;
+
+ScanSession::ScanSession(ScanBackend *backend)
+    : backend_(backend),
+      state_(kStateDefault),
+      snap_(0),
+      reset_(0),
+      losts_(0),
+      hits_(0),
+      confirmations_(1),
+      max_losts_(2),
+      parallel_(false),
+      deduplicates_(false),
+      tracks_(false),
+      adaptive_(false),
+      matches_skipped_(0),
+      search_time_(0),
+      match_time_(0),
+      decode_time_(0) {
+  ds_dedup_init(&dedup_, kDedupMaxDistance, kDedupSceneDistance, kDedupTTL);
+  ds_tracker_init(&tracker_, kTrackRadius, kTrackMinScore);
+  ds_strategy_init(&strategy_, 0, kStrategyPeriod, kStrategyWindow);
+}
+
+void ScanSession::Reset() {
+  result_.Clear();
+  ds_tracker_stop(&tracker_);
+  losts_ = 0;
+  hits_ = 0;
+}
+
+/* The state changes may come from another thread than the scanning one:
+ * they only flip `state_` and post requests that `Scan` applies */
+
+bool ScanSession::Pause() {
+  return __sync_bool_compare_and_swap(&state_, kStateDefault, kStatePause);
+}
+
+bool ScanSession::Resume() {
+  if (state_ != kStatePause) return false;
+  /* Posted before scanning resumes, so that the next scan sees it */
+  __sync_fetch_and_and(&snap_, 0);
+  __sync_fetch_and_or(&reset_, 1);
+  return __sync_bool_compare_and_swap(&state_, kStatePause, kStateDefault);
+}
+
+bool ScanSession::Snap() {
+  if (state_ != kStateDefault) return false;
+  __sync_fetch_and_or(&snap_, 1);
+  return true;
+}
+
+void ScanSession::SearchStarted() {
+  __sync_fetch_and_or(&reset_, 1);
+}
+
+void ScanSession::SearchFinished() {
+  __sync_bool_compare_and_swap(&state_, kStateSearch, kStateDefault);
+}
+
+int ScanSession::CheckLock(const ScanFrame &frame, bool *anchor, bool *tracked) {
+  /* A result is only confirmed by frames that actually recognize it, so it
+   * is matched on every frame until then */
+  const uint8_t *thumb = (tracks_ && hits_ >= confirmations_) ? frame.thumb : NULL;
+  int found = 0;
+  double t0 = backend_->Now();
+  if (result_.type == kResultImage) {
+    if (thumb && tracker_.active && tracker_.frames < kTrackMatchInterval &&
+        ds_tracker_update(&tracker_, thumb)) {
+      /* The object has barely moved since it was last matched */
+      found = 1;
+      *tracked = true;
+      matches_skipped_++;
+    }
+    else {
+      bool matched = false;
+      ds_tracker_stop(&tracker_);
+      backend_->Match(frame, result_, &matched);
+      found = matched ? 1 : -1;
+      *anchor = matched;
+    }
+  }
+  else if (result_.type == kResultQRCode) {
+    backend_->Decode(frame, kResultQRCode, &scratch_);
+    found = (scratch_ == result_) ? 1 : -1;
+  }
+  match_time_ = backend_->Now() - t0;
+  return found;
+}
+
+ms_errcode ScanSession::Scan(const ScanFrame &frame, int formats, const ScanResult **result) {
+  *result = NULL;
+  if (__sync_fetch_and_and(&reset_, 0)) Reset();
+  if (state_ != kStateDefault) return MS_SUCCESS;
+
+  search_time_ = 0;
+  match_time_ = 0;
+  decode_time_ = 0;
+
+  if (__sync_fetch_and_and(&snap_, 0) &&
+      __sync_bool_compare_and_swap(&state_, kStateDefault, kStateSearch)) {
+    return MS_SUCCESS;
+  }
+
+  /* Leave out the formats that have not been productive lately */
+  if (adaptive_) {
+    if ((uint32_t) formats != strategy_.formats)
+      ds_strategy_set_formats(&strategy_, (uint32_t) formats);
+    formats = (int) ds_strategy_next(&strategy_);
+  }
+
+  const ScanResult *found = NULL;
+  bool seen = false;    /* the result has actually been found in this frame */
+  bool tracked = false; /* ...but only by tracking, which does not confirm it */
+  bool anchor = false;  /* an image result has been matched in this frame */
+
+  /*
+   * Locked result
+   */
+  if (!result_.empty() && losts_ < max_losts_) {
+    int check = CheckLock(frame, &anchor, &tracked);
+    if (check == 1) {
+      /* The current frame matches with the previous result */
+      found = &result_;
+      seen = true;
+      losts_ = 0;
+    }
+    else if (check == -1) {
+      /* The current frame looks different so release the lock if there is
+       * enough consecutive "no match" */
+      losts_++;
+      if (losts_ < max_losts_) found = &result_;
+    }
+  }
+
+  /* Skip the image search if this frame looks like a recent one without match */
+  bool search = (found == NULL && (formats & kResultImage));
+  bool dedup = (deduplicates_ && frame.dhash != 0);
+  double now = dedup ? backend_->Now() : 0;
+  if (search && dedup && ds_dedup_seen(&dedup_, frame.dhash, now))
+    search = false;
+
+  /* In parallel mode the barcodes are decoded by the backend on another
+   * thread while the image search runs on this one
+   * NOTE: the decoding is always waited for, since the frame is released by
+   * the caller once this function returns */
+  bool barcodes = (formats & ~kResultImage) != 0;
+  bool parallel = (parallel_ && search && barcodes && backend_->CanDecodeConcurrently());
+  if (parallel)
+    backend_->StartDecode(frame, formats, &barcode_);
+
+  /*
+   * Image search
+   */
+  if (search) {
+    double t0 = backend_->Now();
+    ms_errcode ecode = backend_->Search(frame, &scratch_);
+    search_time_ = backend_->Now() - t0;
+    if (ecode != MS_SUCCESS && ecode != MS_EMPTY) {
+      if (parallel) backend_->FinishDecode(&decode_time_);
+      return ecode;
+    }
+    if (!scratch_.empty()) {
+      found = &scratch_;
+      seen = true;
+      anchor = true;
+      losts_ = 0;
+    }
+    else if (dedup) {
+      ds_dedup_add(&dedup_, frame.dhash, now);
+    }
+  }
+
+  /*
+   * Barcode decoding
+   */
+  if (parallel) {
+    ms_errcode ecode = backend_->FinishDecode(&decode_time_);
+    if (ecode != MS_SUCCESS && !backend_->CanDecodeConcurrently()) {
+      /* The backend turned out to be unable to decode concurrently: decode
+       * again below, now that the search is over */
+      parallel = false;
+    }
+    else if (found == NULL) {
+      if (ecode != MS_SUCCESS) return ecode;
+      if (!barcode_.empty()) {
+        /* Swap the buffers so that the result is always the scratch one */
+        scratch_.Swap(barcode_);
+        found = &scratch_;
+        seen = true;
+        losts_ = 0;
+      }
+    }
+  }
+
+  if (found == NULL && !parallel && barcodes) {
+    double t0 = backend_->Now();
+    ms_errcode ecode = backend_->Decode(frame, formats, &scratch_);
+    decode_time_ = backend_->Now() - t0;
+    if (ecode != MS_SUCCESS) return ecode;
+    if (!scratch_.empty()) {
+      found = &scratch_;
+      seen = true;
+      losts_ = 0;
+    }
+  }
+
+  if (found == NULL) {
+    result_.Clear();
+    hits_ = 0;
+  }
+  else if (found != &result_ && *found != result_) {
+    /* Swap the buffers: the previous result becomes the scratch one */
+    result_.Swap(scratch_);
+    hits_ = 0;
+  }
+
+  if (adaptive_ && seen)
+    ds_strategy_hit(&strategy_, (uint32_t) result_.type);
+
+  /* Follow the matched image from this frame on */
+  const uint8_t *thumb = tracks_ ? frame.thumb : NULL;
+  if (anchor && thumb)
+    ds_tracker_start(&tracker_, thumb);
+  else if (result_.type != kResultImage)
+    ds_tracker_stop(&tracker_);
+
+  /* Hold the result back until it has been recognized in enough frames */
+  if (seen && !tracked && hits_ < confirmations_) hits_++;
+  if (found != NULL && hits_ >= confirmations_) *result = &result_;
+
+  return MS_SUCCESS;
+}
+
+}  // namespace ds
@@ -0,0 +1,250 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _DS_SESSION_H
+#define _DS_SESSION_H
+
+#include <stdint.h>
+
+#include <string>
+
+#include "moodstocks_sdk.h"
+#include "ds_dhash.h"
+#include "ds_strategy.h"
+#include "ds_track.h"
+
+/*************************************************
+ * Scan session
+ *
+ * Decision logic of a scanner session, independent from the platform:
+ * which of the search, match and decoders run on each frame, when a result
+ * is locked and released, when it is confirmed, and when a snapped frame
+ * goes to the API search. The actual recognition is left to a backend,
+ * typically a thin layer over the Moodstocks SDK (see `ScanBackend`).
+ *
+ * On each frame:
+ * - a locked result is checked first, by tracking or matching an image or
+ *   by decoding a QR Code again. It is kept as long as it is not missed on
+ *   `max_losts` (2 by default) frames in a row,
+ * - otherwise the image search and the barcode decoders run, the decoders
+ *   possibly on another thread while searching (parallel mode). An image
+ *   result wins over a barcode,
+ * - a new result is only returned once it has been recognized (searched,
+ *   matched or decoded) on `confirmations` frames. Tracking only keeps a
+ *   confirmed lock alive: an image is matched on every frame until then.
+ *
+ * A session is not thread-safe: all calls must be made from the scanning
+ * thread, with two exceptions:
+ * - the state changes (`Pause`, `Resume`, `Snap`, `SearchStarted`,
+ *   `SearchFinished`) and `state`/`CanCancel` may be called from any
+ *   thread. They only touch `state_` (changed by compare-and-swap) and the
+ *   `snap_`/`reset_` request flags: the locked result is dropped by the
+ *   next `Scan`, on the scanning thread, rather than by `Resume` or
+ *   `SearchStarted` themselves,
+ * - the counters and times may be read from any thread, e.g. for stats,
+ *   and may then lag one frame behind.
+ * The settings are to be changed while no scan runs.
+ *************************************************/
+
+namespace ds {
+
+/** Result types (same values as `MSResultType`) */
+enum {
+  kResultNone   = 0,
+  kResultEAN8   = 1 << 0,
+  kResultEAN13  = 1 << 1,
+  kResultQRCode = 1 << 2
+};
+static const int kResultImage = (int) (1u << 31);
+
+/** Result of a scan */
+struct ScanResult {
+  int type;              /* one of the `kResult*` types */
+  std::string value;     /* image ID, barcode number or raw QR Code data */
+
+  ScanResult() : type(kResultNone) {}
+
+  bool empty() const { return type == kResultNone; }
+  void Clear() { type = kResultNone; value.clear(); }
+  void Swap(ScanResult &other) {
+    int t = type;
+    type = other.type;
+    other.type = t;
+    value.swap(other.value);
+  }
+  bool operator==(const ScanResult &other) const {
+    return type == other.type && value == other.value;
+  }
+  bool operator!=(const ScanResult &other) const { return !(*this == other); }
+};
+
+/** Frame to be scanned */
+struct ScanFrame {
+  const ms_img_t *image; /* query image */
+  void *user;            /* caller data passed along to the backend */
+  uint64_t dhash;        /* perceptual hash (see `ds_dhash`), 0 if unknown */
+  const uint8_t *thumb;  /* tracking thumbnail (see `ds_thumbnail`), NULL if unknown */
+
+  ScanFrame() : image(NULL), user(NULL), dhash(0), thumb(NULL) {}
+};
+
+/**
+ * Recognition primitives a session relies on
+ *
+ * Results are filled in place (an empty result means nothing was found), so
+ * that a backend reusing their storage does not allocate once warmed up.
+ */
+class ScanBackend {
+ public:
+  virtual ~ScanBackend() {}
+
+  /** Search the offline image database */
+  virtual ms_errcode Search(const ScanFrame &frame, ScanResult *result) = 0;
+
+  /** Match a frame against the reference image of an image result */
+  virtual ms_errcode Match(const ScanFrame &frame, const ScanResult &ref, bool *matched) = 0;
+
+  /** Decode the barcodes of the given formats */
+  virtual ms_errcode Decode(const ScanFrame &frame, int formats, ScanResult *result) = 0;
+
+  /**
+   * Check if `StartDecode` may be used, i.e. if barcodes can be decoded on
+   * another thread while searching.
+   */
+  virtual bool CanDecodeConcurrently() { return false; }
+
+  /**
+   * Start decoding on another thread. `FinishDecode` is always called before
+   * the frame is released.
+   */
+  virtual void StartDecode(const ScanFrame & /* frame */, int /* formats */,
+                           ScanResult * /* result */) {}
+
+  /**
+   * Wait for the decoding started by `StartDecode`, and get its duration (in
+   * seconds) and error code.
+   */
+  virtual ms_errcode FinishDecode(double *seconds) { *seconds = 0; return MS_MISUSE; }
+
+  /** Get the current time, in seconds (any origin) */
+  virtual double Now() = 0;
+};
+
+/** Scanner session */
+class ScanSession {
+ public:
+  enum State {
+    kStateDefault = 0,   /* scanning */
+    kStateSearch,        /* an API search is pending */
+    kStatePause          /* paused until `Resume` is called */
+  };
+
+  /** The backend is not owned, it must outlive the session */
+  explicit ScanSession(ScanBackend *backend);
+
+  /**
+   * Scan a frame for the given formats (bitwise-or of `kResult*` types).
+   * `*result` receives the result found, or NULL if none (or if it is not
+   * confirmed yet). It is owned by the session and only valid until the
+   * next call.
+   * If a snap is pending, nothing is scanned: the state switches to
+   * `kStateSearch` and the caller is expected to send this frame to the API
+   * search, then to call `SearchFinished` once it is over.
+   * The return value is MS_SUCCESS or the error code of the backend.
+   */
+  ms_errcode Scan(const ScanFrame &frame, int formats, const ScanResult **result);
+
+  /** Each function returns false if the state does not allow the change */
+  bool Pause();
+  bool Resume();
+  bool Snap();
+  /** Check if a pending API search may be cancelled */
+  bool CanCancel() const { return state_ == kStateSearch; }
+
+  /** Notifications of the API search life-cycle */
+  void SearchStarted();
+  void SearchFinished();
+
+  State state() const { return (State) state_; }
+
+  /** Locked result, confirmed or not (NULL if none, or if it is to be dropped) */
+  const ScanResult *candidate() const { return (result_.empty() || reset_) ? NULL : &result_; }
+
+  /** Settings (see `MSScannerSession` for their details) */
+  void set_confirmations(int confirmations) { confirmations_ = confirmations; }
+  int confirmations() const { return confirmations_; }
+  /** Number of consecutive misses that release a lock (default: 2) */
+  void set_max_losts(int max_losts) { max_losts_ = max_losts; }
+  int max_losts() const { return max_losts_; }
+  void set_parallel(bool parallel) { parallel_ = parallel; }
+  bool parallel() const { return parallel_; }
+  void set_deduplicates(bool deduplicates) { deduplicates_ = deduplicates; }
+  bool deduplicates() const { return deduplicates_; }
+  void set_tracks(bool tracks) { tracks_ = tracks; }
+  bool tracks() const { return tracks_; }
+  void set_adaptive(bool adaptive) { adaptive_ = adaptive; }
+  bool adaptive() const { return adaptive_; }
+
+  /** Counters */
+  uint32_t searches_skipped() const { return dedup_.skipped; }
+  uint32_t matches_skipped() const { return matches_skipped_; }
+  uint32_t formats_skipped() const { return strategy_.skipped; }
+
+  /** Time spent by the last scan in each stage, in seconds (0 if it has not run) */
+  double search_time() const { return search_time_; }
+  double match_time() const { return match_time_; }
+  double decode_time() const { return decode_time_; }
+
+ private:
+  void Reset();
+  /* Check the locked result: 1 if found, -1 if missed, 0 if not checked */
+  int CheckLock(const ScanFrame &frame, bool *anchor, bool *tracked);
+
+  ScanBackend *backend_;
+  ScanResult result_;    /* locked result */
+  ScanResult scratch_;   /* reused to search and decode each frame */
+  ScanResult barcode_;   /* reused to decode concurrently (parallel mode) */
+  volatile int state_;   /* `State`, shared (see above) */
+  volatile int snap_;    /* 1 if the next frame goes to the API search, shared */
+  volatile int reset_;   /* 1 if the lock is to be dropped by the next scan, shared */
+  int losts_;
+  int hits_;
+  int confirmations_;
+  int max_losts_;
+  bool parallel_;
+  bool deduplicates_;
+  bool tracks_;
+  bool adaptive_;
+  ds_dedup_t dedup_;
+  ds_tracker_t tracker_;
+  ds_strategy_t strategy_;
+  uint32_t matches_skipped_;
+  double search_time_;
+  double match_time_;
+  double decode_time_;
+};
+
+}  // namespace ds
+
+#endif
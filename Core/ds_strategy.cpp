@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "ds_strategy.h"
+
+namespace {
+
+/* Check if a format has hit within the window */
+bool Productive(const ds_strategy_t *s, int i) {
+  return s->last_hit[i] > 0 && s->frame - (s->last_hit[i] - 1) <= s->window;
+}
+
+}  // namespace
+
+void ds_strategy_init(ds_strategy_t *s, uint32_t formats, int period, uint32_t window) {
+  s->period = period < 1 ? 1 : period;
+  s->window = window;
+  s->skipped = 0;
+  ds_strategy_set_formats(s, formats);
+}
+
+void ds_strategy_set_formats(ds_strategy_t *s, uint32_t formats) {
+  s->formats = formats;
+  s->frame = 0;
+  for (int i = 0; i < DS_STRATEGY_FORMATS; i++) s->last_hit[i] = 0;
+}
+
+uint32_t ds_strategy_next(ds_strategy_t *s) {
+  s->frame++;
+
+  uint32_t productive = 0;
+  for (int i = 0; i < DS_STRATEGY_FORMATS; i++) {
+    if ((s->formats & (1u << i)) && Productive(s, i)) productive |= 1u << i;
+  }
+  if (productive == 0) return s->formats;
+
+  uint32_t plan = productive;
+  for (int i = 0; i < DS_STRATEGY_FORMATS; i++) {
+    uint32_t bit = 1u << i;
+    if (!(s->formats & bit) || (productive & bit)) continue;
+    if ((s->frame + i) % s->period == 0)
+      plan |= bit;
+    else
+      s->skipped++;
+  }
+  return plan;
+}
+
+void ds_strategy_hit(ds_strategy_t *s, uint32_t formats) {
+  for (int i = 0; i < DS_STRATEGY_FORMATS; i++) {
+    if (formats & (1u << i)) s->last_hit[i] = s->frame + 1;
+  }
+}
@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _DS_STRATEGY_H
+#define _DS_STRATEGY_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*************************************************
+ * Scan strategy
+ *
+ * Learns which formats (image search, EAN-13, QR Code, ...) actually yield
+ * results in the current session, and runs the others less often: a format
+ * that produced a result within the last `window` frames runs on every
+ * frame, while an unproductive one only runs every `period` frames (formats
+ * are staggered so that they do not all run on the same frame). These
+ * periodic runs keep exploring, so that a format that starts hitting is
+ * promoted back right away.
+ *
+ * As long as no format has hit within the window, all of them run on every
+ * frame: there is nothing to learn from yet.
+ *
+ * Formats are bits of an integer mask (e.g. `MS_RESULT_TYPE_*` values).
+ *************************************************/
+
+/** Number of distinct formats (one per mask bit) */
+#define DS_STRATEGY_FORMATS 32
+
+/** Type of a strategy, to be initialized with `ds_strategy_init` */
+typedef struct {
+  uint32_t formats;                   /* formats allowed */
+  int period;                         /* unproductive formats run every `period` frames */
+  uint32_t window;                    /* frames after which a format with no hit is unproductive */
+  uint32_t frame;                     /* number of frames planned */
+  uint32_t last_hit[DS_STRATEGY_FORMATS]; /* frame of the last hit of each format, plus one (0 if none) */
+  uint32_t skipped;                   /* number of format runs skipped */
+} ds_strategy_t;
+
+/**
+ * Initialize a strategy with no hit yet.
+ */
+void ds_strategy_init(ds_strategy_t *s, uint32_t formats, int period, uint32_t window);
+
+/**
+ * Change the allowed formats (e.g. when switching profiles), which forgets
+ * the hits recorded so far.
+ */
+void ds_strategy_set_formats(ds_strategy_t *s, uint32_t formats);
+
+/**
+ * Get the formats to run on the next frame.
+ */
+uint32_t ds_strategy_next(ds_strategy_t *s);
+
+/**
+ * Record a result of the given format(s) on the last planned frame.
+ */
+void ds_strategy_hit(ds_strategy_t *s, uint32_t formats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,367 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ds_table.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DS_TABLE_MAGIC   0x42545344u /* "DSTB" */
+#define DS_TABLE_VERSION 1u
+#define DS_HEADER_SIZE   32
+#define DS_RECORD_SIZE   16
+
+/* On-disk header layout (little-endian):
+ *   0  magic       u32
+ *   4  version     u32
+ *   8  count       u32
+ *  12  pool_size   u32
+ *  16  expires     i64
+ *  24  cursor      u64   version of the discounts (0 if unknown)
+ *
+ * On-disk record layout (little-endian):
+ *   0  hash        u64
+ *   8  id_off      u32   offset of the ID into the pool
+ *  12  value_off   u32   offset of the value into the pool
+ */
+
+struct ds_table_t_ {
+  void *map;
+  size_t size;
+  uint32_t count;
+  int64_t expires;
+  uint64_t cursor;
+  const unsigned char *records;
+  const char *pool;
+  uint32_t pool_size;
+};
+
+typedef struct {
+  uint64_t hash;
+  char *id;
+  char *value;
+  size_t seq;          /* insertion order, so that the last value wins */
+} ds_entry_t;
+
+struct ds_table_writer_t_ {
+  ds_entry_t *entries;
+  size_t count;
+  size_t capacity;
+};
+
+/*************************************************
+ * Little-endian helpers
+ *************************************************/
+
+static uint32_t ds_get_u32(const unsigned char *p) {
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+         ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint64_t ds_get_u64(const unsigned char *p) {
+  return (uint64_t) ds_get_u32(p) | ((uint64_t) ds_get_u32(p + 4) << 32);
+}
+
+static void ds_put_u32(unsigned char *p, uint32_t v) {
+  p[0] = (unsigned char) v;
+  p[1] = (unsigned char) (v >> 8);
+  p[2] = (unsigned char) (v >> 16);
+  p[3] = (unsigned char) (v >> 24);
+}
+
+static void ds_put_u64(unsigned char *p, uint64_t v) {
+  ds_put_u32(p, (uint32_t) v);
+  ds_put_u32(p + 4, (uint32_t) (v >> 32));
+}
+
+/*************************************************
+ * Reader
+ *************************************************/
+
+uint64_t ds_table_hash(const char *id) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  const unsigned char *s = (const unsigned char *) id;
+  while (*s) {
+    h ^= *s++;
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+ds_errcode ds_table_open(const char *path, ds_table_t **t) {
+  if (!path || !t) return DS_MISUSE;
+  *t = NULL;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return DS_NOFILE;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return DS_ERROR;
+  }
+  size_t size = (size_t) st.st_size;
+  if (size < DS_HEADER_SIZE) {
+    close(fd);
+    return DS_CORRUPT;
+  }
+
+  void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return DS_ERROR;
+
+  const unsigned char *hdr = (const unsigned char *) map;
+  uint32_t count = ds_get_u32(hdr + 8);
+  uint32_t pool_size = ds_get_u32(hdr + 12);
+  if (ds_get_u32(hdr) != DS_TABLE_MAGIC ||
+      ds_get_u32(hdr + 4) != DS_TABLE_VERSION ||
+      (uint64_t) DS_HEADER_SIZE + (uint64_t) count * DS_RECORD_SIZE + pool_size != size ||
+      (pool_size > 0 && hdr[size - 1] != '\0')) {
+    munmap(map, size);
+    return DS_CORRUPT;
+  }
+
+  ds_table_t *table = (ds_table_t *) malloc(sizeof(*table));
+  if (!table) {
+    munmap(map, size);
+    return DS_NOMEM;
+  }
+  table->map = map;
+  table->size = size;
+  table->count = count;
+  table->expires = (int64_t) ds_get_u64(hdr + 16);
+  table->cursor = ds_get_u64(hdr + 24);
+  table->records = hdr + DS_HEADER_SIZE;
+  table->pool = (const char *) (table->records + (size_t) count * DS_RECORD_SIZE);
+  table->pool_size = pool_size;
+
+#ifdef MADV_RANDOM
+  /* Lookups are binary searches: do not read ahead */
+  madvise(map, size, MADV_RANDOM);
+#endif
+
+  *t = table;
+  return DS_SUCCESS;
+}
+
+void ds_table_close(ds_table_t *t) {
+  if (!t) return;
+  munmap(t->map, t->size);
+  free(t);
+}
+
+uint32_t ds_table_count(const ds_table_t *t) {
+  return t ? t->count : 0;
+}
+
+int64_t ds_table_expires(const ds_table_t *t) {
+  return t ? t->expires : 0;
+}
+
+uint64_t ds_table_cursor(const ds_table_t *t) {
+  return t ? t->cursor : 0;
+}
+
+ds_errcode ds_table_entry(const ds_table_t *t, uint32_t index, const char **id, const char **value) {
+  if (!t || !id || !value || index >= t->count) return DS_MISUSE;
+
+  const unsigned char *rec = t->records + (size_t) index * DS_RECORD_SIZE;
+  uint32_t id_off = ds_get_u32(rec + 8);
+  uint32_t value_off = ds_get_u32(rec + 12);
+  if (id_off >= t->pool_size || value_off >= t->pool_size) return DS_CORRUPT;
+  *id = t->pool + id_off;
+  *value = t->pool + value_off;
+  return DS_SUCCESS;
+}
+
+ds_errcode ds_table_lookup(const ds_table_t *t, const char *id, const char **value) {
+  if (!t || !id || !value) return DS_MISUSE;
+  *value = NULL;
+
+  uint64_t h = ds_table_hash(id);
+
+  /* Lower bound on the hash */
+  uint32_t lo = 0, hi = t->count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (ds_get_u64(t->records + (size_t) mid * DS_RECORD_SIZE) < h) lo = mid + 1;
+    else hi = mid;
+  }
+
+  /* Scan the (usually single) records sharing this hash */
+  for (; lo < t->count; lo++) {
+    const unsigned char *rec = t->records + (size_t) lo * DS_RECORD_SIZE;
+    if (ds_get_u64(rec) != h) break;
+    uint32_t id_off = ds_get_u32(rec + 8);
+    uint32_t value_off = ds_get_u32(rec + 12);
+    if (id_off >= t->pool_size || value_off >= t->pool_size) return DS_CORRUPT;
+    if (strcmp(t->pool + id_off, id) == 0) {
+      *value = t->pool + value_off;
+      return DS_SUCCESS;
+    }
+  }
+
+  return DS_NOREC;
+}
+
+/*************************************************
+ * Writer
+ *************************************************/
+
+ds_errcode ds_table_writer_new(ds_table_writer_t **w) {
+  if (!w) return DS_MISUSE;
+  *w = (ds_table_writer_t *) calloc(1, sizeof(**w));
+  return *w ? DS_SUCCESS : DS_NOMEM;
+}
+
+void ds_table_writer_del(ds_table_writer_t *w) {
+  if (!w) return;
+  for (size_t i = 0; i < w->count; i++) {
+    free(w->entries[i].id);
+    free(w->entries[i].value);
+  }
+  free(w->entries);
+  free(w);
+}
+
+static char *ds_strdup(const char *s) {
+  size_t len = strlen(s) + 1;
+  char *d = (char *) malloc(len);
+  if (d) memcpy(d, s, len);
+  return d;
+}
+
+ds_errcode ds_table_writer_add(ds_table_writer_t *w, const char *id, const char *value) {
+  if (!w || !id || !value) return DS_MISUSE;
+
+  if (w->count == w->capacity) {
+    size_t capacity = w->capacity ? 2 * w->capacity : 256;
+    ds_entry_t *entries = (ds_entry_t *) realloc(w->entries, capacity * sizeof(*entries));
+    if (!entries) return DS_NOMEM;
+    w->entries = entries;
+    w->capacity = capacity;
+  }
+
+  ds_entry_t *e = &w->entries[w->count];
+  e->hash = ds_table_hash(id);
+  e->id = ds_strdup(id);
+  e->value = ds_strdup(value);
+  e->seq = w->count;
+  if (!e->id || !e->value) {
+    free(e->id);
+    free(e->value);
+    return DS_NOMEM;
+  }
+  w->count++;
+  return DS_SUCCESS;
+}
+
+static int ds_entry_cmp(const void *a, const void *b) {
+  const ds_entry_t *ea = (const ds_entry_t *) a;
+  const ds_entry_t *eb = (const ds_entry_t *) b;
+  if (ea->hash != eb->hash) return ea->hash < eb->hash ? -1 : 1;
+  int c = strcmp(ea->id, eb->id);
+  if (c != 0) return c;
+  /* Most recent first so that duplicates can be skipped */
+  return ea->seq > eb->seq ? -1 : (ea->seq < eb->seq ? 1 : 0);
+}
+
+ds_errcode ds_table_writer_save(ds_table_writer_t *w, const char *path, int64_t expires, uint64_t cursor) {
+  if (!w || !path) return DS_MISUSE;
+
+  qsort(w->entries, w->count, sizeof(*w->entries), ds_entry_cmp);
+
+  /* Drop the shadowed duplicates and lay out the string pool */
+  size_t count = 0;
+  uint64_t pool_size = 0;
+  for (size_t i = 0; i < w->count; i++) {
+    if (count > 0 && w->entries[i].hash == w->entries[count - 1].hash &&
+        strcmp(w->entries[i].id, w->entries[count - 1].id) == 0) {
+      free(w->entries[i].id);
+      free(w->entries[i].value);
+      continue;
+    }
+    w->entries[count++] = w->entries[i];
+    pool_size += strlen(w->entries[i].id) + strlen(w->entries[i].value) + 2;
+  }
+  w->count = count;
+  if (count > UINT32_MAX / DS_RECORD_SIZE || pool_size > UINT32_MAX) return DS_MISUSE;
+
+  size_t size = DS_HEADER_SIZE + count * DS_RECORD_SIZE + (size_t) pool_size;
+  unsigned char *buf = (unsigned char *) calloc(1, size);
+  if (!buf) return DS_NOMEM;
+
+  ds_put_u32(buf, DS_TABLE_MAGIC);
+  ds_put_u32(buf + 4, DS_TABLE_VERSION);
+  ds_put_u32(buf + 8, (uint32_t) count);
+  ds_put_u32(buf + 12, (uint32_t) pool_size);
+  ds_put_u64(buf + 16, (uint64_t) expires);
+  ds_put_u64(buf + 24, cursor);
+
+  unsigned char *rec = buf + DS_HEADER_SIZE;
+  char *pool = (char *) (rec + count * DS_RECORD_SIZE);
+  uint32_t off = 0;
+  for (size_t i = 0; i < count; i++, rec += DS_RECORD_SIZE) {
+    const ds_entry_t *e = &w->entries[i];
+    size_t id_len = strlen(e->id) + 1;
+    size_t value_len = strlen(e->value) + 1;
+    ds_put_u64(rec, e->hash);
+    ds_put_u32(rec + 8, off);
+    memcpy(pool + off, e->id, id_len);
+    off += (uint32_t) id_len;
+    ds_put_u32(rec + 12, off);
+    memcpy(pool + off, e->value, value_len);
+    off += (uint32_t) value_len;
+  }
+
+  /* Write to a temporary file then rename it over the destination */
+  size_t path_len = strlen(path);
+  char *tmp = (char *) malloc(path_len + 5);
+  if (!tmp) {
+    free(buf);
+    return DS_NOMEM;
+  }
+  memcpy(tmp, path, path_len);
+  memcpy(tmp + path_len, ".tmp", 5);
+
+  ds_errcode ecode = DS_SUCCESS;
+  FILE *f = fopen(tmp, "wb");
+  if (!f) {
+    ecode = DS_ERROR;
+  }
+  else {
+    if (fwrite(buf, 1, size, f) != size) ecode = DS_ERROR;
+    if (fclose(f) != 0) ecode = DS_ERROR;
+    if (ecode == DS_SUCCESS && rename(tmp, path) != 0) ecode = DS_ERROR;
+    if (ecode != DS_SUCCESS) remove(tmp);
+  }
+
+  free(tmp);
+  free(buf);
+  return ecode;
+}
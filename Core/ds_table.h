@@ -0,0 +1,160 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _DS_TABLE_H
+#define _DS_TABLE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*************************************************
+ * Discount table
+ *
+ * Compact on-disk table that maps product IDs to discount values for a
+ * given user. The file is memory-mapped and searched in place, without
+ * any parse step:
+ *
+ *   +----------------------+
+ *   | header   (32 bytes)  |
+ *   +----------------------+
+ *   | records  (16 bytes   |  sorted by (hash, id)
+ *   |           x count)   |
+ *   +----------------------+
+ *   | string pool          |  NUL-terminated IDs and values
+ *   +----------------------+
+ *
+ * All integers are stored little-endian.
+ *************************************************/
+
+/** Type of a library error code */
+typedef int ds_errcode;
+
+enum {                                /* enumeration for error codes */
+  DS_SUCCESS = 0,                     /* success */
+  DS_ERROR,                           /* unspecified error */
+  DS_MISUSE,                          /* invalid use of the library */
+  DS_NOFILE,                          /* file not found */
+  DS_CORRUPT,                         /* file corrupted */
+  DS_NOMEM,                           /* memory allocation failure */
+  DS_NOREC                            /* record not found */
+};
+
+/** Type of a read-only discount table */
+typedef struct ds_table_t_ ds_table_t;
+
+/** Type of a discount table writer */
+typedef struct ds_table_writer_t_ ds_table_writer_t;
+
+/**
+ * Hash function used to sort the records (64-bit FNV-1a)
+ */
+uint64_t ds_table_hash(const char *id);
+
+/**
+ * Map a table file into memory.
+ * `path` specifies the path of the table file.
+ * `t` specifies the pointer to the variable into which the table object is
+ * assigned. It must be released with `ds_table_close`.
+ * The return value is `DS_SUCCESS` or an error code.
+ */
+ds_errcode ds_table_open(const char *path, ds_table_t **t);
+
+/**
+ * Unmap a table.
+ * Any value previously returned by `ds_table_lookup` becomes invalid.
+ */
+void ds_table_close(ds_table_t *t);
+
+/**
+ * Get the number of records of a table.
+ */
+uint32_t ds_table_count(const ds_table_t *t);
+
+/**
+ * Get the expiry date of a table, as a UNIX timestamp (0 if none).
+ */
+int64_t ds_table_expires(const ds_table_t *t);
+
+/**
+ * Get the version cursor of a table (0 if unknown).
+ * It identifies the version of the discounts held by the table, so that
+ * subsequent changes can be fetched incrementally.
+ */
+uint64_t ds_table_cursor(const ds_table_t *t);
+
+/**
+ * Get a record of a table by index, e.g. to iterate over all records.
+ * `index` must be lower than `ds_table_count`. Records come in no
+ * particular order.
+ * `id` and `value` specify the pointers to the variables into which the
+ * strings are assigned. They stay valid until the table is closed.
+ * The return value is `DS_SUCCESS` or an error code.
+ */
+ds_errcode ds_table_entry(const ds_table_t *t, uint32_t index, const char **id, const char **value);
+
+/**
+ * Look up the discount value of a product.
+ * `value` specifies the pointer to the variable into which the value is
+ * assigned. It points inside the mapping and stays valid until the table
+ * is closed.
+ * The return value is `DS_SUCCESS`, `DS_NOREC` if the product is not part of
+ * the table, or an error code.
+ */
+ds_errcode ds_table_lookup(const ds_table_t *t, const char *id, const char **value);
+
+/**
+ * Create a table writer.
+ * It must be released with `ds_table_writer_del`.
+ */
+ds_errcode ds_table_writer_new(ds_table_writer_t **w);
+
+/**
+ * Release a table writer.
+ */
+void ds_table_writer_del(ds_table_writer_t *w);
+
+/**
+ * Add a record to a table writer.
+ * Both strings are copied. If an ID is added more than once, the last value
+ * wins.
+ */
+ds_errcode ds_table_writer_add(ds_table_writer_t *w, const char *id, const char *value);
+
+/**
+ * Sort the records and write the table file.
+ * `expires` specifies the expiry date of the table as a UNIX timestamp (0 if
+ * none).
+ * `cursor` specifies the version cursor of the table (0 if unknown).
+ * The file is written under a temporary name then atomically renamed, so
+ * that a table mapped by a reader is never altered.
+ */
+ds_errcode ds_table_writer_save(ds_table_writer_t *w, const char *path, int64_t expires, uint64_t cursor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
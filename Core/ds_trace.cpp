@@ -0,0 +1,310 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "ds_trace.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+namespace {
+
+struct Event {
+  const char *cat;
+  const char *name;
+  uint64_t ts;
+  uint64_t arg;                       /* duration (complete) or identifier (begin / end) */
+  char phase;                         /* Chrome trace event phase */
+};
+
+/* Ring buffer of a thread. Rings are never freed: the ring of a thread that
+ * has exited goes to the next new thread. Only the owner thread writes
+ * events, then publishes them by moving `head` forward. */
+struct Ring {
+  Event events[DS_TRACE_EVENTS];
+  volatile uint64_t head;             /* number of events written in this generation */
+  volatile uint32_t generation;       /* start the events were written after */
+  volatile int idle;                  /* the owner thread has exited */
+  int tid;
+  char name[32];
+  Ring *next;
+};
+
+pthread_once_t g_once = PTHREAD_ONCE_INIT;
+pthread_key_t g_key;
+pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+Ring *volatile g_rings = 0;           /* guarded by `g_lock` for writing */
+int g_tids = 0;                       /* guarded by `g_lock` */
+volatile int g_enabled = 0;
+volatile uint32_t g_generation = 0;
+volatile uint64_t g_ids = 0;
+
+void Detach(void *p) {
+  Ring *r = (Ring *) p;
+  __sync_synchronize();
+  r->idle = 1;
+}
+
+void Init() {
+  pthread_key_create(&g_key, Detach);
+}
+
+void DefaultName(Ring *r) {
+  r->name[0] = '\0';
+#ifdef __APPLE__
+  if (pthread_main_np()) {
+    strcpy(r->name, "main");
+    return;
+  }
+#endif
+  pthread_getname_np(pthread_self(), r->name, sizeof(r->name));
+  if (r->name[0] == '\0')
+    snprintf(r->name, sizeof(r->name), "thread %d", r->tid);
+}
+
+/* Ring of the calling thread, created (or taken over) on its first event */
+Ring *Attach() {
+  Ring *r = (Ring *) pthread_getspecific(g_key);
+  if (r) return r;
+
+  pthread_mutex_lock(&g_lock);
+  for (r = g_rings; r; r = r->next) {
+    if (r->idle) break;
+  }
+  if (r == 0) {
+    r = (Ring *) calloc(1, sizeof(Ring));
+    if (r) {
+      r->tid = ++g_tids;
+      r->next = g_rings;
+      __sync_synchronize();
+      g_rings = r;
+    }
+  }
+  if (r) {
+    // A ring taken over keeps the events of its previous thread
+    r->idle = 0;
+    DefaultName(r);
+    pthread_setspecific(g_key, r);
+  }
+  pthread_mutex_unlock(&g_lock);
+  return r;
+}
+
+void Record(char phase, const char *cat, const char *name, uint64_t ts, uint64_t arg) {
+  if (!g_enabled) return;
+  Ring *r = Attach();
+  if (r == 0) return;
+
+  uint32_t generation = g_generation;
+  if (r->generation != generation) {
+    r->head = 0;
+    __sync_synchronize();
+    r->generation = generation;
+  }
+  uint64_t head = r->head;
+  Event *e = &r->events[head % DS_TRACE_EVENTS];
+  e->cat = cat;
+  e->name = name;
+  e->ts = ts;
+  e->arg = arg;
+  e->phase = phase;
+  __sync_synchronize();
+  r->head = head + 1;
+}
+
+/* Copy the events of a ring still in it: the ones overwritten (or being
+ * overwritten) while copying are dropped. The return value is the number
+ * of events copied. */
+size_t Snapshot(const Ring *r, uint32_t generation, Event *out) {
+  if (r->generation != generation) return 0;
+  __sync_synchronize();
+  uint64_t head = r->head;
+  uint64_t first = head > DS_TRACE_EVENTS ? head - DS_TRACE_EVENTS : 0;
+  __sync_synchronize();
+  for (uint64_t i = first; i < head; i++)
+    out[i - first] = r->events[i % DS_TRACE_EVENTS];
+  __sync_synchronize();
+  uint64_t last = r->head;
+  if (r->generation != generation || last < head) return 0;
+
+  uint64_t valid = last + 1 > DS_TRACE_EVENTS ? last + 1 - DS_TRACE_EVENTS : 0;
+  if (valid <= first) return (size_t) (head - first);
+  if (valid >= head) return 0;
+  memmove(out, out + (valid - first), (size_t) (head - valid) * sizeof(Event));
+  return (size_t) (head - valid);
+}
+
+void WriteString(FILE *f, const char *s) {
+  fputc('"', f);
+  for (; *s; s++) {
+    unsigned char c = (unsigned char) *s;
+    if (c == '"' || c == '\\')
+      fprintf(f, "\\%c", c);
+    else if (c < 0x20)
+      fprintf(f, "\\u%04x", c);
+    else
+      fputc(c, f);
+  }
+  fputc('"', f);
+}
+
+/* Nanoseconds to (fractional) microseconds */
+void WriteTime(FILE *f, const char *key, uint64_t ns) {
+  fprintf(f, ",\"%s\":%llu.%03u", key, (unsigned long long) (ns / 1000), (unsigned) (ns % 1000));
+}
+
+void WriteEvent(FILE *f, const Event &e, int pid, int tid) {
+  fprintf(f, "{\"ph\":\"%c\",\"cat\":", e.phase);
+  WriteString(f, e.cat);
+  fputs(",\"name\":", f);
+  WriteString(f, e.name);
+  fprintf(f, ",\"pid\":%d,\"tid\":%d", pid, tid);
+  WriteTime(f, "ts", e.ts);
+  switch (e.phase) {
+    case 'X':
+      WriteTime(f, "dur", e.arg);
+      break;
+    case 'b':
+    case 'e':
+      fprintf(f, ",\"id\":\"0x%llx\"", (unsigned long long) e.arg);
+      break;
+    case 'i':
+      fputs(",\"s\":\"t\"", f);
+      break;
+  }
+  fputc('}', f);
+}
+
+}  // namespace
+
+void ds_trace_start(void) {
+  pthread_once(&g_once, Init);
+  pthread_mutex_lock(&g_lock);
+  g_generation++;
+  __sync_synchronize();
+  g_enabled = 1;
+  pthread_mutex_unlock(&g_lock);
+}
+
+void ds_trace_stop(void) {
+  g_enabled = 0;
+  __sync_synchronize();
+}
+
+int ds_trace_enabled(void) {
+  return g_enabled;
+}
+
+uint64_t ds_trace_now(void) {
+#ifdef __APPLE__
+  static mach_timebase_info_data_t timebase;
+  if (timebase.denom == 0) mach_timebase_info(&timebase);
+  return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+uint64_t ds_trace_new_id(void) {
+  return __sync_add_and_fetch(&g_ids, 1);
+}
+
+uint64_t ds_trace_key(const char *s) {
+  // 64-bit FNV-1a
+  uint64_t h = 14695981039346656037ULL;
+  for (; s && *s; s++) {
+    h ^= (unsigned char) *s;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+void ds_trace_thread_name(const char *name) {
+  if (!g_enabled) return;
+  Ring *r = Attach();
+  if (r == 0) return;
+  snprintf(r->name, sizeof(r->name), "%s", name);
+}
+
+void ds_trace_complete(const char *cat, const char *name, uint64_t start, uint64_t end) {
+  Record('X', cat, name, start, end > start ? end - start : 0);
+}
+
+void ds_trace_instant(const char *cat, const char *name) {
+  Record('i', cat, name, ds_trace_now(), 0);
+}
+
+void ds_trace_async_begin(const char *cat, const char *name, uint64_t id, uint64_t ts) {
+  Record('b', cat, name, ts, id);
+}
+
+void ds_trace_async_end(const char *cat, const char *name, uint64_t id, uint64_t ts) {
+  Record('e', cat, name, ts, id);
+}
+
+ds_errcode ds_trace_export(const char *path) {
+  Event *events = (Event *) malloc(DS_TRACE_EVENTS * sizeof(Event));
+  if (events == 0) return DS_NOMEM;
+  FILE *f = fopen(path, "w");
+  if (f == 0) {
+    free(events);
+    return DS_NOFILE;
+  }
+
+  int pid = (int) getpid();
+  uint32_t generation = g_generation;
+  bool first = true;
+  fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", f);
+  // Rings are only ever pushed at the head of the list
+  __sync_synchronize();
+  for (const Ring *r = g_rings; r; r = r->next) {
+    size_t n = Snapshot(r, generation, events);
+    if (n == 0) continue;
+    fprintf(f, "%s\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+            first ? "" : ",", pid, r->tid);
+    WriteString(f, r->name);
+    fputs("}}", f);
+    first = false;
+    for (size_t i = 0; i < n; i++) {
+      fputs(",\n", f);
+      WriteEvent(f, events[i], pid, r->tid);
+    }
+  }
+  fputs("\n]}\n", f);
+
+  free(events);
+  int failed = ferror(f);
+  if (fclose(f) != 0 || failed) return DS_ERROR;
+  return DS_SUCCESS;
+}
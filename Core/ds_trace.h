@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _DS_TRACE_H
+#define _DS_TRACE_H
+
+#include <stdint.h>
+
+#include "ds_table.h"                 /* error codes */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*************************************************
+ * Latency tracing
+ *
+ * Records timed spans from any thread and exports them in the Chrome trace
+ * event format (JSON), to be loaded into `chrome://tracing` or Perfetto.
+ *
+ * Each thread writes into its own ring buffer of `DS_TRACE_EVENTS` events:
+ * recording an event takes no lock and never allocates, except for the
+ * first event of a thread. Once a ring is full its oldest events are
+ * overwritten. When tracing is stopped, recording costs a single check.
+ *
+ * Times are in nanoseconds on the monotonic clock returned by
+ * `ds_trace_now`. On Apple platforms it is the host clock, so camera
+ * presentation timestamps (`CMSampleBufferGetPresentationTimeStamp`) can be
+ * used as is once converted to nanoseconds.
+ *
+ * Category and event names are not copied: they must be string literals
+ * (or live as long as the process).
+ *
+ * Spans that start and end on the same thread are recorded in one go with
+ * `ds_trace_complete`. Spans that cross threads or callbacks (e.g. a handoff
+ * to the main thread, a network lookup) are recorded as a begin and an end
+ * event that share the same category, name and identifier.
+ *************************************************/
+
+/** Capacity of the ring buffer of each thread, in events */
+#define DS_TRACE_EVENTS 8192
+
+/**
+ * Start recording events, dropping the ones recorded so far.
+ */
+void ds_trace_start(void);
+
+/**
+ * Stop recording events. The events recorded so far are kept until the
+ * next start, and can still be exported.
+ */
+void ds_trace_stop(void);
+
+/**
+ * Check if events are being recorded.
+ */
+int ds_trace_enabled(void);
+
+/**
+ * Get the current time, in nanoseconds.
+ */
+uint64_t ds_trace_now(void);
+
+/**
+ * Get a new identifier to pair the begin and end events of a span.
+ */
+uint64_t ds_trace_new_id(void);
+
+/**
+ * Get the identifier derived from a string (e.g. a product ID), so that
+ * code that only shares this string can pair the events of a span.
+ */
+uint64_t ds_trace_key(const char *s);
+
+/**
+ * Name the calling thread in the exported trace (the name is copied).
+ * Threads are otherwise named after their system name, if any.
+ * This has no effect while tracing is stopped.
+ */
+void ds_trace_thread_name(const char *name);
+
+/**
+ * Record a span of the calling thread, from `start` to `end`.
+ */
+void ds_trace_complete(const char *cat, const char *name, uint64_t start, uint64_t end);
+
+/**
+ * Record an instant event on the calling thread.
+ */
+void ds_trace_instant(const char *cat, const char *name);
+
+/**
+ * Record the begin (resp. end) of a span identified by `id`, at time `ts`
+ * (e.g. `ds_trace_now()`).
+ */
+void ds_trace_async_begin(const char *cat, const char *name, uint64_t id, uint64_t ts);
+void ds_trace_async_end(const char *cat, const char *name, uint64_t id, uint64_t ts);
+
+/**
+ * Write the events recorded by all threads to a JSON file.
+ * This may run while events are being recorded: the events overwritten
+ * meanwhile are left out.
+ * The return value is `DS_SUCCESS` or an error code.
+ */
+ds_errcode ds_trace_export(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
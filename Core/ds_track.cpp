@@ -0,0 +1,165 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "ds_track.h"
+
+#include <math.h>
+
+namespace {
+
+/* Lowest standard deviation of a trackable template, in gray levels */
+const double kMinContrast = 4.0;
+
+const int kArea = DS_TEMPLATE_SIDE * DS_TEMPLATE_SIDE;
+
+/* NCC score of the template at (x, y) */
+double Score(const ds_tracker_t *t, const uint8_t *thumb, int x, int y) {
+  uint32_t sum = 0;
+  uint64_t sq = 0;
+  uint64_t dot = 0;
+  const uint8_t *tpl = t->tpl;
+  for (int j = 0; j < DS_TEMPLATE_SIDE; j++) {
+    const uint8_t *row = thumb + (y + j) * DS_THUMB_SIDE + x;
+    uint32_t rsq = 0;
+    uint32_t rdot = 0;
+    for (int i = 0; i < DS_TEMPLATE_SIDE; i++) {
+      uint32_t p = row[i];
+      sum += p;
+      rsq += p * p;
+      rdot += p * tpl[i];
+    }
+    sq += rsq;
+    dot += rdot;
+    tpl += DS_TEMPLATE_SIDE;
+  }
+  double var = (double) sq - (double) sum * sum / kArea;
+  if (var <= 0) return 0;
+  double cov = (double) dot - (double) sum * t->tpl_sum / kArea;
+  return cov / (sqrt(var) * t->tpl_norm);
+}
+
+}  // namespace
+
+int ds_thumbnail(const uint8_t *gray, int w, int h, int bpr, int step, uint8_t *thumb) {
+  if (!gray || w < DS_THUMB_SIDE || h < DS_THUMB_SIDE) return -1;
+  if (step < 1) step = 1;
+
+  for (int cy = 0; cy < DS_THUMB_SIDE; cy++) {
+    int y0 = cy * h / DS_THUMB_SIDE;
+    int y1 = (cy + 1) * h / DS_THUMB_SIDE;
+    for (int cx = 0; cx < DS_THUMB_SIDE; cx++) {
+      int x0 = cx * w / DS_THUMB_SIDE;
+      int x1 = (cx + 1) * w / DS_THUMB_SIDE;
+      uint32_t sum = 0;
+      uint32_t n = 0;
+      for (int y = y0; y < y1; y += step) {
+        const uint8_t *row = gray + (int64_t) y * bpr;
+        for (int x = x0; x < x1; x += step) sum += row[x];
+        n += (x1 - x0 + step - 1) / step;
+      }
+      *thumb++ = (uint8_t) (n ? sum / n : 0);
+    }
+  }
+  return 0;
+}
+
+void ds_tracker_init(ds_tracker_t *t, int radius, double min_score) {
+  t->radius = radius;
+  t->min_score = min_score;
+  ds_tracker_stop(t);
+}
+
+int ds_tracker_start(ds_tracker_t *t, const uint8_t *thumb) {
+  ds_tracker_stop(t);
+
+  const int origin = (DS_THUMB_SIDE - DS_TEMPLATE_SIDE) / 2;
+  uint32_t sum = 0;
+  uint64_t sq = 0;
+  uint8_t *tpl = t->tpl;
+  for (int j = 0; j < DS_TEMPLATE_SIDE; j++) {
+    const uint8_t *row = thumb + (origin + j) * DS_THUMB_SIDE + origin;
+    for (int i = 0; i < DS_TEMPLATE_SIDE; i++) {
+      uint32_t p = row[i];
+      sum += p;
+      sq += p * p;
+      *tpl++ = (uint8_t) p;
+    }
+  }
+
+  double var = (double) sq - (double) sum * sum / kArea;
+  if (var < kMinContrast * kMinContrast * kArea) return 0;
+
+  t->tpl_sum = sum;
+  t->tpl_norm = sqrt(var);
+  t->x = origin;
+  t->y = origin;
+  t->active = 1;
+  t->score = 1;
+  return 1;
+}
+
+int ds_tracker_update(ds_tracker_t *t, const uint8_t *thumb) {
+  if (!t->active) return 0;
+
+  const int last = DS_THUMB_SIDE - DS_TEMPLATE_SIDE;
+  int x0 = t->x - t->radius < 0 ? 0 : t->x - t->radius;
+  int y0 = t->y - t->radius < 0 ? 0 : t->y - t->radius;
+  int x1 = t->x + t->radius > last ? last : t->x + t->radius;
+  int y1 = t->y + t->radius > last ? last : t->y + t->radius;
+
+  double best = -1;
+  int bx = t->x;
+  int by = t->y;
+  for (int y = y0; y <= y1; y++) {
+    for (int x = x0; x <= x1; x++) {
+      double score = Score(t, thumb, x, y);
+      if (score > best) {
+        best = score;
+        bx = x;
+        by = y;
+      }
+    }
+  }
+
+  if (best < t->min_score) {
+    ds_tracker_stop(t);
+    t->score = best;
+    return 0;
+  }
+  t->score = best;
+  t->x = bx;
+  t->y = by;
+  t->frames++;
+  return 1;
+}
+
+void ds_tracker_stop(ds_tracker_t *t) {
+  t->tpl_sum = 0;
+  t->tpl_norm = 0;
+  t->x = 0;
+  t->y = 0;
+  t->active = 0;
+  t->score = 0;
+  t->frames = 0;
+}
@@ -0,0 +1,107 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _DS_TRACK_H
+#define _DS_TRACK_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*************************************************
+ * Lock tracking
+ *
+ * Keeps a recognized object locked from frame to frame without running a
+ * full match: frames are reduced to small grayscale thumbnails, the center
+ * of the thumbnail where the object was last matched is kept as a template,
+ * and the template is looked for around its previous position in the next
+ * thumbnails by normalized cross-correlation (NCC). The NCC score is
+ * insensitive to exposure changes and serves as the tracking confidence.
+ *
+ * The template is only ever taken from a matched frame, so that tracking
+ * errors do not accumulate.
+ *************************************************/
+
+/** Side of a thumbnail, in pixels */
+#define DS_THUMB_SIDE 64
+
+/** Side of a template, in pixels */
+#define DS_TEMPLATE_SIDE 32
+
+/**
+ * Reduce a grayscale image to a `DS_THUMB_SIDE` x `DS_THUMB_SIDE` thumbnail
+ * (the aspect ratio is not preserved).
+ * Thumbnail cells are averaged every `step` pixels in both directions.
+ * The return value is 0 on success, -1 if the image is too small.
+ */
+int ds_thumbnail(const uint8_t *gray, int w, int h, int bpr, int step, uint8_t *thumb);
+
+/** Type of a tracker, to be initialized with `ds_tracker_init` */
+typedef struct {
+  int radius;                         /* search radius around the last position, in thumbnail pixels */
+  double min_score;                   /* NCC score under which the object is lost */
+  uint8_t tpl[DS_TEMPLATE_SIDE * DS_TEMPLATE_SIDE];
+  double tpl_sum;                     /* sum of the template pixels */
+  double tpl_norm;                    /* centered norm of the template */
+  int x;                              /* template position in the last thumbnail */
+  int y;
+  int active;                         /* 1 if a template is being tracked */
+  double score;                       /* NCC score of the last update */
+  uint32_t frames;                    /* number of frames tracked since the last start */
+} ds_tracker_t;
+
+/**
+ * Initialize an idle tracker.
+ * `radius` specifies how far (in thumbnail pixels) the object may move
+ * between two frames, and `min_score` the lowest acceptable NCC score
+ * (e.g. 0.8).
+ */
+void ds_tracker_init(ds_tracker_t *t, int radius, double min_score);
+
+/**
+ * Take the center of a thumbnail as the new template.
+ * The return value is 1 if the tracker is active, 0 if the template is too
+ * flat to be tracked reliably.
+ */
+int ds_tracker_start(ds_tracker_t *t, const uint8_t *thumb);
+
+/**
+ * Look for the template in a new thumbnail.
+ * The return value is 1 if it has been found with a score of at least
+ * `min_score`, 0 otherwise (the tracker is then stopped).
+ */
+int ds_tracker_update(ds_tracker_t *t, const uint8_t *thumb);
+
+/**
+ * Stop tracking.
+ */
+void ds_tracker_stop(ds_tracker_t *t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
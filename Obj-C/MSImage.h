@@ -28,21 +28,58 @@
 #endif
 
 #include "moodstocks_sdk.h"
+#include "ds_track.h"
 
 /**
  * Wrapper around the Moodstocks SDK image data structure
  */
 @interface MSImage : NSObject {
     ms_img_t *_img;
+    uint8_t *_pixels;      /* conversion buffer, kept across refills */
+    size_t _pixelsSize;
+    double _sharpness;
+    uint64_t _dhash;
+    uint8_t _thumb[DS_THUMB_SIDE * DS_THUMB_SIDE];
+    BOOL _hasThumb;
 }
 
 @property (readonly, nonatomic) ms_img_t *image;
 
+/**
+ * Sharpness estimate of the frame (see `ds_sharpness`), or 0 if unknown
+ * Only the images built from a camera frame have one.
+ */
+@property (readonly, nonatomic) double sharpness;
+
+/**
+ * Perceptual hash of the frame (see `ds_dhash`), or 0 if unknown
+ * Only the images built from a camera frame have one.
+ */
+@property (readonly, nonatomic) uint64_t dhash;
+
+/**
+ * Thumbnail of the frame used to track a locked result (see `ds_thumbnail`),
+ * or NULL if unknown
+ * Only the images built from a camera frame have one.
+ */
+@property (readonly, nonatomic) const uint8_t *thumbnail;
+
 - (id)init;
 #if MS_SDK_REQUIREMENTS
 - (id)initWithBuffer:(CMSampleBufferRef)buf;
 - (id)initWithBuffer:(CMSampleBufferRef)buf
          orientation:(AVCaptureVideoOrientation)orientation;
+
+/**
+ * Replace the image content with a new camera frame
+ *
+ * The conversion buffer of the previous frame is reused, so that a single
+ * image object can be refilled at each frame without extra allocations.
+ * Returns NO if the frame could not be converted, in which case the image is
+ * left empty.
+ */
+- (BOOL)setBuffer:(CMSampleBufferRef)buf
+      orientation:(AVCaptureVideoOrientation)orientation;
 #endif
 
 @end
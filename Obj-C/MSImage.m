@@ -24,12 +24,21 @@
 #import "MSImage.h"
 #import "MSObjC.h"
 
+#include "ds_image.h"
+#include "ds_quality.h"
+#include "ds_dhash.h"
+
 #if MS_SDK_REQUIREMENTS
 /**
  * Creates an image with Moodstocks format from a camera frame buffer
  *
- * The pixel format *must* be 32-bit BGRA (i.e `kCVPixelFormatType_32BGRA`)
- * otherwise the method returns a NULL pointer
+ * The pixel format *must* be either 32-bit BGRA (i.e `kCVPixelFormatType_32BGRA`)
+ * or 4:2:0 bi-planar YpCbCr (i.e `kCVPixelFormatType_420YpCbCr8BiPlanarFullRange`
+ * or `kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange`) otherwise the method
+ * returns a NULL pointer
+ *
+ * With a bi-planar buffer only the luma plane is used, as a grayscale image,
+ * so that no color conversion takes place
  *
  * The caller must manage deletion
  */
@@ -42,16 +51,37 @@ ms_img_t *MSCreateImageFromSampleBuffer(CMSampleBufferRef sbuf);
  * The caller must manage deletion
  */
 ms_img_t *MSCreateImageFromSampleBuffer2(CMSampleBufferRef sbuf, AVCaptureVideoOrientation orientation);
+
+/**
+ * Same as above, but the BGRA conversion buffer is provided by the caller:
+ * `*pixels` is (re)allocated whenever `*size` is too small, and must be freed
+ * by the caller
+ *
+ * If `sharpness` and `dhash` are not NULL, the sharpness and the perceptual
+ * hash of the frame are computed too, and so is its tracking thumbnail if
+ * `thumb` is not NULL (`*hasThumb` tells whether it could be computed)
+ */
+static ms_img_t *MSCreateImageFromSampleBuffer3(CMSampleBufferRef sbuf, AVCaptureVideoOrientation orientation,
+                                                uint8_t **pixels, size_t *size,
+                                                double *sharpness, uint64_t *dhash,
+                                                uint8_t *thumb, BOOL *hasThumb);
 #endif
 
 @implementation MSImage
 
 @synthesize image = _img;
+@synthesize sharpness = _sharpness;
+@synthesize dhash = _dhash;
 
 - (id)init {
     self = [super init];
     if (self) {
         _img = NULL;
+        _pixels = NULL;
+        _pixelsSize = 0;
+        _sharpness = 0;
+        _dhash = 0;
+        _hasThumb = NO;
     }
     return self;
 }
@@ -69,18 +99,36 @@ ms_img_t *MSCreateImageFromSampleBuffer2(CMSampleBufferRef sbuf, AVCaptureVideoO
          orientation:(AVCaptureVideoOrientation)orientation {
     self = [self init];
     if (self) {
-        _img = MSCreateImageFromSampleBuffer2(buf, orientation);
+        [self setBuffer:buf orientation:orientation];
     }
     return self;
 }
+
+- (BOOL)setBuffer:(CMSampleBufferRef)buf
+      orientation:(AVCaptureVideoOrientation)orientation {
+    if (_img) ms_img_del(_img);
+    _sharpness = 0;
+    _dhash = 0;
+    _hasThumb = NO;
+    _img = MSCreateImageFromSampleBuffer3(buf, orientation, &_pixels, &_pixelsSize, &_sharpness, &_dhash,
+                                          _thumb, &_hasThumb);
+    return _img != NULL;
+}
 #endif
 
+- (const uint8_t *)thumbnail {
+    return _hasThumb ? _thumb : NULL;
+}
+
 - (void)dealloc {
 #if MS_SDK_REQUIREMENTS
     if (_img) ms_img_del(_img);
 #endif
     _img = NULL;
     
+    if (_pixels) free(_pixels);
+    _pixels = NULL;
+    
 #if ! __has_feature(objc_arc)
     [super dealloc];
 #endif
@@ -89,48 +137,110 @@ ms_img_t *MSCreateImageFromSampleBuffer2(CMSampleBufferRef sbuf, AVCaptureVideoO
 @end
 
 #if MS_SDK_REQUIREMENTS
+/* Bounds of the largest side of the images handed to the SDK */
+static const int kMSImageMinSide = 480;
+static const int kMSImageMaxSide = 1280;
+
+/* Sampling step of the sharpness estimate, of the hash and of the thumbnail, in pixels */
+static const int kMSSharpnessStep = 4;
+
 ms_img_t *MSCreateImageFromSampleBuffer(CMSampleBufferRef sbuf) {
     return MSCreateImageFromSampleBuffer2(sbuf, -1);
 }
 
 ms_img_t *MSCreateImageFromSampleBuffer2(CMSampleBufferRef sbuf, AVCaptureVideoOrientation orientation) {
+    uint8_t *pixels = NULL;
+    size_t size = 0;
+    ms_img_t *img = MSCreateImageFromSampleBuffer3(sbuf, orientation, &pixels, &size, NULL, NULL, NULL, NULL);
+    free(pixels);
+    return img;
+}
+
+static ms_img_t *MSCreateImageFromSampleBuffer3(CMSampleBufferRef sbuf, AVCaptureVideoOrientation orientation,
+                                                uint8_t **pixels, size_t *size,
+                                                double *sharpness, uint64_t *dhash,
+                                                uint8_t *thumb, BOOL *hasThumb) {
     CVImageBufferRef imageBuffer = CMSampleBufferGetImageBuffer(sbuf);
+    OSType pixelFormat = CVPixelBufferGetPixelFormatType(imageBuffer);
     
-    if (CVPixelBufferGetPixelFormatType(imageBuffer) != kCVPixelFormatType_32BGRA)
+    BOOL biPlanar = (pixelFormat == kCVPixelFormatType_420YpCbCr8BiPlanarFullRange ||
+                     pixelFormat == kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange);
+    if (pixelFormat != kCVPixelFormatType_32BGRA && !biPlanar)
         return NULL;
     
     CVPixelBufferLockBaseAddress(imageBuffer, 0); 
     
-    void *data = CVPixelBufferGetBaseAddress(imageBuffer); 
-    size_t bpr = CVPixelBufferGetBytesPerRow(imageBuffer); 
-    size_t width = CVPixelBufferGetWidth(imageBuffer); 
-    size_t height = CVPixelBufferGetHeight(imageBuffer);
-    
-    ms_pix_fmt_t fmt = MS_PIX_FMT_RGB32;
     ms_ori_t ori = MS_UNDEFINED_ORI;
+    ds_rotation rot = DS_ROTATE_0;
     switch (orientation) {
         case AVCaptureVideoOrientationPortrait:
             ori = MS_LEFT_BOTTOM_ORI;
+            rot = DS_ROTATE_270;
             break;
             
         case AVCaptureVideoOrientationLandscapeRight:
             ori = MS_TOP_LEFT_ORI;
+            rot = DS_ROTATE_0;
             break;
             
         case AVCaptureVideoOrientationLandscapeLeft:
             ori = MS_BOTTOM_RIGHT_ORI;
+            rot = DS_ROTATE_180;
             break;
             
         case AVCaptureVideoOrientationPortraitUpsideDown:
             ori = MS_RIGHT_TOP_ORI;
+            rot = DS_ROTATE_90;
             break;
             
         default:
             break;
     }
     
-    ms_img_t *img;
-    ms_errcode ecode = ms_img_new(data, width, height, bpr, fmt, ori, &img);
+    ms_img_t *img = NULL;
+    ms_errcode ecode = MS_ERROR;
+    if (biPlanar) {
+        // The luma plane (Y) is a ready-to-use grayscale image
+        void *data = CVPixelBufferGetBaseAddressOfPlane(imageBuffer, 0);
+        size_t bpr = CVPixelBufferGetBytesPerRowOfPlane(imageBuffer, 0);
+        size_t width = CVPixelBufferGetWidthOfPlane(imageBuffer, 0);
+        size_t height = CVPixelBufferGetHeightOfPlane(imageBuffer, 0);
+        ecode = ms_img_new(data, width, height, bpr, MS_PIX_FMT_GRAY8, ori, &img);
+        if (sharpness)
+            *sharpness = ds_sharpness(data, width, height, bpr, kMSSharpnessStep);
+        if (dhash)
+            *dhash = ds_dhash(data, width, height, bpr, kMSSharpnessStep);
+        if (thumb)
+            *hasThumb = (ds_thumbnail(data, width, height, bpr, kMSSharpnessStep, thumb) == 0);
+    }
+    else {
+        // Convert, rotate and downscale in one go with the SIMD kernels, so
+        // that the SDK receives an upright grayscale image it uses as is
+        const uint8_t *data = CVPixelBufferGetBaseAddress(imageBuffer);
+        int bpr = (int) CVPixelBufferGetBytesPerRow(imageBuffer);
+        int width = (int) CVPixelBufferGetWidth(imageBuffer);
+        int height = (int) CVPixelBufferGetHeight(imageBuffer);
+        
+        size_t needed = ds_prepare_gray_size(width, height);
+        if (*size < needed) {
+            free(*pixels);
+            *pixels = malloc(needed);
+            *size = (*pixels != NULL) ? needed : 0;
+        }
+        ds_gray_t gray;
+        if (*pixels && ds_prepare_gray(data, width, height, bpr, DS_PIX_BGRA, rot,
+                                       kMSImageMinSide, kMSImageMaxSide, *pixels, *size, &gray) == 0) {
+            ecode = ms_img_new(gray.data, gray.width, gray.height, gray.bpr, MS_PIX_FMT_GRAY8,
+                               (ori == MS_UNDEFINED_ORI) ? MS_UNDEFINED_ORI : MS_TOP_LEFT_ORI, &img);
+            if (sharpness)
+                *sharpness = ds_sharpness(gray.data, gray.width, gray.height, gray.bpr, kMSSharpnessStep);
+            if (dhash)
+                *dhash = ds_dhash(gray.data, gray.width, gray.height, gray.bpr, kMSSharpnessStep);
+            if (thumb)
+                *hasThumb = (ds_thumbnail(gray.data, gray.width, gray.height, gray.bpr,
+                                          kMSSharpnessStep, thumb) == 0);
+        }
+    }
     
     CVPixelBufferUnlockBaseAddress(imageBuffer, 0);
     
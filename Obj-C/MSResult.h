@@ -52,6 +52,7 @@ typedef enum {
     int _type;
     int _length;
     char *_bytes;
+    int _capacity;
 }
 
 @property (nonatomic, readonly) int type;
@@ -63,6 +64,15 @@ typedef enum {
 - (id)initWithBarcode:(const ms_barcode_t *)barcode;
 - (id)initWithImageID:(const char *)uid;
 
+/**
+ * Overwrite the content of the result
+ * The byte storage is kept and only grows when needed, so that a result can
+ * be refilled frame after frame without allocating (pass NULL bytes and
+ * `MS_RESULT_TYPE_NONE` to empty it)
+ */
+- (void)setBytes:(const void *)bytes length:(NSUInteger)length type:(int)type;
+- (void)setBarcode:(const ms_barcode_t *)barcode;
+
 /**
  * Return the result as a string with UTF-8 encoding
  * Use `getData` if you intend to create a string with another
@@ -36,6 +36,7 @@
         _type = MS_RESULT_TYPE_NONE;
         _length = -1;
         _bytes = NULL;
+        _capacity = 0;
     }
     return self;
 }
@@ -43,26 +44,16 @@
 - (id)initWithBytes:(const void *)bytes length:(NSUInteger)length type:(int)type {
     self = [self init];
     if (self) {
-        _type = type;
-        _length = length;
-        if (bytes) {
-            _bytes = malloc(length + 1);
-            memcpy(_bytes, bytes, length);
-            _bytes[length] = '\0';
-        }
+        [self setBytes:bytes length:length type:type];
     }
     return self;
 }
 
 - (id)initWithBarcode:(const ms_barcode_t *)barcode {
-#if MS_SDK_REQUIREMENTS
-    int length;
-    const char *bytes;
-    ms_barcode_get_data(barcode, &bytes, &length);
-    self = [self initWithBytes:bytes length:length type:ms_barcode_get_fmt(barcode)];
-#else
     self = [self init];
-#endif
+    if (self) {
+        [self setBarcode:barcode];
+    }
     return self;
 }
 
@@ -70,9 +61,34 @@
     return [self initWithBytes:uid length:strlen(uid) type:MS_RESULT_TYPE_IMAGE];
 }
 
+- (void)setBytes:(const void *)bytes length:(NSUInteger)length type:(int)type {
+    _type = type;
+    if (!bytes) {
+        _length = -1;
+        return;
+    }
+    if ((int) length + 1 > _capacity) {
+        if (_bytes) free(_bytes);
+        _capacity = length + 1;
+        _bytes = malloc(_capacity);
+    }
+    _length = length;
+    memcpy(_bytes, bytes, length);
+    _bytes[length] = '\0';
+}
+
+- (void)setBarcode:(const ms_barcode_t *)barcode {
+#if MS_SDK_REQUIREMENTS
+    int length;
+    const char *bytes;
+    ms_barcode_get_data(barcode, &bytes, &length);
+    [self setBytes:bytes length:length type:ms_barcode_get_fmt(barcode)];
+#endif
+}
+
 - (NSString *)getValue {
     NSString *str = nil;
-    if (_bytes) {
+    if (_bytes && _length >= 0) {
         str = [[[NSString alloc] initWithBytes:_bytes
                                         length:_length
                                       encoding:NSUTF8StringEncoding] autorelease_stub];
@@ -81,6 +97,7 @@
 }
 
 - (NSData *)getData {
+    if (_length < 0) return nil;
     return [[[NSData alloc] initWithBytes:_bytes length:_length] autorelease_stub];
 }
 
@@ -89,7 +106,8 @@
 }
 
 - (BOOL)isEqualToResult:(MSResult *)result {
-    if (_type != [result type] || _length != [result length] || memcmp(_bytes, [result bytes], _length))
+    if (_type != [result type] || _length != [result length] ||
+        (_length > 0 && memcmp(_bytes, [result bytes], _length)))
         return NO;
     return YES;
 }
@@ -104,7 +122,7 @@
 }
 
 - (id)copyWithZone:(NSZone *)zone {
-    return [[MSResult allocWithZone:zone] initWithBytes:_bytes
+    return [[MSResult allocWithZone:zone] initWithBytes:(_length >= 0 ? _bytes : NULL)
                                                  length:_length
                                                    type:_type];
 }
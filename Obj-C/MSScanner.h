@@ -44,10 +44,21 @@
  * - offline search over the local database of image records,
  * - remote search on Moodstocks API,
  * - 1D/2D barcode decoding.
+ *
+ * Thread safety: the SDK does not guarantee that offline search, matching
+ * and decoding may run concurrently on the same `ms_scanner_t`. Decoding
+ * with `decode:formats:intoResult:` thus uses a dedicated handle, so that it
+ * can run at the same time as a search (see `canDecodeConcurrently`), but
+ * each handle must only be used by one thread at a time. Debug builds
+ * assert it.
  */
 @interface MSScanner : NSObject {
     NSString *_dbPath;
     ms_scanner_t *_scanner;
+    ms_scanner_t *_decoder;      /* dedicated to `decode:formats:intoResult:` */
+    BOOL _decoderFailed;
+    volatile int32_t _scannerUsers;
+    volatile int32_t _decoderUsers;
     NSOperationQueue *_syncQueue;
     NSMutableArray *_syncDelegates;
     NSOperationQueue *_searchQueue;
@@ -140,6 +151,30 @@
  */
 - (MSResult *)decode:(MSImage *)qry formats:(int)formats error:(NSError **)error;
 
+/**
+ * Same as `search:error:` and `decode:formats:error:` above, except that the
+ * result is written into the provided (reusable) result object, which is
+ * emptied if nothing is found, and that the SDK error code is returned as is
+ *
+ * This does not allocate any Objective-C object, which makes these methods
+ * suited to per-frame use.
+ */
+- (ms_errcode)search:(MSImage *)qry intoResult:(MSResult *)result;
+- (ms_errcode)decode:(MSImage *)qry formats:(int)formats intoResult:(MSResult *)result;
+
+/**
+ * Check if `decode:formats:intoResult:` may run while a search or a match is
+ * running on another thread, i.e. if the dedicated decoding handle is usable
+ */
+- (BOOL)canDecodeConcurrently;
+
+/**
+ * Matches a query image against the image reference of a previous result
+ *
+ * Unlike `match:uid:error:` the image ID is passed as is to the SDK.
+ */
+- (ms_errcode)match:(MSImage *)qry result:(MSResult *)result matched:(BOOL *)matched;
+
 #endif
 
 @end
@@ -27,6 +27,10 @@
 #import "MSApiSearch.h"
 #import "MSObjC.h"
 
+#import <libkern/OSAtomic.h>
+
+#include "ds_trace.h"
+
 // Callbacks to create a non retaining array
 static const void *MSScannerRetainNoOp(CFAllocatorRef allocator, const void *value) { return value; }
 static void MSScannerNoOp(CFAllocatorRef allocator, const void *value) { }
@@ -48,6 +52,16 @@ static NSString *kMSAPISecret  = @"no1E8LOeJJUbK65m";
 // back into the foreground
 #define MSSCANNER_KEEP_OPENED 1
 
+// Check that a scanner handle is not used by several threads at once
+#ifdef DEBUG
+  #define MS_HANDLE_ENTER(users) NSAssert(OSAtomicIncrement32Barrier(&(users)) == 1, \
+                                          @"Scanner handle used concurrently")
+  #define MS_HANDLE_LEAVE(users) OSAtomicDecrement32Barrier(&(users))
+#else
+  #define MS_HANDLE_ENTER(users)
+  #define MS_HANDLE_LEAVE(users)
+#endif
+
 @interface MSScanner ()
 
 #if MS_SDK_REQUIREMENTS
@@ -73,6 +87,10 @@ static NSString *kMSAPISecret  = @"no1E8LOeJJUbK65m";
     self = [super init];
     if (self) {
         _scanner = NULL;
+        _decoder = NULL;
+        _decoderFailed = NO;
+        _scannerUsers = 0;
+        _decoderUsers = 0;
 
 #if MS_SDK_REQUIREMENTS
 
@@ -87,6 +105,11 @@ static NSString *kMSAPISecret  = @"no1E8LOeJJUbK65m";
                                    userInfo:nil] raise];
         }
         
+        // Barcode decoding does not need the database: a second handle lets it
+        // run concurrently with offline search (not fatal if unavailable)
+        if (ms_scanner_new(&_decoder) != MS_SUCCESS)
+            _decoder = NULL;
+        
         // Build database path for later use
         NSArray *paths = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
         NSString *cachesPath = [paths objectAtIndex:0];
@@ -130,8 +153,10 @@ static NSString *kMSAPISecret  = @"no1E8LOeJJUbK65m";
 
 #if MS_SDK_REQUIREMENTS
     if (_scanner) ms_scanner_del(_scanner);
+    if (_decoder) ms_scanner_del(_decoder);
 #endif
     _scanner = NULL;
+    _decoder = NULL;
     
     [_dbPath release_stub];
     _dbPath = nil;
@@ -253,7 +278,9 @@ static NSString *kMSAPISecret  = @"no1E8LOeJJUbK65m";
     MSResult *result = nil;
 
     char *uid = NULL;
+    MS_HANDLE_ENTER(_scannerUsers);
     ms_errcode ecode = ms_scanner_search(_scanner, [qry image], &uid);
+    MS_HANDLE_LEAVE(_scannerUsers);
     if (ecode == MS_SUCCESS) {
         if (uid != NULL) {
             result = [[[MSResult alloc] initWithImageID:uid] autorelease_stub];
@@ -271,7 +298,9 @@ static NSString *kMSAPISecret  = @"no1E8LOeJJUbK65m";
     BOOL match = NO;
     
     int m;
+    MS_HANDLE_ENTER(_scannerUsers);
     ms_errcode ecode = ms_scanner_match(_scanner, [qry image], [uid UTF8String], &m);
+    MS_HANDLE_LEAVE(_scannerUsers);
     if (ecode == MS_SUCCESS) {
         match = (m == 1) ? YES : NO;
     }
@@ -296,7 +325,9 @@ static NSString *kMSAPISecret  = @"no1E8LOeJJUbK65m";
     MSResult *result = nil;
 
     ms_barcode_t *barcode = NULL;
+    MS_HANDLE_ENTER(_scannerUsers);
     ms_errcode ecode = ms_scanner_decode(_scanner, [qry image], formats, &barcode);
+    MS_HANDLE_LEAVE(_scannerUsers);
     if (ecode == MS_SUCCESS) {
         if (barcode != NULL) {
             result = [[[MSResult alloc] initWithBarcode:barcode] autorelease_stub];
@@ -309,6 +340,72 @@ static NSString *kMSAPISecret  = @"no1E8LOeJJUbK65m";
     
     return result;
 }
+
+- (ms_errcode)search:(MSImage *)qry intoResult:(MSResult *)result {
+    char *uid = NULL;
+    uint64_t t0 = ds_trace_now();
+    MS_HANDLE_ENTER(_scannerUsers);
+    ms_errcode ecode = ms_scanner_search(_scanner, [qry image], &uid);
+    MS_HANDLE_LEAVE(_scannerUsers);
+    ds_trace_complete("scanner", "search", t0, ds_trace_now());
+    if (ecode == MS_SUCCESS && uid != NULL) {
+        [result setBytes:uid length:strlen(uid) type:MS_RESULT_TYPE_IMAGE];
+        free(uid);
+    }
+    else {
+        [result setBytes:NULL length:0 type:MS_RESULT_TYPE_NONE];
+    }
+    
+    return ecode;
+}
+
+- (ms_errcode)decode:(MSImage *)qry formats:(int)formats intoResult:(MSResult *)result {
+    ms_barcode_t *barcode = NULL;
+    ms_errcode ecode;
+    uint64_t t0 = ds_trace_now();
+    if ([self canDecodeConcurrently]) {
+        MS_HANDLE_ENTER(_decoderUsers);
+        ecode = ms_scanner_decode(_decoder, [qry image], formats, &barcode);
+        MS_HANDLE_LEAVE(_decoderUsers);
+        // The SDK may require an opened scanner to decode: in this case stick
+        // to the main handle from now on
+        if (ecode == MS_MISUSE && [qry image] != NULL) {
+            NSLog(@" [MOODSTOCKS SDK] DEDICATED DECODER UNAVAILABLE");
+            _decoderFailed = YES;
+        }
+    }
+    else {
+        MS_HANDLE_ENTER(_scannerUsers);
+        ecode = ms_scanner_decode(_scanner, [qry image], formats, &barcode);
+        MS_HANDLE_LEAVE(_scannerUsers);
+    }
+    ds_trace_complete("scanner", "decode", t0, ds_trace_now());
+    if (ecode == MS_SUCCESS && barcode != NULL) {
+        [result setBarcode:barcode];
+        ms_barcode_del(barcode);
+    }
+    else {
+        [result setBytes:NULL length:0 type:MS_RESULT_TYPE_NONE];
+    }
+    
+    return ecode;
+}
+
+- (ms_errcode)match:(MSImage *)qry result:(MSResult *)result matched:(BOOL *)matched {
+    int m = 0;
+    uint64_t t0 = ds_trace_now();
+    MS_HANDLE_ENTER(_scannerUsers);
+    ms_errcode ecode = ms_scanner_match(_scanner, [qry image], [result bytes], &m);
+    MS_HANDLE_LEAVE(_scannerUsers);
+    ds_trace_complete("scanner", "match", t0, ds_trace_now());
+    if (matched) *matched = (ecode == MS_SUCCESS && m == 1) ? YES : NO;
+    
+    return ecode;
+}
+
+- (BOOL)canDecodeConcurrently {
+    return _decoder != NULL && !_decoderFailed;
+}
 #endif
 
 #pragma mark - NSNotifications
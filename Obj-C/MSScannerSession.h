@@ -40,11 +40,10 @@ typedef enum {
 <MSScannerDelegate>
 #endif
 {
-    MSResult *_result;
-    int _losts;
+    void *_core;       /* ds::ScanSession (see ds_session.h) */
+    void *_backend;    /* recognition backend of the core, over `_scanner` */
+    MSResult *_result; /* locked result of the core */
     MSScanner *_scanner;
-    BOOL _snap;
-    MSScanState _state;
 #if __has_feature(objc_arc_weak)
     id<MSScannerDelegate> __weak _delegate;
 #elif __has_feature(objc_arc)
@@ -63,11 +62,101 @@ typedef enum {
 #endif
 @property (nonatomic, readonly) MSScanState state;
 
+/**
+ * Number of consecutive frames in which a result must be found before `scan`
+ * returns it (default: 1, i.e. results are returned as soon as found)
+ *
+ * Until then the result is only tentative (see `candidate`).
+ */
+@property (nonatomic, assign) int confirmations;
+
+/**
+ * The result currently tracked by the scanner session, be it confirmed or
+ * still tentative, or nil if none
+ *
+ * This can be used to start working on a result (e.g. remote lookups) while
+ * it is being confirmed. It turns nil as soon as the lock on it is lost.
+ */
+@property (nonatomic, readonly) MSResult *candidate;
+
+/**
+ * Parallel mode (default: NO)
+ * When both offline image search and barcode decoding are requested, run
+ * the decoding on another thread at the same time as the search, so that a
+ * frame takes as long as the slowest of the two instead of their sum.
+ * Image results still take precedence over barcodes found in the same frame.
+ * This only makes sense on multi-core devices.
+ */
+@property (nonatomic, assign) BOOL parallel;
+
+/**
+ * Deduplication (default: NO)
+ * Skip the offline image search on frames that look the same as a recent
+ * frame without match (see `ds_dhash.h`), e.g. while the camera is aimed at
+ * unknown content. The search is re-armed as soon as the scene changes, and
+ * after 2 seconds anyway. Barcodes are still decoded on every frame.
+ */
+@property (nonatomic, assign) BOOL deduplicates;
+
+/**
+ * Number of image searches skipped by deduplication
+ */
+@property (nonatomic, readonly) NSUInteger searchesSkipped;
+
+/**
+ * Enable or disable the tracking mode (disabled by default)
+ *
+ * While an image result is locked, the frames are normally matched against
+ * it one by one. In tracking mode the center of the last matched frame is
+ * followed in the next frames instead (see `ds_tracker_update`), which costs
+ * a small fraction of a match. A full match still runs every 10 frames, or
+ * as soon as tracking loses the object.
+ * Tracking does not confirm a result (see `confirmations`): it only starts
+ * once the result is confirmed.
+ */
+@property (nonatomic, assign) BOOL tracks;
+
+/**
+ * Number of matches replaced by tracking
+ */
+@property (nonatomic, readonly) NSUInteger matchesSkipped;
+
+/**
+ * Enable or disable the adaptive mode (disabled by default)
+ *
+ * In adaptive mode the session learns which of the requested formats
+ * actually yield results, and runs the others only every few frames (see
+ * `ds_strategy_next`). E.g. in front of a shelf of boxes the barcode
+ * decoders are mostly skipped, until one of them finds something. Changing
+ * the requested formats starts learning over.
+ */
+@property (nonatomic, assign) BOOL adaptive;
+
+/**
+ * Number of format runs (search or decoding) skipped in adaptive mode
+ */
+@property (nonatomic, readonly) NSUInteger formatsSkipped;
+
+/**
+ * Time spent by the last scan to search, match (or decode a locked
+ * QR Code) and decode, in seconds (0 if the stage has not run)
+ * In parallel mode, decoding overlaps with searching.
+ */
+@property (nonatomic, readonly) NSTimeInterval searchTime;
+@property (nonatomic, readonly) NSTimeInterval matchTime;
+@property (nonatomic, readonly) NSTimeInterval decodeTime;
+
 /**
  * Create a new scanner session.
  *
  * You should create a new MSScannerSession each time a scanner is
  * presented to the user.
+ *
+ * `scan` and `candidate` must be used from a single scanning thread. The
+ * state changes (`pause`, `resume`, `snap`, `cancel`) and `state` may be
+ * used from any thread, e.g. the main thread: the locked result is then
+ * dropped by the next `scan` (see `ds_session.h`). The settings are to be
+ * changed before scanning starts.
  */
 - (id)initWithScanner:(MSScanner *)scanner;
 
@@ -105,6 +194,14 @@ typedef enum {
  * e.g. if you choose to perform offline image recognition and QR-Code decoding:
  *
  * int options = MS_RESULT_TYPE_IMAGE | MS_RESULT_TYPE_QRCODE;
+ *
+ * NOTE: nil is returned while the result found is not confirmed yet (see
+ *       `confirmations`)
+ *
+ * NOTE: the returned result is owned by the session and only valid until the
+ *       next call, copy it to keep it. Likewise the query image may be retained
+ *       by an API search when a snap is pending (see `snap`), so it must not be
+ *       refilled if the session state is `MS_SCAN_STATE_SEARCH` afterwards.
  */
 - (MSResult *)scan:(MSImage *)qry options:(int)options error:(NSError **)error;
 
@@ -0,0 +1,380 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import "MSScannerSession.h"
+
+#include "ds_session.h"
+#include "ds_trace.h"
+
+#if MS_SDK_REQUIREMENTS
+static void MSCopyResult(MSResult *from, ds::ScanResult *to) {
+    to->type = [from type];
+    if (to->type == MS_RESULT_TYPE_NONE || [from length] <= 0)
+        to->value.clear();
+    else
+        to->value.assign([from bytes], [from length]);
+}
+
+static void MSScannerBackendDecode(void *backend);
+
+/**
+ * Backend of the session core over the Objective-C scanner
+ *
+ * The SDK results are received into reusable MSResult objects, then copied
+ * into the core results whose storage is reused as well.
+ * Concurrent decoding runs on a global dispatch queue.
+ */
+class MSScannerBackend : public ds::ScanBackend {
+public:
+    explicit MSScannerBackend(MSScanner *scanner)
+        : _scanner(scanner), _decodeQuery(nil), _decodeFormats(0), _decodeResult(NULL),
+          _decodeError(MS_SUCCESS), _decodeTime(0) {
+        _scratch = [[MSResult alloc] init];
+        _barcode = [[MSResult alloc] init];
+        _ref = [[MSResult alloc] init];
+        _decoded = dispatch_semaphore_create(0);
+    }
+    
+    virtual ~MSScannerBackend() {
+        [_scratch release_stub];
+        _scratch = nil;
+        [_barcode release_stub];
+        _barcode = nil;
+        [_ref release_stub];
+        _ref = nil;
+#if !(__has_feature(objc_arc) && OS_OBJECT_USE_OBJC)
+        dispatch_release(_decoded);
+#endif
+        _decoded = nil;
+    }
+    
+    virtual ms_errcode Search(const ds::ScanFrame &frame, ds::ScanResult *result) {
+        ms_errcode ecode = [_scanner search:Query(frame) intoResult:_scratch];
+        MSCopyResult(_scratch, result);
+        return ecode;
+    }
+    
+    virtual ms_errcode Match(const ds::ScanFrame &frame, const ds::ScanResult &ref, bool *matched) {
+        [_ref setBytes:ref.value.data() length:ref.value.size() type:ref.type];
+        BOOL m = NO;
+        ms_errcode ecode = [_scanner match:Query(frame) result:_ref matched:&m];
+        *matched = m;
+        return ecode;
+    }
+    
+    virtual ms_errcode Decode(const ds::ScanFrame &frame, int formats, ds::ScanResult *result) {
+        ms_errcode ecode = [_scanner decode:Query(frame) formats:formats intoResult:_scratch];
+        MSCopyResult(_scratch, result);
+        return ecode;
+    }
+    
+    virtual bool CanDecodeConcurrently() {
+        return [_scanner canDecodeConcurrently];
+    }
+    
+    virtual void StartDecode(const ds::ScanFrame &frame, int formats, ds::ScanResult *result) {
+        _decodeQuery = Query(frame);
+        _decodeFormats = formats;
+        _decodeResult = result;
+        dispatch_async_f(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0),
+                         this, MSScannerBackendDecode);
+    }
+    
+    virtual ms_errcode FinishDecode(double *seconds) {
+        dispatch_semaphore_wait(_decoded, DISPATCH_TIME_FOREVER);
+        _decodeQuery = nil;
+        _decodeResult = NULL;
+        *seconds = _decodeTime;
+        return _decodeError;
+    }
+    
+    virtual double Now() {
+        return CFAbsoluteTimeGetCurrent();
+    }
+    
+    // NOTE: called from a worker thread while `FinishDecode` waits for it
+    void DecodePending() {
+        CFAbsoluteTime t0 = CFAbsoluteTimeGetCurrent();
+        _decodeError = [_scanner decode:_decodeQuery formats:_decodeFormats intoResult:_barcode];
+        MSCopyResult(_barcode, _decodeResult);
+        _decodeTime = CFAbsoluteTimeGetCurrent() - t0;
+        dispatch_semaphore_signal(_decoded);
+    }
+    
+private:
+    static MSImage *Query(const ds::ScanFrame &frame) {
+#if __has_feature(objc_arc)
+        return (__bridge MSImage *) frame.user;
+#else
+        return (MSImage *) frame.user;
+#endif
+    }
+    
+    MSScanner *_scanner;
+    MSResult *_scratch;  /* reused to search and decode each frame */
+    MSResult *_barcode;  /* reused to decode concurrently */
+    MSResult *_ref;      /* reused to match against the locked result */
+    dispatch_semaphore_t _decoded;
+    MSImage *_decodeQuery;
+    int _decodeFormats;
+    ds::ScanResult *_decodeResult;
+    ms_errcode _decodeError;
+    double _decodeTime;
+};
+
+static void MSScannerBackendDecode(void *backend) {
+    ((MSScannerBackend *) backend)->DecodePending();
+}
+#endif
+
+/* The session state values mirror the core ones */
+static MSScanState MSScanStateFromCore(ds::ScanSession::State state) {
+    switch (state) {
+        case ds::ScanSession::kStateSearch: return MS_SCAN_STATE_SEARCH;
+        case ds::ScanSession::kStatePause:  return MS_SCAN_STATE_PAUSE;
+        default:                            return MS_SCAN_STATE_DEFAULT;
+    }
+}
+
+#define CORE ((ds::ScanSession *) _core)
+
+@interface MSScannerSession ()
+
+- (void)syncResult;
+
+@end
+
+@implementation MSScannerSession
+
+@synthesize delegate = _delegate;
+@synthesize candidate = _result;
+
+- (id)initWithScanner:(MSScanner *)scanner {
+    self = [super init];
+    if (self) {
+        _backend = NULL;
+#if MS_SDK_REQUIREMENTS
+        _backend = new MSScannerBackend(scanner);
+#endif
+        _core = new ds::ScanSession((ds::ScanBackend *) _backend);
+        _result = nil;
+        _scanner = scanner;
+        _delegate = nil;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    delete CORE;
+    _core = NULL;
+
+#if MS_SDK_REQUIREMENTS
+    delete (MSScannerBackend *) _backend;
+#endif
+    _backend = NULL;
+
+    [_result release_stub];
+    _result = nil;
+
+    _delegate = nil;
+
+#if ! __has_feature(objc_arc)
+    [super dealloc];
+#endif
+}
+
+// Mirror the locked result of the core (if any) into `_result`
+- (void)syncResult {
+    const ds::ScanResult *locked = CORE->candidate();
+    if (locked == NULL) {
+        [_result release_stub];
+        _result = nil;
+        return;
+    }
+    if (_result == nil)
+        _result = [[MSResult alloc] init];
+    if ([_result type] != locked->type || [_result length] != (int) locked->value.size() ||
+        memcmp([_result bytes], locked->value.data(), locked->value.size()) != 0) {
+        [_result setBytes:locked->value.data() length:locked->value.size() type:locked->type];
+    }
+}
+
+#pragma mark - Settings
+
+- (MSScanState)state {
+    return MSScanStateFromCore(CORE->state());
+}
+
+- (int)confirmations {
+    return CORE->confirmations();
+}
+
+- (void)setConfirmations:(int)confirmations {
+    CORE->set_confirmations(confirmations);
+}
+
+- (BOOL)parallel {
+    return CORE->parallel();
+}
+
+- (void)setParallel:(BOOL)parallel {
+    CORE->set_parallel(parallel);
+}
+
+- (BOOL)deduplicates {
+    return CORE->deduplicates();
+}
+
+- (void)setDeduplicates:(BOOL)deduplicates {
+    CORE->set_deduplicates(deduplicates);
+}
+
+- (BOOL)tracks {
+    return CORE->tracks();
+}
+
+- (void)setTracks:(BOOL)tracks {
+    CORE->set_tracks(tracks);
+}
+
+- (BOOL)adaptive {
+    return CORE->adaptive();
+}
+
+- (void)setAdaptive:(BOOL)adaptive {
+    CORE->set_adaptive(adaptive);
+}
+
+- (NSUInteger)searchesSkipped {
+    return CORE->searches_skipped();
+}
+
+- (NSUInteger)matchesSkipped {
+    return CORE->matches_skipped();
+}
+
+- (NSUInteger)formatsSkipped {
+    return CORE->formats_skipped();
+}
+
+- (NSTimeInterval)searchTime {
+    return CORE->search_time();
+}
+
+- (NSTimeInterval)matchTime {
+    return CORE->match_time();
+}
+
+- (NSTimeInterval)decodeTime {
+    return CORE->decode_time();
+}
+
+#pragma mark - Scanning
+
+- (BOOL)pause {
+    return CORE->Pause();
+}
+
+// NOTE: the locked result is dropped by the next scan, on the scanning thread
+- (BOOL)resume {
+    return CORE->Resume();
+}
+
+- (MSResult *)scan:(MSImage *)qry options:(int)options error:(NSError **)error {
+    MSResult *result = nil;
+#if MS_SDK_REQUIREMENTS
+    if (CORE->state() != ds::ScanSession::kStateDefault) return nil;
+
+    ds::ScanFrame frame;
+    frame.image = [qry image];
+#if __has_feature(objc_arc)
+    frame.user = (__bridge void *) qry;
+#else
+    frame.user = qry;
+#endif
+    frame.dhash = [qry dhash];
+    frame.thumb = [qry thumbnail];
+
+    const ds::ScanResult *found = NULL;
+    uint64_t t0 = ds_trace_now();
+    ms_errcode ecode = CORE->Scan(frame, options, &found);
+    ds_trace_complete("scanner", "scan", t0, ds_trace_now());
+
+    // A snap was pending: this frame goes to the API search
+    if (CORE->state() == ds::ScanSession::kStateSearch) {
+        [[MSScanner sharedInstance] apiSearch:qry withDelegate:self];
+        return nil;
+    }
+
+    [self syncResult];
+    if (ecode != MS_SUCCESS) {
+        if (error) *error = [NSError errorWithDomain:@"moodstocks-sdk" code:ecode userInfo:nil];
+        return nil;
+    }
+    if (found != NULL)
+        result = _result;
+#endif
+    return result;
+}
+
+- (BOOL)snap {
+    return CORE->Snap();
+}
+
+- (BOOL)cancel {
+    if (!CORE->CanCancel()) return NO;
+#if MS_SDK_REQUIREMENTS
+    [_scanner cancelApiSearch];
+#endif
+    return YES;
+}
+
+#pragma mark - MSScannerDelegate
+
+- (void)scannerWillSearch:(MSScanner *)scanner {
+    // Called on the main thread: `candidate` is updated by the next scan
+    CORE->SearchStarted();
+
+    if ([_delegate respondsToSelector:@selector(scannerWillSearch:)]) {
+        [_delegate scannerWillSearch:_scanner];
+    }
+}
+
+- (void)scanner:(MSScanner *)scanner didSearchWithResult:(MSResult *)result {
+    CORE->SearchFinished();
+
+    if ([_delegate respondsToSelector:@selector(scanner:didSearchWithResult:)]) {
+        [_delegate scanner:_scanner didSearchWithResult:result];
+    }
+}
+
+- (void)scanner:(MSScanner *)scanner failedToSearchWithError:(NSError *)error {
+    CORE->SearchFinished();
+
+    if ([_delegate respondsToSelector:@selector(scanner:failedToSearchWithError:)]) {
+        [_delegate scanner:_scanner failedToSearchWithError:error];
+    }
+}
+
+@end
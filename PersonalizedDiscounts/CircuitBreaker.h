@@ -0,0 +1,53 @@
+//
+//  CircuitBreaker.h
+//  PersonalizedDiscounts
+//
+//  Copyright (c) 2012 Moodstocks. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/** Circuit breaker state */
+typedef enum {
+    CIRCUIT_CLOSED = 0,     /* requests flow normally */
+    CIRCUIT_OPEN,           /* the backend keeps failing: requests fail fast */
+    CIRCUIT_HALF_OPEN       /* cooldown elapsed: a single trial request is allowed */
+} CircuitState;
+
+/**
+ * Stops sending requests to a backend that keeps erroring
+ *
+ * The circuit opens after a number of consecutive failures. Once a cooldown
+ * has elapsed a single trial request is let through: the circuit closes if
+ * it succeeds and opens again otherwise.
+ *
+ * All methods are thread-safe.
+ */
+@interface CircuitBreaker : NSObject {
+    NSUInteger _threshold;
+    NSTimeInterval _cooldown;
+    NSUInteger _failures;
+    CircuitState _state;
+    NSDate *_openedAt;      /* date of the last failure or trial */
+    BOOL _trialPending;
+}
+
+- (id)initWithThreshold:(NSUInteger)threshold cooldown:(NSTimeInterval)cooldown;
+
+@property (nonatomic, readonly) CircuitState state;
+
+/**
+ * Return YES if a request may be sent now
+ *
+ * When half-open, only the first caller gets YES until the trial request
+ * reports its outcome.
+ */
+- (BOOL)allowRequest;
+
+/**
+ * Report the outcome of a request that has been let through
+ */
+- (void)recordSuccess;
+- (void)recordFailure;
+
+@end
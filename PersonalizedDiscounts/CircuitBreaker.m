@@ -0,0 +1,83 @@
+//
+//  CircuitBreaker.m
+//  PersonalizedDiscounts
+//
+//  Copyright (c) 2012 Moodstocks. All rights reserved.
+//
+
+#import "CircuitBreaker.h"
+
+@implementation CircuitBreaker
+
+- (id)initWithThreshold:(NSUInteger)threshold cooldown:(NSTimeInterval)cooldown {
+    self = [super init];
+    if (self) {
+        _threshold = threshold;
+        _cooldown = cooldown;
+        _failures = 0;
+        _state = CIRCUIT_CLOSED;
+        _openedAt = nil;
+        _trialPending = NO;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_openedAt release];
+    _openedAt = nil;
+
+    [super dealloc];
+}
+
+- (CircuitState)state {
+    @synchronized(self) {
+        if (_state == CIRCUIT_OPEN && -[_openedAt timeIntervalSinceNow] >= _cooldown) {
+            _state = CIRCUIT_HALF_OPEN;
+            _trialPending = NO;
+        }
+        return _state;
+    }
+}
+
+- (BOOL)allowRequest {
+    @synchronized(self) {
+        switch ([self state]) {
+            case CIRCUIT_CLOSED:
+                return YES;
+
+            case CIRCUIT_HALF_OPEN:
+                // A trial whose outcome never came back (e.g. it has been
+                // cancelled) is given up after another cooldown
+                if (_trialPending && -[_openedAt timeIntervalSinceNow] < _cooldown) return NO;
+                _trialPending = YES;
+                [_openedAt release];
+                _openedAt = [[NSDate alloc] init];
+                return YES;
+
+            default:
+                return NO;
+        }
+    }
+}
+
+- (void)recordSuccess {
+    @synchronized(self) {
+        _failures = 0;
+        _state = CIRCUIT_CLOSED;
+        _trialPending = NO;
+    }
+}
+
+- (void)recordFailure {
+    @synchronized(self) {
+        _failures++;
+        if (_state == CIRCUIT_HALF_OPEN || _failures >= _threshold) {
+            _state = CIRCUIT_OPEN;
+            _trialPending = NO;
+            [_openedAt release];
+            _openedAt = [[NSDate alloc] init];
+        }
+    }
+}
+
+@end
@@ -0,0 +1,96 @@
+//
+//  DiscountCache.h
+//  PersonalizedDiscounts
+//
+//  Copyright (c) 2012 Moodstocks. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * A cached discount along with its freshness information
+ */
+@interface DiscountCacheEntry : NSObject <NSCoding> {
+    NSString *_discount;
+    NSDate *_expires;
+    NSString *_etag;
+    NSString *_lastModified;
+}
+
+@property (nonatomic, copy) NSString *discount;
+@property (nonatomic, retain) NSDate *expires;
+@property (nonatomic, copy) NSString *etag;         /* `ETag` response header (if any) */
+@property (nonatomic, copy) NSString *lastModified; /* `Last-Modified` response header (if any) */
+
+/**
+ * Return YES if the entry has not expired yet
+ */
+- (BOOL)isFresh;
+
+/**
+ * Return YES if the entry can be revalidated with a conditional request
+ */
+- (BOOL)hasValidators;
+
+@end
+
+/**
+ * Two-tier discount cache
+ *
+ * Entries are kept in a bounded in-memory LRU, backed by one file per entry
+ * under the caches directory so that they survive app restarts. The disk
+ * tier is bounded too: past `diskCapacity` files, the least recently written
+ * ones are removed (at launch, then every few writes).
+ *
+ * All methods are thread-safe.
+ */
+@interface DiscountCache : NSObject {
+    NSUInteger _capacity;
+    NSMutableDictionary *_entries;
+    NSMutableArray *_lru;          /* keys, least recently used first */
+    NSUInteger _diskCapacity;
+    NSUInteger _writes;            /* disk writes since the last trim (I/O queue only) */
+    NSString *_path;
+    dispatch_queue_t _ioQueue;
+}
+
+- (id)initWithCapacity:(NSUInteger)capacity diskCapacity:(NSUInteger)diskCapacity path:(NSString *)path;
+
+/**
+ * Build the cache key of a (user, product) pair
+ */
++ (NSString *)keyForProduct:(NSString *)productId user:(NSString *)userId;
+
+/**
+ * Look up an entry in memory only, whatever its freshness
+ *
+ * This never touches the disk so it can be used from the main thread.
+ */
+- (DiscountCacheEntry *)memoryEntryForKey:(NSString *)key;
+
+/**
+ * Look up an entry in memory then on disk, whatever its freshness
+ *
+ * Entries found on disk are promoted into memory, except expired ones that
+ * cannot be revalidated (see `hasValidators`): those are removed instead.
+ */
+- (DiscountCacheEntry *)entryForKey:(NSString *)key;
+
+/**
+ * Insert or replace an entry
+ *
+ * The disk copy is written in the background.
+ */
+- (void)setEntry:(DiscountCacheEntry *)entry forKey:(NSString *)key;
+
+/**
+ * Remove an entry from memory and disk
+ */
+- (void)removeEntryForKey:(NSString *)key;
+
+/**
+ * Remove all entries from memory and disk
+ */
+- (void)removeAllEntries;
+
+@end
@@ -0,0 +1,247 @@
+//
+//  DiscountCache.m
+//  PersonalizedDiscounts
+//
+//  Copyright (c) 2012 Moodstocks. All rights reserved.
+//
+
+#import <CommonCrypto/CommonDigest.h>
+
+#import "DiscountCache.h"
+
+@implementation DiscountCacheEntry
+
+@synthesize discount = _discount;
+@synthesize expires = _expires;
+@synthesize etag = _etag;
+@synthesize lastModified = _lastModified;
+
+- (id)initWithCoder:(NSCoder *)decoder {
+    self = [super init];
+    if (self) {
+        self.discount = [decoder decodeObjectForKey:@"discount"];
+        self.expires = [decoder decodeObjectForKey:@"expires"];
+        self.etag = [decoder decodeObjectForKey:@"etag"];
+        self.lastModified = [decoder decodeObjectForKey:@"lastModified"];
+    }
+    return self;
+}
+
+- (void)encodeWithCoder:(NSCoder *)encoder {
+    [encoder encodeObject:_discount forKey:@"discount"];
+    [encoder encodeObject:_expires forKey:@"expires"];
+    [encoder encodeObject:_etag forKey:@"etag"];
+    [encoder encodeObject:_lastModified forKey:@"lastModified"];
+}
+
+- (void)dealloc {
+    [_discount release];
+    [_expires release];
+    [_etag release];
+    [_lastModified release];
+
+    [super dealloc];
+}
+
+- (BOOL)isFresh {
+    return _expires != nil && [_expires timeIntervalSinceNow] > 0;
+}
+
+- (BOOL)hasValidators {
+    return _etag != nil || _lastModified != nil;
+}
+
+@end
+
+/* The disk tier is trimmed after this many writes */
+static const NSUInteger kDiscountCacheTrimInterval = 64;
+
+@interface DiscountCache ()
+- (NSString *)pathForKey:(NSString *)key;
+- (void)touchKey:(NSString *)key;
+- (void)trimDisk;
+@end
+
+@implementation DiscountCache
+
+- (id)initWithCapacity:(NSUInteger)capacity diskCapacity:(NSUInteger)diskCapacity path:(NSString *)path {
+    self = [super init];
+    if (self) {
+        _capacity = capacity;
+        _diskCapacity = diskCapacity;
+        _writes = 0;
+        _entries = [[NSMutableDictionary alloc] initWithCapacity:capacity];
+        _lru = [[NSMutableArray alloc] initWithCapacity:capacity];
+        _path = [path copy];
+        _ioQueue = dispatch_queue_create("DiscountCache", DISPATCH_QUEUE_SERIAL);
+
+        [[NSFileManager defaultManager] createDirectoryAtPath:_path
+                                  withIntermediateDirectories:YES
+                                                   attributes:nil
+                                                        error:nil];
+
+        // Entries left over by previous runs
+        dispatch_async(_ioQueue, ^{
+            [self trimDisk];
+        });
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_entries release];
+    [_lru release];
+    [_path release];
+    dispatch_release(_ioQueue);
+
+    [super dealloc];
+}
+
++ (NSString *)keyForProduct:(NSString *)productId user:(NSString *)userId {
+    return [NSString stringWithFormat:@"%@/%@", userId, productId];
+}
+
+- (DiscountCacheEntry *)memoryEntryForKey:(NSString *)key {
+    DiscountCacheEntry *entry = nil;
+    @synchronized(self) {
+        entry = [[[_entries objectForKey:key] retain] autorelease];
+        if (entry != nil) [self touchKey:key];
+    }
+    return entry;
+}
+
+- (DiscountCacheEntry *)entryForKey:(NSString *)key {
+    DiscountCacheEntry *entry = [self memoryEntryForKey:key];
+    if (entry != nil) return entry;
+
+    __block DiscountCacheEntry *stored = nil;
+    NSString *file = [self pathForKey:key];
+    dispatch_sync(_ioQueue, ^{
+        @try {
+            stored = [[NSKeyedUnarchiver unarchiveObjectWithFile:file] retain];
+        }
+        @catch (NSException *e) {
+            // Corrupted entry: behave as a miss, it will be overwritten
+            stored = nil;
+        }
+
+        // Of no use anymore: it can neither be served nor revalidated
+        if ([stored isKindOfClass:[DiscountCacheEntry class]] && ![stored isFresh] && ![stored hasValidators]) {
+            [[NSFileManager defaultManager] removeItemAtPath:file error:nil];
+            [stored release];
+            stored = nil;
+        }
+    });
+
+    if (![stored isKindOfClass:[DiscountCacheEntry class]]) {
+        [stored release];
+        return nil;
+    }
+
+    @synchronized(self) {
+        if ([_entries objectForKey:key] == nil) {
+            [_entries setObject:stored forKey:key];
+            [self touchKey:key];
+        }
+    }
+    return [stored autorelease];
+}
+
+- (void)setEntry:(DiscountCacheEntry *)entry forKey:(NSString *)key {
+    @synchronized(self) {
+        [_entries setObject:entry forKey:key];
+        [self touchKey:key];
+    }
+
+    NSData *data = [NSKeyedArchiver archivedDataWithRootObject:entry];
+    NSString *file = [self pathForKey:key];
+    dispatch_async(_ioQueue, ^{
+        [data writeToFile:file atomically:YES];
+        if (++_writes >= kDiscountCacheTrimInterval)
+            [self trimDisk];
+    });
+}
+
+- (void)removeEntryForKey:(NSString *)key {
+    @synchronized(self) {
+        [_entries removeObjectForKey:key];
+        [_lru removeObject:key];
+    }
+
+    NSString *file = [self pathForKey:key];
+    dispatch_async(_ioQueue, ^{
+        [[NSFileManager defaultManager] removeItemAtPath:file error:nil];
+    });
+}
+
+- (void)removeAllEntries {
+    @synchronized(self) {
+        [_entries removeAllObjects];
+        [_lru removeAllObjects];
+    }
+
+    NSString *path = [[_path retain] autorelease];
+    dispatch_async(_ioQueue, ^{
+        NSFileManager *fm = [NSFileManager defaultManager];
+        for (NSString *file in [fm contentsOfDirectoryAtPath:path error:nil]) {
+            [fm removeItemAtPath:[path stringByAppendingPathComponent:file] error:nil];
+        }
+    });
+}
+
+#pragma mark - Private
+
+- (NSString *)pathForKey:(NSString *)key {
+    const char *str = [key UTF8String];
+    unsigned char md5[CC_MD5_DIGEST_LENGTH];
+    CC_MD5(str, (CC_LONG) strlen(str), md5);
+
+    NSMutableString *name = [NSMutableString stringWithCapacity:2 * CC_MD5_DIGEST_LENGTH];
+    for (int i = 0; i < CC_MD5_DIGEST_LENGTH; i++) {
+        [name appendFormat:@"%02x", md5[i]];
+    }
+    return [_path stringByAppendingPathComponent:name];
+}
+
+// NOTE: I/O queue only
+
+- (void)trimDisk {
+    _writes = 0;
+
+    NSFileManager *fm = [NSFileManager defaultManager];
+    NSArray *names = [fm contentsOfDirectoryAtPath:_path error:nil];
+    if ([names count] <= _diskCapacity) return;
+
+    NSMutableArray *files = [NSMutableArray arrayWithCapacity:[names count]];
+    for (NSString *name in names) {
+        NSString *file = [_path stringByAppendingPathComponent:name];
+        NSDate *date = [[fm attributesOfItemAtPath:file error:nil] fileModificationDate];
+        if (date == nil) continue;
+        [files addObject:[NSArray arrayWithObjects:date, file, nil]];
+    }
+
+    // Least recently written first
+    [files sortUsingComparator:^NSComparisonResult(NSArray *a, NSArray *b) {
+        return [[a objectAtIndex:0] compare:[b objectAtIndex:0]];
+    }];
+
+    NSUInteger count = [files count];
+    for (NSUInteger i = 0; i < count && count - i > _diskCapacity; i++) {
+        [fm removeItemAtPath:[[files objectAtIndex:i] objectAtIndex:1] error:nil];
+    }
+}
+
+// NOTE: must be called with the lock held
+
+- (void)touchKey:(NSString *)key {
+    [_lru removeObject:key];
+    [_lru addObject:key];
+
+    while ([_lru count] > _capacity) {
+        NSString *lru = [_lru objectAtIndex:0];
+        [_entries removeObjectForKey:lru];
+        [_lru removeObjectAtIndex:0];
+    }
+}
+
+@end
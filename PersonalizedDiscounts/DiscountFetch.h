@@ -0,0 +1,75 @@
+//
+//  DiscountFetch.h
+//  PersonalizedDiscounts
+//
+//  Copyright (c) 2012 Moodstocks. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "DiscountCache.h"
+
+/** Error domain of the discount lookups */
+extern NSString * const DiscountErrorDomain;
+
+enum {                              /* enumeration for discount error codes */
+    DISCOUNT_ERR_CANCELLED = -1,    /* the lookup has been cancelled */
+    DISCOUNT_ERR_NETWORK   = 1,     /* no connection, timeout, etc */
+    DISCOUNT_ERR_HTTP,              /* unexpected HTTP status code */
+    DISCOUNT_ERR_PARSE,             /* malformed response body */
+    DISCOUNT_ERR_UNAVAILABLE        /* the backend is down and nothing is cached */
+};
+
+/**
+ * Called on the main thread when a lookup completes
+ *
+ * `discount` is nil whenever `error` is set.
+ */
+typedef void (^DiscountHandler)(NSString *discount, NSError *error);
+
+/**
+ * Get the time to live of a discount response from its `Cache-Control` header
+ */
+NSTimeInterval DiscountTTLFromResponse(NSHTTPURLResponse *response);
+
+/**
+ * Background operation that fetches the discount of a single product from
+ * the discount web service
+ *
+ * A fresh entry found in the cache is returned without any remote call. A
+ * stale one is revalidated with a conditional request (ETag/Last-Modified),
+ * and is still returned if the backend cannot be reached (stale-if-error).
+ */
+@interface DiscountFetch : NSOperation {
+    NSURL *_url;
+    NSString *_key;
+    DiscountCache *_cache;
+    NSTimeInterval _timeout;
+    DiscountHandler _handler;
+    NSTimeInterval _latency;
+    BOOL _backendFailed;
+}
+
+- (id)initWithURL:(NSURL *)url
+              key:(NSString *)key
+            cache:(DiscountCache *)cache
+          timeout:(NSTimeInterval)timeout
+          handler:(DiscountHandler)handler;
+
+/**
+ * Round-trip time (in seconds) of the backend request, the timeout if it
+ * timed out, or a negative value if it has not been sent or failed early
+ * (cache hit, network error, etc)
+ *
+ * NOTE: only meaningful once the handler has been called
+ */
+@property (nonatomic, readonly) NSTimeInterval latency;
+
+/**
+ * YES if the backend could not be reached or answered with a server error
+ *
+ * NOTE: only meaningful once the handler has been called
+ */
+@property (nonatomic, readonly) BOOL backendFailed;
+
+@end
@@ -0,0 +1,182 @@
+//
+//  DiscountFetch.m
+//  PersonalizedDiscounts
+//
+//  Copyright (c) 2012 Moodstocks. All rights reserved.
+//
+
+#import "DiscountFetch.h"
+#import "HTTPClient.h"
+
+NSString * const DiscountErrorDomain = @"discount-service";
+
+/* Time to live (in seconds) of a discount when the server does not specify one */
+static const NSTimeInterval kDiscountDefaultTTL = 3600.0;
+
+NSTimeInterval DiscountTTLFromResponse(NSHTTPURLResponse *response) {
+    NSString *cacheControl = [[response allHeaderFields] objectForKey:@"Cache-Control"];
+    for (NSString *directive in [cacheControl componentsSeparatedByString:@","]) {
+        directive = [directive stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+        if ([directive hasPrefix:@"max-age="]) {
+            return [[directive substringFromIndex:8] doubleValue];
+        }
+        if ([directive isEqualToString:@"no-cache"] || [directive isEqualToString:@"no-store"]) {
+            return 0;
+        }
+    }
+    return kDiscountDefaultTTL;
+}
+
+@interface DiscountFetch ()
+- (void)notifyDiscount:(NSString *)discount error:(NSError *)error;
+@end
+
+@implementation DiscountFetch
+
+@synthesize latency = _latency;
+@synthesize backendFailed = _backendFailed;
+
+- (id)initWithURL:(NSURL *)url
+              key:(NSString *)key
+            cache:(DiscountCache *)cache
+          timeout:(NSTimeInterval)timeout
+          handler:(DiscountHandler)handler {
+    self = [super init];
+    if (self) {
+        _url = [url retain];
+        _key = [key copy];
+        _cache = [cache retain];
+        _timeout = timeout;
+        _handler = [handler copy];
+        _latency = -1;
+        _backendFailed = NO;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_url release];
+    _url = nil;
+    [_key release];
+    _key = nil;
+    [_cache release];
+    _cache = nil;
+    [_handler release];
+    _handler = nil;
+
+    [super dealloc];
+}
+
+- (void)cancel {
+    NSError *error = [NSError errorWithDomain:DiscountErrorDomain code:DISCOUNT_ERR_CANCELLED userInfo:nil];
+    if ([NSThread isMainThread]) {
+        [self notifyDiscount:nil error:error];
+    }
+    else {
+        dispatch_sync(dispatch_get_main_queue(), ^{
+            [self notifyDiscount:nil error:error];
+        });
+    }
+
+    [super cancel];
+}
+
+- (void)main {
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+
+    NSString *discount = nil;
+    NSError *error = nil;
+
+    DiscountCacheEntry *cached = [self isCancelled] ? nil : [_cache entryForKey:_key];
+
+    if ([cached isFresh]) {
+        discount = cached.discount;
+    }
+    else if (![self isCancelled]) {
+        HTTPClient *client = [HTTPClient sharedClient];
+        NSMutableURLRequest *request = [client requestWithURL:_url timeout:_timeout];
+        if (cached.etag != nil)
+            [request setValue:cached.etag forHTTPHeaderField:@"If-None-Match"];
+        if (cached.lastModified != nil)
+            [request setValue:cached.lastModified forHTTPHeaderField:@"If-Modified-Since"];
+
+        NSHTTPURLResponse *response = nil;
+        NSError *err = nil;
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        NSData *data = [client sendSynchronousRequest:request returningResponse:&response error:&err];
+        NSInteger status = [response statusCode];
+        if (data != nil) {
+            _latency = CFAbsoluteTimeGetCurrent() - start;
+        }
+        else if ([[err domain] isEqualToString:NSURLErrorDomain] && [err code] == NSURLErrorTimedOut) {
+            // The backend took at least that long: without this sample the
+            // timeout could not grow back if the backend slows down
+            _latency = _timeout;
+        }
+        _backendFailed = (data == nil || status >= 500);
+
+        if (_backendFailed && cached != nil) {
+            // Better an outdated discount than none at all
+            discount = cached.discount;
+        }
+        else if (data == nil) {
+            NSDictionary *info = err ? [NSDictionary dictionaryWithObject:err forKey:NSUnderlyingErrorKey] : nil;
+            error = [NSError errorWithDomain:DiscountErrorDomain code:DISCOUNT_ERR_NETWORK userInfo:info];
+        }
+        else if (status == 304 && cached != nil) {
+            // Not modified: keep the cached value and extend its lifetime
+            DiscountCacheEntry *entry = [[[DiscountCacheEntry alloc] init] autorelease];
+            entry.discount = cached.discount;
+            entry.etag = cached.etag;
+            entry.lastModified = cached.lastModified;
+            entry.expires = [NSDate dateWithTimeIntervalSinceNow:DiscountTTLFromResponse(response)];
+            [_cache setEntry:entry forKey:_key];
+            discount = cached.discount;
+        }
+        else if (status != 200) {
+            error = [NSError errorWithDomain:DiscountErrorDomain code:DISCOUNT_ERR_HTTP userInfo:nil];
+        }
+        else {
+            id json = [NSJSONSerialization JSONObjectWithData:data options:kNilOptions error:nil];
+            id off = [json isKindOfClass:[NSDictionary class]] ? [json objectForKey:@"Off"] : nil;
+            if (off == nil || off == [NSNull null]) {
+                error = [NSError errorWithDomain:DiscountErrorDomain code:DISCOUNT_ERR_PARSE userInfo:nil];
+            }
+            else {
+                discount = [off description];
+
+                NSDictionary *headers = [response allHeaderFields];
+                DiscountCacheEntry *entry = [[[DiscountCacheEntry alloc] init] autorelease];
+                entry.discount = discount;
+                entry.etag = [headers objectForKey:@"Etag"];
+                entry.lastModified = [headers objectForKey:@"Last-Modified"];
+                entry.expires = [NSDate dateWithTimeIntervalSinceNow:DiscountTTLFromResponse(response)];
+                [_cache setEntry:entry forKey:_key];
+            }
+        }
+    }
+
+    if (![self isCancelled]) {
+        dispatch_sync(dispatch_get_main_queue(), ^{
+            [self notifyDiscount:discount error:error];
+        });
+    }
+
+    [pool release];
+}
+
+#pragma mark - Private
+
+// NOTE: always called on the main thread, so that the handler fires at most once
+// even if the operation is cancelled while completing
+
+- (void)notifyDiscount:(NSString *)discount error:(NSError *)error {
+    DiscountHandler handler = _handler;
+    _handler = nil;
+    if (handler) {
+        handler(discount, error);
+        [handler release];
+    }
+}
+
+@end
@@ -0,0 +1,56 @@
+//
+//  DiscountPrefetch.h
+//  PersonalizedDiscounts
+//
+//  Copyright (c) 2012 Moodstocks. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * Background operation that brings the local discount store of a user up to
+ * date (see DiscountStore.h)
+ *
+ * If the store already holds a version cursor, only the changes made since
+ * then are fetched. Otherwise, or if the server no longer knows the cursor,
+ * the discounts of the whole catalog are fetched as a new snapshot, using a
+ * few batched requests.
+ *
+ * The batch endpoint receives a JSON array of product IDs and answers with
+ * a JSON object that maps each product ID to its discount, along with the
+ * version cursor in the `X-Discounts-Cursor` header. The changes endpoint
+ * answers with a JSON object like:
+ *
+ *   {"Cursor": 1234, "Changes": {"<product ID>": "<discount>" or null}}
+ *
+ * or with a 410 status if the cursor is too old.
+ *
+ * The discount rules of the user (see DiscountRules.h) are fetched as well.
+ */
+@interface DiscountPrefetch : NSOperation {
+    NSString *_userId;
+    NSArray *_productIds;
+    NSString *_tablePath;
+    NSString *_rulesPath;
+    NSTimeInterval _timeout;
+    NSArray *_changedProducts;
+}
+
+/**
+ * `productIds` may be nil, in which case only changes can be fetched
+ */
+- (id)initWithUser:(NSString *)userId
+          products:(NSArray *)productIds
+         tablePath:(NSString *)tablePath
+         rulesPath:(NSString *)rulesPath
+           timeout:(NSTimeInterval)timeout;
+
+/**
+ * IDs of the products whose discount has changed, or nil if the store could
+ * not be updated
+ *
+ * NOTE: only meaningful once the operation is finished
+ */
+@property (nonatomic, readonly) NSArray *changedProducts;
+
+@end
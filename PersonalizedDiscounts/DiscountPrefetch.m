@@ -0,0 +1,261 @@
+//
+//  DiscountPrefetch.m
+//  PersonalizedDiscounts
+//
+//  Copyright (c) 2012 Moodstocks. All rights reserved.
+//
+
+#import "DiscountPrefetch.h"
+#import "DiscountFetch.h"
+#import "DiscountStore.h"
+#import "DiscountRules.h"
+#import "HTTPClient.h"
+#import "Constants.h"
+
+/* Maximum number of product IDs sent within a single batch request */
+static const NSUInteger kDiscountPrefetchBatchSize = 500;
+
+@interface DiscountPrefetch ()
+- (BOOL)syncChangesOf:(DiscountStore *)store expired:(BOOL *)expired;
+- (BOOL)syncSnapshotOf:(DiscountStore *)store;
+- (void)syncRules;
+- (NSDate *)fetchBatch:(NSArray *)batch
+                  into:(NSMutableDictionary *)discounts
+                cursor:(unsigned long long *)cursor
+                 error:(NSError **)error;
+@end
+
+@implementation DiscountPrefetch
+
+@synthesize changedProducts = _changedProducts;
+
+- (id)initWithUser:(NSString *)userId
+          products:(NSArray *)productIds
+         tablePath:(NSString *)tablePath
+         rulesPath:(NSString *)rulesPath
+           timeout:(NSTimeInterval)timeout {
+    self = [super init];
+    if (self) {
+        _userId = [userId copy];
+        _productIds = [productIds copy];
+        _tablePath = [tablePath copy];
+        _rulesPath = [rulesPath copy];
+        _timeout = timeout;
+        _changedProducts = nil;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_userId release];
+    _userId = nil;
+    [_productIds release];
+    _productIds = nil;
+    [_tablePath release];
+    _tablePath = nil;
+    [_rulesPath release];
+    _rulesPath = nil;
+    [_changedProducts release];
+    _changedProducts = nil;
+
+    [super dealloc];
+}
+
+- (void)main {
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+
+    DiscountStore *store = [[[DiscountStore alloc] initWithPath:_tablePath] autorelease];
+    BOOL expired = NO;
+
+    // NOTE: a failed sync keeps the previous store rather than replacing it
+    //       with a partial one
+    if ([store cursor] > 0) {
+        if (![self syncChangesOf:store expired:&expired] && expired && ![self isCancelled]) {
+            [self syncSnapshotOf:store];
+        }
+    }
+    else if (![self isCancelled]) {
+        [self syncSnapshotOf:store];
+    }
+
+    if (![self isCancelled]) {
+        [self syncRules];
+    }
+
+    [pool release];
+}
+
+#pragma mark - Private
+
+- (BOOL)syncChangesOf:(DiscountStore *)store expired:(BOOL *)expired {
+    NSString *urlString = [NSString stringWithFormat:DISCOUNT_CHANGES_SERVICE_URL,
+                           [_userId stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding],
+                           [store cursor]];
+    HTTPClient *client = [HTTPClient sharedClient];
+    NSMutableURLRequest *request = [client requestWithURL:[NSURL URLWithString:urlString] timeout:_timeout];
+
+    NSHTTPURLResponse *response = nil;
+    NSData *data = [client sendSynchronousRequest:request returningResponse:&response error:nil];
+    NSInteger status = [response statusCode];
+
+    if (data == nil || status != 200) {
+        // The server no longer knows this cursor: a new snapshot is needed
+        *expired = (status == 410);
+        NSLog(@" [DISCOUNTS] CHANGES SYNC FAILED WITH STATUS: %d", status);
+        return NO;
+    }
+
+    id json = [NSJSONSerialization JSONObjectWithData:data options:kNilOptions error:nil];
+    id cursor = [json isKindOfClass:[NSDictionary class]] ? [json objectForKey:@"Cursor"] : nil;
+    id changes = [json isKindOfClass:[NSDictionary class]] ? [json objectForKey:@"Changes"] : nil;
+    if (![cursor isKindOfClass:[NSNumber class]] || ![changes isKindOfClass:[NSDictionary class]]) {
+        NSLog(@" [DISCOUNTS] CHANGES SYNC FAILED: MALFORMED RESPONSE");
+        return NO;
+    }
+
+    if ([self isCancelled]) return NO;
+
+    NSDate *expires = [NSDate dateWithTimeIntervalSinceNow:DiscountTTLFromResponse(response)];
+    if ([changes count] > 0 || [cursor unsignedLongLongValue] != [store cursor] || ![store isFresh]) {
+        if (![DiscountStore applyChanges:changes
+                                 expires:expires
+                                  cursor:[cursor unsignedLongLongValue]
+                                  toPath:_tablePath]) {
+            NSLog(@" [DISCOUNTS] FAILED TO WRITE DISCOUNT CHANGES");
+            return NO;
+        }
+    }
+
+    [_changedProducts release];
+    _changedProducts = [[changes allKeys] retain];
+    NSLog(@" [DISCOUNTS] SYNCED %d CHANGE(S)", [changes count]);
+    return YES;
+}
+
+- (BOOL)syncSnapshotOf:(DiscountStore *)store {
+    NSUInteger total = [_productIds count];
+    if (total == 0) return NO;
+
+    NSMutableDictionary *discounts = [NSMutableDictionary dictionaryWithCapacity:total];
+    NSDate *expires = nil;
+    unsigned long long cursor = ULLONG_MAX;
+    BOOL failed = NO;
+
+    for (NSUInteger i = 0; i < total && !failed && ![self isCancelled]; i += kDiscountPrefetchBatchSize) {
+        NSAutoreleasePool* batchPool = [[NSAutoreleasePool alloc] init];
+
+        NSRange range = NSMakeRange(i, MIN(kDiscountPrefetchBatchSize, total - i));
+        NSError *error = nil;
+        unsigned long long batchCursor = 0;
+        NSDate *batchExpires = [self fetchBatch:[_productIds subarrayWithRange:range]
+                                           into:discounts
+                                         cursor:&batchCursor
+                                          error:&error];
+        if (error != nil) {
+            NSLog(@" [DISCOUNTS] PREFETCH FAILED WITH ERROR: %d", [error code]);
+            failed = YES;
+        }
+        else {
+            if (expires == nil || [batchExpires compare:expires] == NSOrderedAscending) {
+                // The snapshot expires with its shortest-lived batch
+                [expires release];
+                expires = [batchExpires retain];
+            }
+            // ...and is as recent as its oldest batch, so that changes fetched
+            // from its cursor cover all of them
+            cursor = MIN(cursor, batchCursor);
+        }
+
+        [batchPool release];
+    }
+    [expires autorelease];
+
+    if (failed || [self isCancelled]) return NO;
+
+    if (![DiscountStore writeSnapshot:discounts expires:expires cursor:cursor toPath:_tablePath]) {
+        NSLog(@" [DISCOUNTS] FAILED TO WRITE DISCOUNT TABLE");
+        return NO;
+    }
+    NSLog(@" [DISCOUNTS] PREFETCHED %d DISCOUNT(S) FOR %d PRODUCT(S)", [discounts count], total);
+
+    // Report the products whose discount differs from the previous store
+    NSMutableArray *changed = [NSMutableArray array];
+    for (NSString *productId in _productIds) {
+        NSString *discount = [discounts objectForKey:productId];
+        NSString *previous = [store discountForProduct:productId];
+        if (discount != previous && ![discount isEqualToString:previous]) {
+            [changed addObject:productId];
+        }
+    }
+    [_changedProducts release];
+    _changedProducts = [changed retain];
+    return YES;
+}
+
+- (void)syncRules {
+    NSString *urlString = [NSString stringWithFormat:DISCOUNT_RULES_SERVICE_URL,
+                           [_userId stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding]];
+    HTTPClient *client = [HTTPClient sharedClient];
+    NSMutableURLRequest *request = [client requestWithURL:[NSURL URLWithString:urlString] timeout:_timeout];
+    [request setValue:@"text/plain" forHTTPHeaderField:@"Accept"];
+
+    NSHTTPURLResponse *response = nil;
+    NSData *data = [client sendSynchronousRequest:request returningResponse:&response error:nil];
+    NSInteger status = [response statusCode];
+
+    if (data != nil && status == 404) {
+        // No rules for this user (anymore)
+        [[NSFileManager defaultManager] removeItemAtPath:_rulesPath error:nil];
+    }
+    else if (data == nil || status != 200) {
+        NSLog(@" [DISCOUNTS] RULES SYNC FAILED WITH STATUS: %d", status);
+    }
+    else if ([[[DiscountRules alloc] initWithData:data] autorelease] != nil) {
+        // NOTE: malformed rules are not written so that the previous ones remain
+        [data writeToFile:_rulesPath atomically:YES];
+    }
+}
+
+- (NSDate *)fetchBatch:(NSArray *)batch
+                  into:(NSMutableDictionary *)discounts
+                cursor:(unsigned long long *)cursor
+                 error:(NSError **)error {
+    NSString *urlString = [NSString stringWithFormat:DISCOUNT_BATCH_SERVICE_URL,
+                           [_userId stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding]];
+    HTTPClient *client = [HTTPClient sharedClient];
+    NSMutableURLRequest *request = [client requestWithURL:[NSURL URLWithString:urlString] timeout:_timeout];
+    [request setHTTPMethod:@"POST"];
+    [request setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
+    [request setHTTPBody:[NSJSONSerialization dataWithJSONObject:batch options:0 error:nil]];
+
+    NSHTTPURLResponse *response = nil;
+    NSData *data = [client sendSynchronousRequest:request returningResponse:&response error:nil];
+
+    if (data == nil) {
+        *error = [NSError errorWithDomain:DiscountErrorDomain code:DISCOUNT_ERR_NETWORK userInfo:nil];
+        return nil;
+    }
+    if ([response statusCode] != 200) {
+        *error = [NSError errorWithDomain:DiscountErrorDomain code:DISCOUNT_ERR_HTTP userInfo:nil];
+        return nil;
+    }
+
+    id json = [NSJSONSerialization JSONObjectWithData:data options:kNilOptions error:nil];
+    if (![json isKindOfClass:[NSDictionary class]]) {
+        *error = [NSError errorWithDomain:DiscountErrorDomain code:DISCOUNT_ERR_PARSE userInfo:nil];
+        return nil;
+    }
+
+    for (NSString *productId in batch) {
+        id off = [json objectForKey:productId];
+        if (off == nil || off == [NSNull null]) continue;
+        [discounts setObject:[off description] forKey:productId];
+    }
+
+    NSString *version = [[response allHeaderFields] objectForKey:@"X-Discounts-Cursor"];
+    *cursor = version ? strtoull([version UTF8String], NULL, 10) : 0;
+
+    return [NSDate dateWithTimeIntervalSinceNow:DiscountTTLFromResponse(response)];
+}
+
+@end
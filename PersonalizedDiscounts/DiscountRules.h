@@ -0,0 +1,46 @@
+//
+//  DiscountRules.h
+//  PersonalizedDiscounts
+//
+//  Copyright (c) 2012 Moodstocks. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * Discount rules of a user, evaluated on the device (see ds_rules.h for the
+ * rules format)
+ *
+ * Evaluating a product only takes a few microseconds so it can be done from
+ * the main thread.
+ */
+@interface DiscountRules : NSObject {
+    void *_rules;  /* ds::RuleSet */
+}
+
+/**
+ * Parse the given rules
+ *
+ * Returns nil if they are malformed.
+ */
+- (id)initWithData:(NSData *)data;
+
+/**
+ * Load the rules file found at the given path
+ *
+ * Returns nil if the file is missing or malformed.
+ */
+- (id)initWithPath:(NSString *)path;
+
+/**
+ * Compute the discount of a product at the given date (e.g. @"20%", or @"0%"
+ * if a rule grants no discount), or nil if no rule applies
+ */
+- (NSString *)discountForProduct:(NSString *)productId date:(NSDate *)date;
+
+/**
+ * Number of rules
+ */
+- (NSUInteger)count;
+
+@end
@@ -0,0 +1,64 @@
+//
+//  DiscountRules.mm
+//  PersonalizedDiscounts
+//
+//  Copyright (c) 2012 Moodstocks. All rights reserved.
+//
+
+#import "DiscountRules.h"
+
+#include "ds_rules.h"
+
+@implementation DiscountRules
+
+- (id)initWithData:(NSData *)data {
+    self = [super init];
+    if (self) {
+        ds::RuleSet *rules = new ds::RuleSet();
+        _rules = rules;
+
+        std::string text = data ? std::string((const char *) [data bytes], [data length]) : std::string();
+        std::string error;
+        if (data == nil || !rules->Parse(text, &error)) {
+            NSLog(@" [DISCOUNTS] INVALID RULES: %s", error.c_str());
+            [self release];
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (id)initWithPath:(NSString *)path {
+    NSData *data = [NSData dataWithContentsOfMappedFile:path];
+    if (data == nil) {
+        [self release];
+        return nil;
+    }
+    return [self initWithData:data];
+}
+
+- (void)dealloc {
+    delete (ds::RuleSet *) _rules;
+    _rules = NULL;
+
+    [super dealloc];
+}
+
+- (NSString *)discountForProduct:(NSString *)productId date:(NSDate *)date {
+    const ds::RuleSet *rules = (const ds::RuleSet *) _rules;
+
+    ds::RuleContext ctx;
+    ctx.segments = rules->segments();
+    ctx.time = (int64_t) [date timeIntervalSince1970];
+    ctx.utc_offset = (int32_t) [[NSTimeZone localTimeZone] secondsFromGMTForDate:date];
+
+    // A matched 0% is an answer too ("no discount"), unlike no rule at all
+    int off = rules->Evaluate([productId UTF8String], ctx);
+    return (off >= 0) ? [NSString stringWithFormat:@"%d%%", off] : nil;
+}
+
+- (NSUInteger)count {
+    return ((const ds::RuleSet *) _rules)->size();
+}
+
+@end
@@ -8,9 +8,101 @@
 
 #import <Foundation/Foundation.h>
 
-@interface DiscountService : NSObject
+#import "DiscountFetch.h"
+#import "DiscountCache.h"
+#import "DiscountStore.h"
+#import "DiscountRules.h"
+#import "LatencyTracker.h"
+#import "CircuitBreaker.h"
+
+@interface DiscountService : NSObject {
+    NSOperationQueue *_fetchQueue;
+    NSMutableDictionary *_inflight; /* key => array of DiscountFetch (first one + hedges) */
+    NSMutableDictionary *_waiters;  /* key => array of requests waiting for it */
+    NSOperationQueue *_prefetchQueue;
+    DiscountCache *_cache;
+    DiscountStore *_store;         /* local discounts of `_storeUser` */
+    DiscountRules *_rules;         /* discount rules of `_storeUser` */
+    NSString *_storeUser;
+    NSArray *_products;            /* catalog of the last prefetch */
+    NSDate *_lastSync;
+    NSTimeInterval _timeout;
+    LatencyTracker *_latencies;
+    CircuitBreaker *_breaker;
+}
+
+/**
+ * Maximum time (in seconds) a single discount lookup may take before it
+ * fails with a timeout error
+ *
+ * Once enough lookups have completed, the actual timeout is derived from the
+ * recent latencies of the backend and this value only acts as an upper bound.
+ */
+@property (nonatomic, assign) NSTimeInterval timeout;
 
--(NSString*) getDiscountForProduct:(NSString *)productId
-                            User:(NSString *)userId;
 +(DiscountService*)sharedInstance;
+
+/**
+ * Look up the discount of a product for the given user
+ *
+ * The lookup runs in the background so you can safely call it from the main
+ * thread. The handler is always called on the main thread, either with the
+ * discount value or with an error (see DiscountFetch.h for error codes).
+ *
+ * NOTE: if a fresh discount is found in the memory cache, or any discount in
+ *       the local discount store, the handler is called right away, before
+ *       this method returns, and nil is returned.
+ *
+ * The local store is served even if it is outdated (e.g. offline), in which
+ * case it is brought up to date in the background. Products missing from it
+ * are then evaluated against the discount rules of the user, if any, before
+ * falling back to the discount web service.
+ *
+ * Concurrent lookups of the same (user, product) pair share a single network
+ * request and all receive the same result.
+ *
+ * A lookup slower than most recent ones is hedged: a duplicate request is
+ * sent and the first answer wins. When the backend keeps failing, lookups
+ * fail fast with an outdated discount if one is at hand, or a
+ * `DISCOUNT_ERR_UNAVAILABLE` error otherwise, until it recovers.
+ *
+ * Returns an opaque request object that can be passed to `cancel:`.
+ */
+-(id) getDiscountForProduct:(NSString *)productId
+                       User:(NSString *)userId
+                 completion:(DiscountHandler)handler;
+
+/**
+ * Cancel a pending lookup
+ *
+ * Its handler is called with a `DISCOUNT_ERR_CANCELLED` error, unless it
+ * already completed. The underlying network request is only aborted once
+ * every lookup sharing it has been cancelled.
+ *
+ * NOTE: main thread only
+ */
+-(void) cancel:(id)request;
+
+/**
+ * Cancel all pending lookups
+ */
+-(void) cancelAll;
+
+/**
+ * Open a connection to the discount host ahead of time, so that the first
+ * lookup does not pay for the connection setup
+ */
+-(void) prewarm;
+
+/**
+ * Bring up to date in the background the local discount store of a user, so
+ * that subsequent lookups are answered locally, even offline
+ *
+ * Only the changes made since the last prefetch are fetched when possible,
+ * otherwise the discounts of all the given products are.
+ *
+ * Any prefetch still pending is cancelled first.
+ */
+-(void) prefetchDiscountsForProducts:(NSArray *)productIds
+                                User:(NSString *)userId;
 @end
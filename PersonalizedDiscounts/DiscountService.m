@@ -7,15 +7,102 @@
 //
 
 #import "DiscountService.h"
+#import "DiscountPrefetch.h"
+#import "HTTPClient.h"
 #import "Constants.h"
 
-@interface DiscountService(){
-    NSMutableData *receivedData;
+#include "ds_trace.h"
+
+/* Default lookup timeout (in seconds) */
+static const NSTimeInterval kDiscountServiceTimeout = 5.0;
+
+/* The adaptive timeout is twice the p99 latency, never below this value */
+static const NSTimeInterval kDiscountMinTimeout = 1.0;
+
+/* Number of latency samples required before adapting timeouts and hedging */
+static const NSUInteger kDiscountMinSamples = 10;
+
+/* Percentile of the latency after which a lookup is hedged */
+static const double kDiscountHedgePercentile = 95.0;
+
+/* The circuit opens after this many consecutive backend failures... */
+static const NSUInteger kDiscountBreakerThreshold = 5;
+/* ...and lets a trial request through after this cooldown (in seconds) */
+static const NSTimeInterval kDiscountBreakerCooldown = 30.0;
+
+/* Timeout (in seconds) of a single batch of a prefetch */
+static const NSTimeInterval kDiscountPrefetchTimeout = 30.0;
+
+/* An outdated discount store is not synced more often than this (in seconds) */
+static const NSTimeInterval kDiscountSyncInterval = 60.0;
+
+/* Maximum number of discounts kept in memory, and on disk */
+static const NSUInteger kDiscountCacheCapacity = 256;
+static const NSUInteger kDiscountCacheDiskCapacity = 4096;
+static NSString *kDiscountCacheDirname = @"discounts";
+
+/**
+ * A caller waiting for the discount of a (user, product) pair
+ *
+ * Concurrent lookups of the same pair share a single DiscountFetch, each
+ * caller being handed its own request so that it can cancel independently.
+ */
+@interface DiscountRequest : NSObject {
+    NSString *_key;
+    DiscountHandler _handler;
+}
+
+- (id)initWithKey:(NSString *)key handler:(DiscountHandler)handler;
+
+@property (nonatomic, readonly) NSString *key;
+@property (nonatomic, readonly) DiscountHandler handler;
+
+@end
+
+@implementation DiscountRequest
+
+@synthesize key = _key;
+@synthesize handler = _handler;
+
+- (id)initWithKey:(NSString *)key handler:(DiscountHandler)handler {
+    self = [super init];
+    if (self) {
+        _key = [key copy];
+        _handler = [handler copy];
+    }
+    return self;
 }
+
+- (void)dealloc {
+    [_key release];
+    _key = nil;
+    [_handler release];
+    _handler = nil;
+
+    [super dealloc];
+}
+
+@end
+
+@interface DiscountService ()
+-(void) finishFetch:(DiscountFetch *)op
+                key:(NSString *)key
+           discount:(NSString *)discount
+              error:(NSError *)error;
+-(DiscountFetch *) startFetchForKey:(NSString *)key url:(NSURL *)url;
+-(void) hedgeFetchForKey:(NSString *)key url:(NSURL *)url ops:(NSMutableArray *)ops;
+-(NSTimeInterval) currentTimeout;
+-(void) syncDiscountsForUser:(NSString *)userId products:(NSArray *)productIds;
+-(void) refreshDiscountsForUser:(NSString *)userId;
+-(NSString *) tablePathForUser:(NSString *)userId;
+-(NSString *) rulesPathForUser:(NSString *)userId;
+-(DiscountStore *) storeForUser:(NSString *)userId;
 @end
 
 @implementation DiscountService
 
+@synthesize timeout = _timeout;
+
 static DiscountService *service = nil;
 
 +(DiscountService *)sharedInstance{
@@ -25,23 +112,333 @@ static DiscountService *service = nil;
     return service;
 }
 
--(NSString*) getDiscountForProduct:(NSString *)productId
-                            User:(NSString *)userId{
-    
-    NSString *urlString =[NSString stringWithFormat:DISCOUNT_SERVICE_URL,userId,productId];
-    
+- (id)init {
+    self = [super init];
+    if (self) {
+        _fetchQueue = [[NSOperationQueue alloc] init];
+        _inflight = [[NSMutableDictionary alloc] init];
+        _waiters = [[NSMutableDictionary alloc] init];
+        _prefetchQueue = [[NSOperationQueue alloc] init];
+        [_prefetchQueue setMaxConcurrentOperationCount:1];
+        _timeout = kDiscountServiceTimeout;
+        _latencies = [[LatencyTracker alloc] init];
+        _breaker = [[CircuitBreaker alloc] initWithThreshold:kDiscountBreakerThreshold
+                                                    cooldown:kDiscountBreakerCooldown];
+        
+        NSArray *paths = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
+        NSString *cachePath = [[paths objectAtIndex:0] stringByAppendingPathComponent:kDiscountCacheDirname];
+        _cache = [[DiscountCache alloc] initWithCapacity:kDiscountCacheCapacity
+                                            diskCapacity:kDiscountCacheDiskCapacity
+                                                    path:cachePath];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_fetchQueue cancelAllOperations];
+    [_fetchQueue release];
+    _fetchQueue = nil;
+    [_inflight release];
+    _inflight = nil;
+    [_waiters release];
+    _waiters = nil;
+    [_prefetchQueue cancelAllOperations];
+    [_prefetchQueue release];
+    _prefetchQueue = nil;
+    [_cache release];
+    _cache = nil;
+    [_store release];
+    _store = nil;
+    [_rules release];
+    _rules = nil;
+    [_storeUser release];
+    _storeUser = nil;
+    [_products release];
+    _products = nil;
+    [_lastSync release];
+    _lastSync = nil;
+    [_latencies release];
+    _latencies = nil;
+    [_breaker release];
+    _breaker = nil;
+
+    [super dealloc];
+}
+
+-(id) getDiscountForProduct:(NSString *)productId
+                       User:(NSString *)userId
+                 completion:(DiscountHandler)handler{
+
+    // Trace the lookup until its handler runs, whatever answers it
+    if (ds_trace_enabled()) {
+        uint64_t traceId = ds_trace_new_id();
+        DiscountHandler traced = handler;
+        ds_trace_async_begin("discount", "lookup", traceId, ds_trace_now());
+        handler = [[^(NSString *discount, NSError *error) {
+            ds_trace_async_end("discount", "lookup", traceId, ds_trace_now());
+            traced(discount, error);
+        } copy] autorelease];
+    }
+
+    NSString *key = [DiscountCache keyForProduct:productId user:userId];
+    DiscountCacheEntry *entry = [_cache memoryEntryForKey:key];
+    if ([entry isFresh]) {
+        handler(entry.discount, nil);
+        return nil;
+    }
+
+    // Offline first: serve the local copy, even outdated, and refresh it
+    DiscountStore *store = [self storeForUser:userId];
+    NSString *discount = [store discountForProduct:productId];
+    if (discount != nil) {
+        if (![store isFresh]) [self refreshDiscountsForUser:userId];
+        handler(discount, nil);
+        return nil;
+    }
+
+    discount = [_rules discountForProduct:productId date:[NSDate date]];
+    if (discount != nil) {
+        handler(discount, nil);
+        return nil;
+    }
+
+    DiscountRequest *request = [[[DiscountRequest alloc] initWithKey:key handler:handler] autorelease];
+
+    // Join the lookup already in flight for this pair (if any)
+    NSMutableArray *waiters = [_waiters objectForKey:key];
+    if (waiters != nil) {
+        [waiters addObject:request];
+        return request;
+    }
+
+    // The backend keeps failing: fail fast with whatever is at hand
+    if (![_breaker allowRequest]) {
+        if (entry != nil) {
+            handler(entry.discount, nil);
+        }
+        else {
+            handler(nil, [NSError errorWithDomain:DiscountErrorDomain code:DISCOUNT_ERR_UNAVAILABLE userInfo:nil]);
+        }
+        return nil;
+    }
+
+    NSString *urlString =[NSString stringWithFormat:DISCOUNT_SERVICE_URL,
+                          [userId stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding],
+                          [productId stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding]];
+
     NSURL *url = [NSURL URLWithString:urlString];
-    NSError *error;
-    NSString *data = [NSString stringWithContentsOfURL:url encoding:NSUTF8StringEncoding error:&error];
-    NSDictionary *result = [self getDictionaryFromJsonString:data];
-    return [result objectForKey:@"Off"];
+    NSMutableArray *ops = [NSMutableArray array];
+    [_waiters setObject:[NSMutableArray arrayWithObject:request] forKey:key];
+    [_inflight setObject:ops forKey:key];
+    [ops addObject:[self startFetchForKey:key url:url]];
+
+    // Send a duplicate request if this one turns out slower than most
+    if ([_latencies count] >= kDiscountMinSamples) {
+        NSTimeInterval delay = [_latencies percentile:kDiscountHedgePercentile];
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t) (delay * NSEC_PER_SEC)),
+                       dispatch_get_main_queue(), ^{
+            [self hedgeFetchForKey:key url:url ops:ops];
+        });
+    }
+
+    return request;
+}
+
+-(void) cancel:(id)request{
+    if (request == nil) return;
+
+    DiscountRequest *req = (DiscountRequest *) request;
+    NSString *key = req.key;
+    NSMutableArray *waiters = [_waiters objectForKey:key];
+    if (waiters == nil || [waiters indexOfObjectIdenticalTo:req] == NSNotFound) return;
+
+    [[req retain] autorelease];
+    [waiters removeObjectIdenticalTo:req];
+
+    // Abort the shared fetch once nobody waits for it anymore
+    if ([waiters count] == 0) {
+        NSArray *ops = [[[_inflight objectForKey:key] retain] autorelease];
+        [_waiters removeObjectForKey:key];
+        [_inflight removeObjectForKey:key];
+        [ops makeObjectsPerformSelector:@selector(cancel)];
+    }
+
+    NSError *error = [NSError errorWithDomain:DiscountErrorDomain code:DISCOUNT_ERR_CANCELLED userInfo:nil];
+    req.handler(nil, error);
+}
+
+-(void) cancelAll{
+    NSDictionary *waiters = [[_waiters copy] autorelease];
+    NSMutableArray *ops = [NSMutableArray array];
+    for (NSArray *fetches in [_inflight allValues]) {
+        [ops addObjectsFromArray:fetches];
+    }
+    [_waiters removeAllObjects];
+    [_inflight removeAllObjects];
+    [ops makeObjectsPerformSelector:@selector(cancel)];
+
+    NSError *error = [NSError errorWithDomain:DiscountErrorDomain code:DISCOUNT_ERR_CANCELLED userInfo:nil];
+    for (NSString *key in waiters) {
+        for (DiscountRequest *req in [waiters objectForKey:key]) {
+            req.handler(nil, error);
+        }
+    }
+}
+
+-(void) prewarm{
+    NSString *urlString = [NSString stringWithFormat:DISCOUNT_SERVICE_URL, @"", @""];
+    [[HTTPClient sharedClient] prewarmURL:[NSURL URLWithString:urlString]];
+}
+
+-(void) prefetchDiscountsForProducts:(NSArray *)productIds
+                                User:(NSString *)userId{
+    if (userId == nil || [productIds count] == 0) return;
+
+    [_products release];
+    _products = [productIds copy];
+
+    [_prefetchQueue cancelAllOperations];
+    [self syncDiscountsForUser:userId products:productIds];
 }
 
-- (id) getDictionaryFromJsonString:(NSString *)jsonString {
-    NSData *data = [jsonString dataUsingEncoding:NSUTF8StringEncoding];
-    NSError* error;
-    NSDictionary* result = [NSJSONSerialization JSONObjectWithData:data options:kNilOptions error:&error];
-    return result;
+#pragma mark - Private
+
+// NOTE: main thread only
+
+-(void) finishFetch:(DiscountFetch *)op
+                key:(NSString *)key
+           discount:(NSString *)discount
+              error:(NSError *)error{
+    // Ignore fetches that have been given up (see `cancel:`)
+    NSMutableArray *ops = [_inflight objectForKey:key];
+    if ([ops indexOfObjectIdenticalTo:op] == NSNotFound) return;
+
+    if (op.latency >= 0) [_latencies addSample:op.latency];
+    if (op.backendFailed) {
+        [_breaker recordFailure];
+    }
+    else if (op.latency >= 0) {
+        // The backend is reachable again: catch up with the changes missed
+        if ([_breaker state] != CIRCUIT_CLOSED) [self refreshDiscountsForUser:_storeUser];
+        [_breaker recordSuccess];
+    }
+
+    // Another request for this pair may still succeed
+    if (error != nil && [ops count] > 1) {
+        [ops removeObjectIdenticalTo:op];
+        return;
+    }
+
+    NSArray *waiters = [[[_waiters objectForKey:key] retain] autorelease];
+    [[ops retain] autorelease];
+    [_waiters removeObjectForKey:key];
+    [_inflight removeObjectForKey:key];
+
+    // The first answer wins: drop the other requests
+    [ops removeObjectIdenticalTo:op];
+    [ops makeObjectsPerformSelector:@selector(cancel)];
+
+    for (DiscountRequest *req in waiters) {
+        req.handler(discount, error);
+    }
+}
+
+-(DiscountFetch *) startFetchForKey:(NSString *)key url:(NSURL *)url{
+    __block DiscountFetch *op = nil;
+    uint64_t traceId = ds_trace_new_id();
+    ds_trace_async_begin("discount", "fetch", traceId, ds_trace_now());
+    DiscountHandler done = ^(NSString *discount, NSError *error) {
+        ds_trace_async_end("discount", "fetch", traceId, ds_trace_now());
+        [self finishFetch:op key:key discount:discount error:error];
+    };
+    op = [[[DiscountFetch alloc] initWithURL:url
+                                         key:key
+                                       cache:_cache
+                                     timeout:[self currentTimeout]
+                                     handler:done] autorelease];
+    [_fetchQueue addOperation:op];
+    return op;
+}
+
+// NOTE: main thread only
+
+-(void) hedgeFetchForKey:(NSString *)key url:(NSURL *)url ops:(NSMutableArray *)ops{
+    // Only hedge the lookup that scheduled it, if it is still pending
+    if ([_inflight objectForKey:key] != ops || [ops count] != 1) return;
+    if ([_breaker state] != CIRCUIT_CLOSED) return;
+
+    [ops addObject:[self startFetchForKey:key url:url]];
+}
+
+-(NSTimeInterval) currentTimeout{
+    return [_latencies timeoutWithMin:kDiscountMinTimeout max:_timeout samples:kDiscountMinSamples];
+}
+
+-(void) syncDiscountsForUser:(NSString *)userId products:(NSArray *)productIds{
+    [_lastSync release];
+    _lastSync = [[NSDate alloc] init];
+
+    __block DiscountPrefetch *op = nil;
+    op = [[[DiscountPrefetch alloc] initWithUser:userId
+                                        products:productIds
+                                       tablePath:[self tablePathForUser:userId]
+                                       rulesPath:[self rulesPathForUser:userId]
+                                         timeout:kDiscountPrefetchTimeout] autorelease];
+    [op setCompletionBlock:^{
+        NSArray *changed = [[op changedProducts] retain];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            // Open the new store and rules (if any) at next lookup
+            [_store release];
+            _store = nil;
+            [_rules release];
+            _rules = nil;
+            [_storeUser release];
+            _storeUser = nil;
+
+            // NOTE: the store is more recent than any discount fetched before, so
+            //       drop the cached ones that would otherwise take precedence
+            for (NSString *productId in changed) {
+                [_cache removeEntryForKey:[DiscountCache keyForProduct:productId user:userId]];
+            }
+            [changed release];
+        });
+    }];
+    [_prefetchQueue addOperation:op];
+}
+
+// NOTE: main thread only
+
+-(void) refreshDiscountsForUser:(NSString *)userId{
+    if (userId == nil || [_prefetchQueue operationCount] > 0) return;
+    if (_lastSync != nil && -[_lastSync timeIntervalSinceNow] < kDiscountSyncInterval) return;
+
+    [self syncDiscountsForUser:userId products:_products];
+}
+
+-(NSString *) tablePathForUser:(NSString *)userId{
+    NSArray *paths = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
+    NSString *name = [NSString stringWithFormat:@"%@-%016llx.dst", kDiscountCacheDirname,
+                      (unsigned long long) ds_table_hash([userId UTF8String])];
+    return [[paths objectAtIndex:0] stringByAppendingPathComponent:name];
+}
+
+-(NSString *) rulesPathForUser:(NSString *)userId{
+    return [[self tablePathForUser:userId] stringByAppendingPathExtension:@"rules"];
+}
+
+// NOTE: main thread only, the rules of the user are opened along with it
+
+-(DiscountStore *) storeForUser:(NSString *)userId{
+    if (userId == nil) return nil;
+    if (_storeUser == nil || ![_storeUser isEqualToString:userId]) {
+        [_store release];
+        _store = [[DiscountStore alloc] initWithPath:[self tablePathForUser:userId]];
+        [_rules release];
+        _rules = [[DiscountRules alloc] initWithPath:[self rulesPathForUser:userId]];
+        [_storeUser release];
+        _storeUser = [userId copy];
+    }
+    return _store;
 }
 
 @end
@@ -0,0 +1,73 @@
+//
+//  DiscountStore.h
+//  PersonalizedDiscounts
+//
+//  Copyright (c) 2012 Moodstocks. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "DiscountTable.h"
+
+/**
+ * Local copy of the discounts of a user, used to answer lookups offline
+ *
+ * It is made of a full snapshot (a discount table, see DiscountTable.h) and
+ * of the changes applied since then (a small property list stored next to
+ * it). Both carry a version cursor: the changes are only taken into account
+ * if they are more recent than the snapshot.
+ *
+ * A store object is an immutable view: it is not affected by subsequent
+ * writes to its path.
+ */
+@interface DiscountStore : NSObject {
+    DiscountTable *_table;
+    NSDictionary *_changes;       /* product ID => discount, or empty string if removed */
+    NSDate *_expires;
+    unsigned long long _cursor;
+}
+
+/**
+ * Open the store found at the given path
+ *
+ * Returns nil if there is no snapshot at this path.
+ */
+- (id)initWithPath:(NSString *)path;
+
+/**
+ * Return the discount of a product, or nil if it has none
+ */
+- (NSString *)discountForProduct:(NSString *)productId;
+
+/**
+ * Return YES if the store has not expired yet
+ */
+- (BOOL)isFresh;
+
+/**
+ * Version cursor of the store (0 if unknown)
+ */
+- (unsigned long long)cursor;
+
+/**
+ * Replace the store with a full snapshot (product ID => discount)
+ */
++ (BOOL)writeSnapshot:(NSDictionary *)discounts
+              expires:(NSDate *)expires
+               cursor:(unsigned long long)cursor
+               toPath:(NSString *)path;
+
+/**
+ * Apply changes (product ID => discount, or NSNull if removed) on top of the
+ * store found at the given path
+ *
+ * Once they pile up the changes are merged into a new snapshot.
+ *
+ * Returns NO if there is no snapshot at this path.
+ */
++ (BOOL)applyChanges:(NSDictionary *)changes
+             expires:(NSDate *)expires
+              cursor:(unsigned long long)cursor
+              toPath:(NSString *)path;
+
+@end
@@ -0,0 +1,115 @@
+//
+//  DiscountStore.m
+//  PersonalizedDiscounts
+//
+//  Copyright (c) 2012 Moodstocks. All rights reserved.
+//
+
+#import "DiscountStore.h"
+
+/* Changes are merged into a new snapshot once there are more than this */
+static const NSUInteger kDiscountStoreMaxChanges = 256;
+
+static NSString *kDiscountStoreCursorKey  = @"cursor";
+static NSString *kDiscountStoreExpiresKey = @"expires";
+static NSString *kDiscountStoreChangesKey = @"changes";
+
+static NSString *DiscountStoreChangesPath(NSString *path) {
+    return [path stringByAppendingPathExtension:@"delta"];
+}
+
+@implementation DiscountStore
+
+- (id)initWithPath:(NSString *)path {
+    self = [super init];
+    if (self) {
+        _table = [[DiscountTable alloc] initWithPath:path];
+        if (_table == nil) {
+            [self release];
+            return nil;
+        }
+        _cursor = [_table cursor];
+
+        // NOTE: changes older than the snapshot are left over by an interrupted
+        //       write and must be ignored
+        NSDictionary *delta = [NSDictionary dictionaryWithContentsOfFile:DiscountStoreChangesPath(path)];
+        unsigned long long cursor = [[delta objectForKey:kDiscountStoreCursorKey] unsignedLongLongValue];
+        if (_cursor > 0 && cursor >= _cursor) {
+            _changes = [[delta objectForKey:kDiscountStoreChangesKey] retain];
+            _expires = [[delta objectForKey:kDiscountStoreExpiresKey] retain];
+            _cursor = cursor;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_table release];
+    _table = nil;
+    [_changes release];
+    _changes = nil;
+    [_expires release];
+    _expires = nil;
+
+    [super dealloc];
+}
+
+- (NSString *)discountForProduct:(NSString *)productId {
+    NSString *discount = [_changes objectForKey:productId];
+    if (discount != nil) return ([discount length] > 0) ? discount : nil;
+    return [_table discountForProduct:productId];
+}
+
+- (BOOL)isFresh {
+    if (_changes != nil) return _expires == nil || [_expires timeIntervalSinceNow] > 0;
+    return [_table isFresh];
+}
+
+- (unsigned long long)cursor {
+    return _cursor;
+}
+
++ (BOOL)writeSnapshot:(NSDictionary *)discounts
+              expires:(NSDate *)expires
+               cursor:(unsigned long long)cursor
+               toPath:(NSString *)path {
+    if (![DiscountTable writeDiscounts:discounts expires:expires cursor:cursor toPath:path]) return NO;
+    [[NSFileManager defaultManager] removeItemAtPath:DiscountStoreChangesPath(path) error:nil];
+    return YES;
+}
+
++ (BOOL)applyChanges:(NSDictionary *)changes
+             expires:(NSDate *)expires
+              cursor:(unsigned long long)cursor
+              toPath:(NSString *)path {
+    DiscountStore *store = [[[DiscountStore alloc] initWithPath:path] autorelease];
+    if (store == nil) return NO;
+
+    NSMutableDictionary *merged = [NSMutableDictionary dictionaryWithDictionary:store->_changes];
+    for (NSString *productId in changes) {
+        id discount = [changes objectForKey:productId];
+        [merged setObject:(discount == [NSNull null] ? @"" : [discount description]) forKey:productId];
+    }
+
+    if ([merged count] > kDiscountStoreMaxChanges) {
+        NSMutableDictionary *discounts = [NSMutableDictionary dictionaryWithDictionary:[store->_table allDiscounts]];
+        for (NSString *productId in merged) {
+            NSString *discount = [merged objectForKey:productId];
+            if ([discount length] > 0) {
+                [discounts setObject:discount forKey:productId];
+            }
+            else {
+                [discounts removeObjectForKey:productId];
+            }
+        }
+        return [self writeSnapshot:discounts expires:expires cursor:cursor toPath:path];
+    }
+
+    NSMutableDictionary *delta = [NSMutableDictionary dictionaryWithCapacity:3];
+    [delta setObject:[NSNumber numberWithUnsignedLongLong:cursor] forKey:kDiscountStoreCursorKey];
+    [delta setObject:merged forKey:kDiscountStoreChangesKey];
+    if (expires != nil) [delta setObject:expires forKey:kDiscountStoreExpiresKey];
+    return [delta writeToFile:DiscountStoreChangesPath(path) atomically:YES];
+}
+
+@end
@@ -0,0 +1,64 @@
+//
+//  DiscountTable.h
+//  PersonalizedDiscounts
+//
+//  Copyright (c) 2012 Moodstocks. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#include "ds_table.h"
+
+/**
+ * Wrapper around a memory-mapped discount table (see ds_table.h)
+ *
+ * Lookups are binary searches performed in place, so they are cheap enough
+ * to be run from the main thread.
+ */
+@interface DiscountTable : NSObject {
+    ds_table_t *_table;
+}
+
+/**
+ * Map the table file found at the given path
+ *
+ * Returns nil if the file is missing or corrupted.
+ */
+- (id)initWithPath:(NSString *)path;
+
+/**
+ * Return the discount of a product, or nil if it is not part of the table
+ */
+- (NSString *)discountForProduct:(NSString *)productId;
+
+/**
+ * Return YES if the table has not expired yet
+ */
+- (BOOL)isFresh;
+
+/**
+ * Number of discounts held by the table
+ */
+- (NSUInteger)count;
+
+/**
+ * Version cursor of the discounts held by the table (0 if unknown)
+ */
+- (unsigned long long)cursor;
+
+/**
+ * Return all the discounts of the table (product ID => discount)
+ */
+- (NSDictionary *)allDiscounts;
+
+/**
+ * Write a table made of the given discounts (product ID => discount)
+ *
+ * Any table mapped from the same path remains valid until released.
+ */
++ (BOOL)writeDiscounts:(NSDictionary *)discounts
+               expires:(NSDate *)expires
+                cursor:(unsigned long long)cursor
+                toPath:(NSString *)path;
+
+@end
@@ -0,0 +1,87 @@
+//
+//  DiscountTable.m
+//  PersonalizedDiscounts
+//
+//  Copyright (c) 2012 Moodstocks. All rights reserved.
+//
+
+#import "DiscountTable.h"
+
+@implementation DiscountTable
+
+- (id)initWithPath:(NSString *)path {
+    self = [super init];
+    if (self) {
+        _table = NULL;
+        if (ds_table_open([path fileSystemRepresentation], &_table) != DS_SUCCESS) {
+            [self release];
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_table) ds_table_close(_table);
+    _table = NULL;
+
+    [super dealloc];
+}
+
+- (NSString *)discountForProduct:(NSString *)productId {
+    const char *value = NULL;
+    if (ds_table_lookup(_table, [productId UTF8String], &value) != DS_SUCCESS)
+        return nil;
+    return [NSString stringWithUTF8String:value];
+}
+
+- (BOOL)isFresh {
+    int64_t expires = ds_table_expires(_table);
+    return expires == 0 || expires > (int64_t) [[NSDate date] timeIntervalSince1970];
+}
+
+- (NSUInteger)count {
+    return ds_table_count(_table);
+}
+
+- (unsigned long long)cursor {
+    return ds_table_cursor(_table);
+}
+
+- (NSDictionary *)allDiscounts {
+    uint32_t count = ds_table_count(_table);
+    NSMutableDictionary *discounts = [NSMutableDictionary dictionaryWithCapacity:count];
+    for (uint32_t i = 0; i < count; i++) {
+        const char *productId = NULL;
+        const char *value = NULL;
+        if (ds_table_entry(_table, i, &productId, &value) != DS_SUCCESS) continue;
+        [discounts setObject:[NSString stringWithUTF8String:value]
+                      forKey:[NSString stringWithUTF8String:productId]];
+    }
+    return discounts;
+}
+
++ (BOOL)writeDiscounts:(NSDictionary *)discounts
+               expires:(NSDate *)expires
+                cursor:(unsigned long long)cursor
+                toPath:(NSString *)path {
+    ds_table_writer_t *writer = NULL;
+    if (ds_table_writer_new(&writer) != DS_SUCCESS) return NO;
+
+    ds_errcode ecode = DS_SUCCESS;
+    for (NSString *productId in discounts) {
+        NSString *discount = [discounts objectForKey:productId];
+        ecode = ds_table_writer_add(writer, [productId UTF8String], [discount UTF8String]);
+        if (ecode != DS_SUCCESS) break;
+    }
+
+    if (ecode == DS_SUCCESS) {
+        int64_t ts = expires ? (int64_t) [expires timeIntervalSince1970] : 0;
+        ecode = ds_table_writer_save(writer, [path fileSystemRepresentation], ts, cursor);
+    }
+
+    ds_table_writer_del(writer);
+    return ecode == DS_SUCCESS;
+}
+
+@end
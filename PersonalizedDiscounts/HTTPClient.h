@@ -0,0 +1,49 @@
+//
+//  HTTPClient.h
+//  PersonalizedDiscounts
+//
+//  Copyright (c) 2012 Moodstocks. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * Shared, long-lived HTTP client used by the backend services
+ *
+ * All requests go through the same client so that they reuse the pooled
+ * keep-alive connections of the underlying URL loading system instead of
+ * paying for DNS resolution and TCP (and TLS) setup each time.
+ */
+@interface HTTPClient : NSObject {
+    NSOperationQueue *_prewarmQueue;
+    NSMutableDictionary *_prewarmed;  /* host => date of the last prewarm */
+}
+
+/**
+ * Obtain the singleton instance
+ */
++ (HTTPClient *)sharedClient;
+
+/**
+ * Build a request with the headers shared by all backend calls
+ */
+- (NSMutableURLRequest *)requestWithURL:(NSURL *)url timeout:(NSTimeInterval)timeout;
+
+/**
+ * Perform a request and wait for its response
+ *
+ * NOTE: this method blocks, never call it from the main thread.
+ */
+- (NSData *)sendSynchronousRequest:(NSURLRequest *)request
+                 returningResponse:(NSHTTPURLResponse **)response
+                             error:(NSError **)error;
+
+/**
+ * Open a connection to the host of the given URL in the background, so that
+ * the next request to this host finds a warm connection
+ *
+ * This is a no-op if the host has been prewarmed recently.
+ */
+- (void)prewarmURL:(NSURL *)url;
+
+@end
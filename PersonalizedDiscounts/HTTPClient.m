@@ -0,0 +1,91 @@
+//
+//  HTTPClient.m
+//  PersonalizedDiscounts
+//
+//  Copyright (c) 2012 Moodstocks. All rights reserved.
+//
+
+#import "HTTPClient.h"
+
+/* A host is not prewarmed again within this interval (in seconds), which
+ * roughly matches the idle timeout of keep-alive connections */
+static const NSTimeInterval kHTTPClientPrewarmInterval = 30.0;
+static const NSTimeInterval kHTTPClientPrewarmTimeout  = 10.0;
+
+@implementation HTTPClient
+
+static HTTPClient *client = nil;
+
++ (HTTPClient *)sharedClient {
+    if (!client) {
+        client = [[HTTPClient alloc] init];
+    }
+    return client;
+}
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        _prewarmQueue = [[NSOperationQueue alloc] init];
+        [_prewarmQueue setMaxConcurrentOperationCount:1];
+        _prewarmed = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_prewarmQueue cancelAllOperations];
+    [_prewarmQueue release];
+    _prewarmQueue = nil;
+    [_prewarmed release];
+    _prewarmed = nil;
+
+    [super dealloc];
+}
+
+- (NSMutableURLRequest *)requestWithURL:(NSURL *)url timeout:(NSTimeInterval)timeout {
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:url
+                                                           cachePolicy:NSURLRequestReloadIgnoringLocalCacheData
+                                                       timeoutInterval:timeout];
+    [request setValue:@"keep-alive" forHTTPHeaderField:@"Connection"];
+    [request setValue:@"application/json" forHTTPHeaderField:@"Accept"];
+    [request setHTTPShouldHandleCookies:NO];
+    [request setHTTPShouldUsePipelining:YES];
+    return request;
+}
+
+- (NSData *)sendSynchronousRequest:(NSURLRequest *)request
+                 returningResponse:(NSHTTPURLResponse **)response
+                             error:(NSError **)error {
+    NSURLResponse *resp = nil;
+    NSData *data = [NSURLConnection sendSynchronousRequest:request returningResponse:&resp error:error];
+    if (response) {
+        *response = [resp isKindOfClass:[NSHTTPURLResponse class]] ? (NSHTTPURLResponse *) resp : nil;
+    }
+    return data;
+}
+
+- (void)prewarmURL:(NSURL *)url {
+    NSString *host = [url host];
+    if (host == nil) return;
+
+    @synchronized(_prewarmed) {
+        NSDate *last = [_prewarmed objectForKey:host];
+        if (last != nil && -[last timeIntervalSinceNow] < kHTTPClientPrewarmInterval) return;
+        [_prewarmed setObject:[NSDate date] forKey:host];
+    }
+
+    // A HEAD request on the host root is enough to resolve the host name and
+    // open a connection that stays in the keep-alive pool
+    NSString *root = [NSString stringWithFormat:@"%@://%@%@/", [url scheme], host,
+                      ([url port] ? [NSString stringWithFormat:@":%@", [url port]] : @"")];
+    NSMutableURLRequest *request = [self requestWithURL:[NSURL URLWithString:root]
+                                                timeout:kHTTPClientPrewarmTimeout];
+    [request setHTTPMethod:@"HEAD"];
+
+    [_prewarmQueue addOperationWithBlock:^{
+        [self sendSynchronousRequest:request returningResponse:NULL error:NULL];
+    }];
+}
+
+@end
@@ -0,0 +1,51 @@
+//
+//  LatencyTracker.h
+//  PersonalizedDiscounts
+//
+//  Copyright (c) 2012 Moodstocks. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#include "ds_latency.h"
+
+/* Number of recent samples kept by a tracker */
+#define LATENCY_TRACKER_WINDOW DS_LATENCY_WINDOW
+
+/**
+ * Keeps the most recent request latencies and computes percentiles and
+ * timeouts over them (see ds_latency.h)
+ *
+ * All methods are thread-safe.
+ */
+@interface LatencyTracker : NSObject {
+    ds_latency_t _window;
+}
+
+/**
+ * Record the latency (in seconds) of a completed request
+ *
+ * NOTE: a request that timed out must be recorded too, with its timeout as
+ *       latency, so that the timeout can grow if the backend slows down
+ */
+- (void)addSample:(NSTimeInterval)latency;
+
+/**
+ * Number of samples currently held (at most LATENCY_TRACKER_WINDOW)
+ */
+- (NSUInteger)count;
+
+/**
+ * Get the given percentile (between 0 and 100) of the recent latencies, or
+ * a negative value if no sample has been recorded yet
+ */
+- (NSTimeInterval)percentile:(double)p;
+
+/**
+ * Get the timeout to give to the next request: twice the 99th percentile of
+ * the recent latencies, between `min` and `max`, or `max` as long as fewer
+ * than `samples` latencies have been recorded
+ */
+- (NSTimeInterval)timeoutWithMin:(NSTimeInterval)min max:(NSTimeInterval)max samples:(NSUInteger)samples;
+
+@end
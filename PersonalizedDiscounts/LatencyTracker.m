@@ -0,0 +1,44 @@
+//
+//  LatencyTracker.m
+//  PersonalizedDiscounts
+//
+//  Copyright (c) 2012 Moodstocks. All rights reserved.
+//
+
+#import "LatencyTracker.h"
+
+@implementation LatencyTracker
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        ds_latency_init(&_window);
+    }
+    return self;
+}
+
+- (void)addSample:(NSTimeInterval)latency {
+    @synchronized(self) {
+        ds_latency_add(&_window, latency);
+    }
+}
+
+- (NSUInteger)count {
+    @synchronized(self) {
+        return ds_latency_count(&_window);
+    }
+}
+
+- (NSTimeInterval)percentile:(double)p {
+    @synchronized(self) {
+        return ds_latency_percentile(&_window, p);
+    }
+}
+
+- (NSTimeInterval)timeoutWithMin:(NSTimeInterval)min max:(NSTimeInterval)max samples:(NSUInteger)samples {
+    @synchronized(self) {
+        return ds_latency_timeout(&_window, min, max, (uint32_t) samples);
+    }
+}
+
+@end
@@ -333,6 +333,10 @@
     _lastSync = [[NSDate date] timeIntervalSince1970];
     
     NSLog(@" [MOODSTOCKS SDK] DID SYNC. DATABASE SIZE = %d IMAGE(S)", [scanner count:nil]);
+    
+    // Fetch the discounts of the whole catalog so that scans are answered locally
+    [[DiscountService sharedInstance] prefetchDiscountsForProducts:[scanner info:nil]
+                                                              User:[[UserService sharedInstance] email]];
 }
 
 - (void)scanner:(MSScanner *)scanner failedToSyncWithError:(NSError *)error {
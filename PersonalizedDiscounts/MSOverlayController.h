@@ -33,6 +33,8 @@
 #endif
 > {
     MSScannerController *_scanner; // parent scanner
+    id _discountRequest;           // pending discount lookup (if any)
+    id _speculativeRequest;        // lookup started for a tentative result (if any)
 }
 
 @property (nonatomic, assign) BOOL decodeEAN_8;
@@ -28,6 +28,8 @@
 #import "DiscountService.h"
 #import "UserService.h"
 
+#include "ds_trace.h"
+
 /* UI settings */
 static const NSInteger kMSScanInfoMargin = 5;
 static const NSInteger kMSInfoFontSize   = 14;
@@ -40,6 +42,7 @@ static const NSInteger kMSInfoFontSize   = 14;
 - (void)updateCache:(NSString *)info;
 - (void)updateEAN;
 - (void)updateQRCode;
+- (void)showDiscountForProduct:(NSString *)productId;
 
 @end
 
@@ -56,6 +59,8 @@ static const NSInteger kMSInfoFontSize   = 14;
     self = [super initWithNibName:nibNameOrNil bundle:nibBundleOrNil];
     if (self) {
         _scanner = nil;
+        _discountRequest = nil;
+        _speculativeRequest = nil;
         
         // Register as a sync delegate to update the UI when a sync is pending
         // NOTE: you are not supposed to register as follow if you do not plan
@@ -66,6 +71,13 @@ static const NSInteger kMSInfoFontSize   = 14;
 }
 
 - (void)dealloc {
+    [NSObject cancelPreviousPerformRequestsWithTarget:self];
+    [[DiscountService sharedInstance] cancel:_discountRequest];
+    [_discountRequest release];
+    _discountRequest = nil;
+    [[DiscountService sharedInstance] cancel:_speculativeRequest];
+    [_speculativeRequest release];
+    _speculativeRequest = nil;
     
     [[[MSScanner sharedInstance] syncDelegates] removeObject:self];
     [super dealloc];
@@ -282,13 +294,7 @@ static const NSInteger kMSInfoFontSize   = 14;
     
     switch (type) {
         case MS_RESULT_TYPE_IMAGE:
-            resultStr = [NSString stringWithFormat:@"%@ off",[[DiscountService sharedInstance] getDiscountForProduct:value User:[[UserService sharedInstance] email]]];
-            [self.discountText setText:resultStr];
-            // Present the most up-to-date result in overlay
-            [self.discountSticker setHidden:NO];
-            [self.discountText setHidden:NO];
-            [self performSelector:@selector(hideLabelAndImage) withObject:nil afterDelay:3 ];
-            
+            [self showDiscountForProduct:value];
             break;
             
         case MS_RESULT_TYPE_EAN8:
@@ -311,6 +317,24 @@ static const NSInteger kMSInfoFontSize   = 14;
     
 }
 
+- (void)scanner:(MSScannerController *)scanner tentativeResultFound:(MSResult *)result {
+    DiscountService *discountService = [DiscountService sharedInstance];
+    
+    // The previous tentative result has been lost or replaced
+    [discountService cancel:_speculativeRequest];
+    [_speculativeRequest release];
+    _speculativeRequest = nil;
+    
+    if ([result getType] != MS_RESULT_TYPE_IMAGE) return;
+    
+    // Start the lookup right away: once the result is confirmed the actual
+    // lookup either joins this one or finds its outcome in the cache
+    DiscountHandler handler = ^(NSString *discount, NSError *error) {};
+    _speculativeRequest = [[discountService getDiscountForProduct:[result getValue]
+                                                             User:[[UserService sharedInstance] email]
+                                                       completion:handler] retain];
+}
+
 - (void)scanner:(MSScannerController *)scanner stateUpdated:(NSDictionary *)state {
     NSNumber *ean8 = (NSNumber *) [state objectForKey:@"decode_ean_8"];
     if (ean8 != nil)
@@ -328,6 +352,44 @@ static const NSInteger kMSInfoFontSize   = 14;
     }
 }
 
+- (void)showDiscountForProduct:(NSString *)productId {
+    DiscountService *discountService = [DiscountService sharedInstance];
+    
+    // Drop any lookup still pending for a previous product
+    [discountService cancel:_discountRequest];
+    [_discountRequest release];
+    _discountRequest = nil;
+    [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(hideLabelAndImage) object:nil];
+    
+    // Present a placeholder right away, the discount is filled in when it arrives
+    [self.discountText setText:@"... off"];
+    [self.discountSticker setHidden:NO];
+    [self.discountText setHidden:NO];
+    ds_trace_instant("ui", "overlay shown");
+    
+    // NOTE: not retained to avoid a cycle, the lookup is cancelled at dealloc time
+    __block MSOverlayController *overlay = self;
+    uint64_t traceKey = ds_trace_key([productId UTF8String]);
+    DiscountHandler handler = ^(NSString *discount, NSError *error) {
+        // NOTE: ignore negative error codes (i.e. the lookup has been cancelled)
+        if (error != nil && [error code] < 0) return;
+        
+        [overlay.discountText setText:(discount != nil ? [NSString stringWithFormat:@"%@ off", discount] : @"n/a")];
+        ds_trace_instant("ui", "discount shown");
+        ds_trace_async_end("discount", "scan to discount", traceKey, ds_trace_now());
+        [overlay performSelector:@selector(hideLabelAndImage) withObject:nil afterDelay:3];
+    };
+    _discountRequest = [[discountService getDiscountForProduct:productId
+                                                          User:[[UserService sharedInstance] email]
+                                                    completion:handler] retain];
+    
+    // The speculative lookup (if any) is not needed anymore: the lookup above
+    // shares its network request
+    [discountService cancel:_speculativeRequest];
+    [_speculativeRequest release];
+    _speculativeRequest = nil;
+}
+
 - (void) hideLabelAndImage{
     [self.discountText setHidden:YES];
     [self.discountSticker setHidden:YES];
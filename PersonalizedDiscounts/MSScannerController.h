@@ -31,11 +31,30 @@
 
 #import "MSScanner.h"
 #import "MSScannerSession.h"
+#import "MSImage.h"
 #import "MSActivityView.h"
 
+#include "ds_mailbox.h"
+#include "ds_quality.h"
+#include "ds_record.h"
+#include "ds_sched.h"
+
 @protocol MSScannerOverlayDelegate;
 @class MSOverlayController;
 
+/** Pixel format of the camera frames */
+typedef enum {
+    MS_CAPTURE_FORMAT_BGRA = 0,  /* 32-bit BGRA, converted to grayscale by the SDK */
+    MS_CAPTURE_FORMAT_LUMA       /* luma plane of the native 4:2:0 output, used as is */
+} MSCaptureFormat;
+
+/** Set of formats scanned */
+typedef enum {
+    MS_SCAN_PROFILE_DEFAULT = 0,  /* images and barcodes (see `kMSScanOptions`) */
+    MS_SCAN_PROFILE_AISLE,        /* images only, e.g. to browse the shelves */
+    MS_SCAN_PROFILE_CHECKOUT      /* EAN-8 and EAN-13 only, e.g. at the checkout */
+} MSScanProfile;
+
 @interface MSScannerController : UIViewController
 <
 MSActivityViewDelegate
@@ -52,6 +71,30 @@ MSActivityViewDelegate
     AVCaptureVideoOrientation   orientation;
 #endif
     MSResult *_result; // previous result
+    MSResult *_candidate; // result being confirmed (speculative mode only)
+    MSImage *_query; // refilled with each frame (scan thread only)
+#if MS_SDK_REQUIREMENTS
+    ds_mailbox_t _frames; // newest frame not scanned yet (retained)
+    dispatch_semaphore_t _framePosted;
+    dispatch_semaphore_t _scanFinished; // signaled when the scan thread exits
+    NSThread *_scanThread;
+    ds_gate_t _gate; // sharpness gate (scan thread only)
+    ds_sched_t _sched; // scan cadence (scan thread only)
+    NSTimeInterval _frameInterval; // camera frame interval last requested
+    BOOL _lowBattery;
+    dispatch_queue_t _recordQueue; // writes the recorded frames (NULL if not recording)
+    ds_record_writer_t *_recording; // record queue only
+    volatile int32_t _recordPending; // frames copied but not written yet
+#endif
+    MSCaptureFormat _captureFormat;
+    MSScanProfile _scanProfile;
+    volatile BOOL _speculative; // read by the scan thread
+    volatile int _scanOptions; // formats of the profile (read by the scan thread)
+#ifdef DEBUG
+    NSUInteger _statsFrames;
+    CFAbsoluteTime _statsImageTime;
+    CFAbsoluteTime _statsScanTime;
+#endif
 }
 
 #if MS_SDK_REQUIREMENTS
@@ -60,6 +103,42 @@ MSActivityViewDelegate
 @property (nonatomic, assign) AVCaptureVideoOrientation orientation;
 #endif
 
+/**
+ * Pixel format of the camera frames (default: `MS_CAPTURE_FORMAT_LUMA`)
+ *
+ * It can be changed while capturing. The luma format avoids any color
+ * conversion and moves 4x less memory per frame.
+ */
+@property (nonatomic, assign) MSCaptureFormat captureFormat;
+
+/**
+ * Formats scanned (default: `MS_SCAN_PROFILE_DEFAULT`)
+ *
+ * It can be changed while capturing, e.g. when the user moves from the
+ * aisles to the checkout. Within a profile, the formats that do not yield
+ * results are run less often (see `kMSAdaptive`).
+ */
+@property (nonatomic, assign) MSScanProfile scanProfile;
+
+/**
+ * Speculative mode (default: NO)
+ *
+ * A result must be found in a few consecutive frames before being shown, and
+ * the overlay is told about it as soon as it is first found (see
+ * `scanner:tentativeResultFound:`) so that it can start its discount lookup
+ * while the result is being confirmed. Every candidate costs a lookup, even
+ * one that is never confirmed: only turn it on when the backend can afford
+ * it. Meant to be set before capture starts.
+ */
+@property (nonatomic, assign) BOOL speculative;
+
+/**
+ * Number of frames scanned, and number of frames skipped because they were
+ * too blurry to be recognized (see `kMSSharpnessGate`)
+ */
+@property (nonatomic, readonly) NSUInteger framesAdmitted;
+@property (nonatomic, readonly) NSUInteger framesRejected;
+
 /**
  * Flush the last recognized result (if any) and start scanning again
  */
@@ -79,4 +158,12 @@ MSActivityViewDelegate
  * Used to communicate any information (e.g. options, etc) that may be shown on the overlay side
  */
 - (void)scanner:(MSScannerController *)scanner stateUpdated:(NSDictionary *)state;
+
+/**
+ * Used to communicate a result that is not confirmed yet, so that the overlay
+ * can start working on it ahead of time (speculative mode only)
+ *
+ * This is called again with nil if the result is lost before it is confirmed.
+ */
+- (void)scanner:(MSScannerController *)scanner tentativeResultFound:(MSResult *)result;
 @end
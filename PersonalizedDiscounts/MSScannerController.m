@@ -26,8 +26,12 @@
 #import "MSOverlayController.h"
 #import "MSDebug.h"
 #import "MSImage.h"
+#import "DiscountService.h"
+
+#import <libkern/OSAtomic.h>
 
 #include "moodstocks_sdk.h"
+#include "ds_trace.h"
 
 #if MS_SDK_REQUIREMENTS
 /**
@@ -39,6 +43,141 @@ static NSInteger kMSScanOptions = MS_RESULT_TYPE_IMAGE |
                                   MS_RESULT_TYPE_EAN13 |
                                   MS_RESULT_TYPE_QRCODE;
 
+/**
+ * Confirmations
+ * Number of consecutive frames in which a result must be found before being
+ * shown, in speculative mode only (see the `speculative` property).
+ */
+static int kMSConfirmations = 3;
+
+/**
+ * Parallel mode
+ * On multi-core devices, decode barcodes while the offline image search
+ * runs instead of only after it missed.
+ */
+static BOOL kMSParallel = YES;
+
+/**
+ * Deduplication
+ * Do not search again frames that look the same as a recent frame that did
+ * not match anything (e.g. while aiming at unknown content).
+ */
+static BOOL kMSDeduplicate = YES;
+
+/**
+ * Tracking
+ * Keep a recognized image locked by following it from frame to frame,
+ * instead of matching every frame against it.
+ */
+static BOOL kMSTrack = YES;
+
+/**
+ * Adaptive mode
+ * Run the formats that have not found anything for a while only every few
+ * frames (e.g. skip the barcode decoders while recognizing images).
+ */
+static BOOL kMSAdaptive = YES;
+
+/**
+ * Sharpness gate
+ * Frames much blurrier than the sharpest recent ones are not scanned, since
+ * they are very unlikely to be recognized. One frame is scanned anyway after
+ * a few consecutive rejections.
+ */
+static BOOL   kMSSharpnessGate  = YES;
+static double kMSSharpnessRatio = 0.5;
+static double kMSSharpnessDecay = 0.98;
+static int    kMSSharpnessSkips = 10;
+
+/**
+ * Scan scheduler
+ * Frames are scanned at the pace the device sustains within a share of one
+ * CPU core (smaller when the battery runs low), and the camera is slowed
+ * down accordingly, between 15 and 30 fps.
+ */
+static double         kMSScanBudget           = 0.6;
+static double         kMSScanLowBatteryBudget = 0.3;
+static float          kMSLowBatteryLevel      = 0.2;
+static NSTimeInterval kMSScanMaxInterval      = 0.5;
+static NSTimeInterval kMSCameraMinInterval    = 1.0 / 30;
+static NSTimeInterval kMSCameraMaxInterval    = 1.0 / 15;
+static NSUInteger     kMSCameraUpdateFrames   = 30;
+
+/**
+ * Recording
+ * Write the frames handed to the scanner to `Documents/scan-<date>.dsrec`,
+ * so that the session can be replayed offline (see `tools/replay.cpp`).
+ * Frames are written from a background queue: they are dropped while too
+ * many are pending, and recording stops once the file reaches its maximum
+ * size.
+ * NOTE: for debugging only, frames take about 1 MB each (4 MB in BGRA)
+ */
+static BOOL               kMSRecord           = NO;
+static int32_t            kMSRecordMaxPending = 8;
+static unsigned long long kMSRecordMaxBytes   = 1ULL << 30;
+
+/**
+ * Tracing
+ * Record where the time goes between the capture of a frame and the display
+ * of the discount of the product found in it (conversion, recognition,
+ * handoff to the main thread, discount lookup), then write it to
+ * `Documents/trace-<date>.json` when the capture stops. The file can be
+ * opened with `chrome://tracing` or Perfetto (see ds_trace.h).
+ */
+static BOOL kMSTrace = NO;
+
+/* Number of frames scanned between two drains of the scan thread autorelease pool */
+static const NSUInteger kMSPoolFrames = 30;
+
+#ifdef DEBUG
+/* Number of frames between two logs of the average per-frame timings */
+static const NSUInteger kMSStatsFrames = 100;
+#endif
+
+static int MSScanOptionsForProfile(MSScanProfile profile) {
+    switch (profile) {
+        case MS_SCAN_PROFILE_AISLE:
+            return MS_RESULT_TYPE_IMAGE;
+            
+        case MS_SCAN_PROFILE_CHECKOUT:
+            return MS_RESULT_TYPE_EAN8 | MS_RESULT_TYPE_EAN13;
+            
+        default:
+            return (int) kMSScanOptions;
+    }
+}
+
+static ms_ori_t MSOrientationForVideo(AVCaptureVideoOrientation orientation) {
+    switch (orientation) {
+        case AVCaptureVideoOrientationPortrait:
+            return MS_LEFT_BOTTOM_ORI;
+        case AVCaptureVideoOrientationLandscapeRight:
+            return MS_TOP_LEFT_ORI;
+        case AVCaptureVideoOrientationLandscapeLeft:
+            return MS_BOTTOM_RIGHT_ORI;
+        case AVCaptureVideoOrientationPortraitUpsideDown:
+            return MS_RIGHT_TOP_ORI;
+        default:
+            return MS_UNDEFINED_ORI;
+    }
+}
+
+/* Capture time of a frame, on the clock of `ds_trace_now` */
+static uint64_t MSPresentationTime(CMSampleBufferRef sampleBuffer) {
+    CMTime pts = CMSampleBufferGetPresentationTimeStamp(sampleBuffer);
+    return (uint64_t) CMTimeConvertScale(pts, 1000000000, kCMTimeRoundingMethod_Default).value;
+}
+
+/* Path of a new file named after the current date in the Documents directory */
+static NSString *MSDocumentPath(NSString *prefix, NSString *extension) {
+    NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+    [formatter setDateFormat:@"yyyyMMdd-HHmmss"];
+    NSString *name = [NSString stringWithFormat:@"%@-%@.%@", prefix, [formatter stringFromDate:[NSDate date]], extension];
+    [formatter release];
+    NSArray *paths = NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES);
+    return [[paths objectAtIndex:0] stringByAppendingPathComponent:name];
+}
+
 /* Do not modify */
 static void ms_avcapture_cleanup(void *p) {
     [((MSScannerController *) p) release];
@@ -52,6 +191,17 @@ static void ms_avcapture_cleanup(void *p) {
 - (void)deviceOrientationDidChange;
 - (AVCaptureDevice *)cameraWithPosition:(AVCaptureDevicePosition)position;
 - (AVCaptureDevice *)backFacingCamera;
+- (NSDictionary *)videoSettingsForOutput:(AVCaptureVideoDataOutput *)output;
+- (void)scanLoop;
+- (void)scanFrame:(CMSampleBufferRef)sampleBuffer;
+- (void)scheduleFrameInterval;
+- (void)applyFrameInterval:(NSTimeInterval)interval;
+- (void)batteryDidChange;
+- (void)notifyScanOptions;
+- (void)startRecording;
+- (void)stopRecording;
+- (void)recordFrame:(CMSampleBufferRef)sampleBuffer;
+- (void)exportTrace;
 #endif
 
 - (void)startCapture;
@@ -73,6 +223,8 @@ static void ms_avcapture_cleanup(void *p) {
 @synthesize previewLayer;
 @synthesize orientation;
 #endif
+@synthesize captureFormat = _captureFormat;
+@synthesize scanProfile = _scanProfile;
 
 - (id)initWithNibName:(NSString *)nibNameOrNil bundle:(NSBundle *)nibBundleOrNil {
     self = [super initWithNibName:nibNameOrNil bundle:nibBundleOrNil];
@@ -83,17 +235,55 @@ static void ms_avcapture_cleanup(void *p) {
         self.navigationItem.leftBarButtonItem = barButton;
         
         _scannerSession = [[MSScannerSession alloc] initWithScanner:[MSScanner sharedInstance]];
+        _candidate = nil;
+        _speculative = NO;
+        _query = nil;
+        _captureFormat = MS_CAPTURE_FORMAT_LUMA;
+        _scanProfile = MS_SCAN_PROFILE_DEFAULT;
+#if MS_SDK_REQUIREMENTS
+        _scanOptions = MSScanOptionsForProfile(_scanProfile);
+#endif
 
 #if MS_SDK_REQUIREMENTS
         // This is to register to the API search notifications triggered by the snap & send mode
         _scannerSession.delegate = self;
         
+        if (kMSParallel && [[NSProcessInfo processInfo] activeProcessorCount] > 1)
+            _scannerSession.parallel = YES;
+        
+        _scannerSession.deduplicates = kMSDeduplicate;
+        _scannerSession.tracks = kMSTrack;
+        _scannerSession.adaptive = kMSAdaptive;
+        
+        ds_mailbox_init(&_frames);
+        ds_gate_init(&_gate, kMSSharpnessRatio, kMSSharpnessDecay, kMSSharpnessSkips);
+        ds_sched_init(&_sched, kMSCameraMinInterval, kMSScanMaxInterval, kMSScanBudget);
+        _frameInterval = kMSCameraMinInterval;
+        _lowBattery = NO;
+        _framePosted = dispatch_semaphore_create(0);
+        _scanFinished = dispatch_semaphore_create(0);
+        _scanThread = nil;
+        _recordQueue = NULL;
+        _recording = NULL;
+        _recordPending = 0;
+        
         [[UIDevice currentDevice] beginGeneratingDeviceOrientationNotifications];
         [[NSNotificationCenter defaultCenter] addObserver:self
                                                  selector:@selector(deviceOrientationDidChange)
                                                      name:UIDeviceOrientationDidChangeNotification
                                                    object:nil];
         self.orientation = AVCaptureVideoOrientationPortrait;
+        
+        [[UIDevice currentDevice] setBatteryMonitoringEnabled:YES];
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(batteryDidChange)
+                                                     name:UIDeviceBatteryLevelDidChangeNotification
+                                                   object:nil];
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(batteryDidChange)
+                                                     name:UIDeviceBatteryStateDidChangeNotification
+                                                   object:nil];
+        [self batteryDidChange];
 #endif
         
         _overlayController = [[MSOverlayController alloc] init];
@@ -110,9 +300,24 @@ static void ms_avcapture_cleanup(void *p) {
     [_result release];
     _result = nil;
     
+    [_candidate release];
+    _candidate = nil;
+    
+    [_query release];
+    _query = nil;
+    
 #if MS_SDK_REQUIREMENTS
+    CMSampleBufferRef pending = (CMSampleBufferRef) ds_mailbox_take(&_frames);
+    if (pending) CFRelease(pending);
+    dispatch_release(_framePosted);
+    dispatch_release(_scanFinished);
+    
     [[NSNotificationCenter defaultCenter] removeObserver:self name:UIDeviceOrientationDidChangeNotification object:nil];
     [[UIDevice currentDevice] endGeneratingDeviceOrientationNotifications];
+    
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:UIDeviceBatteryLevelDidChangeNotification object:nil];
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:UIDeviceBatteryStateDidChangeNotification object:nil];
+    [[UIDevice currentDevice] setBatteryMonitoringEnabled:NO];
 #endif
     
     [super dealloc];
@@ -148,9 +353,235 @@ static void ms_avcapture_cleanup(void *p) {
 - (AVCaptureDevice *)backFacingCamera {
     return [self cameraWithPosition:AVCaptureDevicePositionBack];
 }
+
+- (NSDictionary *)videoSettingsForOutput:(AVCaptureVideoDataOutput *)output {
+    OSType pixelFormat = kCVPixelFormatType_32BGRA;
+    if (_captureFormat == MS_CAPTURE_FORMAT_LUMA) {
+        // Prefer the full range flavor (0-255 luma) when available
+        NSArray *available = [output availableVideoCVPixelFormatTypes];
+        NSNumber *full = [NSNumber numberWithInt:kCVPixelFormatType_420YpCbCr8BiPlanarFullRange];
+        NSNumber *video = [NSNumber numberWithInt:kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange];
+        if ([available containsObject:full])
+            pixelFormat = kCVPixelFormatType_420YpCbCr8BiPlanarFullRange;
+        else if ([available containsObject:video])
+            pixelFormat = kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange;
+    }
+    return [NSDictionary dictionaryWithObject:[NSNumber numberWithInt:pixelFormat]
+                                       forKey:(id)kCVPixelBufferPixelFormatTypeKey];
+}
+
+- (void)scanLoop {
+    NSAutoreleasePool *threadPool = [[NSAutoreleasePool alloc] init];
+    NSThread *thread = [NSThread currentThread];
+    [thread setName:@"MSScannerController.scan"];
+    
+    // Scanning a frame autoreleases little (errors, results handed over to
+    // the main thread) and nothing that holds on to the camera frame, so a
+    // pool is drained every few frames rather than created for each one.
+    // The query image is refilled in place (see `scanFrame:`), and the
+    // scan path does not allocate in steady state besides the SDK image of
+    // each frame: tests/test_alloc.cpp checks it.
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSUInteger poolFrames = 0;
+    
+    while (![thread isCancelled]) {
+        dispatch_semaphore_wait(_framePosted, DISPATCH_TIME_FOREVER);
+        
+        // Several posts may have been coalesced into the pending frame
+        CMSampleBufferRef frame = (CMSampleBufferRef) ds_mailbox_take(&_frames);
+        if (frame == NULL) continue;
+        
+        uint64_t t0 = ds_trace_now();
+        [self scanFrame:frame];
+        ds_trace_complete("scanner", "frame", t0, ds_trace_now());
+        CFRelease(frame);
+        
+        if (++poolFrames == kMSPoolFrames) {
+            [pool drain];
+            pool = [[NSAutoreleasePool alloc] init];
+            poolFrames = 0;
+        }
+    }
+    
+    [pool drain];
+    [threadPool drain];
+    
+    // Nothing touches the scanner from this thread anymore (see `stopCapture`)
+    dispatch_semaphore_signal(_scanFinished);
+}
+
+// NOTE: scan thread only
+- (void)scheduleFrameInterval {
+    NSTimeInterval interval = _sched.interval;
+    if (interval < kMSCameraMinInterval) interval = kMSCameraMinInterval;
+    if (interval > kMSCameraMaxInterval) interval = kMSCameraMaxInterval;
+    
+    // Avoid reconfiguring the camera for small variations
+    if (fabs(interval - _frameInterval) <= 0.1 * _frameInterval) return;
+    _frameInterval = interval;
+    
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self applyFrameInterval:interval];
+    });
+}
+
+- (void)applyFrameInterval:(NSTimeInterval)interval {
+    AVCaptureVideoDataOutput *output = (AVCaptureVideoDataOutput *) [captureSession.outputs lastObject];
+    if (output == nil) return;
+    
+    CMTime duration = CMTimeMakeWithSeconds(interval, 600);
+    AVCaptureConnection *connection = [output connectionWithMediaType:AVMediaTypeVideo];
+    if ([connection respondsToSelector:@selector(isVideoMinFrameDurationSupported)]) {
+        // iOS 5+
+        if (connection.isVideoMinFrameDurationSupported)
+            connection.videoMinFrameDuration = duration;
+    }
+    else {
+        output.minFrameDuration = duration;
+    }
+}
+
+- (void)batteryDidChange {
+    UIDevice *device = [UIDevice currentDevice];
+    float level = [device batteryLevel]; // -1 if unknown
+    _lowBattery = ([device batteryState] == UIDeviceBatteryStateUnplugged &&
+                   level >= 0 && level < kMSLowBatteryLevel);
+}
+
+- (void)notifyScanOptions {
+    int options = _scanOptions;
+    NSDictionary *state = [NSDictionary dictionaryWithObjectsAndKeys:
+                           [NSNumber numberWithBool:!!(options & MS_RESULT_TYPE_EAN8)],   @"decode_ean_8",
+                           [NSNumber numberWithBool:!!(options & MS_RESULT_TYPE_EAN13)],  @"decode_ean_13",
+                           [NSNumber numberWithBool:!!(options & MS_RESULT_TYPE_QRCODE)], @"decode_qrcode", nil];
+    [_overlayController scanner:self stateUpdated:state];
+}
+
+- (void)startRecording {
+    NSString *path = MSDocumentPath(@"scan", @"dsrec");
+    
+    // Compress when LZ4 is built in (see ds_record.h)
+    if (ds_record_writer_open([path fileSystemRepresentation], DS_RECORD_COMPRESS, &_recording) != DS_SUCCESS) {
+        NSLog(@" [MOODSTOCKS SDK] CANNOT RECORD TO %@", path);
+        return;
+    }
+    MSDLog(@" [MOODSTOCKS SDK] RECORDING TO %@", path);
+    _recordPending = 0;
+    _recordQueue = dispatch_queue_create("MSScannerController.record", DISPATCH_QUEUE_SERIAL);
+}
+
+// NOTE: main thread only, capture stopped
+- (void)stopRecording {
+    if (_recordQueue == NULL) return;
+    
+    // Detach the record queue on the capture queue, which reads it for each
+    // frame (see `recordFrame:`): no frame can be handed over to it past this
+    __block dispatch_queue_t queue = NULL;
+    void (^detach)(void) = ^{
+        queue = _recordQueue;
+        _recordQueue = NULL;
+    };
+    AVCaptureVideoDataOutput *output = (AVCaptureVideoDataOutput *) [captureSession.outputs lastObject];
+    dispatch_queue_t captureQueue = [output sampleBufferCallbackQueue];
+    if (captureQueue != NULL)
+        dispatch_sync(captureQueue, detach);
+    else
+        detach();
+    
+    // Close once the pending frames (at most `kMSRecordMaxPending`) are
+    // written, before a new recording may reuse `_recording`
+    dispatch_sync(queue, ^{
+        if (_recording) ds_record_writer_close(_recording);
+        _recording = NULL;
+    });
+    dispatch_release(queue);
+}
+
+// NOTE: capture queue only
+- (void)recordFrame:(CMSampleBufferRef)sampleBuffer {
+    dispatch_queue_t queue = _recordQueue;
+    if (queue == NULL) return;
+    
+    // Never hold the capture back: drop frames while the disk lags behind
+    if (OSAtomicIncrement32Barrier(&_recordPending) > kMSRecordMaxPending) {
+        OSAtomicDecrement32Barrier(&_recordPending);
+        return;
+    }
+    
+    // Copy the frame: its buffer goes back to the camera as soon as the
+    // scanner is done with it
+    CVImageBufferRef imageBuffer = CMSampleBufferGetImageBuffer(sampleBuffer);
+    BOOL bgra = (CVPixelBufferGetPixelFormatType(imageBuffer) == kCVPixelFormatType_32BGRA);
+    CVPixelBufferLockBaseAddress(imageBuffer, 0);
+    ds_frame_t frame;
+    const uint8_t *src;
+    size_t bpr;
+    if (bgra) {
+        src = CVPixelBufferGetBaseAddress(imageBuffer);
+        bpr = CVPixelBufferGetBytesPerRow(imageBuffer);
+        frame.width = (int) CVPixelBufferGetWidth(imageBuffer);
+        frame.height = (int) CVPixelBufferGetHeight(imageBuffer);
+        frame.fmt = DS_FRAME_BGRA;
+        frame.bpr = 4 * frame.width;
+    }
+    else {
+        // The luma plane is all the scanner uses
+        src = CVPixelBufferGetBaseAddressOfPlane(imageBuffer, 0);
+        bpr = CVPixelBufferGetBytesPerRowOfPlane(imageBuffer, 0);
+        frame.width = (int) CVPixelBufferGetWidthOfPlane(imageBuffer, 0);
+        frame.height = (int) CVPixelBufferGetHeightOfPlane(imageBuffer, 0);
+        frame.fmt = DS_FRAME_GRAY8;
+        frame.bpr = frame.width;
+    }
+    uint8_t *pixels = malloc((size_t) frame.bpr * frame.height);
+    if (pixels) {
+        for (int y = 0; y < frame.height; y++)
+            memcpy(pixels + (size_t) y * frame.bpr, src + y * bpr, frame.bpr);
+    }
+    CVPixelBufferUnlockBaseAddress(imageBuffer, 0);
+    if (pixels == NULL) {
+        OSAtomicDecrement32Barrier(&_recordPending);
+        return;
+    }
+    
+    frame.data = pixels;
+    frame.orientation = MSOrientationForVideo(self.orientation);
+    frame.options = _scanOptions;
+    frame.timestamp = (int64_t) (CMTimeGetSeconds(CMSampleBufferGetPresentationTimeStamp(sampleBuffer)) * 1e6);
+    
+    dispatch_async(queue, ^{
+        if (_recording) {
+            if (ds_record_writer_add(_recording, &frame) != DS_SUCCESS ||
+                ds_record_writer_size(_recording) >= kMSRecordMaxBytes) {
+                NSLog(@" [MOODSTOCKS SDK] RECORDING STOPPED (%llu BYTES)", ds_record_writer_size(_recording));
+                ds_record_writer_close(_recording);
+                _recording = NULL;
+            }
+        }
+        free(pixels);
+        OSAtomicDecrement32Barrier(&_recordPending);
+    });
+}
+
+- (void)exportTrace {
+    ds_trace_stop();
+    NSString *path = MSDocumentPath(@"trace", @"json");
+    
+    // The trace holds a few MB of events: keep the main thread out of it
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        if (ds_trace_export([path fileSystemRepresentation]) != DS_SUCCESS) {
+            NSLog(@" [MOODSTOCKS SDK] CANNOT WRITE TRACE TO %@", path);
+            return;
+        }
+        MSDLog(@" [MOODSTOCKS SDK] TRACE WRITTEN TO %@", path);
+    });
+}
 #endif
 
 - (void)startCapture {
+    // Warm up the connection to the discount backend while the camera starts
+    [[DiscountService sharedInstance] prewarm];
+    
 #if MS_SDK_REQUIREMENTS    
     // == CAPTURE SESSION SETUP
     AVCaptureDeviceInput *newVideoInput = [[AVCaptureDeviceInput alloc] initWithDevice:[self backFacingCamera] error:nil];
@@ -163,9 +594,7 @@ static void ms_avcapture_cleanup(void *p) {
     dispatch_release(videoDataOutputQueue);
     [self retain]; /* a release is made at `ms_avcapture_cleanup` time */
     
-    NSDictionary *outputSettings = [NSDictionary dictionaryWithObject:[NSNumber numberWithInt:kCVPixelFormatType_32BGRA]
-                                                               forKey:(id)kCVPixelBufferPixelFormatTypeKey];
-    [newCaptureOutput setVideoSettings:outputSettings];
+    [newCaptureOutput setVideoSettings:[self videoSettingsForOutput:newCaptureOutput]];
     [newCaptureOutput setAlwaysDiscardsLateVideoFrames:YES];
     
     AVCaptureSession *cSession = [[AVCaptureSession alloc] init];
@@ -195,6 +624,10 @@ static void ms_avcapture_cleanup(void *p) {
     [newVideoInput release];
     [newCaptureOutput release];
     
+    // == FRAME RATE
+    // Keep the pace of the previous capture (see `scheduleFrameInterval`)
+    [self applyFrameInterval:_frameInterval];
+    
     // == VIDEO PREVIEW SETUP
     if (!self.previewLayer)
         self.previewLayer = [AVCaptureVideoPreviewLayer layerWithSession:self.captureSession];
@@ -216,14 +649,25 @@ static void ms_avcapture_cleanup(void *p) {
         }
     }
     
+    // == TRACING
+    // From the first frame on (see `exportTrace`)
+    if (kMSTrace)
+        ds_trace_start();
+    
+    // == SCAN THREAD SETUP
+    // Frames are handed over to a dedicated thread, so that the capture callback
+    // returns right away and each scan runs on the newest frame available
+    // NOTE: the thread retains `self` until it exits (see `stopCapture`)
+    _scanThread = [[NSThread alloc] initWithTarget:self selector:@selector(scanLoop) object:nil];
+    [_scanThread start];
+    
+    if (kMSRecord)
+        [self startRecording];
+    
     [self.captureSession startRunning];
     
     // == OVERLAY NOTIFICATION
-    NSDictionary *state = [NSDictionary dictionaryWithObjectsAndKeys:
-                           [NSNumber numberWithBool:!!(kMSScanOptions & MS_RESULT_TYPE_EAN8)],   @"decode_ean_8",
-                           [NSNumber numberWithBool:!!(kMSScanOptions & MS_RESULT_TYPE_EAN13)],  @"decode_ean_13",
-                           [NSNumber numberWithBool:!!(kMSScanOptions & MS_RESULT_TYPE_QRCODE)], @"decode_qrcode", nil];
-    [_overlayController scanner:self stateUpdated:state];
+    [self notifyScanOptions];
 #endif
 }
 
@@ -231,6 +675,18 @@ static void ms_avcapture_cleanup(void *p) {
 #if MS_SDK_REQUIREMENTS
     [captureSession stopRunning];
     
+    // Wait for the frame being scanned (if any): the scanner is shared, and
+    // must not be used by this thread while the next capture starts
+    [_scanThread cancel];
+    dispatch_semaphore_signal(_framePosted);
+    dispatch_semaphore_wait(_scanFinished, DISPATCH_TIME_FOREVER);
+    [_scanThread release];
+    _scanThread = nil;
+    
+    [self stopRecording];
+    if (kMSTrace)
+        [self exportTrace];
+    
     AVCaptureInput *input = [captureSession.inputs objectAtIndex:0];
     [captureSession removeInput:input];
     
@@ -295,24 +751,97 @@ didOutputSampleBuffer:(CMSampleBufferRef)sampleBuffer
        fromConnection:(AVCaptureConnection *)connection {
     if (_scannerSession.state != MS_SCAN_STATE_DEFAULT) return;
     
+    // Time taken by the camera to deliver the frame
+    if (ds_trace_enabled())
+        ds_trace_complete("camera", "delivery", MSPresentationTime(sampleBuffer), ds_trace_now());
+    
+    [self recordFrame:sampleBuffer];
+    
+    // Hand the frame over to the scan thread, replacing the one it has not
+    // picked up yet (if any)
+    CFRetain(sampleBuffer);
+    CMSampleBufferRef stale = (CMSampleBufferRef) ds_mailbox_post(&_frames, (void *) sampleBuffer);
+    if (stale) CFRelease(stale);
+    dispatch_semaphore_signal(_framePosted);
+}
+
+// NOTE: scan thread only
+- (void)scanFrame:(CMSampleBufferRef)sampleBuffer {
+    if (_scannerSession.state != MS_SCAN_STATE_DEFAULT) return;
+    
+    // Keep to the sustainable scan rate
+    // --
+    CFAbsoluteTime t0 = CFAbsoluteTimeGetCurrent();
+    double budget = _lowBattery ? kMSScanLowBatteryBudget : kMSScanBudget;
+    if (_sched.budget != budget)
+        ds_sched_set_budget(&_sched, budget);
+    if (!ds_sched_due(&_sched, t0))
+        return;
+    
     // Convert camera frame
     // --
-    MSImage *qry = [[MSImage alloc] initWithBuffer:sampleBuffer orientation:self.orientation];
+    // The same image object (and its conversion buffer) is refilled frame
+    // after frame, so that steady-state scanning does not allocate
+    if (_query == nil)
+        _query = [[MSImage alloc] init];
+    uint64_t imageStart = ds_trace_now();
+    [_query setBuffer:sampleBuffer orientation:self.orientation];
+    ds_trace_complete("scanner", "image", imageStart, ds_trace_now());
+    
+    // Skip blurry frames
+    // --
+    if (kMSSharpnessGate && !ds_gate_admit(&_gate, _query.sharpness))
+        return;
+    
+#ifdef DEBUG
+    CFAbsoluteTime t1 = CFAbsoluteTimeGetCurrent();
+#endif
     
     // Scan
     // --
     NSError *err = nil;
-    MSResult *result = [_scannerSession scan:qry options:kMSScanOptions error:&err];
+    MSResult *result = [_scannerSession scan:_query options:_scanOptions error:&err];
     if (err != nil) {
         NSLog(@" [MOODSTOCKS SDK] SCAN ERROR: %@", [NSString stringWithCString:ms_errmsg([err code])
                                                                        encoding:NSUTF8StringEncoding]);
     }
     
+    ds_sched_record(&_sched, DS_STAGE_FRAME, CFAbsoluteTimeGetCurrent() - t0);
+    if (_scannerSession.searchTime > 0)
+        ds_sched_record(&_sched, DS_STAGE_SEARCH, _scannerSession.searchTime);
+    if (_scannerSession.matchTime > 0)
+        ds_sched_record(&_sched, DS_STAGE_MATCH, _scannerSession.matchTime);
+    if (_scannerSession.decodeTime > 0)
+        ds_sched_record(&_sched, DS_STAGE_DECODE, _scannerSession.decodeTime);
+    if (_sched.samples[DS_STAGE_FRAME] % kMSCameraUpdateFrames == 0)
+        [self scheduleFrameInterval];
+    
+#ifdef DEBUG
+    // Compare the capture formats: log the average per-frame timings
+    _statsImageTime += t1 - t0;
+    _statsScanTime += CFAbsoluteTimeGetCurrent() - t1;
+    if (++_statsFrames == kMSStatsFrames) {
+        OSType pixelFormat = CVPixelBufferGetPixelFormatType(CMSampleBufferGetImageBuffer(sampleBuffer));
+        MSDLog(@" [MOODSTOCKS SDK] %@ FRAMES: IMAGE %.2f ms, SCAN %.2f ms (%u/%u FRAMES SKIPPED, %u BLURRY, %u SEARCHES SKIPPED, %u MATCHES SKIPPED, %u FORMAT RUNS SKIPPED)",
+               (pixelFormat == kCVPixelFormatType_32BGRA ? @"BGRA" : @"LUMA"),
+               1000 * _statsImageTime / _statsFrames, 1000 * _statsScanTime / _statsFrames,
+               _frames.dropped, _frames.posted, _gate.rejected, _scannerSession.searchesSkipped,
+               _scannerSession.matchesSkipped, _scannerSession.formatsSkipped);
+        MSDLog(@" [MOODSTOCKS SDK] SCAN EVERY %.0f ms: SEARCH %.2f ms, MATCH %.2f ms, DECODE %.2f ms",
+               1000 * _sched.interval, 1000 * _sched.cost[DS_STAGE_SEARCH],
+               1000 * _sched.cost[DS_STAGE_MATCH], 1000 * _sched.cost[DS_STAGE_DECODE]);
+        _statsFrames = 0;
+        _statsImageTime = 0;
+        _statsScanTime = 0;
+    }
+#endif
+    
     // Notify the overlay
     // --
     if (result != nil) {
         // We choose to notify only if a *new* result has been found
         if (![_result isEqualToResult:result]) {
+            // NOTE: the result is owned by the scanner session, hence the copy
             [_result release];
             _result = [result copy];
             
@@ -320,14 +849,46 @@ didOutputSampleBuffer:(CMSampleBufferRef)sampleBuffer
             // is shown on the overlay side (see `resume` method below)
             [_scannerSession pause];
             
+            // The overlay ends this span once the discount is shown
+            if (ds_trace_enabled() && [_result getType] == MS_RESULT_TYPE_IMAGE) {
+                ds_trace_async_begin("discount", "scan to discount", ds_trace_key([[_result getValue] UTF8String]),
+                                     MSPresentationTime(sampleBuffer));
+            }
+            
             // Make sure this happens into the *main* thread
+            MSResult *found = [[_result retain] autorelease];
+            uint64_t handoff = ds_trace_new_id();
+            ds_trace_async_begin("scanner", "handoff", handoff, ds_trace_now());
+            CFRunLoopPerformBlock(CFRunLoopGetMain(), kCFRunLoopCommonModes, ^(void) {
+                ds_trace_async_end("scanner", "handoff", handoff, ds_trace_now());
+                [_overlayController scanner:self resultFound:found];
+            });
+        }
+    }
+    
+    // Notify the overlay of the tentative result (if any) as soon as it changes
+    // --
+    if (_speculative) {
+        MSResult *candidate = _scannerSession.candidate;
+        if (candidate != _candidate && ![candidate isEqualToResult:_candidate]) {
+            [_candidate release];
+            _candidate = [candidate copy];
+            
+            MSResult *tentative = [[_candidate retain] autorelease];
+            uint64_t handoff = ds_trace_new_id();
+            ds_trace_async_begin("scanner", "handoff", handoff, ds_trace_now());
             CFRunLoopPerformBlock(CFRunLoopGetMain(), kCFRunLoopCommonModes, ^(void) {
-                [_overlayController scanner:self resultFound:result];
+                ds_trace_async_end("scanner", "handoff", handoff, ds_trace_now());
+                [_overlayController scanner:self tentativeResultFound:tentative];
             });
         }
     }
     
-    [qry release];
+    // The query is now held by an API search (snap mode): do not refill it
+    if (_scannerSession.state == MS_SCAN_STATE_SEARCH) {
+        [_query release];
+        _query = nil;
+    }
     return;
 }
 #endif
@@ -457,6 +1018,51 @@ didOutputSampleBuffer:(CMSampleBufferRef)sampleBuffer
 
 #pragma mark - Public
 
+- (NSUInteger)framesAdmitted {
+#if MS_SDK_REQUIREMENTS
+    return _gate.admitted;
+#else
+    return 0;
+#endif
+}
+
+- (NSUInteger)framesRejected {
+#if MS_SDK_REQUIREMENTS
+    return _gate.rejected;
+#else
+    return 0;
+#endif
+}
+
+- (void)setCaptureFormat:(MSCaptureFormat)captureFormat {
+    _captureFormat = captureFormat;
+#if MS_SDK_REQUIREMENTS
+    // Apply the new format to the running session (if any)
+    AVCaptureVideoDataOutput *output = (AVCaptureVideoDataOutput *) [captureSession.outputs lastObject];
+    if (output != nil)
+        [output setVideoSettings:[self videoSettingsForOutput:output]];
+#endif
+}
+
+- (void)setScanProfile:(MSScanProfile)scanProfile {
+    _scanProfile = scanProfile;
+#if MS_SDK_REQUIREMENTS
+    // Picked up by the scan thread on its next frame
+    _scanOptions = MSScanOptionsForProfile(scanProfile);
+    [self notifyScanOptions];
+#endif
+}
+
+- (BOOL)speculative {
+    return _speculative;
+}
+
+- (void)setSpeculative:(BOOL)speculative {
+    _speculative = speculative;
+    // Without the early lookups, confirming a result only delays it
+    _scannerSession.confirmations = speculative ? kMSConfirmations : 1;
+}
+
 - (void)resume {
     [_result release];
     _result = nil;
@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _DS_CHECK_H
+#define _DS_CHECK_H
+
+/*
+ * Minimal test harness of the unit tests (tests/test_*.cpp)
+ *
+ * A test is a function registered with `TEST`. A failed `CHECK` reports the
+ * expression and moves on to the next check; the program exits with a
+ * non-zero status if any check failed, so that ctest reports it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+namespace check {
+
+typedef void (*TestFn)();
+
+struct Test {
+  const char *name;
+  TestFn fn;
+  Test *next;
+};
+
+inline Test *&Tests() {
+  static Test *tests = NULL;
+  return tests;
+}
+
+inline int &Failures() {
+  static int failures = 0;
+  return failures;
+}
+
+struct Registrar {
+  Registrar(Test *test) {
+    /* Append, so that tests run in declaration order */
+    Test **last = &Tests();
+    while (*last) last = &(*last)->next;
+    *last = test;
+  }
+};
+
+inline void Fail(const char *file, int line, const char *expr) {
+  fprintf(stderr, "%s:%d: CHECK failed: %s\n", file, line, expr);
+  Failures()++;
+}
+
+inline int RunAll(int argc, char **argv) {
+  int tests = 0;
+  for (Test *t = Tests(); t; t = t->next) {
+    if (argc > 1 && strstr(t->name, argv[1]) == NULL) continue;
+    int failures = Failures();
+    t->fn();
+    printf("%-4s %s\n", Failures() == failures ? "ok" : "FAIL", t->name);
+    tests++;
+  }
+  printf("%d tests, %d failed checks\n", tests, Failures());
+  return Failures() == 0 ? 0 : 1;
+}
+
+}  // namespace check
+
+#define TEST(name)                                                   \
+  static void test_##name();                                         \
+  static check::Test test_##name##_info = {#name, test_##name, NULL}; \
+  static check::Registrar test_##name##_registrar(&test_##name##_info); \
+  static void test_##name()
+
+#define CHECK(expr)                                                  \
+  do {                                                               \
+    if (!(expr)) check::Fail(__FILE__, __LINE__, #expr);             \
+  } while (0)
+
+#define CHECK_EQ(a, b) CHECK((a) == (b))
+
+/* Optional filter: a substring of the names of the tests to run */
+#define TEST_MAIN()                                                  \
+  int main(int argc, char **argv) { return check::RunAll(argc, argv); }
+
+#endif
@@ -0,0 +1,339 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Steady-state allocations of the per-frame scan path: once warmed up, the
+ * pipeline of the tools (scan_pipeline.h, which mirrors MSScannerController:
+ * image preparation as MSImage, sharpness gate, cadence, scan session over
+ * the SDK, tracing) must not allocate for a frame, neither from C
+ * (`malloc`) nor from C++ (`operator new`).
+ *
+ * The one exception is the SDK image of each frame (`ms_img_t`): the SDK
+ * has no call to refill an existing one, so it is created and deleted for
+ * every frame that reaches the sharpness gate. Its allocations are measured
+ * once and accounted for.
+ *
+ * Allocations are counted with hooks on `operator new` and, on glibc, on
+ * the `malloc` family (from all threads, e.g. the decoding worker).
+ */
+
+#include "scan_pipeline.h"
+#include "sdk_standin.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <new>
+#include <string>
+#include <vector>
+
+#include "check.h"
+
+/*************************************************
+ * Counting hooks
+ *************************************************/
+
+static volatile unsigned long g_mallocs = 0;
+static volatile unsigned long g_news = 0;
+
+#if defined(__GLIBC__)
+#define HOOKS_MALLOC 1
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void __libc_free(void *p);
+
+void *malloc(size_t size) {
+  __sync_fetch_and_add(&g_mallocs, 1);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  __sync_fetch_and_add(&g_mallocs, 1);
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size) {
+  __sync_fetch_and_add(&g_mallocs, 1);
+  return __libc_realloc(p, size);
+}
+
+void free(void *p) {
+  __libc_free(p);
+}
+}
+
+/* Not counted twice as a `malloc` */
+static void *RawAlloc(size_t size) { return __libc_malloc(size); }
+static void RawFree(void *p) { __libc_free(p); }
+#else
+#define HOOKS_MALLOC 0
+static void *RawAlloc(size_t size) { return malloc(size); }
+static void RawFree(void *p) { free(p); }
+#endif
+
+void *operator new(size_t size) {
+  __sync_fetch_and_add(&g_news, 1);
+  void *p = RawAlloc(size ? size : 1);
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void *p) throw() {
+  RawFree(p);
+}
+
+void operator delete[](void *p) throw() {
+  RawFree(p);
+}
+
+#if __cplusplus >= 201402L
+void operator delete(void *p, size_t) throw() {
+  RawFree(p);
+}
+
+void operator delete[](void *p, size_t) throw() {
+  RawFree(p);
+}
+#endif
+
+struct Counts {
+  unsigned long mallocs;
+  unsigned long news;
+
+  static Counts Now() {
+    Counts c = { __sync_fetch_and_add(&g_mallocs, 0), __sync_fetch_and_add(&g_news, 0) };
+    return c;
+  }
+};
+
+/*************************************************
+ * Fixture
+ *************************************************/
+
+static const int kWidth = 640;
+static const int kHeight = 480;
+static const uint32_t kReference = 1;      /* seed of the object in the database */
+static const uint32_t kUnknown = 99;       /* seed of an object that is not */
+static const int kWarmup = 50;
+static const int kFrames = 200;
+
+/* Scanner synchronized with a stand-in server holding a single object */
+static ms_scanner_t *Scanner() {
+  static ms_scanner_t *scanner = NULL;
+  if (scanner) return scanner;
+
+  char dir[64], db[80];
+  snprintf(dir, sizeof(dir), "/tmp/test_alloc-%d", (int) getpid());
+  snprintf(db, sizeof(db), "%s.db", dir);
+  std::vector<uint8_t> gray(kWidth * kHeight);
+  ms_standin_render(kReference, 0, &gray[0], kWidth, kHeight, kWidth);
+  ms_img_t *img = NULL;
+  ms_img_new(&gray[0], kWidth, kHeight, kWidth, MS_PIX_FMT_GRAY8, MS_TOP_LEFT_ORI, &img);
+  ms_standin_server_add(dir, "reference", img);
+  ms_img_del(img);
+
+  ms_standin_set_server(dir);
+  ms_errcode ecode = ms_scanner_new(&scanner);
+  if (ecode == MS_SUCCESS) ecode = ms_scanner_open(scanner, db, "test", "test");
+  if (ecode == MS_SUCCESS) ecode = ms_scanner_sync(scanner);
+  if (ecode != MS_SUCCESS) {
+    fprintf(stderr, "cannot set the scanner up: %s\n", ms_errmsg(ecode));
+    exit(1);
+  }
+  return scanner;
+}
+
+/* A camera frame (BGRA, as converted by MSImage) of an object */
+struct Frame {
+  std::vector<uint8_t> bgra;
+  ds_frame_t frame;
+
+  Frame(uint32_t seed, uint32_t noise) : bgra(4 * kWidth * kHeight) {
+    std::vector<uint8_t> gray(kWidth * kHeight);
+    ms_standin_render(seed, noise, &gray[0], kWidth, kHeight, kWidth);
+    for (size_t i = 0; i < gray.size(); i++) {
+      bgra[4 * i] = bgra[4 * i + 1] = bgra[4 * i + 2] = gray[i];
+      bgra[4 * i + 3] = 0xff;
+    }
+    frame.data = &bgra[0];
+    frame.width = kWidth;
+    frame.height = kHeight;
+    frame.bpr = 4 * kWidth;
+    frame.fmt = DS_FRAME_BGRA;
+    frame.orientation = MS_TOP_LEFT_ORI;
+    frame.options = ds::kResultImage | ds::kResultEAN13 | ds::kResultQRCode;
+    frame.timestamp = 0;
+  }
+};
+
+/*
+ * Allocations made by the SDK to create (and delete) the image of a frame,
+ * measured once while no other thread runs (the hooks count all threads)
+ */
+static Counts ImageAllocations() {
+  static Counts c = { 0, 0 };
+  static bool measured = false;
+  if (measured) return c;
+
+  std::vector<uint8_t> gray(kWidth * kHeight);
+  Counts before = Counts::Now();
+  ms_img_t *img = NULL;
+  ms_img_new(&gray[0], kWidth, kHeight, kWidth, MS_PIX_FMT_GRAY8, MS_TOP_LEFT_ORI, &img);
+  ms_img_del(img);
+  Counts after = Counts::Now();
+  c.mallocs = after.mallocs - before.mallocs;
+  c.news = after.news - before.news;
+  measured = true;
+  return c;
+}
+
+/*
+ * Run `frames` (cycling through them) through a pipeline, first to warm it
+ * up then measuring, and check that the only allocations are those of the
+ * SDK images. Returns the number of results found while measuring.
+ */
+static int Run(const std::vector<Frame *> &frames, const PipelineOptions &options) {
+  Counts image = ImageAllocations();
+  ScanPipeline pipeline(Scanner(), options);
+  const ds::ScanResult *result = NULL;
+  ms_errcode ecode = MS_SUCCESS;
+  int results = 0, images = 0;
+
+  for (int i = 0; i < kWarmup; i++)
+    pipeline.Process(frames[i % frames.size()]->frame, 0, &result, &ecode);
+
+  Counts before = Counts::Now();
+  for (int i = 0; i < kFrames; i++) {
+    ScanPipeline::Fate fate = pipeline.Process(frames[i % frames.size()]->frame, 0, &result, &ecode);
+    if (fate == ScanPipeline::kScanned || fate == ScanPipeline::kBlurry) images++;
+    if (result) results++;
+  }
+  Counts after = Counts::Now();
+
+  CHECK_EQ(ecode, MS_SUCCESS);
+  CHECK_EQ(images, kFrames);
+  CHECK_EQ(after.news - before.news, images * image.news);
+  CHECK_EQ(after.mallocs - before.mallocs, images * image.mallocs);
+  if (after.news - before.news != images * image.news ||
+      after.mallocs - before.mallocs != images * image.mallocs) {
+    fprintf(stderr, "  %lu mallocs and %lu news over %d frames, %lu and %lu per SDK image\n",
+            after.mallocs - before.mallocs, after.news - before.news, kFrames, image.mallocs,
+            image.news);
+  }
+  return results;
+}
+
+static PipelineOptions Options() {
+  PipelineOptions options;
+  options.schedule = false;       /* scan every frame */
+  options.sharpness_gate = false; /* the rendered objects are all equally sharp */
+  return options;
+}
+
+/*************************************************
+ * Tests
+ *************************************************/
+
+TEST(hooks_count) {
+  Counts before = Counts::Now();
+  std::string *s = new std::string(100, 'x');
+  delete s;
+  void *p = malloc(16);
+  free(p);
+  Counts after = Counts::Now();
+  CHECK(after.news - before.news >= 1);
+  if (HOOKS_MALLOC) CHECK(after.mallocs - before.mallocs >= 1);
+  else fprintf(stderr, "  malloc is not hooked on this platform\n");
+}
+
+TEST(nothing_in_view) {
+  std::vector<Frame *> frames;
+  for (uint32_t i = 0; i < 4; i++) frames.push_back(new Frame(kUnknown, i + 1));
+  CHECK_EQ(Run(frames, Options()), 0);
+  for (size_t i = 0; i < frames.size(); i++) delete frames[i];
+}
+
+TEST(nothing_in_view_sequential) {
+  std::vector<Frame *> frames;
+  for (uint32_t i = 0; i < 4; i++) frames.push_back(new Frame(kUnknown, i + 1));
+  PipelineOptions options = Options();
+  options.parallel = false;
+  CHECK_EQ(Run(frames, options), 0);
+  for (size_t i = 0; i < frames.size(); i++) delete frames[i];
+}
+
+TEST(object_locked) {
+  std::vector<Frame *> frames;
+  for (uint32_t i = 0; i < 4; i++) frames.push_back(new Frame(kReference, i + 1));
+  CHECK(Run(frames, Options()) > 0);
+  for (size_t i = 0; i < frames.size(); i++) delete frames[i];
+}
+
+TEST(object_locked_without_tracking) {
+  std::vector<Frame *> frames;
+  for (uint32_t i = 0; i < 4; i++) frames.push_back(new Frame(kReference, i + 1));
+  PipelineOptions options = Options();
+  options.tracks = false;
+  CHECK(Run(frames, options) > 0);
+  for (size_t i = 0; i < frames.size(); i++) delete frames[i];
+}
+
+TEST(still_frame) {
+  std::vector<Frame *> frames(1, new Frame(kUnknown, 1));
+  CHECK_EQ(Run(frames, Options()), 0);
+  delete frames[0];
+}
+
+TEST(traced) {
+  ds_trace_start();
+  std::vector<Frame *> frames;
+  for (uint32_t i = 0; i < 4; i++) frames.push_back(new Frame(kReference, i + 1));
+  CHECK(Run(frames, Options()) > 0);
+  for (size_t i = 0; i < frames.size(); i++) delete frames[i];
+  ds_trace_stop();
+}
+
+TEST(cleanup) {
+  char dir[64], path[96];
+  snprintf(dir, sizeof(dir), "/tmp/test_alloc-%d", (int) getpid());
+  ms_scanner_t *scanner = Scanner();
+  ms_scanner_close(scanner);
+  ms_scanner_del(scanner);
+  snprintf(path, sizeof(path), "%s.db", dir);
+  ms_scanner_clean(path);
+  snprintf(path, sizeof(path), "%s/index", dir);
+  unlink(path);
+  rmdir(dir);
+}
+
+TEST_MAIN()
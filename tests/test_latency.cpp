@@ -0,0 +1,120 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Unit tests of the latency window and adaptive timeouts (ds_latency.h),
+ * including the way DiscountService uses them: a timed-out request is
+ * recorded with its timeout as latency (see DiscountFetch).
+ */
+
+#include "ds_latency.h"
+
+#include "check.h"
+
+/* Bounds used by DiscountService */
+static const double kMinTimeout = 1.0;
+static const double kMaxTimeout = 5.0;
+static const uint32_t kMinSamples = 10;
+
+static double Timeout(const ds_latency_t &l) {
+  return ds_latency_timeout(&l, kMinTimeout, kMaxTimeout, kMinSamples);
+}
+
+/* Send a request to a backend answering in `latency` seconds, as a fetch
+ * does: returns true if it answered in time */
+static bool Fetch(ds_latency_t *l, double latency) {
+  double timeout = Timeout(*l);
+  bool answered = latency < timeout;
+  ds_latency_add(l, answered ? latency : timeout);
+  return answered;
+}
+
+TEST(percentiles) {
+  ds_latency_t l;
+  ds_latency_init(&l);
+  CHECK(ds_latency_percentile(&l, 50) < 0);
+  for (int i = 1; i <= 10; i++) ds_latency_add(&l, i * 0.1);
+  CHECK_EQ(ds_latency_count(&l), 10u);
+  CHECK_EQ(ds_latency_percentile(&l, 0), 0.1);
+  CHECK_EQ(ds_latency_percentile(&l, 50), 0.5);
+  CHECK_EQ(ds_latency_percentile(&l, 95), 1.0);
+  CHECK_EQ(ds_latency_percentile(&l, 100), 1.0);
+}
+
+TEST(window_keeps_recent_samples) {
+  ds_latency_t l;
+  ds_latency_init(&l);
+  for (int i = 0; i < DS_LATENCY_WINDOW; i++) ds_latency_add(&l, 3.0);
+  for (int i = 0; i < DS_LATENCY_WINDOW; i++) ds_latency_add(&l, 0.2);
+  CHECK_EQ(ds_latency_count(&l), (uint32_t) DS_LATENCY_WINDOW);
+  CHECK_EQ(ds_latency_percentile(&l, 100), 0.2);
+}
+
+TEST(timeout_bounds) {
+  ds_latency_t l;
+  ds_latency_init(&l);
+  CHECK_EQ(Timeout(l), kMaxTimeout);
+  for (uint32_t i = 0; i < kMinSamples - 1; i++) ds_latency_add(&l, 0.1);
+  CHECK_EQ(Timeout(l), kMaxTimeout);
+  ds_latency_add(&l, 0.1);
+  CHECK_EQ(Timeout(l), kMinTimeout);
+  ds_latency_add(&l, 0.8);
+  CHECK_EQ(Timeout(l), 1.6);
+  ds_latency_add(&l, 4.0);
+  CHECK_EQ(Timeout(l), kMaxTimeout);
+}
+
+TEST(timeout_recovers_after_backend_slows) {
+  ds_latency_t l;
+  ds_latency_init(&l);
+
+  /* A fast backend brings the timeout down to its minimum */
+  for (int i = 0; i < 100; i++) CHECK(Fetch(&l, 0.1));
+  CHECK_EQ(Timeout(l), kMinTimeout);
+
+  /* It slows down beyond the timeout: the first request times out, but is
+   * recorded, so that the next ones are given enough time */
+  CHECK(!Fetch(&l, 1.5));
+  CHECK(Timeout(l) > 1.5);
+  int answered = 0;
+  for (int i = 0; i < 100; i++) answered += Fetch(&l, 1.5);
+  CHECK_EQ(answered, 100);
+
+  /* Once it is fast again, the timeout goes back down */
+  for (int i = 0; i < DS_LATENCY_WINDOW; i++) CHECK(Fetch(&l, 0.1));
+  CHECK_EQ(Timeout(l), kMinTimeout);
+}
+
+TEST(timeout_without_timed_out_samples_is_stuck) {
+  /* What happens if timed-out requests are not recorded (the bug this
+   * guards against): every request to the slower backend times out */
+  ds_latency_t l;
+  ds_latency_init(&l);
+  for (int i = 0; i < 100; i++) ds_latency_add(&l, 0.1);
+  int answered = 0;
+  for (int i = 0; i < 100; i++) answered += (1.5 < Timeout(l));
+  CHECK_EQ(answered, 0);
+}
+
+TEST_MAIN()
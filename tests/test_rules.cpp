@@ -0,0 +1,175 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Unit tests of the discount rules (ds_rules.h): parsing errors, daily hours
+ * windows, week days, time ranges, segments and precedence.
+ */
+
+#include "ds_rules.h"
+
+#include "check.h"
+
+/* 2013-01-01 00:00 UTC, a Tuesday */
+static const int64_t kMidnight = 1356998400;
+
+static int At(const ds::RuleSet &rules, const char *product, int64_t time) {
+  ds::RuleContext ctx;
+  ctx.segments = rules.segments();
+  ctx.time = time;
+  return rules.Evaluate(product, ctx);
+}
+
+/* Discount at each hour of the day, as a mask of the hours it applies to */
+static uint32_t Hours(const char *text) {
+  ds::RuleSet rules;
+  std::string error;
+  if (!rules.Parse(text, &error)) {
+    fprintf(stderr, "%s: %s\n", text, error.c_str());
+    return 0;
+  }
+  uint32_t mask = 0;
+  for (int h = 0; h < 24; h++) {
+    if (At(rules, "p", kMidnight + h * 3600 + 1800) >= 0) mask |= 1u << h;
+  }
+  return mask;
+}
+
+static bool Rejects(const char *text) {
+  ds::RuleSet rules;
+  std::string error;
+  bool ok = rules.Parse(text, &error);
+  return !ok && !error.empty() && rules.size() == 0;
+}
+
+TEST(hours_window) {
+  CHECK_EQ(Hours("rule off=10 hours=18-22"), 0x3c0000u);
+  CHECK_EQ(Hours("rule off=10 hours=0-1"), 0x1u);
+}
+
+TEST(hours_end_of_day) {
+  CHECK_EQ(Hours("rule off=10 hours=0-24"), 0xffffffu);
+  CHECK_EQ(Hours("rule off=10 hours=22-24"), 0xc00000u);
+  CHECK_EQ(Hours("rule off=10 hours=23-24"), 0x800000u);
+}
+
+TEST(hours_wrap_around_midnight) {
+  CHECK_EQ(Hours("rule off=10 hours=22-2"), 0xc00003u);
+  CHECK_EQ(Hours("rule off=10 hours=23-0"), 0x800000u);
+  CHECK_EQ(Hours("rule off=10 hours=1-0"), 0xfffffeu);
+}
+
+TEST(hours_rejected) {
+  CHECK(Rejects("rule off=10 hours=5-5"));
+  CHECK(Rejects("rule off=10 hours=0-0"));
+  CHECK(Rejects("rule off=10 hours=24-2"));
+  CHECK(Rejects("rule off=10 hours=0-25"));
+  CHECK(Rejects("rule off=10 hours=18"));
+  CHECK(Rejects("rule off=10 hours=-1-3"));
+}
+
+TEST(hours_local_time) {
+  ds::RuleSet rules;
+  CHECK(rules.Parse("rule off=10 hours=18-22", NULL));
+  ds::RuleContext ctx;
+  ctx.time = kMidnight + 17 * 3600;
+  CHECK_EQ(rules.Evaluate("p", ctx), -1);
+  ctx.utc_offset = 3600;
+  CHECK_EQ(rules.Evaluate("p", ctx), 10);
+}
+
+TEST(days) {
+  ds::RuleSet rules;
+  CHECK(rules.Parse("rule off=10 days=06", NULL));
+  CHECK_EQ(At(rules, "p", kMidnight), -1);              /* Tuesday */
+  CHECK_EQ(At(rules, "p", kMidnight + 4 * 86400), 10);  /* Saturday */
+  CHECK_EQ(At(rules, "p", kMidnight + 5 * 86400), 10);  /* Sunday */
+  CHECK_EQ(At(rules, "p", kMidnight + 6 * 86400), -1);  /* Monday */
+}
+
+TEST(time_range) {
+  ds::RuleSet rules;
+  CHECK(rules.Parse("rule off=10 from=1000 until=2000", NULL));
+  CHECK_EQ(At(rules, "p", 999), -1);
+  CHECK_EQ(At(rules, "p", 1000), 10);
+  CHECK_EQ(At(rules, "p", 1999), 10);
+  CHECK_EQ(At(rules, "p", 2000), -1);
+}
+
+TEST(products_categories_and_segments) {
+  ds::RuleSet rules;
+  std::string error;
+  CHECK(rules.Parse("segments gold\n"
+                    "category a shoes,sale\n"
+                    "rule off=5 product=b,c\n"
+                    "rule off=15 category=sale\n"
+                    "rule off=30 category=shoes segment=silver\n"
+                    "rule off=25 category=shoes segment=gold,silver\n", &error));
+  CHECK_EQ(rules.size(), 4u);
+  CHECK_EQ(At(rules, "a", kMidnight), 25);
+  CHECK_EQ(At(rules, "b", kMidnight), 5);
+  CHECK_EQ(At(rules, "c", kMidnight), 5);
+  CHECK_EQ(At(rules, "d", kMidnight), -1);
+
+  /* Without the gold segment, only the sale category applies */
+  ds::RuleContext ctx;
+  ctx.time = kMidnight;
+  CHECK_EQ(rules.Evaluate("a", ctx), 15);
+  std::vector<std::string> silver(1, "silver");
+  ctx.segments = rules.SegmentMask(silver);
+  CHECK_EQ(rules.Evaluate("a", ctx), 30);
+}
+
+TEST(priority_then_discount) {
+  ds::RuleSet rules;
+  CHECK(rules.Parse("rule off=50\n"
+                    "rule off=10 product=p priority=1\n"
+                    "rule off=20 product=p priority=1  # comment\n", NULL));
+  CHECK_EQ(At(rules, "p", kMidnight), 20);
+  CHECK_EQ(At(rules, "q", kMidnight), 50);
+}
+
+TEST(zero_discount_is_not_no_rule) {
+  ds::RuleSet rules;
+  CHECK(rules.Parse("rule off=30 category=shoes\n"
+                    "rule off=0 product=p priority=1\n"
+                    "category p shoes\n"
+                    "category q shoes\n", NULL));
+  CHECK_EQ(At(rules, "p", kMidnight), 0);
+  CHECK_EQ(At(rules, "q", kMidnight), 30);
+  CHECK_EQ(At(rules, "r", kMidnight), -1);
+}
+
+TEST(malformed_input_clears_the_set) {
+  ds::RuleSet rules;
+  CHECK(rules.Parse("rule off=10", NULL));
+  CHECK(Rejects("rule off=101"));
+  CHECK(Rejects("rule off=10 product"));
+  CHECK(Rejects("discount off=10"));
+  CHECK(!rules.Parse("rule off=10\nrule off=x", NULL));
+  CHECK_EQ(rules.size(), 0u);
+  CHECK_EQ(At(rules, "p", kMidnight), -1);
+}
+
+TEST_MAIN()
@@ -0,0 +1,420 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Unit tests of the scan session logic (ds_session.h), over a scripted
+ * backend: lock hysteresis, confirmations, snap and API search states
+ * (including from another thread), and the parallel / sequential decoding
+ * paths.
+ */
+
+#include "ds_session.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "check.h"
+
+/* Backend whose answers are set by each test before each frame */
+class ScriptedBackend : public ds::ScanBackend {
+ public:
+  ScriptedBackend()
+      : matches(true), concurrent(false), concurrent_error(MS_SUCCESS), searches(0),
+        match_calls(0), decodes(0), started(0), finished(0), clock(0), pending_(NULL),
+        pending_formats_(0) {}
+
+  virtual ms_errcode Search(const ds::ScanFrame &, ds::ScanResult *result) {
+    searches++;
+    Fill(image, ds::kResultImage, result);
+    return MS_SUCCESS;
+  }
+
+  virtual ms_errcode Match(const ds::ScanFrame &, const ds::ScanResult &ref, bool *matched) {
+    match_calls++;
+    *matched = matches && ref.value == image_ref;
+    return MS_SUCCESS;
+  }
+
+  virtual ms_errcode Decode(const ds::ScanFrame &, int formats, ds::ScanResult *result) {
+    decodes++;
+    DecodeInto(formats, result);
+    return MS_SUCCESS;
+  }
+
+  virtual bool CanDecodeConcurrently() { return concurrent; }
+
+  virtual void StartDecode(const ds::ScanFrame &, int formats, ds::ScanResult *result) {
+    started++;
+    pending_ = result;
+    pending_formats_ = formats;
+  }
+
+  virtual ms_errcode FinishDecode(double *seconds) {
+    finished++;
+    *seconds = 0;
+    if (concurrent_error != MS_SUCCESS) {
+      /* e.g. the SDK requires an opened scanner to decode */
+      concurrent = false;
+      pending_->Clear();
+      return concurrent_error;
+    }
+    DecodeInto(pending_formats_, pending_);
+    return MS_SUCCESS;
+  }
+
+  virtual double Now() { return clock; }
+
+  std::string image;       /* image found by the search ("" if none) */
+  std::string image_ref;   /* image the frames match */
+  std::string ean13;       /* EAN-13 barcode in the frames ("" if none) */
+  bool matches;
+  bool concurrent;
+  ms_errcode concurrent_error;
+
+  int searches;
+  int match_calls;
+  int decodes;
+  int started;
+  int finished;
+  double clock;
+
+ private:
+  static void Fill(const std::string &value, int type, ds::ScanResult *result) {
+    if (value.empty()) {
+      result->Clear();
+    }
+    else {
+      result->type = type;
+      result->value = value;
+    }
+  }
+
+  void DecodeInto(int formats, ds::ScanResult *result) {
+    Fill((formats & ds::kResultEAN13) ? ean13 : std::string(), ds::kResultEAN13, result);
+  }
+
+  ds::ScanResult *pending_;
+  int pending_formats_;
+};
+
+static const int kFormats = ds::kResultImage | ds::kResultEAN13;
+
+/* Scan a frame, and get the value of the result returned ("" if none) */
+static std::string ScanValue(ds::ScanSession *session, ms_errcode *ecode = NULL,
+                             const uint8_t *thumb = NULL) {
+  ds::ScanFrame frame;
+  frame.thumb = thumb;
+  const ds::ScanResult *result = NULL;
+  ms_errcode err = session->Scan(frame, kFormats, &result);
+  if (ecode) *ecode = err;
+  return result ? result->value : std::string();
+}
+
+static std::string CandidateValue(const ds::ScanSession &session) {
+  return session.candidate() ? session.candidate()->value : std::string();
+}
+
+TEST(confirmations_hold_back_new_results) {
+  ScriptedBackend backend;
+  ds::ScanSession session(&backend);
+  session.set_confirmations(3);
+  backend.image = backend.image_ref = "cover";
+
+  CHECK_EQ(ScanValue(&session), "");
+  CHECK_EQ(CandidateValue(session), "cover");  /* tentative right away */
+  CHECK_EQ(ScanValue(&session), "");
+  CHECK_EQ(ScanValue(&session), "cover");
+  CHECK_EQ(ScanValue(&session), "cover");
+  /* Once locked, the result is matched instead of searched */
+  CHECK_EQ(backend.searches, 1);
+  CHECK_EQ(backend.match_calls, 3);
+}
+
+TEST(confirmations_restart_on_another_result) {
+  ScriptedBackend backend;
+  ds::ScanSession session(&backend);
+  session.set_confirmations(2);
+  backend.image = backend.image_ref = "a";
+  CHECK_EQ(ScanValue(&session), "");
+
+  /* "a" is lost, "b" shows up: its count starts over */
+  backend.image.clear();
+  backend.matches = false;
+  CHECK_EQ(ScanValue(&session), "");
+  CHECK_EQ(ScanValue(&session), "");
+  CHECK(session.candidate() == NULL);
+  backend.matches = true;
+  backend.image = backend.image_ref = "b";
+  CHECK_EQ(ScanValue(&session), "");
+  CHECK_EQ(CandidateValue(session), "b");
+  CHECK_EQ(ScanValue(&session), "b");
+}
+
+TEST(lock_survives_isolated_misses) {
+  ScriptedBackend backend;
+  ds::ScanSession session(&backend);
+  backend.image = backend.image_ref = "cover";
+  CHECK_EQ(ScanValue(&session), "cover");
+
+  /* A single miss keeps the lock, and a match resets the count */
+  backend.matches = false;
+  CHECK_EQ(ScanValue(&session), "cover");
+  backend.matches = true;
+  CHECK_EQ(ScanValue(&session), "cover");
+  backend.matches = false;
+  CHECK_EQ(ScanValue(&session), "cover");
+  CHECK_EQ(backend.searches, 1);
+}
+
+TEST(lock_released_after_max_losts) {
+  ScriptedBackend backend;
+  ds::ScanSession session(&backend);
+  session.set_max_losts(3);
+  backend.image = backend.image_ref = "cover";
+  CHECK_EQ(ScanValue(&session), "cover");
+
+  backend.image.clear();
+  backend.matches = false;
+  CHECK_EQ(ScanValue(&session), "cover");
+  CHECK_EQ(ScanValue(&session), "cover");
+  CHECK_EQ(ScanValue(&session), "");
+  CHECK(session.candidate() == NULL);
+  /* Searching again once released */
+  CHECK_EQ(ScanValue(&session), "");
+  CHECK_EQ(backend.searches, 3);
+}
+
+TEST(tracking_does_not_confirm) {
+  ScriptedBackend backend;
+  ds::ScanSession session(&backend);
+  session.set_confirmations(3);
+  session.set_tracks(true);
+  backend.image = backend.image_ref = "cover";
+
+  /* Textured thumbnail, the same in every frame: always trackable */
+  uint8_t thumb[DS_THUMB_SIDE * DS_THUMB_SIDE];
+  uint32_t seed = 1;
+  for (int i = 0; i < DS_THUMB_SIDE * DS_THUMB_SIDE; i++) {
+    seed = seed * 1103515245u + 12345u;
+    thumb[i] = (uint8_t) (seed >> 16);
+  }
+
+  /* Until confirmed, each frame is matched rather than tracked */
+  CHECK_EQ(ScanValue(&session, NULL, thumb), "");
+  CHECK_EQ(ScanValue(&session, NULL, thumb), "");
+  CHECK_EQ(ScanValue(&session, NULL, thumb), "cover");
+  CHECK_EQ(backend.match_calls, 2);
+  CHECK_EQ(session.matches_skipped(), 0u);
+
+  /* Then tracking keeps the lock alive */
+  CHECK_EQ(ScanValue(&session, NULL, thumb), "cover");
+  CHECK_EQ(ScanValue(&session, NULL, thumb), "cover");
+  CHECK_EQ(backend.match_calls, 2);
+  CHECK_EQ(session.matches_skipped(), 2u);
+}
+
+TEST(snap_sends_next_frame_to_api_search) {
+  ScriptedBackend backend;
+  ds::ScanSession session(&backend);
+  backend.image = backend.image_ref = "cover";
+  CHECK_EQ(ScanValue(&session), "cover");
+
+  CHECK(session.Snap());
+  CHECK_EQ(session.state(), ds::ScanSession::kStateDefault);
+  CHECK(!session.CanCancel());
+
+  /* The snapped frame is not scanned */
+  int calls = backend.searches + backend.match_calls + backend.decodes;
+  CHECK_EQ(ScanValue(&session), "");
+  CHECK_EQ(session.state(), ds::ScanSession::kStateSearch);
+  CHECK(session.CanCancel());
+  CHECK(!session.Pause());
+  CHECK(!session.Snap());
+
+  session.SearchStarted();
+  CHECK(session.candidate() == NULL);
+  CHECK_EQ(ScanValue(&session), "");
+  CHECK_EQ(backend.searches + backend.match_calls + backend.decodes, calls);
+
+  /* Back to scanning from scratch */
+  session.SearchFinished();
+  CHECK_EQ(session.state(), ds::ScanSession::kStateDefault);
+  CHECK_EQ(ScanValue(&session), "cover");
+  CHECK_EQ(backend.searches, 2);
+}
+
+TEST(pause_and_resume) {
+  ScriptedBackend backend;
+  ds::ScanSession session(&backend);
+  backend.image = backend.image_ref = "cover";
+  CHECK_EQ(ScanValue(&session), "cover");
+
+  CHECK(session.Pause());
+  CHECK(!session.Pause());
+  CHECK(!session.Snap());
+  CHECK_EQ(ScanValue(&session), "");
+  CHECK_EQ(backend.match_calls, 0);
+
+  CHECK(session.Resume());
+  CHECK(!session.Resume());
+  CHECK(session.candidate() == NULL);
+  CHECK_EQ(ScanValue(&session), "cover");
+  CHECK_EQ(backend.searches, 2);
+}
+
+/* Drives the state changes as the main thread does, while the test scans */
+struct StateDriver {
+  ds::ScanSession *session;
+  int rounds;
+
+  static void *Run(void *arg) {
+    StateDriver *d = (StateDriver *) arg;
+    for (int i = 0; i < d->rounds; i++) {
+      if (d->session->Snap()) {
+        /* Wait for a scan to pick the snap up, unless it got paused */
+        for (int spins = 0; spins < 1000 && !d->session->CanCancel(); spins++) sched_yield();
+        if (d->session->CanCancel()) {
+          d->session->SearchStarted();
+          d->session->SearchFinished();
+        }
+      }
+      d->session->Pause();
+      sched_yield();
+      d->session->Resume();
+    }
+    return NULL;
+  }
+};
+
+TEST(state_changes_from_another_thread) {
+  ScriptedBackend backend;
+  ds::ScanSession session(&backend);
+  backend.image = backend.image_ref = "cover";
+
+  StateDriver driver = { &session, 2000 };
+  pthread_t thread;
+  CHECK_EQ(pthread_create(&thread, NULL, StateDriver::Run, &driver), 0);
+  for (int i = 0; i < 20000; i++) {
+    ScanValue(&session);
+    if (i % 16 == 0) sched_yield();
+  }
+  pthread_join(thread, NULL);
+
+  /* Whatever the interleaving, the session ends up resumed and consistent */
+  session.SearchFinished();
+  session.Resume();
+  CHECK_EQ(session.state(), ds::ScanSession::kStateDefault);
+  ScanValue(&session);
+  if (session.CanCancel()) {
+    session.SearchStarted();
+    session.SearchFinished();
+    ScanValue(&session);
+  }
+  CHECK_EQ(CandidateValue(session), "cover");
+}
+
+TEST(sequential_decode_only_after_search_misses) {
+  ScriptedBackend backend;
+  ds::ScanSession session(&backend);
+  backend.concurrent = true;  /* not used unless in parallel mode */
+  backend.ean13 = "3017620422003";
+
+  backend.image = backend.image_ref = "cover";
+  CHECK_EQ(ScanValue(&session), "cover");
+  CHECK_EQ(backend.decodes, 0);
+
+  ds::ScanSession other(&backend);
+  backend.image.clear();
+  CHECK_EQ(ScanValue(&other), "3017620422003");
+  CHECK_EQ(backend.decodes, 1);
+  CHECK_EQ(backend.started, 0);
+}
+
+TEST(parallel_decode_runs_during_search) {
+  ScriptedBackend backend;
+  ds::ScanSession session(&backend);
+  session.set_parallel(true);
+  backend.concurrent = true;
+  backend.ean13 = "3017620422003";
+
+  /* Image results win over barcodes found in the same frame */
+  backend.image = backend.image_ref = "cover";
+  CHECK_EQ(ScanValue(&session), "cover");
+  CHECK_EQ(backend.started, 1);
+  CHECK_EQ(backend.finished, 1);
+  CHECK_EQ(backend.decodes, 0);
+
+  ds::ScanSession other(&backend);
+  other.set_parallel(true);
+  backend.image.clear();
+  CHECK_EQ(ScanValue(&other), "3017620422003");
+  CHECK_EQ(backend.started, 2);
+  CHECK_EQ(backend.finished, 2);
+  CHECK_EQ(backend.decodes, 0);
+}
+
+TEST(parallel_falls_back_to_sequential_decode) {
+  ScriptedBackend backend;
+  ds::ScanSession session(&backend);
+  session.set_parallel(true);
+  backend.concurrent = true;
+  backend.concurrent_error = MS_MISUSE;
+  backend.ean13 = "3017620422003";
+
+  /* The concurrent decoding fails and disables itself: the barcode is
+   * decoded again once the search is over */
+  ms_errcode ecode = MS_ERROR;
+  CHECK_EQ(ScanValue(&session, &ecode), "3017620422003");
+  CHECK_EQ(ecode, MS_SUCCESS);
+  CHECK_EQ(backend.started, 1);
+  CHECK_EQ(backend.finished, 1);
+  CHECK_EQ(backend.decodes, 1);
+
+  /* From then on decoding is sequential */
+  CHECK_EQ(ScanValue(&session), "3017620422003");
+  CHECK_EQ(backend.started, 1);
+  CHECK_EQ(backend.decodes, 2);
+}
+
+TEST(parallel_error_is_reported) {
+  /* The backend may still decode concurrently, so the error stands */
+  class StickyBackend : public ScriptedBackend {
+   public:
+    virtual ms_errcode FinishDecode(double *seconds) {
+      ms_errcode ecode = ScriptedBackend::FinishDecode(seconds);
+      concurrent = true;
+      return ecode;
+    }
+  } sticky;
+  sticky.concurrent = true;
+  sticky.concurrent_error = MS_ERROR;
+  ds::ScanSession session(&sticky);
+  session.set_parallel(true);
+  ms_errcode ecode = MS_SUCCESS;
+  CHECK_EQ(ScanValue(&session, &ecode), "");
+  CHECK_EQ(ecode, MS_ERROR);
+  CHECK_EQ(sticky.decodes, 0);
+}
+
+TEST_MAIN()
@@ -0,0 +1,259 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Latency of discount lookups against the stand-in backend
+ * (tools/discount_server.c), cold versus warm, in the way HTTPClient sends
+ * them:
+ *
+ * - cold: each lookup opens a new connection (what stringWithContentsOfURL:
+ *   used to do),
+ * - prewarmed: a connection is opened ahead with a HEAD request on the host
+ *   root (see -[HTTPClient prewarmURL:]), then the first lookup is timed,
+ * - warm: lookups reuse a keep-alive connection.
+ *
+ * Give the server a connection delay (`-c`) to stand in for DNS, TCP and
+ * TLS setup on a real network, and a request delay (`-l`) for the backend.
+ * With `-s`, the server is started (and stopped) by the benchmark itself;
+ * the run then fails if any lookup fails, so that it can run as a test.
+ *
+ * Build and run from the repository root, e.g.:
+ *
+ *   gcc -std=c99 -O2 -pthread tools/discount_server.c -o discount_server
+ *   gcc -std=c99 -O2 tools/bench_http.c -o bench_http
+ *   ./bench_http -s ./discount_server -l 20 -c 150
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *host = "127.0.0.1";
+static int port = 8080;
+
+static double now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static int connect_server(void) {
+  struct sockaddr_in addr;
+  int one = 1;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons((uint16_t) port);
+  if (inet_pton(AF_INET, host, &addr.sin_addr) != 1 ||
+      connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+/* Send a request and read the response: returns the HTTP status, or -1 */
+static int request(int fd, const char *method, const char *path, int keep_alive) {
+  char buf[8192];
+  size_t size = 0, head = 0, length = 0;
+  int status = -1;
+  int n = snprintf(buf, sizeof(buf),
+                   "%s %s HTTP/1.1\r\n"
+                   "Host: %s:%d\r\n"
+                   "Accept: application/json\r\n"
+                   "Connection: %s\r\n"
+                   "\r\n",
+                   method, path, host, port, keep_alive ? "keep-alive" : "close");
+  if (write(fd, buf, (size_t) n) != n) return -1;
+
+  for (;;) {
+    char *end;
+    ssize_t r = read(fd, buf + size, sizeof(buf) - 1 - size);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return -1;
+    size += (size_t) r;
+    buf[size] = '\0';
+    if (head == 0 && (end = strstr(buf, "\r\n\r\n")) != NULL) {
+      char *cl;
+      head = (size_t) (end - buf) + 4;
+      if (sscanf(buf, "HTTP/1.%*d %d", &status) != 1) return -1;
+      cl = strstr(buf, "Content-Length:");
+      if (cl != NULL && cl < end) length = (size_t) strtoul(cl + 15, NULL, 10);
+      if (strcmp(method, "HEAD") == 0) length = 0;
+      if (head + length >= sizeof(buf)) return -1;
+    }
+    if (head > 0 && size >= head + length) return status;
+  }
+}
+
+static int compare(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+static void report(const char *name, double *ms, int n) {
+  double sum = 0;
+  int i;
+  for (i = 0; i < n; i++) sum += ms[i];
+  qsort(ms, (size_t) n, sizeof(*ms), compare);
+  printf("%-10s %8.2f %8.2f %8.2f %8.2f\n", name, sum / n, ms[n / 2], ms[(n * 95) / 100],
+         ms[n - 1]);
+}
+
+static void lookup_path(int i, char *path, size_t size) {
+  snprintf(path, size, "/api/discounts/bench/%013d", 3000000 + i);
+}
+
+/* Start the server and wait until it accepts connections */
+static pid_t spawn(const char *server, const char *request_delay, const char *connect_delay) {
+  char port_arg[16];
+  int i;
+  pid_t pid;
+  snprintf(port_arg, sizeof(port_arg), "%d", port);
+  pid = fork();
+  if (pid == 0) {
+    execl(server, server, "-p", port_arg, "-l", request_delay, "-c", connect_delay, (char *) NULL);
+    perror(server);
+    _exit(127);
+  }
+  for (i = 0; pid > 0 && i < 200; i++) {
+    struct timespec ts = { 0, 10000000L };
+    int fd = connect_server();
+    if (fd >= 0) {
+      /* A probe without any request, which the server just drops */
+      close(fd);
+      return pid;
+    }
+    nanosleep(&ts, NULL);
+  }
+  if (pid > 0) kill(pid, SIGTERM);
+  return -1;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-n lookups] [-p port] [-s server [-l ms] [-c ms]] [host]\n"
+          "  -n lookups  number of lookups of each kind (default: 50)\n"
+          "  -p port     port of the server (default: 8080)\n"
+          "  -s server   path of discount_server, to start it on that port\n"
+          "  -l ms       request delay of the started server (default: 20)\n"
+          "  -c ms       connection delay of the started server (default: 150)\n"
+          "host is an IPv4 address (default: 127.0.0.1)\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  const char *server = NULL, *request_delay = "20", *connect_delay = "150";
+  int lookups = 50, failures = 0, opt, i, fd;
+  double *ms;
+  pid_t pid = -1;
+  char path[64];
+
+  while ((opt = getopt(argc, argv, "n:p:s:l:c:h")) != -1) {
+    switch (opt) {
+      case 'n': lookups = atoi(optarg); break;
+      case 'p': port = atoi(optarg); break;
+      case 's': server = optarg; break;
+      case 'l': request_delay = optarg; break;
+      case 'c': connect_delay = optarg; break;
+      default: usage(argv[0]); return 2;
+    }
+  }
+  if (optind < argc) host = argv[optind++];
+  if (optind != argc || lookups < 1) {
+    usage(argv[0]);
+    return 2;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  if (server != NULL && (pid = spawn(server, request_delay, connect_delay)) < 0) {
+    fprintf(stderr, "cannot start %s on port %d\n", server, port);
+    return 1;
+  }
+
+  ms = malloc((size_t) lookups * sizeof(*ms));
+  printf("%d lookups of each kind against %s:%d (ms)\n", lookups, host, port);
+  printf("%-10s %8s %8s %8s %8s\n", "", "mean", "p50", "p95", "max");
+
+  /* Cold: a new connection per lookup */
+  for (i = 0; i < lookups; i++) {
+    double start = now();
+    lookup_path(i, path, sizeof(path));
+    fd = connect_server();
+    if (fd < 0 || request(fd, "GET", path, 0) != 200) failures++;
+    if (fd >= 0) close(fd);
+    ms[i] = (now() - start) * 1e3;
+  }
+  report("cold", ms, lookups);
+
+  /* Prewarmed: the connection is opened ahead, only the lookup is timed */
+  for (i = 0; i < lookups; i++) {
+    double start;
+    fd = connect_server();
+    if (fd < 0 || request(fd, "HEAD", "/", 1) != 200) failures++;
+    lookup_path(i, path, sizeof(path));
+    start = now();
+    if (fd < 0 || request(fd, "GET", path, 0) != 200) failures++;
+    ms[i] = (now() - start) * 1e3;
+    if (fd >= 0) close(fd);
+  }
+  report("prewarmed", ms, lookups);
+
+  /* Warm: a single keep-alive connection */
+  fd = connect_server();
+  if (fd < 0 || request(fd, "HEAD", "/", 1) != 200) failures++;
+  for (i = 0; i < lookups; i++) {
+    double start = now();
+    lookup_path(i, path, sizeof(path));
+    if (fd < 0 || request(fd, "GET", path, 1) != 200) failures++;
+    ms[i] = (now() - start) * 1e3;
+  }
+  if (fd >= 0) close(fd);
+  report("warm", ms, lookups);
+
+  free(ms);
+  if (pid > 0) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+  }
+  if (failures > 0) {
+    fprintf(stderr, "FAILED: %d request(s) failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
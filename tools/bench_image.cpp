@@ -0,0 +1,259 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Throughput benchmark of the image preprocessing kernels (ds_image.h):
+ * SIMD versus scalar reference, in megapixels per second.
+ *
+ * Before timing anything, the output of each SIMD kernel is compared byte
+ * for byte with the scalar reference, over odd sizes and unaligned buffers
+ * and strides. Any mismatch is reported and makes the benchmark exit with
+ * a non-zero status (`-c` only runs this check, e.g. as a test).
+ *
+ * Build and run from the repository root, e.g.:
+ *
+ *   g++ -O2 -march=native -I Core tools/bench_image.cpp Core/ds_image.cpp -o bench_image
+ *   ./bench_image [-c] [width height]
+ */
+
+#include "ds_image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <vector>
+
+static double now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/* Run `fn` repeatedly for about half a second and return Mpixel/s */
+template <typename Fn>
+static double bench(Fn fn, double pixels) {
+  fn();
+  int runs = 0;
+  double start = now(), elapsed = 0;
+  do {
+    fn();
+    runs++;
+    elapsed = now() - start;
+  } while (elapsed < 0.5);
+  return pixels * runs / elapsed / 1e6;
+}
+
+struct Gray {
+  const uint8_t *src; int w, h; uint8_t *dst; bool ref;
+  void operator()() const {
+    if (ref) ds_bgra_to_gray_ref(src, w, h, 4 * w, dst, w);
+    else ds_bgra_to_gray(src, w, h, 4 * w, dst, w);
+  }
+};
+
+struct Rotate {
+  const uint8_t *src; int w, h; ds_rotation rot; uint8_t *dst; bool ref;
+  void operator()() const {
+    int bpr = (rot == DS_ROTATE_90 || rot == DS_ROTATE_270) ? h : w;
+    if (ref) ds_rotate_to_gray_ref(src, w, h, 4 * w, DS_PIX_BGRA, rot, dst, bpr);
+    else ds_rotate_to_gray(src, w, h, 4 * w, DS_PIX_BGRA, rot, dst, bpr);
+  }
+};
+
+struct Downscale {
+  const uint8_t *src; int w, h; uint8_t *dst; bool ref;
+  void operator()() const {
+    if (ref) ds_gray_downscale_2x_ref(src, w, h, w, dst, w / 2);
+    else ds_gray_downscale_2x(src, w, h, w, dst, w / 2);
+  }
+};
+
+/*************************************************
+ * Check against the scalar reference
+ *************************************************/
+
+/* Misalignment of the buffers (bytes) and extra bytes per row, so that the
+ * SIMD kernels have to deal with unaligned loads, stores and row starts */
+static const int kOffsets[] = { 0, 1, 3 };
+static const int kPaddings[] = { 0, 1, 5 };
+
+/* Filler of the destination buffers, to catch writes out of the image */
+static const uint8_t kGuard = 0xa5;
+
+struct Layout {
+  int w, h;
+  int src_offset, src_pad;
+  int dst_offset, dst_pad;
+};
+
+static int mismatches = 0;
+
+/* Compare the whole destination buffers, padding and guard bytes included */
+static void compare(const char *kernel, const Layout &l, const std::vector<uint8_t> &simd,
+                    const std::vector<uint8_t> &ref, int dst_bpr) {
+  if (memcmp(&simd[0], &ref[0], simd.size()) == 0) return;
+  size_t i = 0;
+  while (simd[i] == ref[i]) i++;
+  long pos = (long) i - l.dst_offset;
+  if (mismatches++ < 20) {
+    fprintf(stderr,
+            "MISMATCH %s %dx%d (src +%d, pad %d; dst +%d, pad %d): byte %ld (row %ld, col %ld)"
+            " simd %d != ref %d\n",
+            kernel, l.w, l.h, l.src_offset, l.src_pad, l.dst_offset, l.dst_pad, pos,
+            pos / dst_bpr, pos % dst_bpr, simd[i], ref[i]);
+  }
+}
+
+static void check_layout(const Layout &l) {
+  static const char *rotations[] = { "rotate_0", "rotate_90", "rotate_180", "rotate_270" };
+  char name[64];
+
+  /* Sources: BGRA and gray, with random pixels */
+  int bgra_bpr = 4 * l.w + l.src_pad;
+  int gray_bpr = l.w + l.src_pad;
+  std::vector<uint8_t> bgra(l.src_offset + (size_t) bgra_bpr * l.h);
+  std::vector<uint8_t> gray(l.src_offset + (size_t) gray_bpr * l.h);
+  for (size_t i = 0; i < bgra.size(); i++) bgra[i] = (uint8_t) rand();
+  for (size_t i = 0; i < gray.size(); i++) gray[i] = (uint8_t) rand();
+  const uint8_t *bgra_src = &bgra[l.src_offset];
+  const uint8_t *gray_src = &gray[l.src_offset];
+
+  /* Destinations large enough for a rotated image, plus guard bytes */
+  int side = l.w > l.h ? l.w : l.h;
+  int dst_bpr = side + l.dst_pad;
+  size_t dst_size = l.dst_offset + (size_t) dst_bpr * side + 64;
+  std::vector<uint8_t> simd(dst_size), ref(dst_size);
+
+  simd.assign(dst_size, kGuard);
+  ref.assign(dst_size, kGuard);
+  ds_bgra_to_gray(bgra_src, l.w, l.h, bgra_bpr, &simd[l.dst_offset], dst_bpr);
+  ds_bgra_to_gray_ref(bgra_src, l.w, l.h, bgra_bpr, &ref[l.dst_offset], dst_bpr);
+  compare("bgra_to_gray", l, simd, ref, dst_bpr);
+
+  for (int r = 0; r < 4; r++) {
+    for (int f = 0; f < 2; f++) {
+      ds_pix_fmt fmt = f ? DS_PIX_GRAY : DS_PIX_BGRA;
+      const uint8_t *src = f ? gray_src : bgra_src;
+      int bpr = f ? gray_bpr : bgra_bpr;
+      simd.assign(dst_size, kGuard);
+      ref.assign(dst_size, kGuard);
+      ds_rotate_to_gray(src, l.w, l.h, bpr, fmt, (ds_rotation) r, &simd[l.dst_offset], dst_bpr);
+      ds_rotate_to_gray_ref(src, l.w, l.h, bpr, fmt, (ds_rotation) r, &ref[l.dst_offset],
+                            dst_bpr);
+      snprintf(name, sizeof(name), "%s (%s)", rotations[r], f ? "gray" : "bgra");
+      compare(name, l, simd, ref, dst_bpr);
+    }
+  }
+
+  simd.assign(dst_size, kGuard);
+  ref.assign(dst_size, kGuard);
+  ds_gray_downscale_2x(gray_src, l.w, l.h, gray_bpr, &simd[l.dst_offset], dst_bpr);
+  ds_gray_downscale_2x_ref(gray_src, l.w, l.h, gray_bpr, &ref[l.dst_offset], dst_bpr);
+  compare("downscale_2x", l, simd, ref, dst_bpr);
+}
+
+/* Returns the number of layouts checked */
+static int check(int bench_w, int bench_h) {
+  /* Around the SIMD widths (up to 32 pixels per iteration), and odd */
+  const int widths[] = { 1, 2, 3, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 65, 97, 129, 255 };
+  const int heights[] = { 1, 2, 3, 8, 17 };
+  int layouts = 0;
+  for (size_t wi = 0; wi < sizeof(widths) / sizeof(widths[0]); wi++) {
+    for (size_t hi = 0; hi < sizeof(heights) / sizeof(heights[0]); hi++) {
+      for (size_t so = 0; so < sizeof(kOffsets) / sizeof(kOffsets[0]); so++) {
+        for (size_t sp = 0; sp < sizeof(kPaddings) / sizeof(kPaddings[0]); sp++) {
+          /* Vary the destination along with the source to keep it short */
+          Layout l = { widths[wi], heights[hi], kOffsets[so], kPaddings[sp],
+                       kOffsets[(so + sp) % 3], kPaddings[(so + 2 * sp) % 3] };
+          check_layout(l);
+          layouts++;
+        }
+      }
+    }
+  }
+  /* The benchmarked size itself, aligned and not */
+  Layout aligned = { bench_w, bench_h, 0, 0, 0, 0 };
+  Layout unaligned = { bench_w, bench_h, 1, 3, 3, 1 };
+  check_layout(aligned);
+  check_layout(unaligned);
+  return layouts + 2;
+}
+
+/*************************************************
+ * Benchmark
+ *************************************************/
+
+static void report(const char *name, double simd, double ref) {
+  printf("%-16s %10.1f %10.1f %8.2fx\n", name, simd, ref, simd / ref);
+}
+
+int main(int argc, char **argv) {
+  bool check_only = argc > 1 && strcmp(argv[1], "-c") == 0;
+  if (check_only) {
+    argc--;
+    argv++;
+  }
+  int w = argc > 2 ? atoi(argv[1]) : 1280;
+  int h = argc > 2 ? atoi(argv[2]) : 720;
+  if (w <= 0 || h <= 0) {
+    fprintf(stderr, "usage: %s [-c] [width height]\n", argv[0]);
+    return 1;
+  }
+
+  int layouts = check(w, h);
+  if (mismatches > 0) {
+    fprintf(stderr, "FAILED: %d mismatches between the %s kernels and the scalar reference\n",
+            mismatches, ds_image_simd());
+    return 1;
+  }
+  printf("%s kernels match the scalar reference (%d layouts)\n", ds_image_simd(), layouts);
+  if (check_only) return 0;
+
+  std::vector<uint8_t> bgra(4 * (size_t) w * h);
+  for (size_t i = 0; i < bgra.size(); i++) bgra[i] = (uint8_t) rand();
+  std::vector<uint8_t> gray((size_t) w * h);
+  std::vector<uint8_t> dst((size_t) w * h);
+  double px = (double) w * h;
+
+  printf("%dx%d, %s (Mpixel/s)\n", w, h, ds_image_simd());
+  printf("%-16s %10s %10s %9s\n", "kernel", "simd", "scalar", "speedup");
+
+  Gray g1 = { &bgra[0], w, h, &gray[0], false }, g2 = g1;
+  g2.ref = true;
+  report("bgra_to_gray", bench(g1, px), bench(g2, px));
+
+  const char *names[] = { "rotate_0", "rotate_90", "rotate_180", "rotate_270" };
+  for (int r = 0; r < 4; r++) {
+    Rotate r1 = { &bgra[0], w, h, (ds_rotation) r, &dst[0], false }, r2 = r1;
+    r2.ref = true;
+    report(names[r], bench(r1, px), bench(r2, px));
+  }
+
+  Downscale d1 = { &gray[0], w, h, &dst[0], false }, d2 = d1;
+  d2.ref = true;
+  report("downscale_2x", bench(d1, px), bench(d2, px));
+
+  return 0;
+}
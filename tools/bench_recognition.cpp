@@ -0,0 +1,392 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+/*
+ * Time-to-recognition benchmark: runs labeled frame recordings (see
+ * ds_record.h) through the scan pipeline under several strategies, on top
+ * of the stand-in SDK (see sdk_standin.h), and reports what shoppers
+ * experience rather than the cost of a frame:
+ *
+ * - time to the first correct result of each product segment, from the
+ *   moment the product comes into view (the start of the segment),
+ * - false lock rate, i.e. the share of the results shown that are not the
+ *   product in view (or that show up while no product is),
+ * - scanning time spent per recognized product, from the start of its
+ *   segment to its first correct result.
+ *
+ * The camera is simulated on a virtual clock: frames arrive at their
+ * recorded time, each scan keeps the scanner busy for the time it actually
+ * took, and frames that arrive meanwhile are replaced by newer ones as in
+ * the app (see ds_mailbox.h). Use `-d` so that the stand-in SDK costs about
+ * as much as on a device.
+ *
+ * Each recording comes with a `<recording>.labels` text file, with one
+ * segment per line, in seconds from the first frame:
+ *
+ *   # start end product
+ *   0.0 2.0 -
+ *   2.0 5.0 9782070360024
+ *
+ * where the product is the expected image ID or barcode data, or `-` if no
+ * product is in view.
+ *
+ * Build and run from the repository root, e.g.:
+ *
+ *   gcc -std=c99 -O2 -I . -I Core -c tools/sdk_standin.c Core/ds_record.c
+ *   g++ -O2 -I . -I Core -I tools tools/bench_recognition.cpp Core/ds_session.cpp \
+ *       Core/ds_dhash.cpp Core/ds_track.cpp Core/ds_strategy.cpp Core/ds_quality.cpp \
+ *       Core/ds_sched.cpp Core/ds_image.cpp Core/ds_trace.cpp sdk_standin.o ds_record.o -lpthread \
+ *       -o bench_recognition
+ *   ./bench_recognition -d -s server/ aisle.dsrec checkout.dsrec
+ */
+
+#include "sdk_standin.h"
+#include "scan_pipeline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/* Labeled segment of a recording */
+struct Segment {
+  double start;
+  double end;
+  std::string product;   /* empty if no product is in view */
+};
+
+/* Pipeline settings compared by the benchmark */
+struct Strategy {
+  const char *name;
+  const char *description;
+  PipelineOptions options;
+  int skip;              /* scan one camera frame out of `skip` */
+};
+
+/* Measures of a strategy over the whole corpus */
+struct Measures {
+  std::vector<double> ttr;   /* time to first correct result, per recognized segment */
+  std::vector<double> cost;  /* scanning time until then, per recognized segment */
+  uint32_t segments;         /* product segments */
+  uint32_t results;          /* results shown */
+  uint32_t false_locks;      /* results that are not the product in view */
+  uint32_t scanned;
+  double cost_total;         /* scanning time over the whole corpus */
+
+  Measures() : segments(0), results(0), false_locks(0), scanned(0), cost_total(0) {}
+};
+
+static std::vector<Strategy> strategies(void) {
+  std::vector<Strategy> all;
+  Strategy s;
+  s.skip = 1;
+
+  /* As shipped (see MSScannerController.m) */
+  s.name = "default";
+  s.description = "app settings";
+  all.push_back(s);
+
+  /* Lock hysteresis */
+  s.name = "confirm-1";
+  s.description = "results shown as soon as found";
+  s.options = PipelineOptions();
+  s.options.confirmations = 1;
+  all.push_back(s);
+  s.name = "confirm-5";
+  s.description = "results found on 5 frames before being shown";
+  s.options = PipelineOptions();
+  s.options.confirmations = 5;
+  all.push_back(s);
+  s.name = "release-1";
+  s.description = "locks released on the first miss";
+  s.options = PipelineOptions();
+  s.options.max_losts = 1;
+  all.push_back(s);
+  s.name = "release-4";
+  s.description = "locks released after 4 misses in a row";
+  s.options = PipelineOptions();
+  s.options.max_losts = 4;
+  all.push_back(s);
+
+  /* Frame skipping */
+  s.name = "every-frame";
+  s.description = "no scan scheduler nor sharpness gate";
+  s.options = PipelineOptions();
+  s.options.schedule = false;
+  s.options.sharpness_gate = false;
+  all.push_back(s);
+  s.name = "no-gate";
+  s.description = "no sharpness gate";
+  s.options = PipelineOptions();
+  s.options.sharpness_gate = false;
+  all.push_back(s);
+  s.name = "skip-2";
+  s.description = "one camera frame out of 2";
+  s.options = PipelineOptions();
+  s.skip = 2;
+  all.push_back(s);
+  s.name = "skip-4";
+  s.description = "one camera frame out of 4";
+  s.skip = 4;
+  all.push_back(s);
+  s.skip = 1;
+
+  /* Decoder ordering */
+  s.name = "serial";
+  s.description = "barcodes decoded after the image search";
+  s.options = PipelineOptions();
+  s.options.parallel = false;
+  all.push_back(s);
+  s.name = "all-formats";
+  s.description = "every format run on every frame (not adaptive)";
+  s.options = PipelineOptions();
+  s.options.adaptive = false;
+  all.push_back(s);
+  s.name = "no-track";
+  s.description = "locked images matched on every frame";
+  s.options = PipelineOptions();
+  s.options.tracks = false;
+  all.push_back(s);
+  return all;
+}
+
+static bool load_labels(const std::string &path, std::vector<Segment> *segments) {
+  FILE *f = fopen(path.c_str(), "r");
+  if (!f) return false;
+  char line[1024];
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), f)) {
+    char product[900];
+    Segment seg;
+    if (line[0] == '#' || strspn(line, " \t\r\n") == strlen(line)) continue;
+    if (sscanf(line, "%lf %lf %899s", &seg.start, &seg.end, product) != 3 || seg.end < seg.start) {
+      ok = false;
+      break;
+    }
+    if (strcmp(product, "-") != 0) seg.product = product;
+    segments->push_back(seg);
+  }
+  fclose(f);
+  return ok;
+}
+
+/* Index of the segment in view at time `t` (-1 if none) */
+static int segment_at(const std::vector<Segment> &segments, double t) {
+  for (size_t i = 0; i < segments.size(); i++) {
+    if (t >= segments[i].start && t < segments[i].end) return (int) i;
+  }
+  return -1;
+}
+
+static bool run(const char *path, const std::vector<Segment> &segments, const Strategy &strategy,
+                ms_scanner_t *scanner, bool verbose, Measures *m) {
+  ds_record_reader_t *reader = NULL;
+  ds_errcode err = ds_record_reader_open(path, &reader);
+  if (err != DS_SUCCESS) return false;
+
+  ScanPipeline pipeline(scanner, strategy.options);
+  std::vector<double> cost(segments.size(), 0);
+  std::vector<bool> recognized(segments.size(), false);
+  for (size_t i = 0; i < segments.size(); i++) {
+    if (!segments[i].product.empty()) m->segments++;
+  }
+
+  OwnedFrame cur, next;
+  ds_frame_t f;
+  bool have = (err = ds_record_reader_next(reader, &f)) == DS_SUCCESS;
+  if (have) cur.Assign(f);
+  int64_t ts0 = have ? cur.frame.timestamp : 0;
+  double busy = 0;  /* virtual time at which the scanner is free again */
+  ds::ScanResult last;
+  for (uint32_t index = 0; have; index++) {
+    bool have_next = (err = ds_record_reader_next(reader, &f)) == DS_SUCCESS;
+    if (have_next) next.Assign(f);
+
+    double t = (cur.frame.timestamp - ts0) * 1e-6;
+    bool delivered = (index % strategy.skip == 0);
+    /* The scanner picks the newest frame up once it is free */
+    bool replaced = have_next && (next.frame.timestamp - ts0) * 1e-6 <= busy;
+    if (delivered && !replaced) {
+      double start = std::max(t, busy);
+      const ds::ScanResult *result = NULL;
+      ms_errcode ecode;
+      ScanPipeline::Fate fate = pipeline.Process(cur.frame, start, &result, &ecode);
+      const FrameTimes &times = pipeline.times();
+      double spent = times.image + times.search + times.match + times.decode;
+      busy = start + times.total;
+      m->cost_total += spent;
+      int seg = segment_at(segments, t);
+      if (seg >= 0 && !recognized[seg]) cost[seg] += spent;
+
+      if (fate == ScanPipeline::kScanned) {
+        m->scanned++;
+        if (result && *result != last) {
+          m->results++;
+          const Segment *in_view = (seg >= 0) ? &segments[seg] : NULL;
+          if (in_view && result->value == in_view->product) {
+            if (!recognized[seg]) {
+              recognized[seg] = true;
+              m->ttr.push_back(busy - in_view->start);
+              m->cost.push_back(cost[seg]);
+              if (verbose)
+                printf("  %-12s %s: %s after %.0f ms\n", strategy.name, path,
+                       result->value.c_str(), 1e3 * (busy - in_view->start));
+            }
+          }
+          else {
+            m->false_locks++;
+            if (verbose)
+              printf("  %-12s %s: false lock on %s at %.3f s\n", strategy.name, path,
+                     result->value.c_str(), t);
+          }
+        }
+        if (result)
+          last = *result;
+        else
+          last.Clear();
+      }
+    }
+
+    cur.Swap(next);
+    have = have_next;
+  }
+  ds_record_reader_close(reader);
+  if (err != DS_NOREC) fprintf(stderr, "%s: recording cut short (error %d)\n", path, err);
+  return true;
+}
+
+static double percentile(std::vector<double> values, double p) {
+  std::sort(values.begin(), values.end());
+  return values[(size_t) (p * (values.size() - 1) + 0.5)];
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-d] [-v] [-s server] [-S strategy,...] recording...\n"
+          "  -d         mimic the latency of a device (see ms_standin_device_latency)\n"
+          "  -v         print every recognition and false lock\n"
+          "  -s server  stand-in server directory (default: $MS_STANDIN_SERVER)\n"
+          "  -S list    comma-separated strategies to run (default: all)\n"
+          "  -l         list the strategies\n"
+          "Each recording needs a `<recording>.labels` file.\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  std::vector<Strategy> all = strategies();
+  bool device = false, verbose = false;
+  const char *server = NULL, *only = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "dvs:S:lh")) != -1) {
+    switch (opt) {
+      case 'd': device = true; break;
+      case 'v': verbose = true; break;
+      case 's': server = optarg; break;
+      case 'S': only = optarg; break;
+      case 'l':
+        for (size_t i = 0; i < all.size(); i++) printf("%-12s %s\n", all[i].name, all[i].description);
+        return 0;
+      default: usage(argv[0]); return 2;
+    }
+  }
+  if (optind >= argc) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::vector<Strategy> selected;
+  for (size_t i = 0; i < all.size(); i++) {
+    if (only) {
+      std::string list = std::string(",") + only + ",";
+      if (list.find(std::string(",") + all[i].name + ",") == std::string::npos) continue;
+    }
+    selected.push_back(all[i]);
+  }
+  if (selected.empty()) {
+    fprintf(stderr, "no such strategy (see -l)\n");
+    return 2;
+  }
+
+  std::vector<std::vector<Segment> > labels(argc - optind);
+  for (int i = optind; i < argc; i++) {
+    std::string path = std::string(argv[i]) + ".labels";
+    if (!load_labels(path, &labels[i - optind])) {
+      fprintf(stderr, "cannot read %s\n", path.c_str());
+      return 1;
+    }
+  }
+
+  /* Scanner with a throwaway database, synchronized with the server */
+  if (server) ms_standin_set_server(server);
+  char db[64];
+  snprintf(db, sizeof(db), "/tmp/bench_recognition-%d.db", (int) getpid());
+  ms_scanner_t *scanner = NULL;
+  ms_errcode ecode = ms_scanner_new(&scanner);
+  if (ecode == MS_SUCCESS) ecode = ms_scanner_open(scanner, db, "bench", "bench");
+  if (ecode == MS_SUCCESS) ecode = ms_scanner_sync(scanner);
+  if (ecode != MS_SUCCESS) {
+    fprintf(stderr, "cannot set the scanner up: %s\n", ms_errmsg(ecode));
+    return 1;
+  }
+  ms_standin_latency_t latency;
+  ms_standin_device_latency(&latency);
+  if (device) ms_standin_set_latency(&latency);
+
+  printf("strategy      found     time to result (ms)    scanning time (ms)     false locks  ms/product\n");
+  printf("                         p50     p95     p99     p50     p95     p99\n");
+  for (size_t s = 0; s < selected.size(); s++) {
+    Measures m;
+    for (int i = optind; i < argc; i++) {
+      if (!run(argv[i], labels[i - optind], selected[s], scanner, verbose, &m)) {
+        fprintf(stderr, "cannot open %s\n", argv[i]);
+        return 1;
+      }
+    }
+
+    printf("%-12s %3lu/%-3u", selected[s].name, (unsigned long) m.ttr.size(), m.segments);
+    if (m.ttr.empty()) {
+      printf("       -       -       -       -       -       -");
+    }
+    else {
+      printf(" %7.0f %7.0f %7.0f %7.1f %7.1f %7.1f",
+             1e3 * percentile(m.ttr, 0.5), 1e3 * percentile(m.ttr, 0.95), 1e3 * percentile(m.ttr, 0.99),
+             1e3 * percentile(m.cost, 0.5), 1e3 * percentile(m.cost, 0.95), 1e3 * percentile(m.cost, 0.99));
+    }
+    printf("   %3u/%-3u %4.1f%%", m.false_locks, m.results,
+           m.results ? 100.0 * m.false_locks / m.results : 0.0);
+    if (m.ttr.empty())
+      printf("          -\n");
+    else
+      printf(" %10.1f\n", 1e3 * m.cost_total / m.ttr.size());
+  }
+
+  ms_scanner_del(scanner);
+  ms_scanner_clean(db);
+  return 0;
+}
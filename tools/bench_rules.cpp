@@ -0,0 +1,146 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Cost of evaluating the discount rules (ds_rules.h) as the number of rules
+ * grows, in nanoseconds per evaluation, along with the parsing time. The
+ * rules are generated: mostly per-product rules with a mix of categories,
+ * segments, hours windows, week days and time ranges, plus a few rules on
+ * any product. Only the rules of the product, of its categories and of any
+ * product are checked, so the evaluation cost follows the number of rules
+ * per product and category (which the generator grows along with the total,
+ * for category rules) and the index lookups, not the total number of rules.
+ *
+ * Build and run from the repository root, e.g.:
+ *
+ *   g++ -O2 -I Core tools/bench_rules.cpp Core/ds_rules.cpp -o bench_rules
+ *   ./bench_rules
+ */
+
+#include "ds_rules.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+static double now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static const int kCategories = 200;
+static const int64_t kTime = 1356998400;  /* 2013-01-01 00:00 UTC */
+
+static std::string Product(int i) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%013d", i);
+  return buf;
+}
+
+/* Generate `n` rules over `n / 2` products (deterministic) */
+static std::string Generate(int n) {
+  std::string text = "segments gold,student\n";
+  char line[256];
+  int products = n / 2 > 0 ? n / 2 : 1;
+  unsigned seed = 42;
+  for (int p = 0; p < products; p++) {
+    snprintf(line, sizeof(line), "category %s c%d,c%d\n", Product(p).c_str(),
+             p % kCategories, (p * 7 + 3) % kCategories);
+    text += line;
+  }
+  for (int i = 0; i < n; i++) {
+    seed = seed * 1103515245 + 12345;
+    unsigned r = seed >> 8;
+    int off = 5 + r % 50;
+    switch (i % 8) {
+      case 0:
+        snprintf(line, sizeof(line), "rule off=%d category=c%d segment=gold\n", off,
+                 (int) (r % kCategories));
+        break;
+      case 1:
+        snprintf(line, sizeof(line), "rule off=%d product=%s hours=%d-%d\n", off,
+                 Product(r % products).c_str(), (int) (r % 24), (int) (r % 24) + 1);
+        break;
+      case 2:
+        snprintf(line, sizeof(line), "rule off=%d product=%s days=06 priority=1\n", off,
+                 Product(r % products).c_str());
+        break;
+      case 3:
+        snprintf(line, sizeof(line), "rule off=%d product=%s from=%lld until=%lld\n", off,
+                 Product(r % products).c_str(), (long long) kTime - 86400,
+                 (long long) kTime + (int64_t) (r % 30) * 86400);
+        break;
+      default:
+        snprintf(line, sizeof(line), "rule off=%d product=%s segment=student\n", off,
+                 Product(r % products).c_str());
+        break;
+    }
+    text += line;
+  }
+  text += "rule off=1 hours=22-2\n";
+  text += "rule off=2 days=0\n";
+  return text;
+}
+
+static void run(int n) {
+  std::string text = Generate(n);
+  ds::RuleSet rules;
+  std::string error;
+  double start = now();
+  if (!rules.Parse(text, &error)) {
+    fprintf(stderr, "parse error: %s\n", error.c_str());
+    exit(1);
+  }
+  double parse = now() - start;
+
+  int products = n / 2 > 0 ? n / 2 : 1;
+  std::vector<std::string> names;
+  for (int p = 0; p < 1024; p++) names.push_back(Product((p * 7919) % products));
+
+  ds::RuleContext ctx;
+  ctx.segments = rules.segments();
+  long evaluations = 0;
+  long total = 0;
+  double elapsed = 0;
+  start = now();
+  do {
+    for (int i = 0; i < 1024; i++, evaluations++) {
+      ctx.time = kTime + (evaluations % 48) * 1800;
+      int off = rules.Evaluate(names[i], ctx);
+      if (off > 0) total += off;
+    }
+    elapsed = now() - start;
+  } while (elapsed < 0.5);
+
+  printf("%8d %10.2f %12.0f %10.1f\n", (int) rules.size(), parse * 1e3,
+         elapsed / evaluations * 1e9, (double) total / evaluations);
+}
+
+int main(void) {
+  printf("%8s %10s %12s %10s\n", "rules", "parse ms", "ns/evaluate", "avg off");
+  const int sizes[] = { 100, 1000, 10000, 100000 };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) run(sizes[i]);
+  return 0;
+}
@@ -0,0 +1,204 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Per-frame overhead of the scan session logic (ds_session.h), in
+ * nanoseconds per frame, for a few typical situations. The recognition
+ * backend is a scripted fake that answers instantly, so that only the
+ * session bookkeeping (locks, tracking, deduplication, strategy, result
+ * buffers) is measured.
+ *
+ * The `allocs` column counts the heap allocations (operator new) per frame,
+ * which should be 0 (tests/test_alloc.cpp checks it for the whole scan
+ * path): the session runs on the scan thread for every camera frame (see
+ * `scanLoop` in MSScannerController.m).
+ *
+ * Build and run from the repository root, e.g.:
+ *
+ *   g++ -O2 -I . -I Core tools/bench_session.cpp Core/ds_session.cpp \
+ *       Core/ds_dhash.cpp Core/ds_track.cpp Core/ds_strategy.cpp -o bench_session
+ *   ./bench_session
+ */
+
+#include "ds_session.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <new>
+
+/* Count the allocations made through operator new (the session is C++) */
+static unsigned long allocations = 0;
+
+void *operator new(size_t size) {
+  allocations++;
+  void *p = malloc(size ? size : 1);
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void *p) throw() {
+  free(p);
+}
+
+void operator delete[](void *p) throw() {
+  free(p);
+}
+
+#if __cplusplus >= 201402L
+void operator delete(void *p, size_t) throw() {
+  free(p);
+}
+
+void operator delete[](void *p, size_t) throw() {
+  free(p);
+}
+#endif
+
+static double now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/* Backend whose answers are fixed by the scenario */
+class FakeBackend : public ds::ScanBackend {
+ public:
+  FakeBackend() : image(false), barcode(false), matches(true), clock(0) {}
+
+  virtual ms_errcode Search(const ds::ScanFrame &, ds::ScanResult *result) {
+    if (image) {
+      result->type = ds::kResultImage;
+      result->value.assign("9782070360024");
+    }
+    else {
+      result->Clear();
+    }
+    return MS_SUCCESS;
+  }
+
+  virtual ms_errcode Match(const ds::ScanFrame &, const ds::ScanResult &, bool *matched) {
+    *matched = matches;
+    return MS_SUCCESS;
+  }
+
+  virtual ms_errcode Decode(const ds::ScanFrame &, int formats, ds::ScanResult *result) {
+    if (barcode && (formats & ds::kResultEAN13)) {
+      result->type = ds::kResultEAN13;
+      result->value.assign("3017620422003");
+    }
+    else {
+      result->Clear();
+    }
+    return MS_SUCCESS;
+  }
+
+  /* A fake clock is enough (and cheaper than a real one) */
+  virtual double Now() { return clock += 1.0 / 30; }
+
+  bool image;
+  bool barcode;
+  bool matches;
+  double clock;
+};
+
+struct Scenario {
+  const char *name;
+  bool image;          /* the search finds an image */
+  bool barcode;        /* the decoder finds an EAN-13 */
+  bool moving;         /* the frames change (hash and thumbnail) */
+  bool tracks;
+  bool deduplicates;
+  bool adaptive;
+};
+
+static const int kFormats = ds::kResultImage | ds::kResultEAN13 | ds::kResultQRCode;
+
+static void run(const Scenario &sc) {
+  FakeBackend backend;
+  backend.image = sc.image;
+  backend.barcode = sc.barcode;
+
+  ds::ScanSession session(&backend);
+  session.set_confirmations(3);
+  session.set_tracks(sc.tracks);
+  session.set_deduplicates(sc.deduplicates);
+  session.set_adaptive(sc.adaptive);
+
+  /* Two textured thumbnails, shifted by a pixel, to alternate between */
+  uint8_t thumbs[2][DS_THUMB_SIDE * DS_THUMB_SIDE];
+  for (int y = 0; y < DS_THUMB_SIDE; y++) {
+    for (int x = 0; x < DS_THUMB_SIDE; x++) {
+      thumbs[0][y * DS_THUMB_SIDE + x] = (uint8_t) ((x * 7 + y * 13 + (x * y) / 5) & 0xff);
+      thumbs[1][y * DS_THUMB_SIDE + x] = (uint8_t) (((x + 1) * 7 + y * 13 + ((x + 1) * y) / 5) & 0xff);
+    }
+  }
+
+  ds::ScanFrame frame;
+  int frames = 0;
+  int results = 0;
+  unsigned long allocated = allocations;
+  double start = now(), elapsed = 0;
+  do {
+    for (int i = 0; i < 1000; i++, frames++) {
+      frame.dhash = sc.moving ? 0x0123456789abcdefULL ^ (uint64_t) (frames & 0xff) << 20
+                              : 0x0123456789abcdefULL;
+      frame.thumb = thumbs[sc.moving ? frames & 1 : 0];
+      const ds::ScanResult *result = NULL;
+      session.Scan(frame, kFormats, &result);
+      if (result) results++;
+    }
+    elapsed = now() - start;
+  } while (elapsed < 0.5);
+  allocated = allocations - allocated;
+
+  printf("%-24s %10.0f %8.3f %8.1f%% %10u %10u %10u\n", sc.name, elapsed / frames * 1e9,
+         (double) allocated / frames, 100.0 * results / frames, session.searches_skipped(),
+         session.matches_skipped(), session.formats_skipped());
+}
+
+int main(void) {
+  const Scenario scenarios[] = {
+    /* name                    image  barcode moving tracks dedup  adaptive */
+    { "nothing",               false, false,  true,  false, false, false },
+    { "nothing, dedup",        false, false,  false, false, true,  false },
+    { "image lock",            true,  false,  true,  false, false, false },
+    { "image lock, tracking",  true,  false,  true,  true,  false, false },
+    { "barcode",               false, true,   true,  false, false, false },
+    { "barcode, adaptive",     false, true,   true,  false, false, true  },
+  };
+
+  printf("%-24s %10s %8s %9s %10s %10s %10s\n", "scenario", "ns/frame", "allocs", "results",
+         "searches-", "matches-", "formats-");
+  for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+    run(scenarios[i]);
+
+  return 0;
+}
@@ -0,0 +1,311 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Cost of the discount table (ds_table.h) versus parsing the same discounts
+ * from JSON into a dictionary, as the app did before (one object mapping
+ * product IDs to discounts, see DiscountPrefetch): time to get ready for
+ * lookups (open versus read and parse), memory used, and time per lookup,
+ * for catalogs of increasing size.
+ *
+ * The JSON path is a minimal parser into an open-addressing hash table of
+ * copied strings, which is cheaper than NSJSONSerialization into an
+ * NSDictionary: the gap on a device is larger than the one measured here.
+ *
+ * Build and run from the repository root, e.g.:
+ *
+ *   gcc -O2 -I Core tools/bench_table.c Core/ds_table.c -o bench_table
+ *   ./bench_table [directory for the temporary files]
+ */
+
+#include "ds_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+static double now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void product_id(int i, char *buf, size_t size) {
+  /* Image IDs of a catalog look like EANs */
+  snprintf(buf, size, "%013llu", 3000000000000ULL + (unsigned long long) i * 7919);
+}
+
+/*************************************************
+ * JSON path
+ *************************************************/
+
+typedef struct {
+  char *id;
+  char *value;
+} dict_entry_t;
+
+typedef struct {
+  dict_entry_t *slots;
+  size_t mask;
+  size_t count;
+  size_t bytes;        /* heap memory used */
+} dict_t;
+
+static void *dict_alloc(dict_t *d, size_t size) {
+  d->bytes += size;
+  return malloc(size);
+}
+
+static void dict_put(dict_t *d, char *id, char *value) {
+  size_t i = (size_t) ds_table_hash(id) & d->mask;
+  while (d->slots[i].id != NULL) {
+    if (strcmp(d->slots[i].id, id) == 0) {
+      free(d->slots[i].value);
+      free(id);
+      d->slots[i].value = value;
+      return;
+    }
+    i = (i + 1) & d->mask;
+  }
+  d->slots[i].id = id;
+  d->slots[i].value = value;
+  d->count++;
+}
+
+static const char *dict_get(const dict_t *d, const char *id) {
+  size_t i = (size_t) ds_table_hash(id) & d->mask;
+  while (d->slots[i].id != NULL) {
+    if (strcmp(d->slots[i].id, id) == 0) return d->slots[i].value;
+    i = (i + 1) & d->mask;
+  }
+  return NULL;
+}
+
+static void dict_free(dict_t *d) {
+  size_t i;
+  for (i = 0; i <= d->mask; i++) {
+    free(d->slots[i].id);
+    free(d->slots[i].value);
+  }
+  free(d->slots);
+}
+
+static void skip_spaces(const char **p) {
+  while (**p == ' ' || **p == '\n' || **p == '\r' || **p == '\t') (*p)++;
+}
+
+/* Parse a string or a number (`"..."` or `-?[0-9.]+`) into a copy */
+static char *parse_scalar(dict_t *d, const char **p) {
+  const char *s = *p;
+  char *out, *q;
+  if (*s == '"') {
+    const char *e = ++s;
+    while (*e && *e != '"') e += (*e == '\\' && e[1]) ? 2 : 1;
+    if (*e != '"') return NULL;
+    out = q = dict_alloc(d, (size_t) (e - s) + 1);
+    while (s < e) {
+      if (*s == '\\') s++;
+      *q++ = *s++;
+    }
+    *q = '\0';
+    *p = e + 1;
+    return out;
+  }
+  while (*s == '-' || *s == '.' || (*s >= '0' && *s <= '9')) s++;
+  if (s == *p) return NULL;
+  out = dict_alloc(d, (size_t) (s - *p) + 1);
+  memcpy(out, *p, (size_t) (s - *p));
+  out[s - *p] = '\0';
+  *p = s;
+  return out;
+}
+
+/* Parse a flat JSON object of scalars */
+static int parse_json(const char *json, dict_t *d) {
+  const char *p = json;
+  size_t slots = 16;
+  size_t n = 0;
+  const char *c;
+  /* Size the table from the number of members, as a dictionary would grow */
+  for (c = json; *c; c++) n += (*c == ':');
+  while (slots < 2 * n) slots *= 2;
+  d->slots = dict_alloc(d, slots * sizeof(*d->slots));
+  memset(d->slots, 0, slots * sizeof(*d->slots));
+  d->mask = slots - 1;
+  d->count = 0;
+
+  skip_spaces(&p);
+  if (*p++ != '{') return -1;
+  skip_spaces(&p);
+  if (*p == '}') return 0;
+  for (;;) {
+    char *id, *value;
+    skip_spaces(&p);
+    if (*p != '"' || (id = parse_scalar(d, &p)) == NULL) return -1;
+    skip_spaces(&p);
+    if (*p++ != ':') return -1;
+    skip_spaces(&p);
+    if ((value = parse_scalar(d, &p)) == NULL) return -1;
+    dict_put(d, id, value);
+    skip_spaces(&p);
+    if (*p == ',') {
+      p++;
+      continue;
+    }
+    return *p == '}' ? 0 : -1;
+  }
+}
+
+static char *read_file(const char *path, size_t *size) {
+  FILE *f = fopen(path, "rb");
+  char *data;
+  long n;
+  if (f == NULL) return NULL;
+  fseek(f, 0, SEEK_END);
+  n = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  data = malloc((size_t) n + 1);
+  if (data && fread(data, 1, (size_t) n, f) != (size_t) n) {
+    free(data);
+    data = NULL;
+  }
+  if (data) data[n] = '\0';
+  fclose(f);
+  *size = (size_t) n;
+  return data;
+}
+
+/*************************************************
+ * Benchmark
+ *************************************************/
+
+static int run(const char *dir, int count) {
+  char json_path[1024], table_path[1024], id[32];
+  int i, lookups = 0, found = 0;
+  double start, json_ready, table_ready, json_lookup, table_lookup;
+  size_t json_size = 0, table_size = 0;
+  FILE *f;
+  char *json;
+  dict_t dict = { NULL, 0, 0, 0 };
+  ds_table_t *table = NULL;
+  ds_table_writer_t *writer = NULL;
+
+  snprintf(json_path, sizeof(json_path), "%s/bench_table.json", dir);
+  snprintf(table_path, sizeof(table_path), "%s/bench_table.dst", dir);
+
+  /* Same discounts in both formats */
+  f = fopen(json_path, "wb");
+  if (f == NULL || ds_table_writer_new(&writer) != DS_SUCCESS) {
+    fprintf(stderr, "cannot write to %s\n", dir);
+    return 1;
+  }
+  fputc('{', f);
+  for (i = 0; i < count; i++) {
+    char off[8];
+    product_id(i, id, sizeof(id));
+    snprintf(off, sizeof(off), "%d", 5 + i % 50);
+    fprintf(f, "%s\"%s\":%s", i ? "," : "", id, off);
+    ds_table_writer_add(writer, id, off);
+  }
+  fputc('}', f);
+  json_size = (size_t) ftell(f);
+  fclose(f);
+  if (ds_table_writer_save(writer, table_path, 0, 0) != DS_SUCCESS) {
+    fprintf(stderr, "cannot write %s\n", table_path);
+    return 1;
+  }
+  ds_table_writer_del(writer);
+
+  /* Get ready for lookups */
+  start = now();
+  json = read_file(json_path, &json_size);
+  if (json == NULL || parse_json(json, &dict) != 0 || dict.count != (size_t) count) {
+    fprintf(stderr, "cannot parse %s\n", json_path);
+    return 1;
+  }
+  free(json);
+  json_ready = now() - start;
+
+  start = now();
+  if (ds_table_open(table_path, &table) != DS_SUCCESS || ds_table_count(table) != (uint32_t) count) {
+    fprintf(stderr, "cannot open %s\n", table_path);
+    return 1;
+  }
+  table_ready = now() - start;
+  f = fopen(table_path, "rb");
+  if (f) {
+    fseek(f, 0, SEEK_END);
+    table_size = (size_t) ftell(f);
+    fclose(f);
+  }
+
+  /* Look up present and absent products alike (a scan may find a product
+   * without any discount). Both timings include formatting the ID */
+  start = now();
+  do {
+    for (i = 0; i < 1000; i++, lookups++) {
+      product_id((lookups * 31) % (2 * count), id, sizeof(id));
+      found += dict_get(&dict, id) != NULL;
+    }
+  } while (now() - start < 0.3);
+  json_lookup = (now() - start) / lookups;
+
+  start = now();
+  lookups = 0;
+  do {
+    for (i = 0; i < 1000; i++, lookups++) {
+      const char *value;
+      product_id((lookups * 31) % (2 * count), id, sizeof(id));
+      found -= ds_table_lookup(table, id, &value) == DS_SUCCESS;
+    }
+  } while (now() - start < 0.3);
+  table_lookup = (now() - start) / lookups;
+
+  printf("%8d  %7.0f KB %9.2f ms %9.0f KB %8.0f ns  |  %7.0f KB %9.3f ms %8.0f ns\n",
+         count, json_size / 1024.0, json_ready * 1e3, dict.bytes / 1024.0, json_lookup * 1e9,
+         table_size / 1024.0, table_ready * 1e3, table_lookup * 1e9);
+
+  dict_free(&dict);
+  ds_table_close(table);
+  unlink(json_path);
+  unlink(table_path);
+  (void) found;
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  const char *dir = argc > 1 ? argv[1] : "/tmp";
+  const int counts[] = { 1000, 10000, 100000 };
+  size_t i;
+
+  printf("%8s  %-48s  |  %s\n", "", "JSON", "table");
+  printf("%8s  %10s %12s %12s %11s  |  %10s %12s %11s\n", "products", "file", "parse",
+         "heap", "lookup", "file", "open", "lookup");
+  for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+    if (run(dir, counts[i]) != 0) return 1;
+  }
+  return 0;
+}
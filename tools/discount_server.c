@@ -0,0 +1,403 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Stand-in discount backend, to exercise the app (or `bench_http`) against
+ * a local server. It speaks HTTP/1.1 with keep-alive and serves the
+ * endpoints of Constants.h, with made-up but stable discounts:
+ *
+ *   HEAD|GET /                                 connection prewarming
+ *   GET  /api/discounts/<user>/<product>       {"Off":<n>}, with ETag and
+ *                                              Cache-Control (304 on match)
+ *   POST /api/discounts/<user>                 JSON array of products in,
+ *                                              {"<product>":<n>,...} out
+ *   GET  /api/discounts/<user>/changes?since=  {"Cursor":1,"Changes":{}}
+ *   GET  /api/discounts/<user>/rules           404 (no rules)
+ *
+ * The latency of a remote backend is simulated with a delay per request and
+ * a delay per connection (standing in for DNS, TCP and TLS setup on a real
+ * network), which is what keep-alive and prewarming save.
+ *
+ * Build and run from the repository root, e.g.:
+ *
+ *   gcc -std=c99 -O2 -pthread tools/discount_server.c -o discount_server
+ *   ./discount_server -p 8080 -l 20 -c 150
+ *
+ * then point the URLs of Constants.h to http://<host>:8080/.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DS_SERVER_MAX_HEADERS  (16 * 1024)
+#define DS_SERVER_MAX_BODY     (4 * 1024 * 1024)
+
+static int request_delay_ms = 0;
+static int connect_delay_ms = 0;
+static int verbose = 0;
+
+typedef struct {
+  char *data;
+  size_t size;
+  size_t cap;
+} buf_t;
+
+static int buf_reserve(buf_t *b, size_t extra) {
+  if (b->size + extra + 1 <= b->cap) return 0;
+  size_t cap = b->cap ? b->cap : 4096;
+  while (cap < b->size + extra + 1) cap *= 2;
+  char *data = realloc(b->data, cap);
+  if (data == NULL) return -1;
+  b->data = data;
+  b->cap = cap;
+  return 0;
+}
+
+static int buf_append(buf_t *b, const char *s, size_t n) {
+  if (buf_reserve(b, n) != 0) return -1;
+  memcpy(b->data + b->size, s, n);
+  b->size += n;
+  b->data[b->size] = '\0';
+  return 0;
+}
+
+static void sleep_ms(int ms) {
+  struct timespec ts;
+  if (ms <= 0) return;
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (long) (ms % 1000) * 1000000L;
+  while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {}
+}
+
+static int write_all(int fd, const char *s, size_t n) {
+  while (n > 0) {
+    ssize_t w = write(fd, s, n);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) return -1;
+    s += w;
+    n -= (size_t) w;
+  }
+  return 0;
+}
+
+/* Stable discount of a product (FNV-1a, as ds_table_hash) */
+static uint64_t product_hash(const char *id, size_t n) {
+  uint64_t h = 14695981039346656037ULL;
+  size_t i;
+  for (i = 0; i < n; i++) {
+    h ^= (unsigned char) id[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static int product_discount(const char *id, size_t n) {
+  return 5 + (int) (product_hash(id, n) % 46);
+}
+
+/*************************************************
+ * Requests
+ *************************************************/
+
+typedef struct {
+  char method[8];
+  char path[1024];
+  int keep_alive;
+  char etag[128];              /* If-None-Match */
+  const char *body;
+  size_t body_size;
+} request_t;
+
+/* Value of a header in the header block, or NULL (`value` is bounded) */
+static int header(const char *headers, const char *name, char *value, size_t size) {
+  size_t len = strlen(name);
+  const char *line = strstr(headers, "\r\n");
+  while (line != NULL && line[2] != '\r') {
+    line += 2;
+    if (strncasecmp(line, name, len) == 0 && line[len] == ':') {
+      const char *v = line + len + 1;
+      const char *end = strstr(v, "\r\n");
+      size_t n;
+      while (*v == ' ' || *v == '\t') v++;
+      n = end ? (size_t) (end - v) : strlen(v);
+      if (n >= size) n = size - 1;
+      memcpy(value, v, n);
+      value[n] = '\0';
+      return 1;
+    }
+    line = strstr(line, "\r\n");
+  }
+  return 0;
+}
+
+static void respond(int fd, const request_t *req, int status, const char *extra_headers,
+                    const char *body, size_t body_size) {
+  const char *reason = status == 200 ? "OK" : status == 304 ? "Not Modified" :
+                       status == 400 ? "Bad Request" : status == 404 ? "Not Found" :
+                       "Internal Server Error";
+  char head[1024];
+  int n = snprintf(head, sizeof(head),
+                   "HTTP/1.1 %d %s\r\n"
+                   "Content-Type: application/json\r\n"
+                   "Content-Length: %lu\r\n"
+                   "Connection: %s\r\n"
+                   "%s"
+                   "\r\n",
+                   status, reason, (unsigned long) body_size,
+                   req->keep_alive ? "keep-alive" : "close",
+                   extra_headers ? extra_headers : "");
+  if (write_all(fd, head, (size_t) n) != 0) return;
+  if (body_size > 0 && strcmp(req->method, "HEAD") != 0) write_all(fd, body, body_size);
+}
+
+/* POST /api/discounts/<user>: a JSON array of product IDs */
+static void serve_batch(int fd, const request_t *req) {
+  buf_t out = { NULL, 0, 0 };
+  const char *p = req->body, *end = req->body + req->body_size;
+  int first = 1;
+  buf_append(&out, "{", 1);
+  while (p < end) {
+    const char *s, *e;
+    char item[64];
+    int n;
+    while (p < end && *p != '"') p++;
+    if (p >= end) break;
+    s = ++p;
+    while (p < end && *p != '"') p++;
+    if (p >= end) break;
+    e = p++;
+    n = snprintf(item, sizeof(item), "%s\"%.*s\":%d", first ? "" : ",", (int) (e - s), s,
+                 product_discount(s, (size_t) (e - s)));
+    if (n > 0 && n < (int) sizeof(item)) buf_append(&out, item, (size_t) n);
+    first = 0;
+  }
+  buf_append(&out, "}", 1);
+  if (out.data == NULL) {
+    respond(fd, req, 500, NULL, NULL, 0);
+    return;
+  }
+  respond(fd, req, 200, "Cache-Control: max-age=3600\r\nX-Discounts-Cursor: 1\r\n", out.data,
+          out.size);
+  free(out.data);
+}
+
+static void serve(int fd, const request_t *req) {
+  const char *prefix = "/api/discounts/";
+  size_t plen = strlen(prefix);
+  const char *user, *slash, *rest;
+
+  if (strcmp(req->path, "/") == 0) {
+    respond(fd, req, 200, NULL, NULL, 0);
+    return;
+  }
+  if (strncmp(req->path, prefix, plen) != 0 || req->path[plen] == '\0') {
+    respond(fd, req, 404, NULL, NULL, 0);
+    return;
+  }
+  user = req->path + plen;
+  slash = strchr(user, '/');
+
+  if (slash == NULL) {
+    if (strcmp(req->method, "POST") == 0) serve_batch(fd, req);
+    else respond(fd, req, 404, NULL, NULL, 0);
+    return;
+  }
+
+  rest = slash + 1;
+  if (strncmp(rest, "changes", 7) == 0 && (rest[7] == '?' || rest[7] == '\0')) {
+    static const char body[] = "{\"Cursor\":1,\"Changes\":{}}";
+    respond(fd, req, 200, NULL, body, sizeof(body) - 1);
+  }
+  else if (strcmp(rest, "rules") == 0) {
+    respond(fd, req, 404, NULL, NULL, 0);
+  }
+  else if (*rest != '\0' && strchr(rest, '/') == NULL) {
+    char etag[64], headers[256], body[64];
+    int off = product_discount(rest, strlen(rest));
+    int n;
+    snprintf(etag, sizeof(etag), "\"%016llx-%d\"",
+             (unsigned long long) product_hash(user, (size_t) (slash - user)), off);
+    snprintf(headers, sizeof(headers), "Cache-Control: max-age=3600\r\nEtag: %s\r\n", etag);
+    if (strcmp(req->etag, etag) == 0) {
+      respond(fd, req, 304, headers, NULL, 0);
+      return;
+    }
+    n = snprintf(body, sizeof(body), "{\"Off\":%d}", off);
+    respond(fd, req, 200, headers, body, (size_t) n);
+  }
+  else {
+    respond(fd, req, 404, NULL, NULL, 0);
+  }
+}
+
+/*************************************************
+ * Connections
+ *************************************************/
+
+static void *connection(void *arg) {
+  int fd = (int) (intptr_t) arg;
+  buf_t in = { NULL, 0, 0 };
+  int requests = 0;
+
+  sleep_ms(connect_delay_ms);
+
+  for (;;) {
+    char *end;
+    request_t req;
+    char value[64], version[16];
+    size_t head_size, content_length = 0;
+
+    /* Read the request line and headers */
+    while ((end = in.data ? strstr(in.data, "\r\n\r\n") : NULL) == NULL) {
+      ssize_t n;
+      if (in.size > DS_SERVER_MAX_HEADERS || buf_reserve(&in, 4096) != 0) goto done;
+      n = read(fd, in.data + in.size, in.cap - in.size - 1);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) goto done;
+      in.size += (size_t) n;
+      in.data[in.size] = '\0';
+    }
+    head_size = (size_t) (end - in.data) + 4;
+
+    memset(&req, 0, sizeof(req));
+    if (sscanf(in.data, "%7s %1023s %15s", req.method, req.path, version) != 3) goto done;
+    req.keep_alive = strcmp(version, "HTTP/1.1") == 0;
+    end[2] = '\0';    /* end the header block (restored below) */
+    if (header(in.data, "Connection", value, sizeof(value)))
+      req.keep_alive = strcasecmp(value, "close") != 0 && (req.keep_alive ||
+                                                           strcasecmp(value, "keep-alive") == 0);
+    header(in.data, "If-None-Match", req.etag, sizeof(req.etag));
+    if (header(in.data, "Content-Length", value, sizeof(value)))
+      content_length = (size_t) strtoul(value, NULL, 10);
+    end[2] = '\r';
+    if (content_length > DS_SERVER_MAX_BODY) goto done;
+
+    /* Read the body */
+    while (in.size < head_size + content_length) {
+      ssize_t n;
+      if (buf_reserve(&in, head_size + content_length - in.size) != 0) goto done;
+      n = read(fd, in.data + in.size, in.cap - in.size - 1);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) goto done;
+      in.size += (size_t) n;
+      in.data[in.size] = '\0';
+    }
+    req.body = in.data + head_size;
+    req.body_size = content_length;
+
+    sleep_ms(request_delay_ms);
+    serve(fd, &req);
+    requests++;
+    if (verbose) fprintf(stderr, "[%d] %s %s\n", fd, req.method, req.path);
+
+    /* Keep what follows (pipelined requests) */
+    memmove(in.data, in.data + head_size + content_length,
+            in.size - head_size - content_length + 1);
+    in.size -= head_size + content_length;
+    if (!req.keep_alive) break;
+  }
+
+done:
+  if (verbose) fprintf(stderr, "[%d] closed after %d request(s)\n", fd, requests);
+  free(in.data);
+  close(fd);
+  return NULL;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-p port] [-l ms] [-c ms] [-v]\n"
+          "  -p port  port to listen to (default: 8080)\n"
+          "  -l ms    delay of each request (default: 0)\n"
+          "  -c ms    delay of each new connection, before its first request\n"
+          "           is read (default: 0)\n"
+          "  -v       log each request\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  int port = 8080, opt, fd, one = 1;
+  struct sockaddr_in addr;
+
+  while ((opt = getopt(argc, argv, "p:l:c:vh")) != -1) {
+    switch (opt) {
+      case 'p': port = atoi(optarg); break;
+      case 'l': request_delay_ms = atoi(optarg); break;
+      case 'c': connect_delay_ms = atoi(optarg); break;
+      case 'v': verbose = 1; break;
+      default: usage(argv[0]); return 2;
+    }
+  }
+  if (optind != argc || port <= 0 || port > 65535) {
+    usage(argv[0]);
+    return 2;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return 1;
+  }
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons((uint16_t) port);
+  if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+    perror("bind");
+    return 1;
+  }
+  fprintf(stderr, "listening on port %d (request delay %d ms, connection delay %d ms)\n", port,
+          request_delay_ms, connect_delay_ms);
+
+  for (;;) {
+    pthread_t thread;
+    int client = accept(fd, NULL, NULL);
+    if (client < 0) {
+      if (errno == EINTR) continue;
+      perror("accept");
+      return 1;
+    }
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (pthread_create(&thread, NULL, connection, (void *) (intptr_t) client) != 0) {
+      close(client);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+}
@@ -0,0 +1,206 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Stress test of the latest-item-wins mailbox (ds_mailbox.h): producers post
+ * numbered items as fast as they can while consumers take them, then checks
+ * that:
+ *
+ * - no item is torn (its contents are fully visible to the taker),
+ * - the items of a producer are taken in the order they were posted,
+ * - every item is either taken or handed back as replaced, exactly once,
+ * - the `posted` and `dropped` counters match.
+ *
+ * Exits with a non-zero status on failure, so that it can run as a test.
+ *
+ * Build and run from the repository root, e.g.:
+ *
+ *   g++ -O2 -pthread -I Core tools/mailbox_stress.cpp Core/ds_mailbox.cpp -o mailbox_stress
+ *   ./mailbox_stress [items per producer] [producers] [consumers]
+ */
+
+#include "ds_mailbox.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <vector>
+
+static const int kPayload = 7;
+
+struct Item {
+  int producer;
+  int seq;
+  int payload[kPayload];
+};
+
+static ds_mailbox_t box;
+static int items_per_producer = 1000000;
+static int producers = 1;
+static int consumers = 1;
+static volatile int producing = 0;    /* number of producers still running */
+static volatile int failures = 0;
+
+/* Number of times each item has been released, either by a consumer (taken)
+ * or by a producer (replaced), indexed by producer then sequence number */
+static std::vector<std::vector<unsigned char> > released;
+
+static double now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void fail(const char *what, const Item *item) {
+  fprintf(stderr, "FAILED: %s (producer %d, item %d)\n", what, item->producer, item->seq);
+  __sync_fetch_and_add(&failures, 1);
+}
+
+static void release(Item *item) {
+  /* The slots are distinct per item, but may share a word with the slots of
+   * other items: update them atomically */
+  unsigned char *count = &released[item->producer][item->seq];
+  if (__sync_fetch_and_add(count, 1) != 0) fail("item released twice", item);
+  delete item;
+}
+
+struct Stats {
+  long taken;
+  long out_of_order;
+};
+
+static void *produce(void *arg) {
+  int id = (int) (intptr_t) arg;
+  for (int s = 0; s < items_per_producer; s++) {
+    Item *item = new Item;
+    item->producer = id;
+    item->seq = s;
+    for (int i = 0; i < kPayload; i++) item->payload[i] = s * kPayload + i;
+    Item *stale = (Item *) ds_mailbox_post(&box, item);
+    if (stale) release(stale);
+  }
+  __sync_fetch_and_sub(&producing, 1);
+  return NULL;
+}
+
+static void *consume(void *arg) {
+  Stats *stats = (Stats *) arg;
+  std::vector<int> last(producers, -1);
+  unsigned empty = 0;
+  for (;;) {
+    Item *item = (Item *) ds_mailbox_take(&box);
+    if (item == NULL) {
+      if (__sync_fetch_and_add(&producing, 0) == 0) {
+        /* Nothing can be posted anymore: the mailbox stays empty */
+        item = (Item *) ds_mailbox_take(&box);
+        if (item == NULL) break;
+      }
+      else {
+        /* Keep polling, so as to race with the producers, but let them
+         * run if they share the CPU */
+        if (++empty % 1024 == 0) sched_yield();
+        continue;
+      }
+    }
+    for (int i = 0; i < kPayload; i++) {
+      if (item->payload[i] != item->seq * kPayload + i) {
+        fail("torn item", item);
+        break;
+      }
+    }
+    /* With several consumers, an item taken earlier may be released later:
+     * only a single consumer can check ordering */
+    if (item->seq <= last[item->producer]) stats->out_of_order++;
+    last[item->producer] = item->seq;
+    stats->taken++;
+    release(item);
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1) items_per_producer = atoi(argv[1]);
+  if (argc > 2) producers = atoi(argv[2]);
+  if (argc > 3) consumers = atoi(argv[3]);
+  if (items_per_producer < 1 || producers < 1 || consumers < 1) {
+    fprintf(stderr, "usage: %s [items per producer] [producers] [consumers]\n", argv[0]);
+    return 2;
+  }
+
+  ds_mailbox_init(&box);
+  released.assign(producers, std::vector<unsigned char>(items_per_producer, 0));
+  producing = producers;
+
+  std::vector<pthread_t> threads(producers + consumers);
+  std::vector<Stats> stats(consumers);
+  double start = now();
+  for (int i = 0; i < consumers; i++) {
+    stats[i].taken = 0;
+    stats[i].out_of_order = 0;
+    pthread_create(&threads[i], NULL, consume, &stats[i]);
+  }
+  for (int i = 0; i < producers; i++)
+    pthread_create(&threads[consumers + i], NULL, produce, (void *) (intptr_t) i);
+  for (size_t i = 0; i < threads.size(); i++) pthread_join(threads[i], NULL);
+  double elapsed = now() - start;
+
+  long taken = 0, out_of_order = 0;
+  for (int i = 0; i < consumers; i++) {
+    taken += stats[i].taken;
+    out_of_order += stats[i].out_of_order;
+  }
+  long total = (long) items_per_producer * producers;
+  long lost = 0;
+  for (int p = 0; p < producers; p++) {
+    for (int s = 0; s < items_per_producer; s++) lost += released[p][s] == 0;
+  }
+
+  printf("%d producer(s), %d consumer(s): %ld items in %.2f s (%.0f ns/item)\n", producers,
+         consumers, total, elapsed, elapsed / total * 1e9);
+  printf("posted %u, dropped %u, taken %ld\n", box.posted, box.dropped, taken);
+
+  if (box.posted != (uint32_t) total) {
+    fprintf(stderr, "FAILED: %u items posted, expected %ld\n", box.posted, total);
+    failures++;
+  }
+  if ((long) box.dropped + taken != total) {
+    fprintf(stderr, "FAILED: %u dropped + %ld taken != %ld posted\n", box.dropped, taken, total);
+    failures++;
+  }
+  if (lost > 0) {
+    fprintf(stderr, "FAILED: %ld items never released\n", lost);
+    failures++;
+  }
+  if (consumers == 1 && out_of_order > 0) {
+    fprintf(stderr, "FAILED: %ld items taken out of order\n", out_of_order);
+    failures++;
+  }
+
+  if (failures) return 1;
+  printf("ok\n");
+  return 0;
+}
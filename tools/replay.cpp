@@ -0,0 +1,274 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+/*
+ * Replay a frame recording (see ds_record.h) through the scan pipeline,
+ * on top of the stand-in SDK (see sdk_standin.h), and report the results,
+ * the throughput and the latency of each stage. With the same recording,
+ * server and options, the results are deterministic at full speed, so that
+ * regressions can be bisected offline.
+ *
+ * Recordings are made on a device with `kMSRecord` (MSScannerController.m),
+ * and reference images are added to the stand-in server with
+ * `ms_standin_server_add`.
+ *
+ * With `-t`, the stages of each frame are traced as in the app (see
+ * ds_trace.h) and written as a Chrome trace, e.g. to compare the host with
+ * a trace recorded on a device with `kMSTrace`.
+ *
+ * Build and run from the repository root, e.g.:
+ *
+ *   gcc -std=c99 -O2 -I . -I Core -c tools/sdk_standin.c Core/ds_record.c
+ *   g++ -O2 -I . -I Core -I tools tools/replay.cpp Core/ds_session.cpp \
+ *       Core/ds_dhash.cpp Core/ds_track.cpp Core/ds_strategy.cpp Core/ds_quality.cpp \
+ *       Core/ds_sched.cpp Core/ds_image.cpp Core/ds_trace.cpp sdk_standin.o ds_record.o \
+ *       -lpthread -o replay
+ *   ./replay -s server/ scan-20121024-183012.dsrec
+ *
+ * (add `-DDS_RECORD_LZ4` when compiling ds_record.c and `-llz4` when linking
+ * to read compressed recordings)
+ */
+
+#include "sdk_standin.h"
+#include "scan_pipeline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+/* Latency samples of a stage, in seconds */
+struct Samples {
+  std::vector<double> values;
+
+  void Add(double seconds) {
+    if (seconds > 0) values.push_back(seconds);
+  }
+  void Print(const char *name) {
+    if (values.empty()) {
+      printf("  %-7s        -\n", name);
+      return;
+    }
+    std::sort(values.begin(), values.end());
+    double sum = 0;
+    for (size_t i = 0; i < values.size(); i++) sum += values[i];
+    printf("  %-7s %8lu %8.2f %8.2f %8.2f %8.2f %8.2f\n", name, (unsigned long) values.size(),
+           1e3 * sum / values.size(), 1e3 * Percentile(0.5), 1e3 * Percentile(0.9),
+           1e3 * Percentile(0.99), 1e3 * values.back());
+  }
+  double Percentile(double p) const {
+    size_t i = (size_t) (p * (values.size() - 1) + 0.5);
+    return values[i];
+  }
+};
+
+static const char *type_name(int type) {
+  switch (type) {
+    case ds::kResultEAN8:   return "EAN8";
+    case ds::kResultEAN13:  return "EAN13";
+    case ds::kResultQRCode: return "QRCODE";
+    case ds::kResultImage:  return "IMAGE";
+    default:                return "?";
+  }
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-r] [-d] [-1] [-n] [-q] [-s server] [-t trace] recording\n"
+          "  -r         real time: frames arrive at their capture pace and those\n"
+          "             the scanner is too busy for are dropped (default: every\n"
+          "             frame is scanned, as fast as possible)\n"
+          "  -d         mimic the latency of a device (see ms_standin_device_latency)\n"
+          "  -1         decode barcodes after searching, instead of concurrently\n"
+          "  -n         no sharpness gate\n"
+          "  -q         only print the results\n"
+          "  -s server  stand-in server directory (default: $MS_STANDIN_SERVER)\n"
+          "  -t trace   write a Chrome trace of the stages of each frame (JSON)\n"
+          "The recording may be a pipe (e.g. /dev/stdin).\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  bool realtime = false, device = false, quiet = false;
+  PipelineOptions options;
+  const char *server = NULL, *trace = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "rd1nqs:t:h")) != -1) {
+    switch (opt) {
+      case 'r': realtime = true; break;
+      case 'd': device = true; break;
+      case '1': options.parallel = false; break;
+      case 'n': options.sharpness_gate = false; break;
+      case 'q': quiet = true; break;
+      case 's': server = optarg; break;
+      case 't': trace = optarg; break;
+      default: usage(argv[0]); return 2;
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return 2;
+  }
+  /* At full speed, every frame is scanned */
+  options.schedule = realtime;
+
+  ds_record_reader_t *reader = NULL;
+  ds_errcode err = ds_record_reader_open(argv[optind], &reader);
+  if (err != DS_SUCCESS) {
+    fprintf(stderr, "cannot open %s (error %d)\n", argv[optind], err);
+    return 1;
+  }
+
+  /* Scanner with a throwaway database, synchronized with the server */
+  if (server) ms_standin_set_server(server);
+  char db[64];
+  snprintf(db, sizeof(db), "/tmp/replay-%d.db", (int) getpid());
+  ms_scanner_t *scanner = NULL;
+  ms_errcode ecode = ms_scanner_new(&scanner);
+  if (ecode == MS_SUCCESS) ecode = ms_scanner_open(scanner, db, "replay", "replay");
+  if (ecode != MS_SUCCESS) {
+    fprintf(stderr, "cannot open the scanner: %s\n", ms_errmsg(ecode));
+    return 1;
+  }
+  ecode = ms_scanner_sync(scanner);
+  if (ecode != MS_SUCCESS)
+    fprintf(stderr, "cannot sync (%s): image recognition disabled\n", ms_errmsg(ecode));
+
+  /* Latency applies to scanning only */
+  ms_standin_latency_t latency;
+  ms_standin_device_latency(&latency);
+  if (device) ms_standin_set_latency(&latency);
+
+  if (trace) {
+    ds_trace_start();
+    ds_trace_thread_name("scan");
+  }
+
+  ScanPipeline pipeline(scanner, options);
+  Samples image, search, match, decode, total;
+  uint32_t frames = 0, scanned = 0, dropped = 0, not_due = 0, blurry = 0, invalid = 0;
+  uint32_t errors = 0, results = 0;
+  ds::ScanResult last_result;
+
+  OwnedFrame cur, next;
+  ds_frame_t f;
+  bool have = (err = ds_record_reader_next(reader, &f)) == DS_SUCCESS;
+  if (have) cur.Assign(f);
+  int64_t ts0 = have ? cur.frame.timestamp : 0, last = ts0;
+  double start = SdkBackend::Clock();
+  uint32_t index = 0;  /* index of `cur` in the recording */
+  while (have) {
+    frames++;
+    last = cur.frame.timestamp;
+    bool have_next = (err = ds_record_reader_next(reader, &f)) == DS_SUCCESS;
+    if (have_next) next.Assign(f);
+
+    double arrival = start + (cur.frame.timestamp - ts0) * 1e-6;
+    bool skip = false;
+    if (realtime) {
+      /* The scanner only ever picks the newest frame up (see ds_mailbox.h) */
+      if (have_next && start + (next.frame.timestamp - ts0) * 1e-6 <= SdkBackend::Clock()) {
+        dropped++;
+        skip = true;
+      }
+      else {
+        double wait = arrival - SdkBackend::Clock();
+        if (wait > 0) usleep((useconds_t) (wait * 1e6));
+      }
+    }
+
+    if (!skip) {
+      const ds::ScanResult *result = NULL;
+      uint64_t frame_start = ds_trace_now();
+      ScanPipeline::Fate fate = pipeline.Process(cur.frame, SdkBackend::Clock(), &result, &ecode);
+      ds_trace_complete("scanner", "frame", frame_start, ds_trace_now());
+      switch (fate) {
+        case ScanPipeline::kScanned: {
+          scanned++;
+          const FrameTimes &t = pipeline.times();
+          image.Add(t.image);
+          search.Add(t.search);
+          match.Add(t.match);
+          decode.Add(t.decode);
+          total.Add(t.total);
+          if (ecode != MS_SUCCESS) errors++;
+          /* A locked result is returned on every frame: only print changes */
+          if (result && *result != last_result) {
+            results++;
+            ds_trace_instant("scanner", "result");
+            printf("%6u %10.3f  %-6s %s\n", index, (cur.frame.timestamp - ts0) * 1e-6,
+                   type_name(result->type), result->value.c_str());
+          }
+          if (result)
+            last_result = *result;
+          else
+            last_result.Clear();
+          break;
+        }
+        case ScanPipeline::kNotDue:  not_due++; break;
+        case ScanPipeline::kBlurry:  blurry++;  break;
+        case ScanPipeline::kInvalid: invalid++; break;
+      }
+    }
+
+    cur.Swap(next);
+    have = have_next;
+    index++;
+  }
+  double elapsed = SdkBackend::Clock() - start;
+  if (trace) {
+    ds_trace_stop();
+    if (ds_trace_export(trace) != DS_SUCCESS)
+      fprintf(stderr, "cannot write the trace to %s\n", trace);
+  }
+  if (err == DS_MISUSE)
+    fprintf(stderr, "compressed frames: build ds_record.c with DS_RECORD_LZ4 to read them\n");
+  else if (err != DS_NOREC)
+    fprintf(stderr, "recording cut short (error %d)\n", err);
+
+  if (!quiet) {
+    double duration = (last - ts0) * 1e-6;
+    printf("\n%u frames (%.1f s recorded), %u scanned, %u dropped, %u not due, %u blurry, "
+           "%u invalid\n", frames, duration, scanned, dropped, not_due, blurry, invalid);
+    printf("%u results, %u errors, %u searches skipped, %u matches skipped, "
+           "%u format runs skipped\n", results, errors, pipeline.session().searches_skipped(),
+           pipeline.session().matches_skipped(), pipeline.session().formats_skipped());
+    printf("%.2f s, %.1f frames/s scanned\n\n", elapsed, elapsed > 0 ? scanned / elapsed : 0);
+    printf("  stage      count  mean ms   p50 ms   p90 ms   p99 ms   max ms\n");
+    image.Print("image");
+    search.Print("search");
+    match.Print("match");
+    decode.Print("decode");
+    total.Print("frame");
+  }
+
+  ds_record_reader_close(reader);
+  ms_scanner_del(scanner);
+  ms_scanner_clean(db);
+  return 0;
+}
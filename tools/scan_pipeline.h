@@ -0,0 +1,220 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _SCAN_PIPELINE_H
+#define _SCAN_PIPELINE_H
+
+#include <algorithm>
+#include <vector>
+
+#include "sdk_backend.h"
+#include "ds_image.h"
+#include "ds_quality.h"
+#include "ds_record.h"
+#include "ds_sched.h"
+#include "ds_trace.h"
+
+/*************************************************
+ * Scan pipeline
+ *
+ * What `MSScannerController` does with each camera frame, for the tools:
+ * scan cadence, image preparation (as `MSImage`), sharpness gate, then the
+ * scan session itself over the SDK.
+ *************************************************/
+
+/** Settings of a pipeline (the defaults are those of `MSScannerController`) */
+struct PipelineOptions {
+  bool sharpness_gate;
+  double sharpness_ratio;
+  double sharpness_decay;
+  int sharpness_skips;
+  bool schedule;          /* keep to the sustainable scan rate */
+  double scan_budget;
+  double min_interval;
+  double max_interval;
+  int confirmations;
+  int max_losts;
+  bool parallel;
+  bool deduplicates;
+  bool tracks;
+  bool adaptive;
+
+  PipelineOptions()
+      : sharpness_gate(true), sharpness_ratio(0.5), sharpness_decay(0.98), sharpness_skips(10),
+        schedule(true), scan_budget(0.6), min_interval(1.0 / 30), max_interval(0.5),
+        confirmations(3), max_losts(2), parallel(true), deduplicates(true), tracks(true), adaptive(true) {}
+};
+
+/** Time spent in each stage by the last frame, in seconds (0 if it has not run) */
+struct FrameTimes {
+  double image;           /* image preparation */
+  double search;
+  double match;
+  double decode;
+  double total;           /* whole frame, image preparation included (even if rejected) */
+};
+
+/** A recorded frame owning its pixels, e.g. to read the next one ahead */
+struct OwnedFrame {
+  ds_frame_t frame;
+  std::vector<uint8_t> pixels;
+
+  void Assign(const ds_frame_t &f) {
+    size_t rows = f.height + (f.fmt == DS_FRAME_NV21 ? (f.height + 1) / 2 : 0);
+    frame = f;
+    pixels.assign(f.data, f.data + (size_t) f.bpr * rows);
+    frame.data = &pixels[0];
+  }
+  void Swap(OwnedFrame &other) {
+    std::swap(frame, other.frame);
+    pixels.swap(other.pixels);
+  }
+};
+
+class ScanPipeline {
+ public:
+  /** What happened to a frame */
+  enum Fate {
+    kScanned = 0,
+    kNotDue,              /* skipped to keep to the scan rate */
+    kBlurry,              /* rejected by the sharpness gate */
+    kInvalid              /* not a valid image for the SDK */
+  };
+
+  /** `scanner` must be opened and outlive the pipeline */
+  ScanPipeline(ms_scanner_t *scanner, const PipelineOptions &options)
+      : options_(options), backend_(scanner, options.parallel), session_(&backend_) {
+    session_.set_confirmations(options.confirmations);
+    session_.set_max_losts(options.max_losts);
+    session_.set_parallel(options.parallel);
+    session_.set_deduplicates(options.deduplicates);
+    session_.set_tracks(options.tracks);
+    session_.set_adaptive(options.adaptive);
+    ds_gate_init(&gate_, options.sharpness_ratio, options.sharpness_decay, options.sharpness_skips);
+    ds_sched_init(&sched_, options.min_interval, options.max_interval, options.scan_budget);
+  }
+
+  /**
+   * Process a frame received at time `now` (in seconds, on the clock of
+   * `SdkBackend::Clock`), with the scan options it was recorded with.
+   * `*result` receives the result found, as with `ds::ScanSession::Scan`.
+   * The return value is the fate of the frame; `*ecode` receives the error
+   * code of the scan, if any.
+   */
+  Fate Process(const ds_frame_t &frame, double now, const ds::ScanResult **result,
+               ms_errcode *ecode) {
+    *result = NULL;
+    *ecode = MS_SUCCESS;
+    times_.image = times_.search = times_.match = times_.decode = times_.total = 0;
+    if (options_.schedule && !ds_sched_due(&sched_, now)) return kNotDue;
+
+    double t0 = SdkBackend::Clock();
+    uint64_t image_start = ds_trace_now();
+    ms_img_t *img = NULL;
+    double sharpness = 0;
+    ds::ScanFrame query;
+    if (!Prepare(frame, &img, &sharpness, &query)) return kInvalid;
+    times_.image = SdkBackend::Clock() - t0;
+    ds_trace_complete("scanner", "image", image_start, ds_trace_now());
+    if (options_.sharpness_gate && !ds_gate_admit(&gate_, sharpness)) {
+      times_.total = times_.image;
+      ms_img_del(img);
+      return kBlurry;
+    }
+
+    uint64_t scan_start = ds_trace_now();
+    *ecode = session_.Scan(query, frame.options, result);
+    ds_trace_complete("scanner", "scan", scan_start, ds_trace_now());
+    ms_img_del(img);
+
+    times_.search = session_.search_time();
+    times_.match = session_.match_time();
+    times_.decode = session_.decode_time();
+    times_.total = SdkBackend::Clock() - t0;
+    ds_sched_record(&sched_, DS_STAGE_FRAME, times_.total);
+    if (times_.search > 0) ds_sched_record(&sched_, DS_STAGE_SEARCH, times_.search);
+    if (times_.match > 0) ds_sched_record(&sched_, DS_STAGE_MATCH, times_.match);
+    if (times_.decode > 0) ds_sched_record(&sched_, DS_STAGE_DECODE, times_.decode);
+    return kScanned;
+  }
+
+  const FrameTimes &times() const { return times_; }
+  const ds::ScanSession &session() const { return session_; }
+  const ds_gate_t &gate() const { return gate_; }
+  const ds_sched_t &sched() const { return sched_; }
+
+ private:
+  /* Same sampling step and size bounds as `MSImage` */
+  enum { kStep = 4, kMinSide = 480, kMaxSide = 1280 };
+
+  bool Prepare(const ds_frame_t &frame, ms_img_t **img, double *sharpness, ds::ScanFrame *query) {
+    const uint8_t *gray = frame.data;
+    int w = frame.width, h = frame.height, bpr = frame.bpr;
+    ms_errcode ecode;
+    if (frame.fmt == DS_FRAME_BGRA) {
+      /* Converted and turned upright before reaching the SDK */
+      ds_rotation rot = DS_ROTATE_0;
+      switch (frame.orientation) {
+        case MS_LEFT_BOTTOM_ORI:  rot = DS_ROTATE_270; break;
+        case MS_BOTTOM_RIGHT_ORI: rot = DS_ROTATE_180; break;
+        case MS_RIGHT_TOP_ORI:    rot = DS_ROTATE_90;  break;
+        default:                  break;
+      }
+      pixels_.resize(ds_prepare_gray_size(w, h));
+      ds_gray_t out;
+      if (ds_prepare_gray(frame.data, w, h, bpr, DS_PIX_BGRA, rot, kMinSide, kMaxSide,
+                          &pixels_[0], pixels_.size(), &out) != 0)
+        return false;
+      gray = out.data;
+      w = out.width;
+      h = out.height;
+      bpr = out.bpr;
+      ms_ori_t ori = (frame.orientation == MS_UNDEFINED_ORI) ? MS_UNDEFINED_ORI : MS_TOP_LEFT_ORI;
+      ecode = ms_img_new(gray, w, h, bpr, MS_PIX_FMT_GRAY8, ori, img);
+    }
+    else {
+      /* The luma plane is used as is */
+      ms_pix_fmt_t fmt = (frame.fmt == DS_FRAME_NV21) ? MS_PIX_FMT_NV21 : MS_PIX_FMT_GRAY8;
+      ecode = ms_img_new(gray, w, h, bpr, fmt, (ms_ori_t) frame.orientation, img);
+    }
+    if (ecode != MS_SUCCESS) return false;
+
+    *sharpness = ds_sharpness(gray, w, h, bpr, kStep);
+    query->image = *img;
+    query->dhash = ds_dhash(gray, w, h, bpr, kStep);
+    query->thumb = (ds_thumbnail(gray, w, h, bpr, kStep, thumb_) == 0) ? thumb_ : NULL;
+    return true;
+  }
+
+  PipelineOptions options_;
+  SdkBackend backend_;
+  ds::ScanSession session_;
+  ds_gate_t gate_;
+  ds_sched_t sched_;
+  FrameTimes times_;
+  std::vector<uint8_t> pixels_;   /* conversion buffer, kept across frames */
+  uint8_t thumb_[DS_THUMB_SIDE * DS_THUMB_SIDE];
+};
+
+#endif
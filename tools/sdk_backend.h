@@ -0,0 +1,192 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _SDK_BACKEND_H
+#define _SDK_BACKEND_H
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sdk_standin.h"
+#include "ds_session.h"
+#include "ds_trace.h"
+
+/*************************************************
+ * Scan backend over the C API of the SDK
+ *
+ * Counterpart of the backend of `MSScannerSession` for the tools: it runs
+ * the SDK calls on the image of each frame (`ScanFrame::image`). In
+ * concurrent mode, barcodes are decoded on a worker thread with a second,
+ * unopened scanner handle, as on multi-core devices.
+ *************************************************/
+
+class SdkBackend : public ds::ScanBackend {
+ public:
+  /** `scanner` must be opened and outlive the backend */
+  SdkBackend(ms_scanner_t *scanner, bool concurrent)
+      : scanner_(scanner), decoder_(NULL), started_(false), stopping_(false),
+        pending_(false), image_(NULL), formats_(0), result_(NULL),
+        error_(MS_SUCCESS), time_(0) {
+    if (concurrent && ms_scanner_new(&decoder_) == MS_SUCCESS) {
+      pthread_mutex_init(&lock_, NULL);
+      pthread_cond_init(&cond_, NULL);
+      started_ = (pthread_create(&thread_, NULL, Worker, this) == 0);
+    }
+  }
+
+  virtual ~SdkBackend() {
+    if (started_) {
+      pthread_mutex_lock(&lock_);
+      stopping_ = true;
+      pthread_cond_broadcast(&cond_);
+      pthread_mutex_unlock(&lock_);
+      pthread_join(thread_, NULL);
+    }
+    if (decoder_) {
+      pthread_cond_destroy(&cond_);
+      pthread_mutex_destroy(&lock_);
+      ms_scanner_del(decoder_);
+    }
+  }
+
+  virtual ms_errcode Search(const ds::ScanFrame &frame, ds::ScanResult *result) {
+    char *id = NULL;
+    uint64_t t0 = ds_trace_now();
+    ms_errcode ecode = ms_scanner_search(scanner_, frame.image, &id);
+    ds_trace_complete("scanner", "search", t0, ds_trace_now());
+    if (ecode == MS_SUCCESS && id != NULL) {
+      result->type = ds::kResultImage;
+      result->value.assign(id);
+    }
+    else {
+      result->Clear();
+    }
+    free(id);
+    return ecode;
+  }
+
+  virtual ms_errcode Match(const ds::ScanFrame &frame, const ds::ScanResult &ref, bool *matched) {
+    int m = 0;
+    uint64_t t0 = ds_trace_now();
+    ms_errcode ecode = ms_scanner_match(scanner_, frame.image, ref.value.c_str(), &m);
+    ds_trace_complete("scanner", "match", t0, ds_trace_now());
+    *matched = (ecode == MS_SUCCESS && m == 1);
+    return ecode;
+  }
+
+  virtual ms_errcode Decode(const ds::ScanFrame &frame, int formats, ds::ScanResult *result) {
+    return DecodeWith(scanner_, frame.image, formats, result);
+  }
+
+  virtual bool CanDecodeConcurrently() { return started_; }
+
+  virtual void StartDecode(const ds::ScanFrame &frame, int formats, ds::ScanResult *result) {
+    pthread_mutex_lock(&lock_);
+    image_ = frame.image;
+    formats_ = formats;
+    result_ = result;
+    pending_ = true;
+    pthread_cond_broadcast(&cond_);
+    pthread_mutex_unlock(&lock_);
+  }
+
+  virtual ms_errcode FinishDecode(double *seconds) {
+    pthread_mutex_lock(&lock_);
+    while (pending_) pthread_cond_wait(&cond_, &lock_);
+    *seconds = time_;
+    ms_errcode ecode = error_;
+    pthread_mutex_unlock(&lock_);
+    return ecode;
+  }
+
+  virtual double Now() { return Clock(); }
+
+  /** Monotonic clock, in seconds */
+  static double Clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+  }
+
+ private:
+  static ms_errcode DecodeWith(ms_scanner_t *scanner, const ms_img_t *image, int formats,
+                               ds::ScanResult *result) {
+    ms_barcode_t *barcode = NULL;
+    uint64_t t0 = ds_trace_now();
+    ms_errcode ecode = ms_scanner_decode(scanner, image, formats, &barcode);
+    ds_trace_complete("scanner", "decode", t0, ds_trace_now());
+    if (ecode == MS_SUCCESS && barcode != NULL) {
+      const char *data = NULL;
+      int size = 0;
+      ms_barcode_get_data(barcode, &data, &size);
+      result->type = ms_barcode_get_fmt(barcode);
+      result->value.assign(data, size);
+      ms_barcode_del(barcode);
+    }
+    else {
+      result->Clear();
+    }
+    return ecode;
+  }
+
+  static void *Worker(void *arg) {
+    SdkBackend *self = static_cast<SdkBackend *>(arg);
+    ds_trace_thread_name("decode");
+    pthread_mutex_lock(&self->lock_);
+    for (;;) {
+      while (!self->pending_ && !self->stopping_) pthread_cond_wait(&self->cond_, &self->lock_);
+      if (self->stopping_) break;
+      pthread_mutex_unlock(&self->lock_);
+
+      double t0 = Clock();
+      ms_errcode ecode = DecodeWith(self->decoder_, self->image_, self->formats_, self->result_);
+      double elapsed = Clock() - t0;
+
+      pthread_mutex_lock(&self->lock_);
+      self->error_ = ecode;
+      self->time_ = elapsed;
+      self->pending_ = false;
+      pthread_cond_broadcast(&self->cond_);
+    }
+    pthread_mutex_unlock(&self->lock_);
+    return NULL;
+  }
+
+  ms_scanner_t *scanner_;
+  ms_scanner_t *decoder_;   /* unopened handle used by the worker */
+  pthread_t thread_;
+  pthread_mutex_t lock_;
+  pthread_cond_t cond_;
+  bool started_;
+  bool stopping_;
+  bool pending_;            /* a decoding was started and is not over */
+  const ms_img_t *image_;
+  int formats_;
+  ds::ScanResult *result_;
+  ms_errcode error_;
+  double time_;
+};
+
+#endif
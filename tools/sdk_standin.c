@@ -0,0 +1,788 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "sdk_standin.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+const char *ms_version = "4.1.5-standin";
+
+#define MS_STANDIN_CELLS   16
+#define MS_STANDIN_WORDS   4          /* 64-bit words of a fingerprint */
+#define MS_STANDIN_DB_MAGIC "MSSTANDIN"
+#define MS_STANDIN_DB_VERSION 1
+#define MS_STANDIN_MAX_LINE 1024
+
+static const unsigned char ms_barcode_magic[4] = { 'M', 'S', 'B', 'C' };
+
+struct ms_img_t_ {
+  int w;
+  int h;
+  uint8_t *gray;                      /* upright, `w` bytes per row */
+};
+
+struct ms_barcode_t_ {
+  ms_barcode_fmt fmt;
+  int size;
+  char *data;                         /* NUL-terminated */
+};
+
+typedef struct {
+  char *id;
+  uint64_t fp[MS_STANDIN_WORDS];
+} ms_record_t;
+
+struct ms_scanner_t_ {
+  int opened;
+  char *path;
+  char *key;
+  char *secret;
+  ms_record_t *records;
+  int count;
+  pthread_rwlock_t lock;              /* guards the records (sync vs. search) */
+};
+
+/*************************************************
+ * Global state
+ *************************************************/
+
+static pthread_mutex_t ms_global_lock = PTHREAD_MUTEX_INITIALIZER;
+static ms_standin_latency_t ms_latency;          /* all zeros: no latency */
+static uint64_t ms_jitter_state = 0x9e3779b97f4a7c15ULL;
+static char *ms_server = NULL;                   /* NULL: use the environment */
+static char **ms_open_paths = NULL;              /* databases currently opened */
+static int ms_open_count = 0;
+
+static void ms_sleep(double seconds) {
+  if (seconds <= 0) return;
+
+  pthread_mutex_lock(&ms_global_lock);
+  double jitter = ms_latency.jitter;
+  /* xorshift64* */
+  ms_jitter_state ^= ms_jitter_state >> 12;
+  ms_jitter_state ^= ms_jitter_state << 25;
+  ms_jitter_state ^= ms_jitter_state >> 27;
+  uint64_t r = ms_jitter_state * 0x2545f4914f6cdd1dULL;
+  pthread_mutex_unlock(&ms_global_lock);
+
+  double u = (double) (r >> 11) / (double) (1ULL << 53);  /* [0, 1) */
+  seconds *= 1 + jitter * (2 * u - 1);
+  if (seconds <= 0) return;
+
+  struct timespec ts;
+  ts.tv_sec = (time_t) seconds;
+  ts.tv_nsec = (long) ((seconds - ts.tv_sec) * 1e9);
+  while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {}
+}
+
+static ms_standin_latency_t ms_get_latency(void) {
+  pthread_mutex_lock(&ms_global_lock);
+  ms_standin_latency_t latency = ms_latency;
+  pthread_mutex_unlock(&ms_global_lock);
+  return latency;
+}
+
+/* The caller must free the returned string */
+static char *ms_server_path(const char *file) {
+  pthread_mutex_lock(&ms_global_lock);
+  const char *dir = ms_server ? ms_server : getenv("MS_STANDIN_SERVER");
+  char *path = NULL;
+  if (dir && *dir) {
+    size_t len = strlen(dir) + strlen(file) + 2;
+    path = malloc(len);
+    if (path) snprintf(path, len, "%s/%s", dir, file);
+  }
+  pthread_mutex_unlock(&ms_global_lock);
+  return path;
+}
+
+static int ms_path_opened(const char *path) {
+  for (int i = 0; i < ms_open_count; i++) {
+    if (strcmp(ms_open_paths[i], path) == 0) return 1;
+  }
+  return 0;
+}
+
+void ms_standin_set_latency(const ms_standin_latency_t *latency) {
+  pthread_mutex_lock(&ms_global_lock);
+  if (latency)
+    ms_latency = *latency;
+  else
+    memset(&ms_latency, 0, sizeof(ms_latency));
+  pthread_mutex_unlock(&ms_global_lock);
+}
+
+void ms_standin_device_latency(ms_standin_latency_t *latency) {
+  latency->search = 0.030;
+  latency->search_per_record = 2e-6;
+  latency->match = 0.015;
+  latency->decode = 0.012;
+  latency->sync_per_record = 0.004;
+  latency->api_search = 0.600;
+  latency->jitter = 0.2;
+}
+
+void ms_standin_set_server(const char *dir) {
+  pthread_mutex_lock(&ms_global_lock);
+  free(ms_server);
+  ms_server = dir ? strdup(dir) : NULL;
+  pthread_mutex_unlock(&ms_global_lock);
+}
+
+/*************************************************
+ * Error codes
+ *************************************************/
+
+const char *ms_errmsg(ms_errcode ecode) {
+  switch (ecode) {
+    case MS_SUCCESS:      return "success";
+    case MS_ERROR:        return "unspecified error";
+    case MS_MISUSE:       return "invalid use of the library";
+    case MS_NOPERM:       return "access permission denied";
+    case MS_NOFILE:       return "file not found";
+    case MS_BUSY:         return "database file locked";
+    case MS_CORRUPT:      return "database file corrupted";
+    case MS_EMPTY:        return "empty database";
+    case MS_AUTH:         return "authorization denied";
+    case MS_NOCONN:       return "no internet connection";
+    case MS_TIMEOUT:      return "operation timeout";
+    case MS_THREAD:       return "threading error";
+    case MS_CREDMISMATCH: return "credentials mismatch";
+    case MS_SLOWCONN:     return "internet connection too slow";
+    case MS_NOREC:        return "record not found";
+    default:              return "unknown error";
+  }
+}
+
+/*************************************************
+ * Images
+ *************************************************/
+
+static uint8_t ms_pixel(const uint8_t *row, int x, ms_pix_fmt_t fmt) {
+  if (fmt == MS_PIX_FMT_RGB32) {
+    const uint8_t *p = row + 4 * x;
+    return (uint8_t) ((29 * p[0] + 150 * p[1] + 77 * p[2] + 128) >> 8);
+  }
+  return row[x];  /* GRAY8, or the luma plane of NV21 */
+}
+
+ms_errcode ms_img_new(const void *data, int w, int h, int bpr, ms_pix_fmt_t fmt,
+                      ms_ori_t ori, ms_img_t **img) {
+  if (!data || !img || fmt < 0 || fmt >= MS_PIX_FMT_NB) return MS_MISUSE;
+  int large = w > h ? w : h;
+  int small = w > h ? h : w;
+  if (small <= 0 || large < 480 || large > 1280 || small > 720) return MS_MISUSE;
+  if (bpr < (fmt == MS_PIX_FMT_RGB32 ? 4 * w : w)) return MS_MISUSE;
+
+  int quarter = (ori == MS_RIGHT_TOP_ORI || ori == MS_LEFT_BOTTOM_ORI);
+  ms_img_t *out = malloc(sizeof(*out));
+  if (!out) return MS_ERROR;
+  out->w = quarter ? h : w;
+  out->h = quarter ? w : h;
+  out->gray = malloc((size_t) w * h);
+  if (!out->gray) {
+    free(out);
+    return MS_ERROR;
+  }
+
+  /* Turn the image upright, i.e. so that row 0 is at the top and column 0
+   * on the left */
+  for (int y = 0; y < h; y++) {
+    const uint8_t *row = (const uint8_t *) data + (size_t) y * bpr;
+    for (int x = 0; x < w; x++) {
+      int ux, uy;
+      switch (ori) {
+        case MS_BOTTOM_RIGHT_ORI: ux = w - 1 - x; uy = h - 1 - y; break;
+        case MS_RIGHT_TOP_ORI:    ux = h - 1 - y; uy = x;         break;
+        case MS_LEFT_BOTTOM_ORI:  ux = y;         uy = w - 1 - x; break;
+        default:                  ux = x;         uy = y;         break;
+      }
+      out->gray[(size_t) uy * out->w + ux] = ms_pixel(row, x, fmt);
+    }
+  }
+
+  *img = out;
+  return MS_SUCCESS;
+}
+
+void ms_img_del(ms_img_t *img) {
+  if (!img) return;
+  free(img->gray);
+  free(img);
+}
+
+/*************************************************
+ * Fingerprints
+ *************************************************/
+
+static void ms_fingerprint(const ms_img_t *img, uint64_t fp[MS_STANDIN_WORDS]) {
+  uint32_t cells[MS_STANDIN_CELLS * MS_STANDIN_CELLS];
+  uint64_t total = 0;
+  int small = img->w < img->h ? img->w : img->h;
+  int step = small / 128 > 1 ? small / 128 : 1;
+
+  for (int cy = 0; cy < MS_STANDIN_CELLS; cy++) {
+    int y0 = cy * img->h / MS_STANDIN_CELLS;
+    int y1 = (cy + 1) * img->h / MS_STANDIN_CELLS;
+    for (int cx = 0; cx < MS_STANDIN_CELLS; cx++) {
+      int x0 = cx * img->w / MS_STANDIN_CELLS;
+      int x1 = (cx + 1) * img->w / MS_STANDIN_CELLS;
+      uint32_t sum = 0, n = 0;
+      for (int y = y0; y < y1; y += step) {
+        const uint8_t *row = img->gray + (size_t) y * img->w;
+        for (int x = x0; x < x1; x += step, n++) sum += row[x];
+      }
+      cells[cy * MS_STANDIN_CELLS + cx] = n ? sum / n : 0;
+      total += cells[cy * MS_STANDIN_CELLS + cx];
+    }
+  }
+
+  uint32_t mean = (uint32_t) (total / (MS_STANDIN_CELLS * MS_STANDIN_CELLS));
+  memset(fp, 0, MS_STANDIN_WORDS * sizeof(uint64_t));
+  for (int i = 0; i < MS_STANDIN_CELLS * MS_STANDIN_CELLS; i++) {
+    if (cells[i] > mean) fp[i / 64] |= 1ULL << (i % 64);
+  }
+}
+
+static int ms_distance(const uint64_t a[MS_STANDIN_WORDS], const uint64_t b[MS_STANDIN_WORDS]) {
+  int n = 0;
+  for (int i = 0; i < MS_STANDIN_WORDS; i++) {
+    uint64_t x = a[i] ^ b[i];
+    while (x) {
+      x &= x - 1;
+      n++;
+    }
+  }
+  return n;
+}
+
+static void ms_format_fingerprint(const uint64_t fp[MS_STANDIN_WORDS], char hex[65]) {
+  for (int i = 0; i < MS_STANDIN_WORDS; i++)
+    snprintf(hex + 16 * i, 17, "%016llx", (unsigned long long) fp[i]);
+}
+
+static int ms_parse_fingerprint(const char *hex, uint64_t fp[MS_STANDIN_WORDS]) {
+  if (strlen(hex) != 16 * MS_STANDIN_WORDS) return -1;
+  for (int i = 0; i < MS_STANDIN_WORDS; i++) {
+    char word[17];
+    memcpy(word, hex + 16 * i, 16);
+    word[16] = '\0';
+    char *end = NULL;
+    fp[i] = strtoull(word, &end, 16);
+    if (*end != '\0') return -1;
+  }
+  return 0;
+}
+
+void ms_standin_fingerprint(const ms_img_t *img, char hex[65]) {
+  uint64_t fp[MS_STANDIN_WORDS];
+  ms_fingerprint(img, fp);
+  ms_format_fingerprint(fp, hex);
+}
+
+void ms_standin_render(uint32_t seed, uint32_t noise, uint8_t *gray, int w, int h, int bpr) {
+  uint8_t levels[MS_STANDIN_CELLS * MS_STANDIN_CELLS];
+  uint32_t s = seed * 2654435761u + 1;
+  for (int i = 0; i < MS_STANDIN_CELLS * MS_STANDIN_CELLS; i++) {
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    levels[i] = (uint8_t) (24 + s % 208);
+  }
+
+  uint32_t n = noise * 2246822519u + 1;
+  for (int y = 0; y < h; y++) {
+    uint8_t *row = gray + (size_t) y * bpr;
+    const uint8_t *cells = levels + (y * MS_STANDIN_CELLS / h) * MS_STANDIN_CELLS;
+    for (int x = 0; x < w; x++) {
+      int v = cells[x * MS_STANDIN_CELLS / w] + ((x ^ y) & 7) - 4;
+      if (noise) {
+        n ^= n << 13;
+        n ^= n >> 17;
+        n ^= n << 5;
+        v += (int) (n % 25) - 12;
+      }
+      row[x] = (uint8_t) (v < 0 ? 0 : v > 255 ? 255 : v);
+    }
+  }
+}
+
+/*************************************************
+ * Databases
+ *************************************************/
+
+static void ms_free_records(ms_record_t *records, int count) {
+  for (int i = 0; i < count; i++) free(records[i].id);
+  free(records);
+}
+
+/* Parse `<id> <fingerprint>` lines; the return value is 0, or -1 if the
+ * input is malformed */
+static int ms_read_records(FILE *f, ms_record_t **records, int *count) {
+  ms_record_t *out = NULL;
+  int n = 0, capacity = 0;
+  char line[MS_STANDIN_MAX_LINE];
+  while (fgets(line, sizeof(line), f)) {
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+    if (len == 0 || line[0] == '#') continue;
+
+    char *sep = strrchr(line, ' ');
+    ms_record_t rec;
+    if (!sep || sep == line || ms_parse_fingerprint(sep + 1, rec.fp) != 0) {
+      ms_free_records(out, n);
+      return -1;
+    }
+    *sep = '\0';
+    if (n == capacity) {
+      capacity = capacity ? 2 * capacity : 64;
+      ms_record_t *grown = realloc(out, capacity * sizeof(*out));
+      if (!grown) {
+        ms_free_records(out, n);
+        return -1;
+      }
+      out = grown;
+    }
+    rec.id = strdup(line);
+    if (!rec.id) {
+      ms_free_records(out, n);
+      return -1;
+    }
+    out[n++] = rec;
+  }
+  *records = out;
+  *count = n;
+  return 0;
+}
+
+static ms_errcode ms_load_database(const char *path, ms_record_t **records, int *count) {
+  FILE *f = fopen(path, "r");
+  if (!f) return errno == ENOENT ? MS_NOFILE : MS_NOPERM;
+
+  char header[64];
+  int version = 0, expected = -1;
+  if (!fgets(header, sizeof(header), f) ||
+      sscanf(header, MS_STANDIN_DB_MAGIC " %d %d", &version, &expected) != 2 ||
+      version != MS_STANDIN_DB_VERSION) {
+    fclose(f);
+    return MS_CORRUPT;
+  }
+  int ok = ms_read_records(f, records, count) == 0;
+  fclose(f);
+  if (!ok) return MS_CORRUPT;
+  if (*count != expected) {
+    ms_free_records(*records, *count);
+    return MS_CORRUPT;
+  }
+  return MS_SUCCESS;
+}
+
+static ms_errcode ms_save_database(const char *path, const ms_record_t *records, int count) {
+  size_t len = strlen(path) + 5;
+  char *tmp = malloc(len);
+  if (!tmp) return MS_ERROR;
+  snprintf(tmp, len, "%s.tmp", path);
+
+  FILE *f = fopen(tmp, "w");
+  if (!f) {
+    free(tmp);
+    return MS_NOPERM;
+  }
+  fprintf(f, MS_STANDIN_DB_MAGIC " %d %d\n", MS_STANDIN_DB_VERSION, count);
+  for (int i = 0; i < count; i++) {
+    char hex[65];
+    ms_format_fingerprint(records[i].fp, hex);
+    fprintf(f, "%s %s\n", records[i].id, hex);
+  }
+  int failed = ferror(f);
+  failed |= fclose(f);
+  if (failed || rename(tmp, path) != 0) {
+    unlink(tmp);
+    free(tmp);
+    return MS_NOPERM;
+  }
+  free(tmp);
+  return MS_SUCCESS;
+}
+
+/* Read the index of the server; the return value is an error code */
+static ms_errcode ms_load_index(const char *key, const char *secret, ms_record_t **records, int *count) {
+  char *path = ms_server_path("credentials");
+  if (!path) return MS_NOCONN;
+  FILE *f = fopen(path, "r");
+  free(path);
+  if (f) {
+    char k[256], s[256];
+    int ok = fscanf(f, "%255s %255s", k, s) == 2;
+    fclose(f);
+    if (!ok || strcmp(k, key) != 0 || strcmp(s, secret) != 0) return MS_AUTH;
+  }
+
+  path = ms_server_path("index");
+  if (!path) return MS_NOCONN;
+  f = fopen(path, "r");
+  free(path);
+  if (!f) return MS_NOCONN;
+  int ok = ms_read_records(f, records, count) == 0;
+  fclose(f);
+  return ok ? MS_SUCCESS : MS_ERROR;
+}
+
+ms_errcode ms_standin_server_add(const char *dir, const char *id, const ms_img_t *img) {
+  if (!dir || !id || !img || !*id || strchr(id, '\n')) return MS_MISUSE;
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST) return MS_NOPERM;
+
+  size_t len = strlen(dir) + 7;
+  char *path = malloc(len);
+  if (!path) return MS_ERROR;
+  snprintf(path, len, "%s/index", dir);
+  FILE *f = fopen(path, "a");
+  free(path);
+  if (!f) return MS_NOPERM;
+
+  char hex[65];
+  ms_standin_fingerprint(img, hex);
+  fprintf(f, "%s %s\n", id, hex);
+  return fclose(f) == 0 ? MS_SUCCESS : MS_NOPERM;
+}
+
+/*************************************************
+ * Scanner
+ *************************************************/
+
+ms_errcode ms_scanner_new(ms_scanner_t **s) {
+  if (!s) return MS_MISUSE;
+  ms_scanner_t *out = calloc(1, sizeof(*out));
+  if (!out) return MS_ERROR;
+  if (pthread_rwlock_init(&out->lock, NULL) != 0) {
+    free(out);
+    return MS_THREAD;
+  }
+  *s = out;
+  return MS_SUCCESS;
+}
+
+void ms_scanner_del(ms_scanner_t *s) {
+  if (!s) return;
+  if (s->opened) ms_scanner_close(s);
+  pthread_rwlock_destroy(&s->lock);
+  free(s);
+}
+
+ms_errcode ms_scanner_open(ms_scanner_t *s, const char *path,
+                           const char *key, const char *secret) {
+  if (!s || !path || !key || !secret || s->opened) return MS_MISUSE;
+
+  pthread_mutex_lock(&ms_global_lock);
+  int busy = ms_path_opened(path);
+  pthread_mutex_unlock(&ms_global_lock);
+  if (busy) return MS_BUSY;
+
+  ms_record_t *records = NULL;
+  int count = 0;
+  ms_errcode ecode = ms_load_database(path, &records, &count);
+  if (ecode == MS_NOFILE) ecode = ms_save_database(path, NULL, 0);
+  if (ecode != MS_SUCCESS) return ecode;
+
+  pthread_mutex_lock(&ms_global_lock);
+  char **paths = realloc(ms_open_paths, (ms_open_count + 1) * sizeof(*paths));
+  if (paths) {
+    ms_open_paths = paths;
+    ms_open_paths[ms_open_count++] = strdup(path);
+  }
+  pthread_mutex_unlock(&ms_global_lock);
+  if (!paths) {
+    ms_free_records(records, count);
+    return MS_ERROR;
+  }
+
+  s->path = strdup(path);
+  s->key = strdup(key);
+  s->secret = strdup(secret);
+  s->records = records;
+  s->count = count;
+  s->opened = 1;
+  return MS_SUCCESS;
+}
+
+ms_errcode ms_scanner_close(ms_scanner_t *s) {
+  if (!s || !s->opened) return MS_MISUSE;
+
+  pthread_mutex_lock(&ms_global_lock);
+  for (int i = 0; i < ms_open_count; i++) {
+    if (strcmp(ms_open_paths[i], s->path) == 0) {
+      free(ms_open_paths[i]);
+      ms_open_paths[i] = ms_open_paths[--ms_open_count];
+      break;
+    }
+  }
+  pthread_mutex_unlock(&ms_global_lock);
+
+  pthread_rwlock_wrlock(&s->lock);
+  ms_free_records(s->records, s->count);
+  s->records = NULL;
+  s->count = 0;
+  pthread_rwlock_unlock(&s->lock);
+
+  free(s->path);
+  free(s->key);
+  free(s->secret);
+  s->path = s->key = s->secret = NULL;
+  s->opened = 0;
+  return MS_SUCCESS;
+}
+
+ms_errcode ms_scanner_clean(const char *path) {
+  if (!path) return MS_MISUSE;
+  pthread_mutex_lock(&ms_global_lock);
+  int busy = ms_path_opened(path);
+  pthread_mutex_unlock(&ms_global_lock);
+  if (busy) return MS_BUSY;
+  if (unlink(path) != 0 && errno != ENOENT) return MS_NOPERM;
+  return MS_SUCCESS;
+}
+
+ms_errcode ms_scanner_sync(ms_scanner_t *s) {
+  return ms_scanner_sync2(s, NULL, NULL);
+}
+
+ms_errcode ms_scanner_sync2(ms_scanner_t *s, ms_scanner_sync_cb cb, void *opq) {
+  if (!s || !s->opened) return MS_MISUSE;
+
+  ms_record_t *records = NULL;
+  int count = 0;
+  ms_errcode ecode = ms_load_index(s->key, s->secret, &records, &count);
+  if (ecode != MS_SUCCESS) return ecode;
+
+  /* Records are "downloaded" one by one */
+  ms_standin_latency_t latency = ms_get_latency();
+  for (int i = 0; i < count; i++) {
+    ms_sleep(latency.sync_per_record);
+    if (cb) cb(opq, count, i + 1);
+  }
+
+  ecode = ms_save_database(s->path, records, count);
+  if (ecode != MS_SUCCESS) {
+    ms_free_records(records, count);
+    return ecode;
+  }
+
+  pthread_rwlock_wrlock(&s->lock);
+  ms_record_t *old = s->records;
+  int old_count = s->count;
+  s->records = records;
+  s->count = count;
+  pthread_rwlock_unlock(&s->lock);
+  ms_free_records(old, old_count);
+  return MS_SUCCESS;
+}
+
+ms_errcode ms_scanner_info(ms_scanner_t *s, int *count, char ***ids) {
+  if (!s || !s->opened || !count) return MS_MISUSE;
+
+  ms_errcode ecode = MS_SUCCESS;
+  pthread_rwlock_rdlock(&s->lock);
+  if (s->count == 0) {
+    ecode = MS_EMPTY;
+  }
+  else if (ids) {
+    char **out = malloc(s->count * sizeof(*out));
+    for (int i = 0; out && i < s->count; i++) {
+      out[i] = strdup(s->records[i].id);
+      if (!out[i]) {
+        while (i-- > 0) free(out[i]);
+        free(out);
+        out = NULL;
+      }
+    }
+    if (out) {
+      *ids = out;
+      *count = s->count;
+    }
+    else {
+      ecode = MS_ERROR;
+    }
+  }
+  else {
+    *count = s->count;
+  }
+  pthread_rwlock_unlock(&s->lock);
+  return ecode;
+}
+
+/* Find the closest record within the matching distance (-1 if none) */
+static int ms_closest(const ms_record_t *records, int count, const uint64_t fp[MS_STANDIN_WORDS]) {
+  int best = -1, best_distance = MS_STANDIN_MAX_DISTANCE + 1;
+  for (int i = 0; i < count; i++) {
+    int d = ms_distance(fp, records[i].fp);
+    if (d < best_distance) {
+      best = i;
+      best_distance = d;
+    }
+  }
+  return best;
+}
+
+ms_errcode ms_scanner_search(ms_scanner_t *s, const ms_img_t *qry, char **id) {
+  if (!s || !s->opened || !qry || !id) return MS_MISUSE;
+  *id = NULL;
+
+  uint64_t fp[MS_STANDIN_WORDS];
+  ms_fingerprint(qry, fp);
+
+  ms_errcode ecode = MS_SUCCESS;
+  int count;
+  pthread_rwlock_rdlock(&s->lock);
+  count = s->count;
+  if (count == 0) {
+    ecode = MS_EMPTY;
+  }
+  else {
+    int best = ms_closest(s->records, count, fp);
+    if (best >= 0) {
+      *id = strdup(s->records[best].id);
+      if (!*id) ecode = MS_ERROR;
+    }
+  }
+  pthread_rwlock_unlock(&s->lock);
+
+  ms_standin_latency_t latency = ms_get_latency();
+  ms_sleep(latency.search + latency.search_per_record * count);
+  return ecode;
+}
+
+ms_errcode ms_scanner_match(ms_scanner_t *s, const ms_img_t *qry, const char *id,
+                            int *match) {
+  if (!s || !s->opened || !qry || !id || !match) return MS_MISUSE;
+  *match = 0;
+
+  uint64_t fp[MS_STANDIN_WORDS];
+  ms_fingerprint(qry, fp);
+
+  ms_errcode ecode = MS_NOREC;
+  pthread_rwlock_rdlock(&s->lock);
+  if (s->count == 0) ecode = MS_EMPTY;
+  for (int i = 0; i < s->count; i++) {
+    if (strcmp(s->records[i].id, id) == 0) {
+      *match = ms_distance(fp, s->records[i].fp) <= MS_STANDIN_MAX_DISTANCE;
+      ecode = MS_SUCCESS;
+      break;
+    }
+  }
+  pthread_rwlock_unlock(&s->lock);
+
+  ms_sleep(ms_get_latency().match);
+  return ecode;
+}
+
+ms_errcode ms_scanner_api_search(ms_scanner_t *s, const ms_img_t *qry, char **id) {
+  if (!s || !s->opened || !qry || !id) return MS_MISUSE;
+  *id = NULL;
+
+  ms_sleep(ms_get_latency().api_search);
+
+  ms_record_t *records = NULL;
+  int count = 0;
+  ms_errcode ecode = ms_load_index(s->key, s->secret, &records, &count);
+  if (ecode != MS_SUCCESS) return ecode;
+
+  uint64_t fp[MS_STANDIN_WORDS];
+  ms_fingerprint(qry, fp);
+  int best = ms_closest(records, count, fp);
+  if (best >= 0) {
+    *id = strdup(records[best].id);
+    if (!*id) ecode = MS_ERROR;
+  }
+  ms_free_records(records, count);
+  return ecode;
+}
+
+/*************************************************
+ * Barcodes
+ *************************************************/
+
+int ms_standin_draw_barcode(uint8_t *gray, int w, ms_barcode_fmt fmt, const char *data) {
+  size_t len = data ? strlen(data) : 0;
+  if (!gray || len > 255 || (size_t) w < sizeof(ms_barcode_magic) + 2 + len) return -1;
+  memcpy(gray, ms_barcode_magic, sizeof(ms_barcode_magic));
+  gray[4] = (uint8_t) fmt;
+  gray[5] = (uint8_t) len;
+  memcpy(gray + 6, data, len);
+  return 0;
+}
+
+/* Decoding does not need an opened scanner */
+ms_errcode ms_scanner_decode(ms_scanner_t *s, const ms_img_t *qry, int formats,
+                             ms_barcode_t **barcode) {
+  if (!s || !qry || !barcode) return MS_MISUSE;
+  *barcode = NULL;
+  if (!(formats & (MS_BARCODE_FMT_EAN8 | MS_BARCODE_FMT_EAN13 | MS_BARCODE_FMT_QRCODE)))
+    return MS_SUCCESS;
+
+  ms_sleep(ms_get_latency().decode);
+
+  const uint8_t *row = qry->gray;
+  if (memcmp(row, ms_barcode_magic, sizeof(ms_barcode_magic)) != 0) return MS_SUCCESS;
+  ms_barcode_fmt fmt = row[4];
+  int size = row[5];
+  if (!(fmt & formats) || 6 + size > qry->w) return MS_SUCCESS;
+
+  ms_barcode_t *out = malloc(sizeof(*out));
+  if (!out) return MS_ERROR;
+  out->fmt = fmt;
+  out->size = size;
+  out->data = malloc(size + 1);
+  if (!out->data) {
+    free(out);
+    return MS_ERROR;
+  }
+  memcpy(out->data, row + 6, size);
+  out->data[size] = '\0';
+  *barcode = out;
+  return MS_SUCCESS;
+}
+
+void ms_barcode_get_data(const ms_barcode_t *b, const char **data, int *siz) {
+  *data = b->data;
+  *siz = b->size;
+}
+
+ms_barcode_fmt ms_barcode_get_fmt(const ms_barcode_t *b) {
+  return b->fmt;
+}
+
+void ms_barcode_del(ms_barcode_t *b) {
+  if (!b) return;
+  free(b->data);
+  free(b);
+}
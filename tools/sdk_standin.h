@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) 2012 Moodstocks SAS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _SDK_STANDIN_H
+#define _SDK_STANDIN_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "moodstocks_sdk.h"
+
+/*************************************************
+ * Stand-in Moodstocks SDK
+ *
+ * Implementation of the whole `moodstocks_sdk.h` API for Linux (or any
+ * POSIX system), so that the code built over the SDK can be run, load-tested
+ * and profiled off-device. It is meant for the tools only: the app links
+ * the real `libmoodstocks-sdk.a`.
+ *
+ * Images are converted to grayscale and turned upright according to their
+ * orientation, with the same size limits as the real SDK.
+ *
+ * Image recognition relies on a deterministic 256-bit fingerprint: the
+ * image is reduced to 16x16 cells, and each bit tells whether a cell is
+ * brighter than the average. Two images match if their fingerprints are at
+ * most `MS_STANDIN_MAX_DISTANCE` bits apart. The offline search scans all
+ * the records, so that its cost grows with the database like the real one.
+ *
+ * Barcodes are not decoded from pixels: a stand-in barcode is a marker
+ * written on the first row of the image (see `ms_standin_draw_barcode`).
+ *
+ * The "server" is a directory holding:
+ * - an `index` file, with one record per line: `<id> <fingerprint>`, where
+ *   the fingerprint is made of 64 hexadecimal digits (see
+ *   `ms_standin_fingerprint` and `ms_standin_server_add`),
+ * - optionally, a `credentials` file: `<key> <secret>`. When present, the
+ *   API key and secret given to `ms_scanner_open` must match it.
+ * Synchronizing copies the index into the database file of the scanner,
+ * while the API search looks the index up directly. Without a server, both
+ * fail with `MS_NOCONN`.
+ *
+ * Every call but image creation can be slowed down to mimic a device and
+ * the network (see `ms_standin_set_latency`). There is no latency by
+ * default.
+ *
+ * Build the stand-in along with the tool using it, e.g.:
+ *
+ *   gcc -std=c99 -O2 -I . -c tools/sdk_standin.c
+ *   g++ -O2 -I . -I Core -I tools my_tool.cpp sdk_standin.o -lpthread
+ *************************************************/
+
+/** Largest fingerprint distance of two matching images, in bits */
+#define MS_STANDIN_MAX_DISTANCE 40
+
+/** Latency model, in seconds */
+typedef struct {
+  double search;                      /* offline search, fixed part */
+  double search_per_record;           /* offline search, per database record */
+  double match;                       /* match against a reference */
+  double decode;                      /* barcode decoding */
+  double sync_per_record;             /* synchronization, per record */
+  double api_search;                  /* API search round trip */
+  double jitter;                      /* relative amplitude of random variations (e.g. 0.2) */
+} ms_standin_latency_t;
+
+/**
+ * Set the latency model (NULL for none).
+ * The random variations are deterministic: the same sequence of calls
+ * sleeps for the same durations.
+ */
+void ms_standin_set_latency(const ms_standin_latency_t *latency);
+
+/**
+ * Fill a latency model with figures in the range of a recent phone on a
+ * 3G network.
+ */
+void ms_standin_device_latency(ms_standin_latency_t *latency);
+
+/**
+ * Set the server directory (NULL to read it from the `MS_STANDIN_SERVER`
+ * environment variable, the default).
+ */
+void ms_standin_set_server(const char *dir);
+
+/**
+ * Render a synthetic grayscale image of an object.
+ * Images rendered with the same `seed` match each other, and those of
+ * different seeds do not. A non-zero `noise` adds pseudo-random variations,
+ * e.g. to get distinct frames of the same object.
+ */
+void ms_standin_render(uint32_t seed, uint32_t noise, uint8_t *gray, int w, int h, int bpr);
+
+/**
+ * Write a stand-in barcode on the first row of a grayscale image, so that
+ * decoding an upright image made of it yields `data` with format `fmt`.
+ * `data` is at most 255 bytes long and the image must be wide enough.
+ * The return value is 0 on success, -1 otherwise.
+ */
+int ms_standin_draw_barcode(uint8_t *gray, int w, ms_barcode_fmt fmt, const char *data);
+
+/**
+ * Compute the fingerprint of an image as 64 hexadecimal digits (plus the
+ * terminating NUL character).
+ */
+void ms_standin_fingerprint(const ms_img_t *img, char hex[65]);
+
+/**
+ * Append a record to the index of a server directory (created if needed).
+ * If successful, the return value is MS_SUCCESS, otherwise an appropriate
+ * error code is returned.
+ */
+ms_errcode ms_standin_server_add(const char *dir, const char *id, const ms_img_t *img);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif